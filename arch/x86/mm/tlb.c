@@ -319,6 +319,37 @@ void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
 	preempt_enable();
 }
 
+static void do_flush_tlb_batched(void *info)
+{
+	if (percpu_read(cpu_tlbstate.state) == TLBSTATE_OK)
+		local_flush_tlb();
+	else
+		leave_mm(smp_processor_id());
+}
+
+/*
+ * Flush the TLB entries of the pages reclaim unmapped from whichever mms,
+ * with one IPI per cpu.  Returns the number of other cpus interrupted.
+ */
+unsigned int flush_tlb_batched(const struct cpumask *cpumask)
+{
+	unsigned int cpu, this_cpu, nr_ipis = 0;
+
+	this_cpu = get_cpu();
+
+	if (cpumask_test_cpu(this_cpu, cpumask))
+		do_flush_tlb_batched(NULL);
+
+	for_each_cpu_and(cpu, cpumask, cpu_online_mask)
+		if (cpu != this_cpu)
+			nr_ipis++;
+	if (nr_ipis)
+		smp_call_function_many(cpumask, do_flush_tlb_batched, NULL, 1);
+
+	put_cpu();
+	return nr_ipis;
+}
+
 static void do_flush_tlb_all(void *info)
 {
 	__flush_tlb_all();
@@ -0,0 +1,418 @@
+/*
+ *  drivers/cpufreq/cpufreq_schedutil.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpu.h>
+#include <linux/irq_work.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+
+/*
+ * schedutil picks the frequency of a policy from the utilisation the
+ * scheduler passes it as tasks are enqueued, dequeued and ticked, rather
+ * than by sampling the idle time of its cpus from a timer:
+ *
+ *   next_freq = 1.25 * max_freq * util / max
+ *
+ * so that a cpu busy 80% of the time runs at the highest frequency, and
+ * one at a lower frequency ramps up before it saturates.  rt and deadline
+ * tasks ask for the highest frequency.  The cpus of a policy sharing its
+ * frequency, the busiest one of those that updated in the last tick sets
+ * it.
+ *
+ * The scheduler calls us with its runqueue lock held, so frequency changes
+ * are made from a work item, and no more often than every rate_limit_us.
+ */
+
+#define LATENCY_MULTIPLIER			(1000)
+#define MIN_LATENCY_MULTIPLIER			(100)
+#define TRANSITION_LATENCY_LIMIT		(10 * 1000 * 1000)
+
+static int cpufreq_governor_schedutil(struct cpufreq_policy *policy,
+				      unsigned int event);
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+static
+#endif
+struct cpufreq_governor cpufreq_gov_schedutil = {
+	.name			= "schedutil",
+	.governor		= cpufreq_governor_schedutil,
+	.max_transition_latency	= TRANSITION_LATENCY_LIMIT,
+	.owner			= THIS_MODULE,
+};
+
+struct sugov_policy {
+	struct cpufreq_policy *policy;
+
+	raw_spinlock_t update_lock;	/* for shared policies */
+	u64 last_freq_update_time;
+	unsigned int next_freq;
+	bool need_freq_update;
+	bool work_in_progress;
+
+	struct irq_work irq_work;
+	struct work_struct work;
+	/* serializes frequency changes with the limits changing */
+	struct mutex work_lock;
+};
+
+struct sugov_cpu {
+	struct update_util_data update_util;
+	struct sugov_policy *sg_policy;
+
+	/* the last utilisation of a cpu of a shared policy */
+	unsigned long util;
+	unsigned long max;
+	u64 last_update;
+};
+
+static DEFINE_PER_CPU(struct sugov_cpu, sugov_cpu);
+
+static unsigned int sugov_enable;	/* number of policies using us */
+
+/* sugov_mutex protects sugov_enable in governor start/stop */
+static DEFINE_MUTEX(sugov_mutex);
+
+static unsigned int min_rate_limit_us;
+
+static struct sugov_tuners {
+	unsigned int rate_limit_us;
+} sugov_tuners_ins;
+
+/************************** sysfs interface ************************/
+
+static ssize_t show_rate_limit_us(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", sugov_tuners_ins.rate_limit_us);
+}
+
+static ssize_t store_rate_limit_us(struct kobject *a, struct attribute *b,
+				   const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+	sugov_tuners_ins.rate_limit_us = max(input, min_rate_limit_us);
+	return count;
+}
+
+define_one_global_rw(rate_limit_us);
+
+static ssize_t show_rate_limit_min_us(struct kobject *kobj,
+				      struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", min_rate_limit_us);
+}
+
+define_one_global_ro(rate_limit_min_us);
+
+static struct attribute *sugov_attributes[] = {
+	&rate_limit_us.attr,
+	&rate_limit_min_us.attr,
+	NULL
+};
+
+static struct attribute_group sugov_attr_group = {
+	.attrs = sugov_attributes,
+	.name = "schedutil",
+};
+
+/************************** sysfs end ************************/
+
+static bool sugov_should_update_freq(struct sugov_policy *sg_policy, u64 time)
+{
+	s64 delta_ns;
+
+	if (sg_policy->work_in_progress)
+		return false;
+
+	if (unlikely(sg_policy->need_freq_update)) {
+		sg_policy->need_freq_update = false;
+		return true;
+	}
+
+	delta_ns = time - sg_policy->last_freq_update_time;
+	return delta_ns >= (s64)sugov_tuners_ins.rate_limit_us * NSEC_PER_USEC;
+}
+
+static void sugov_update_commit(struct sugov_policy *sg_policy, u64 time,
+				unsigned int next_freq)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+
+	next_freq = clamp(next_freq, policy->min, policy->max);
+	sg_policy->last_freq_update_time = time;
+	if (next_freq == sg_policy->next_freq)
+		return;
+
+	sg_policy->next_freq = next_freq;
+	sg_policy->work_in_progress = true;
+	irq_work_queue(&sg_policy->irq_work);
+}
+
+static unsigned int sugov_get_freq(struct sugov_policy *sg_policy,
+				   unsigned long util, unsigned long max)
+{
+	unsigned int freq = sg_policy->policy->cpuinfo.max_freq;
+
+	if (util == ULONG_MAX)
+		return freq;
+
+	return div64_u64((u64)(freq + (freq >> 2)) * util, max);
+}
+
+static void sugov_update_single(struct update_util_data *data, u64 time,
+				unsigned long util, unsigned long max)
+{
+	struct sugov_cpu *sg_cpu = container_of(data, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+
+	if (!sugov_should_update_freq(sg_policy, time))
+		return;
+
+	sugov_update_commit(sg_policy, time,
+			    sugov_get_freq(sg_policy, util, max));
+}
+
+static unsigned int sugov_next_freq_shared(struct sugov_policy *sg_policy,
+					   u64 time, unsigned long util,
+					   unsigned long max)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned int cpu;
+
+	if (util == ULONG_MAX)
+		return policy->cpuinfo.max_freq;
+
+	for_each_cpu(cpu, policy->cpus) {
+		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, cpu);
+		unsigned long j_util, j_max;
+		s64 delta_ns;
+
+		/*
+		 * A cpu that did not update for a tick is idle, and its
+		 * utilisation is out of date: leave it out.
+		 */
+		delta_ns = time - j_sg_cpu->last_update;
+		if (delta_ns > TICK_NSEC)
+			continue;
+
+		j_util = j_sg_cpu->util;
+		if (j_util == ULONG_MAX)
+			return policy->cpuinfo.max_freq;
+
+		j_max = j_sg_cpu->max;
+		if ((u64)j_util * max > (u64)util * j_max) {
+			util = j_util;
+			max = j_max;
+		}
+	}
+
+	return sugov_get_freq(sg_policy, util, max);
+}
+
+static void sugov_update_shared(struct update_util_data *data, u64 time,
+				unsigned long util, unsigned long max)
+{
+	struct sugov_cpu *sg_cpu = container_of(data, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+
+	raw_spin_lock(&sg_policy->update_lock);
+
+	sg_cpu->util = util;
+	sg_cpu->max = max;
+	sg_cpu->last_update = time;
+
+	if (sugov_should_update_freq(sg_policy, time))
+		sugov_update_commit(sg_policy, time,
+			sugov_next_freq_shared(sg_policy, time, util, max));
+
+	raw_spin_unlock(&sg_policy->update_lock);
+}
+
+static void sugov_work(struct work_struct *work)
+{
+	struct sugov_policy *sg_policy = container_of(work, struct sugov_policy,
+						      work);
+
+	mutex_lock(&sg_policy->work_lock);
+	__cpufreq_driver_target(sg_policy->policy, sg_policy->next_freq,
+				CPUFREQ_RELATION_L);
+	mutex_unlock(&sg_policy->work_lock);
+
+	sg_policy->work_in_progress = false;
+}
+
+static void sugov_irq_work(struct irq_work *irq_work)
+{
+	struct sugov_policy *sg_policy = container_of(irq_work,
+						      struct sugov_policy,
+						      irq_work);
+
+	schedule_work_on(smp_processor_id(), &sg_policy->work);
+}
+
+static int sugov_start(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy;
+	unsigned int cpu;
+	int rc;
+
+	sg_policy = kzalloc(sizeof(*sg_policy), GFP_KERNEL);
+	if (!sg_policy)
+		return -ENOMEM;
+
+	sg_policy->policy = policy;
+	raw_spin_lock_init(&sg_policy->update_lock);
+	init_irq_work(&sg_policy->irq_work, sugov_irq_work);
+	INIT_WORK(&sg_policy->work, sugov_work);
+	mutex_init(&sg_policy->work_lock);
+	sg_policy->next_freq = UINT_MAX;
+	sg_policy->need_freq_update = true;
+
+	mutex_lock(&sugov_mutex);
+	/* Set up the tunables when this governor is used for the first time */
+	if (!sugov_enable) {
+		unsigned int latency;
+
+		rc = sysfs_create_group(cpufreq_global_kobject,
+					&sugov_attr_group);
+		if (rc) {
+			mutex_unlock(&sugov_mutex);
+			kfree(sg_policy);
+			return rc;
+		}
+
+		/* policy latency is in nS. Convert it to uS first */
+		latency = policy->cpuinfo.transition_latency / 1000;
+		if (latency == 0)
+			latency = 1;
+		min_rate_limit_us = MIN_LATENCY_MULTIPLIER * latency;
+		sugov_tuners_ins.rate_limit_us = LATENCY_MULTIPLIER * latency;
+	}
+	sugov_enable++;
+	mutex_unlock(&sugov_mutex);
+
+	for_each_cpu(cpu, policy->related_cpus) {
+		struct sugov_cpu *sg_cpu = &per_cpu(sugov_cpu, cpu);
+
+		memset(sg_cpu, 0, sizeof(*sg_cpu));
+		sg_cpu->sg_policy = sg_policy;
+		if (cpumask_weight(policy->related_cpus) > 1)
+			sg_cpu->update_util.func = sugov_update_shared;
+		else
+			sg_cpu->update_util.func = sugov_update_single;
+		cpufreq_set_update_util_data(cpu, &sg_cpu->update_util);
+	}
+
+	return 0;
+}
+
+static void sugov_stop(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy;
+	unsigned int cpu;
+
+	sg_policy = per_cpu(sugov_cpu, policy->cpu).sg_policy;
+
+	if (!sg_policy)
+		return;
+
+	for_each_cpu(cpu, policy->related_cpus) {
+		cpufreq_set_update_util_data(cpu, NULL);
+		per_cpu(sugov_cpu, cpu).sg_policy = NULL;
+	}
+
+	/* Wait for the updates in progress, then for what they queued */
+	synchronize_sched();
+	irq_work_sync(&sg_policy->irq_work);
+	cancel_work_sync(&sg_policy->work);
+
+	mutex_lock(&sugov_mutex);
+	sugov_enable--;
+	if (!sugov_enable)
+		sysfs_remove_group(cpufreq_global_kobject, &sugov_attr_group);
+	mutex_unlock(&sugov_mutex);
+
+	mutex_destroy(&sg_policy->work_lock);
+	kfree(sg_policy);
+}
+
+static void sugov_limits(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy;
+
+	sg_policy = per_cpu(sugov_cpu, policy->cpu).sg_policy;
+	if (!sg_policy)
+		return;
+
+	mutex_lock(&sg_policy->work_lock);
+	if (policy->max < policy->cur)
+		__cpufreq_driver_target(policy, policy->max,
+					CPUFREQ_RELATION_H);
+	else if (policy->min > policy->cur)
+		__cpufreq_driver_target(policy, policy->min,
+					CPUFREQ_RELATION_L);
+	mutex_unlock(&sg_policy->work_lock);
+
+	/* Let the next update pick a frequency within the new limits */
+	sg_policy->need_freq_update = true;
+}
+
+static int cpufreq_governor_schedutil(struct cpufreq_policy *policy,
+				      unsigned int event)
+{
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if (!cpu_online(policy->cpu) || !policy->cur)
+			return -EINVAL;
+		return sugov_start(policy);
+
+	case CPUFREQ_GOV_STOP:
+		sugov_stop(policy);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		sugov_limits(policy);
+		break;
+	}
+	return 0;
+}
+
+static int __init cpufreq_gov_schedutil_init(void)
+{
+	return cpufreq_register_governor(&cpufreq_gov_schedutil);
+}
+
+static void __exit cpufreq_gov_schedutil_exit(void)
+{
+	cpufreq_unregister_governor(&cpufreq_gov_schedutil);
+}
+
+MODULE_DESCRIPTION("'cpufreq_schedutil' - A cpufreq governor driven by "
+	"the utilisation the scheduler tracks");
+MODULE_LICENSE("GPL");
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+fs_initcall(cpufreq_gov_schedutil_init);
+#else
+module_init(cpufreq_gov_schedutil_init);
+#endif
+module_exit(cpufreq_gov_schedutil_exit);
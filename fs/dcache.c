@@ -37,6 +37,7 @@
 #include <linux/rculist_bl.h>
 #include <linux/prefetch.h>
 #include <linux/ratelimit.h>
+#include <linux/memcontrol.h>
 #include "internal.h"
 #include "mount.h"
 
@@ -48,8 +49,10 @@
  *   - the dcache hash table
  * s_anon bl list spinlock protects:
  *   - the s_anon list (see __d_drop)
+ * sb->s_dentry_lru list_lru lock protects:
+ *   - the superblock's unused dentry lists
  * dcache_lru_lock protects:
- *   - the dcache lru lists and counters
+ *   - the private shrink lists (DCACHE_SHRINK_LIST)
  * d_lock protects:
  *   - d_flags
  *   - d_name
@@ -63,10 +66,14 @@
  * Ordering:
  * dentry->d_inode->i_lock
  *   dentry->d_lock
+ *     s_dentry_lru lock
  *     dcache_lru_lock
  *     dcache_hash_bucket lock
  *     s_anon lock
  *
+ * The LRU walks of the dcache shrinker invert the first two and so only
+ * trylock dentry->d_lock.
+ *
  * If there is an ancestor relationship:
  * dentry->d_parent->...->d_parent->d_lock
  *   ...
@@ -118,6 +125,7 @@ struct dentry_stat_t dentry_stat = {
 };
 
 static DEFINE_PER_CPU(unsigned int, nr_dentry);
+static DEFINE_PER_CPU(unsigned int, nr_dentry_unused);
 
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 static int get_nr_dentry(void)
@@ -129,14 +137,30 @@ static int get_nr_dentry(void)
 	return sum < 0 ? 0 : sum;
 }
 
+static int get_nr_dentry_unused(void)
+{
+	int i;
+	int sum = 0;
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_unused, i);
+	return sum < 0 ? 0 : sum;
+}
+
 int proc_nr_dentry(ctl_table *table, int write, void __user *buffer,
 		   size_t *lenp, loff_t *ppos)
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
+	dentry_stat.nr_unused = get_nr_dentry_unused();
 	return proc_dointvec(table, write, buffer, lenp, ppos);
 }
 #endif
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+#define dentry_memcg_id(dentry)	(&(dentry)->d_memcg_id)
+#else
+#define dentry_memcg_id(dentry)	NULL
+#endif
+
 static void __d_free(struct rcu_head *head)
 {
 	struct dentry *dentry = container_of(head, struct dentry, d_u.d_rcu);
@@ -232,20 +256,24 @@ static void dentry_unlink_inode(struct dentry * dentry)
 static void dentry_lru_add(struct dentry *dentry)
 {
 	if (list_empty(&dentry->d_lru)) {
-		spin_lock(&dcache_lru_lock);
-		list_add(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-		dentry->d_sb->s_nr_dentry_unused++;
-		dentry_stat.nr_unused++;
-		spin_unlock(&dcache_lru_lock);
+		if (list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru,
+				 dentry_memcg_id(dentry)))
+			this_cpu_inc(nr_dentry_unused);
 	}
 }
 
 static void __dentry_lru_del(struct dentry *dentry)
 {
-	list_del_init(&dentry->d_lru);
-	dentry->d_flags &= ~DCACHE_SHRINK_LIST;
-	dentry->d_sb->s_nr_dentry_unused--;
-	dentry_stat.nr_unused--;
+	if (dentry->d_flags & DCACHE_SHRINK_LIST) {
+		spin_lock(&dcache_lru_lock);
+		list_del_init(&dentry->d_lru);
+		dentry->d_flags &= ~DCACHE_SHRINK_LIST;
+		spin_unlock(&dcache_lru_lock);
+	} else {
+		list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru,
+			     dentry_memcg_id(dentry));
+	}
+	this_cpu_dec(nr_dentry_unused);
 }
 
 /*
@@ -253,11 +281,8 @@ static void __dentry_lru_del(struct dentry *dentry)
  */
 static void dentry_lru_del(struct dentry *dentry)
 {
-	if (!list_empty(&dentry->d_lru)) {
-		spin_lock(&dcache_lru_lock);
+	if (!list_empty(&dentry->d_lru))
 		__dentry_lru_del(dentry);
-		spin_unlock(&dcache_lru_lock);
-	}
 }
 
 /*
@@ -271,22 +296,24 @@ static void dentry_lru_prune(struct dentry *dentry)
 		if (dentry->d_flags & DCACHE_OP_PRUNE)
 			dentry->d_op->d_prune(dentry);
 
-		spin_lock(&dcache_lru_lock);
 		__dentry_lru_del(dentry);
-		spin_unlock(&dcache_lru_lock);
 	}
 }
 
+/*
+ * Move a dentry that is not on a shrink list yet to the shrink list @list.
+ */
 static void dentry_lru_move_list(struct dentry *dentry, struct list_head *list)
 {
+	if (list_empty(&dentry->d_lru))
+		this_cpu_inc(nr_dentry_unused);
+	else
+		list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru,
+			     dentry_memcg_id(dentry));
+
 	spin_lock(&dcache_lru_lock);
-	if (list_empty(&dentry->d_lru)) {
-		list_add_tail(&dentry->d_lru, list);
-		dentry->d_sb->s_nr_dentry_unused++;
-		dentry_stat.nr_unused++;
-	} else {
-		list_move_tail(&dentry->d_lru, list);
-	}
+	list_add_tail(&dentry->d_lru, list);
+	dentry->d_flags |= DCACHE_SHRINK_LIST;
 	spin_unlock(&dcache_lru_lock);
 }
 
@@ -770,55 +797,91 @@ static void shrink_dentry_list(struct list_head *list)
 	rcu_read_unlock();
 }
 
+/*
+ * Move an unused dentry from the superblock LRU to the shrink list
+ * @arg, giving referenced ones another trip round the LRU and dropping
+ * those that are in use again.
+ */
+static enum lru_status dentry_lru_isolate(struct list_head *item,
+					  struct list_lru_one *lru,
+					  spinlock_t *lru_lock, void *arg)
+{
+	struct list_head *freeable = arg;
+	struct dentry *dentry = container_of(item, struct dentry, d_lru);
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	if (dentry->d_count) {
+		list_lru_isolate(lru, &dentry->d_lru);
+		this_cpu_dec(nr_dentry_unused);
+		spin_unlock(&dentry->d_lock);
+		return LRU_REMOVED;
+	}
+
+	if (dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	spin_lock(&dcache_lru_lock);
+	list_lru_isolate_move(lru, &dentry->d_lru, freeable);
+	dentry->d_flags |= DCACHE_SHRINK_LIST;
+	spin_unlock(&dcache_lru_lock);
+	spin_unlock(&dentry->d_lock);
+	return LRU_REMOVED;
+}
+
 /**
  * prune_dcache_sb - shrink the dcache
  * @sb: superblock
- * @count: number of entries to try to free
+ * @nr_to_scan: number of entries to try to free
+ * @nodes: the nodes whose dentries to scan
+ * @memcg: the memory cgroup whose dentries to scan, or NULL for all
  *
- * Attempt to shrink the superblock dcache LRU by @count entries. This is
- * done when we need more memory an called from the superblock shrinker
- * function.
+ * Attempt to shrink the superblock dcache LRU by @nr_to_scan entries.
+ * This is done when we need more memory an called from the superblock
+ * shrinker function.
  *
  * This function may fail to free any resources if all the dentries are in
- * use.
+ * use.  Returns the number of dentries taken off the LRU.
  */
-void prune_dcache_sb(struct super_block *sb, int count)
+long prune_dcache_sb(struct super_block *sb, unsigned long nr_to_scan,
+		     nodemask_t *nodes, struct mem_cgroup *memcg)
 {
-	struct dentry *dentry;
-	LIST_HEAD(referenced);
-	LIST_HEAD(tmp);
+	LIST_HEAD(dispose);
+	long freed;
 
-relock:
-	spin_lock(&dcache_lru_lock);
-	while (!list_empty(&sb->s_dentry_lru)) {
-		dentry = list_entry(sb->s_dentry_lru.prev,
-				struct dentry, d_lru);
-		BUG_ON(dentry->d_sb != sb);
+	freed = list_lru_walk_nodemask(&sb->s_dentry_lru, nodes, memcg,
+				       dentry_lru_isolate, &dispose,
+				       nr_to_scan);
+	shrink_dentry_list(&dispose);
+	return freed;
+}
 
-		if (!spin_trylock(&dentry->d_lock)) {
-			spin_unlock(&dcache_lru_lock);
-			cpu_relax();
-			goto relock;
-		}
+static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
+						 struct list_lru_one *lru,
+						 spinlock_t *lru_lock,
+						 void *arg)
+{
+	struct list_head *freeable = arg;
+	struct dentry *dentry = container_of(item, struct dentry, d_lru);
 
-		if (dentry->d_flags & DCACHE_REFERENCED) {
-			dentry->d_flags &= ~DCACHE_REFERENCED;
-			list_move(&dentry->d_lru, &referenced);
-			spin_unlock(&dentry->d_lock);
-		} else {
-			list_move_tail(&dentry->d_lru, &tmp);
-			dentry->d_flags |= DCACHE_SHRINK_LIST;
-			spin_unlock(&dentry->d_lock);
-			if (!--count)
-				break;
-		}
-		cond_resched_lock(&dcache_lru_lock);
-	}
-	if (!list_empty(&referenced))
-		list_splice(&referenced, &sb->s_dentry_lru);
-	spin_unlock(&dcache_lru_lock);
+	/*
+	 * we are inverting the lru lock/dentry->d_lock here,
+	 * so use a trylock. If we fail to get the lock, just skip
+	 * it
+	 */
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
 
-	shrink_dentry_list(&tmp);
+	spin_lock(&dcache_lru_lock);
+	list_lru_isolate_move(lru, &dentry->d_lru, freeable);
+	dentry->d_flags |= DCACHE_SHRINK_LIST;
+	spin_unlock(&dcache_lru_lock);
+	spin_unlock(&dentry->d_lock);
+	return LRU_REMOVED;
 }
 
 /**
@@ -830,16 +893,14 @@ relock:
  */
 void shrink_dcache_sb(struct super_block *sb)
 {
-	LIST_HEAD(tmp);
+	while (list_lru_count(&sb->s_dentry_lru)) {
+		LIST_HEAD(dispose);
 
-	spin_lock(&dcache_lru_lock);
-	while (!list_empty(&sb->s_dentry_lru)) {
-		list_splice_init(&sb->s_dentry_lru, &tmp);
-		spin_unlock(&dcache_lru_lock);
-		shrink_dentry_list(&tmp);
-		spin_lock(&dcache_lru_lock);
+		list_lru_walk(&sb->s_dentry_lru, dentry_lru_isolate_shrink,
+			      &dispose, UINT_MAX);
+		shrink_dentry_list(&dispose);
+		cond_resched();
 	}
-	spin_unlock(&dcache_lru_lock);
 }
 EXPORT_SYMBOL(shrink_dcache_sb);
 
@@ -1109,7 +1170,6 @@ resume:
 			dentry_lru_del(dentry);
 		} else if (!(dentry->d_flags & DCACHE_SHRINK_LIST)) {
 			dentry_lru_move_list(dentry, dispose);
-			dentry->d_flags |= DCACHE_SHRINK_LIST;
 			found++;
 		}
 		/*
@@ -1224,6 +1284,9 @@ struct dentry *__d_alloc(struct super_block *sb, const struct qstr *name)
 	dentry->d_fsdata = NULL;
 	INIT_HLIST_BL_NODE(&dentry->d_hash);
 	INIT_LIST_HEAD(&dentry->d_lru);
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+	dentry->d_memcg_id = mem_cgroup_current_id();
+#endif
 	INIT_LIST_HEAD(&dentry->d_subdirs);
 	INIT_LIST_HEAD(&dentry->d_alias);
 	INIT_LIST_HEAD(&dentry->d_u.d_child);
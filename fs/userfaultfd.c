@@ -0,0 +1,826 @@
+/*
+ *  fs/userfaultfd.c
+ *
+ * Page faults handled in userspace.  The missing page faults in the
+ * ranges of anonymous memory registered with a userfaultfd put the
+ * faulting thread to sleep, with mmap_sem released, and queue a message
+ * for read() on the fd.  The reader resolves the fault by installing the
+ * page with UFFDIO_COPY or UFFDIO_ZEROPAGE, which wakes the thread to
+ * retry the fault.
+ */
+
+#include <linux/file.h>
+#include <linux/poll.h>
+#include <linux/fs.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/mempolicy.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/anon_inodes.h>
+#include <linux/syscalls.h>
+#include <linux/security.h>
+#include <linux/userfaultfd_k.h>
+
+enum userfaultfd_state {
+	UFFD_STATE_WAIT_API,
+	UFFD_STATE_RUNNING,
+};
+
+struct userfaultfd_ctx {
+	/* faults not yet read */
+	wait_queue_head_t fault_pending_wqh;
+	/* faults read but not yet resolved */
+	wait_queue_head_t fault_wqh;
+	/* readers and pollers of the fd */
+	wait_queue_head_t fd_wqh;
+	atomic_t refcount;
+	enum userfaultfd_state state;
+	/* the fd is being released: do not wait for it any longer */
+	bool released;
+	/* the mm the ranges are registered in */
+	struct mm_struct *mm;
+};
+
+/*
+ * A faulting thread, on fault_pending_wqh until its message is read, and
+ * then on fault_wqh.  The lock of fault_pending_wqh serializes the moves
+ * between the two queues, and is taken around that of fault_wqh.
+ */
+struct userfaultfd_wait_queue {
+	struct uffd_msg msg;
+	wait_queue_t wq;
+	struct userfaultfd_ctx *ctx;
+};
+
+/* The range of the faults to wake, all of them if len is 0 */
+struct userfaultfd_wake_range {
+	unsigned long start;
+	unsigned long len;
+};
+
+static int userfaultfd_wake_function(wait_queue_t *wq, unsigned mode,
+				     int wake_flags, void *key)
+{
+	struct userfaultfd_wake_range *range = key;
+	struct userfaultfd_wait_queue *uwq;
+	unsigned long address, start, len;
+	int ret;
+
+	uwq = container_of(wq, struct userfaultfd_wait_queue, wq);
+	address = uwq->msg.arg.pagefault.address;
+	start = range->start;
+	len = range->len;
+	if (len && (start > address || start + len <= address))
+		return 0;
+
+	ret = default_wake_function(wq, mode, wake_flags, key);
+	/*
+	 * The thread is gone from the queue once woken: it need not take
+	 * the lock to remove itself, and its message cannot be read again.
+	 */
+	if (ret)
+		list_del_init(&wq->task_list);
+	return ret;
+}
+
+static void userfaultfd_ctx_get(struct userfaultfd_ctx *ctx)
+{
+	if (!atomic_inc_not_zero(&ctx->refcount))
+		BUG();
+}
+
+static void userfaultfd_ctx_put(struct userfaultfd_ctx *ctx)
+{
+	if (atomic_dec_and_test(&ctx->refcount)) {
+		VM_BUG_ON(waitqueue_active(&ctx->fault_pending_wqh));
+		VM_BUG_ON(waitqueue_active(&ctx->fault_wqh));
+		VM_BUG_ON(waitqueue_active(&ctx->fd_wqh));
+		mmdrop(ctx->mm);
+		kfree(ctx);
+	}
+}
+
+/*
+ * Is address still missing?  Called with mmap_sem held, and after the
+ * faulting thread is queued: a page installed after this check is
+ * followed by a wakeup.
+ */
+static bool userfaultfd_must_wait(struct userfaultfd_ctx *ctx,
+				  unsigned long address)
+{
+	struct mm_struct *mm = ctx->mm;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, _pmd;
+	pte_t *pte;
+	bool ret = true;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		goto out;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		goto out;
+	pmd = pmd_offset(pud, address);
+	_pmd = *pmd;
+	barrier();
+	if (pmd_none(_pmd))
+		goto out;
+
+	ret = false;
+	if (pmd_trans_huge(_pmd) || pmd_bad(_pmd))
+		goto out;
+
+	pte = pte_offset_map(pmd, address);
+	if (pte_none(*pte))
+		ret = true;
+	pte_unmap(pte);
+out:
+	return ret;
+}
+
+/**
+ * handle_userfault - report a missing page fault to userspace
+ * @vma: the faulting vma, registered with a userfaultfd
+ * @address: the faulting address
+ * @flags: FAULT_FLAG_xxx of the fault
+ *
+ * Queues the fault for the reader of the userfaultfd, releases mmap_sem
+ * and waits for the fault to be resolved, when the fault is retried.
+ * Returns VM_FAULT_RETRY, or VM_FAULT_SIGBUS if the fault cannot wait:
+ * for get_user_pages() without FAULT_FLAG_ALLOW_RETRY, or on a retry
+ * which still found the page missing.
+ */
+int handle_userfault(struct vm_area_struct *vma, unsigned long address,
+		     unsigned int flags)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct userfaultfd_ctx *ctx = vma->vm_userfaultfd_ctx.ctx;
+	struct userfaultfd_wait_queue uwq;
+	bool must_wait;
+
+	BUG_ON(!rwsem_is_locked(&mm->mmap_sem));
+	VM_BUG_ON(ctx->mm != mm);
+
+	if (!(flags & FAULT_FLAG_ALLOW_RETRY))
+		return VM_FAULT_SIGBUS;
+	/* The fd is going away: userfaultfd_release() will unregister us */
+	if (unlikely(ACCESS_ONCE(ctx->released)))
+		return VM_FAULT_SIGBUS;
+	/* The caller holds on to mmap_sem and will retry */
+	if (flags & FAULT_FLAG_RETRY_NOWAIT)
+		return VM_FAULT_RETRY;
+
+	/* Hold the context across the release of mmap_sem */
+	userfaultfd_ctx_get(ctx);
+
+	init_waitqueue_func_entry(&uwq.wq, userfaultfd_wake_function);
+	uwq.wq.private = current;
+	memset(&uwq.msg, 0, sizeof(uwq.msg));
+	uwq.msg.event = UFFD_EVENT_PAGEFAULT;
+	uwq.msg.arg.pagefault.address = address;
+	if (flags & FAULT_FLAG_WRITE)
+		uwq.msg.arg.pagefault.flags |= UFFD_PAGEFAULT_FLAG_WRITE;
+	uwq.ctx = ctx;
+
+	spin_lock(&ctx->fault_pending_wqh.lock);
+	/* The oldest fault is read first, as __add_wait_queue() adds at head */
+	__add_wait_queue(&ctx->fault_pending_wqh, &uwq.wq);
+	set_current_state(TASK_KILLABLE);
+	spin_unlock(&ctx->fault_pending_wqh.lock);
+
+	must_wait = userfaultfd_must_wait(ctx, address);
+	up_read(&mm->mmap_sem);
+
+	if (likely(must_wait && !ACCESS_ONCE(ctx->released) &&
+		   !fatal_signal_pending(current))) {
+		wake_up_poll(&ctx->fd_wqh, POLLIN);
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+
+	/* Not woken by the resolver: take ourselves off the queues */
+	if (!list_empty_careful(&uwq.wq.task_list)) {
+		spin_lock(&ctx->fault_pending_wqh.lock);
+		list_del(&uwq.wq.task_list);
+		spin_unlock(&ctx->fault_pending_wqh.lock);
+	}
+
+	userfaultfd_ctx_put(ctx);
+	return VM_FAULT_RETRY;
+}
+
+static void __wake_userfault(struct userfaultfd_ctx *ctx,
+			     struct userfaultfd_wake_range *range)
+{
+	spin_lock(&ctx->fault_pending_wqh.lock);
+	if (waitqueue_active(&ctx->fault_pending_wqh))
+		__wake_up_locked_key(&ctx->fault_pending_wqh, TASK_NORMAL,
+				     range);
+	if (waitqueue_active(&ctx->fault_wqh))
+		__wake_up(&ctx->fault_wqh, TASK_NORMAL, 1, range);
+	spin_unlock(&ctx->fault_pending_wqh.lock);
+}
+
+static void wake_userfault(struct userfaultfd_ctx *ctx,
+			   struct userfaultfd_wake_range *range)
+{
+	/*
+	 * Pairs with the queueing in handle_userfault(): either the thread
+	 * is queued by now, or it is yet to see the new pte.
+	 */
+	smp_mb();
+	if (waitqueue_active(&ctx->fault_pending_wqh) ||
+	    waitqueue_active(&ctx->fault_wqh))
+		__wake_userfault(ctx, range);
+}
+
+/*
+ * Take hold of ctx->mm for an ioctl, unless the process has gone: the
+ * context only pins the mm_struct, not the address space.
+ */
+static bool userfaultfd_mm_get(struct userfaultfd_ctx *ctx)
+{
+	return atomic_inc_not_zero(&ctx->mm->mm_users);
+}
+
+static int userfaultfd_release(struct inode *inode, struct file *file)
+{
+	struct userfaultfd_ctx *ctx = file->private_data;
+	struct mm_struct *mm = ctx->mm;
+	struct vm_area_struct *vma, *prev;
+	/* len == 0 means wake all */
+	struct userfaultfd_wake_range range = { .len = 0, };
+
+	ACCESS_ONCE(ctx->released) = true;
+
+	/*
+	 * Unregister all the ranges: their faults are handled normally from
+	 * now on.  The vmas are merged back where they can be.
+	 */
+	if (userfaultfd_mm_get(ctx)) {
+		down_write(&mm->mmap_sem);
+		prev = NULL;
+		for (vma = mm->mmap; vma; vma = vma->vm_next) {
+			if (vma->vm_userfaultfd_ctx.ctx != ctx) {
+				prev = vma;
+				continue;
+			}
+			prev = vma_merge(mm, prev, vma->vm_start, vma->vm_end,
+					 vma->vm_flags, vma->anon_vma,
+					 vma->vm_file, vma->vm_pgoff,
+					 vma_policy(vma), NULL_VM_UFFD_CTX);
+			if (prev)
+				vma = prev;
+			else
+				prev = vma;
+			mmap_seq_write_begin(mm);
+			vma->vm_userfaultfd_ctx = NULL_VM_UFFD_CTX;
+			mmap_seq_write_end(mm);
+		}
+		up_write(&mm->mmap_sem);
+		mmput(mm);
+	}
+
+	/* Wake the threads still waiting, to retry their faults */
+	__wake_userfault(ctx, &range);
+	wake_up_poll(&ctx->fd_wqh, POLLHUP);
+
+	userfaultfd_ctx_put(ctx);
+	return 0;
+}
+
+static unsigned int userfaultfd_poll(struct file *file, poll_table *wait)
+{
+	struct userfaultfd_ctx *ctx = file->private_data;
+
+	poll_wait(file, &ctx->fd_wqh, wait);
+
+	switch (ctx->state) {
+	case UFFD_STATE_WAIT_API:
+		return POLLERR;
+	case UFFD_STATE_RUNNING:
+		/* Pairs with the wake_up_poll() in handle_userfault() */
+		smp_mb();
+		if (waitqueue_active(&ctx->fault_pending_wqh))
+			return POLLIN;
+		return 0;
+	default:
+		BUG();
+	}
+}
+
+/*
+ * Take the oldest pending fault, and move it over to fault_wqh to wait
+ * there for the resolver.  Returns false if there is none.
+ */
+static bool userfaultfd_dequeue_msg(struct userfaultfd_ctx *ctx,
+				    struct uffd_msg *msg)
+{
+	struct userfaultfd_wait_queue *uwq;
+	wait_queue_t *wq;
+
+	spin_lock(&ctx->fault_pending_wqh.lock);
+	if (!waitqueue_active(&ctx->fault_pending_wqh)) {
+		spin_unlock(&ctx->fault_pending_wqh.lock);
+		return false;
+	}
+
+	wq = list_entry(ctx->fault_pending_wqh.task_list.prev,
+			wait_queue_t, task_list);
+	uwq = container_of(wq, struct userfaultfd_wait_queue, wq);
+	*msg = uwq->msg;
+
+	spin_lock(&ctx->fault_wqh.lock);
+	list_del(&wq->task_list);
+	__add_wait_queue(&ctx->fault_wqh, wq);
+	spin_unlock(&ctx->fault_wqh.lock);
+
+	spin_unlock(&ctx->fault_pending_wqh.lock);
+	return true;
+}
+
+static ssize_t userfaultfd_ctx_read(struct userfaultfd_ctx *ctx, int no_wait,
+				    struct uffd_msg *msg)
+{
+	DECLARE_WAITQUEUE(wait, current);
+	ssize_t ret = 0;
+
+	spin_lock(&ctx->fd_wqh.lock);
+	__add_wait_queue(&ctx->fd_wqh, &wait);
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (userfaultfd_dequeue_msg(ctx, msg))
+			break;
+		if (signal_pending(current)) {
+			ret = -ERESTARTSYS;
+			break;
+		}
+		if (no_wait) {
+			ret = -EAGAIN;
+			break;
+		}
+		spin_unlock(&ctx->fd_wqh.lock);
+		schedule();
+		spin_lock(&ctx->fd_wqh.lock);
+	}
+	__remove_wait_queue(&ctx->fd_wqh, &wait);
+	__set_current_state(TASK_RUNNING);
+	spin_unlock(&ctx->fd_wqh.lock);
+
+	return ret;
+}
+
+static ssize_t userfaultfd_read(struct file *file, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct userfaultfd_ctx *ctx = file->private_data;
+	int no_wait = file->f_flags & O_NONBLOCK;
+	struct uffd_msg msg;
+	ssize_t ret, done = 0;
+
+	if (ctx->state == UFFD_STATE_WAIT_API)
+		return -EINVAL;
+
+	/* Return as many messages as are pending, waiting for the first */
+	while (count >= sizeof(msg)) {
+		ret = userfaultfd_ctx_read(ctx, no_wait, &msg);
+		if (ret < 0)
+			return done ? done : ret;
+		if (copy_to_user(buf, &msg, sizeof(msg)))
+			return done ? done : -EFAULT;
+		buf += sizeof(msg);
+		count -= sizeof(msg);
+		done += sizeof(msg);
+		/* after the first message, only take what is there */
+		no_wait = O_NONBLOCK;
+	}
+	return done ? done : -EINVAL;
+}
+
+/* Only private anonymous memory can have its faults handled in userspace */
+static inline bool vma_can_userfault(struct vm_area_struct *vma)
+{
+	return !vma->vm_ops && !vma->vm_file &&
+		!(vma->vm_flags & (VM_SHARED | VM_HUGETLB | VM_PFNMAP |
+				   VM_MIXEDMAP | VM_IO));
+}
+
+/*
+ * Check the range of an ioctl: page aligned, non-empty and within the
+ * user address space.  Whether it is mapped is up to the ioctl.
+ */
+static int validate_range(__u64 start, __u64 len)
+{
+	if (start & ~PAGE_MASK)
+		return -EINVAL;
+	if (len & ~PAGE_MASK)
+		return -EINVAL;
+	if (!len)
+		return -EINVAL;
+	if (start < mmap_min_addr)
+		return -EINVAL;
+	if (start >= TASK_SIZE)
+		return -EINVAL;
+	if (len > TASK_SIZE - start)
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * Set the userfaultfd of the vmas of [start, end) to new_ctx, splitting
+ * and merging them as mprotect_fixup() does.  Every vma of the range
+ * has been checked, and there are no holes in it.  Called with mmap_sem
+ * held for writing.
+ */
+static int userfaultfd_set_range(struct mm_struct *mm,
+				 struct vm_area_struct *vma,
+				 struct vm_area_struct *prev,
+				 unsigned long start, unsigned long end,
+				 struct vm_userfaultfd_ctx new_ctx)
+{
+	unsigned long vma_end;
+	pgoff_t pgoff;
+	int ret = 0;
+
+	if (start > vma->vm_start)
+		prev = vma;
+
+	for (; vma && vma->vm_start < end; vma = vma->vm_next) {
+		cond_resched();
+
+		start = max(start, vma->vm_start);
+		vma_end = min(end, vma->vm_end);
+
+		if (vma->vm_userfaultfd_ctx.ctx == new_ctx.ctx)
+			goto skip;
+
+		pgoff = vma->vm_pgoff + ((start - vma->vm_start) >> PAGE_SHIFT);
+		prev = vma_merge(mm, prev, start, vma_end, vma->vm_flags,
+				 vma->anon_vma, vma->vm_file, pgoff,
+				 vma_policy(vma), new_ctx);
+		if (prev) {
+			vma = prev;
+			goto next;
+		}
+		if (vma->vm_start < start) {
+			ret = split_vma(mm, vma, start, 1);
+			if (ret)
+				break;
+		}
+		if (vma->vm_end > end) {
+			ret = split_vma(mm, vma, end, 0);
+			if (ret)
+				break;
+		}
+	next:
+		/*
+		 * vma_merge() case 8 extends the vma being changed over the
+		 * next one, which is registered already: set it here.
+		 * A speculative fault must see the change, or it could
+		 * fill in a page of a range that was just registered.
+		 */
+		mmap_seq_write_begin(mm);
+		vma->vm_userfaultfd_ctx = new_ctx;
+		mmap_seq_write_end(mm);
+	skip:
+		prev = vma;
+		start = vma->vm_end;
+	}
+	return ret;
+}
+
+static int userfaultfd_register(struct userfaultfd_ctx *ctx,
+				unsigned long arg)
+{
+	struct mm_struct *mm = ctx->mm;
+	struct vm_area_struct *vma, *prev, *cur;
+	struct uffdio_register uffdio_register;
+	struct uffdio_register __user *user_uffdio_register;
+	struct vm_userfaultfd_ctx new_ctx = { .ctx = ctx, };
+	unsigned long start, end;
+	int ret;
+
+	user_uffdio_register = (struct uffdio_register __user *) arg;
+
+	if (copy_from_user(&uffdio_register, user_uffdio_register,
+			   sizeof(uffdio_register) - sizeof(__u64)))
+		return -EFAULT;
+
+	if (uffdio_register.mode != UFFDIO_REGISTER_MODE_MISSING)
+		return -EINVAL;
+
+	ret = validate_range(uffdio_register.range.start,
+			     uffdio_register.range.len);
+	if (ret)
+		return ret;
+
+	start = uffdio_register.range.start;
+	end = start + uffdio_register.range.len;
+
+	if (!userfaultfd_mm_get(ctx))
+		return -ESRCH;
+
+	down_write(&mm->mmap_sem);
+	vma = find_vma_prev(mm, start, &prev);
+	ret = -ENOMEM;
+	if (!vma || vma->vm_start > start)
+		goto out_unlock;
+
+	/*
+	 * Check the whole range first, so that it is registered entirely
+	 * or not at all.
+	 */
+	for (cur = vma; cur && cur->vm_start < end; cur = cur->vm_next) {
+		ret = -ENOMEM;
+		/* no holes */
+		if (cur->vm_end < end && (!cur->vm_next ||
+					  cur->vm_next->vm_start != cur->vm_end))
+			goto out_unlock;
+		ret = -EINVAL;
+		if (!vma_can_userfault(cur))
+			goto out_unlock;
+		/* registered with another userfaultfd already */
+		ret = -EBUSY;
+		if (cur->vm_userfaultfd_ctx.ctx &&
+		    cur->vm_userfaultfd_ctx.ctx != ctx)
+			goto out_unlock;
+	}
+
+	ret = userfaultfd_set_range(mm, vma, prev, start, end, new_ctx);
+out_unlock:
+	up_write(&mm->mmap_sem);
+	mmput(mm);
+	if (!ret) {
+		/* The ioctls the range supports */
+		if (put_user(UFFD_API_RANGE_IOCTLS,
+			     &user_uffdio_register->ioctls))
+			ret = -EFAULT;
+	}
+	return ret;
+}
+
+static int userfaultfd_unregister(struct userfaultfd_ctx *ctx,
+				  unsigned long arg)
+{
+	struct mm_struct *mm = ctx->mm;
+	struct vm_area_struct *vma, *prev, *cur;
+	struct uffdio_range uffdio_unregister;
+	struct userfaultfd_wake_range range;
+	unsigned long start, end;
+	int ret;
+
+	if (copy_from_user(&uffdio_unregister, (void __user *)arg,
+			   sizeof(uffdio_unregister)))
+		return -EFAULT;
+
+	ret = validate_range(uffdio_unregister.start,
+			     uffdio_unregister.len);
+	if (ret)
+		return ret;
+
+	start = uffdio_unregister.start;
+	end = start + uffdio_unregister.len;
+
+	if (!userfaultfd_mm_get(ctx))
+		return -ESRCH;
+
+	down_write(&mm->mmap_sem);
+	vma = find_vma_prev(mm, start, &prev);
+	ret = -ENOMEM;
+	if (!vma || vma->vm_start > start)
+		goto out_unlock;
+
+	for (cur = vma; cur && cur->vm_start < end; cur = cur->vm_next) {
+		ret = -ENOMEM;
+		if (cur->vm_end < end && (!cur->vm_next ||
+					  cur->vm_next->vm_start != cur->vm_end))
+			goto out_unlock;
+		ret = -EINVAL;
+		if (cur->vm_userfaultfd_ctx.ctx &&
+		    cur->vm_userfaultfd_ctx.ctx != ctx)
+			goto out_unlock;
+	}
+
+	ret = userfaultfd_set_range(mm, vma, prev, start, end,
+				    NULL_VM_UFFD_CTX);
+out_unlock:
+	up_write(&mm->mmap_sem);
+	mmput(mm);
+
+	/* The faults of the range no longer wait for userspace */
+	if (!ret) {
+		range.start = start;
+		range.len = end - start;
+		wake_userfault(ctx, &range);
+	}
+	return ret;
+}
+
+static int userfaultfd_wake(struct userfaultfd_ctx *ctx, unsigned long arg)
+{
+	struct uffdio_range uffdio_wake;
+	struct userfaultfd_wake_range range;
+	int ret;
+
+	if (copy_from_user(&uffdio_wake, (void __user *)arg,
+			   sizeof(uffdio_wake)))
+		return -EFAULT;
+
+	ret = validate_range(uffdio_wake.start, uffdio_wake.len);
+	if (ret)
+		return ret;
+
+	range.start = uffdio_wake.start;
+	range.len = uffdio_wake.len;
+	wake_userfault(ctx, &range);
+	return 0;
+}
+
+static int userfaultfd_copy(struct userfaultfd_ctx *ctx, unsigned long arg)
+{
+	struct uffdio_copy uffdio_copy;
+	struct uffdio_copy __user *user_uffdio_copy;
+	struct userfaultfd_wake_range range;
+	ssize_t ret;
+
+	user_uffdio_copy = (struct uffdio_copy __user *) arg;
+
+	if (copy_from_user(&uffdio_copy, user_uffdio_copy,
+			   sizeof(uffdio_copy) - sizeof(__s64)))
+		return -EFAULT;
+
+	ret = validate_range(uffdio_copy.dst, uffdio_copy.len);
+	if (ret)
+		return ret;
+	/* The source must be page aligned and must not overlap the range */
+	if (uffdio_copy.src & ~PAGE_MASK)
+		return -EINVAL;
+	if (uffdio_copy.src + uffdio_copy.len <= uffdio_copy.src)
+		return -EINVAL;
+	if (uffdio_copy.src < uffdio_copy.dst + uffdio_copy.len &&
+	    uffdio_copy.dst < uffdio_copy.src + uffdio_copy.len)
+		return -EINVAL;
+	if (uffdio_copy.mode & ~UFFDIO_COPY_MODE_DONTWAKE)
+		return -EINVAL;
+
+	if (!userfaultfd_mm_get(ctx))
+		return -ESRCH;
+	ret = mcopy_atomic(ctx->mm, uffdio_copy.dst, uffdio_copy.src,
+			   uffdio_copy.len);
+	mmput(ctx->mm);
+
+	if (put_user(ret, &user_uffdio_copy->copy))
+		return -EFAULT;
+	if (ret < 0)
+		return ret;
+
+	/* len == 0 would wake all */
+	BUG_ON(!ret);
+	if (!(uffdio_copy.mode & UFFDIO_COPY_MODE_DONTWAKE)) {
+		range.start = uffdio_copy.dst;
+		range.len = ret;
+		wake_userfault(ctx, &range);
+	}
+	return ret != uffdio_copy.len ? -EAGAIN : 0;
+}
+
+static int userfaultfd_zeropage(struct userfaultfd_ctx *ctx,
+				unsigned long arg)
+{
+	struct uffdio_zeropage uffdio_zeropage;
+	struct uffdio_zeropage __user *user_uffdio_zeropage;
+	struct userfaultfd_wake_range range;
+	ssize_t ret;
+
+	user_uffdio_zeropage = (struct uffdio_zeropage __user *) arg;
+
+	if (copy_from_user(&uffdio_zeropage, user_uffdio_zeropage,
+			   sizeof(uffdio_zeropage) - sizeof(__s64)))
+		return -EFAULT;
+
+	ret = validate_range(uffdio_zeropage.range.start,
+			     uffdio_zeropage.range.len);
+	if (ret)
+		return ret;
+	if (uffdio_zeropage.mode & ~UFFDIO_ZEROPAGE_MODE_DONTWAKE)
+		return -EINVAL;
+
+	if (!userfaultfd_mm_get(ctx))
+		return -ESRCH;
+	ret = mfill_zeropage(ctx->mm, uffdio_zeropage.range.start,
+			     uffdio_zeropage.range.len);
+	mmput(ctx->mm);
+
+	if (put_user(ret, &user_uffdio_zeropage->zeropage))
+		return -EFAULT;
+	if (ret < 0)
+		return ret;
+
+	BUG_ON(!ret);
+	if (!(uffdio_zeropage.mode & UFFDIO_ZEROPAGE_MODE_DONTWAKE)) {
+		range.start = uffdio_zeropage.range.start;
+		range.len = ret;
+		wake_userfault(ctx, &range);
+	}
+	return ret != uffdio_zeropage.range.len ? -EAGAIN : 0;
+}
+
+/*
+ * The handshake: userspace states the API it was written for, and is
+ * told the features and ioctls of this kernel.
+ */
+static int userfaultfd_api(struct userfaultfd_ctx *ctx, unsigned long arg)
+{
+	struct uffdio_api uffdio_api;
+	void __user *buf = (void __user *)arg;
+
+	if (ctx->state != UFFD_STATE_WAIT_API)
+		return -EINVAL;
+	if (copy_from_user(&uffdio_api, buf, sizeof(uffdio_api)))
+		return -EFAULT;
+	if (uffdio_api.api != UFFD_API || uffdio_api.features) {
+		memset(&uffdio_api, 0, sizeof(uffdio_api));
+		if (copy_to_user(buf, &uffdio_api, sizeof(uffdio_api)))
+			return -EFAULT;
+		return -EINVAL;
+	}
+	uffdio_api.features = UFFD_API_FEATURES;
+	uffdio_api.ioctls = UFFD_API_IOCTLS;
+	if (copy_to_user(buf, &uffdio_api, sizeof(uffdio_api)))
+		return -EFAULT;
+	ctx->state = UFFD_STATE_RUNNING;
+	return 0;
+}
+
+static long userfaultfd_ioctl(struct file *file, unsigned cmd,
+			      unsigned long arg)
+{
+	struct userfaultfd_ctx *ctx = file->private_data;
+
+	if (cmd != UFFDIO_API && ctx->state == UFFD_STATE_WAIT_API)
+		return -EINVAL;
+
+	switch (cmd) {
+	case UFFDIO_API:
+		return userfaultfd_api(ctx, arg);
+	case UFFDIO_REGISTER:
+		return userfaultfd_register(ctx, arg);
+	case UFFDIO_UNREGISTER:
+		return userfaultfd_unregister(ctx, arg);
+	case UFFDIO_WAKE:
+		return userfaultfd_wake(ctx, arg);
+	case UFFDIO_COPY:
+		return userfaultfd_copy(ctx, arg);
+	case UFFDIO_ZEROPAGE:
+		return userfaultfd_zeropage(ctx, arg);
+	}
+	return -EINVAL;
+}
+
+static const struct file_operations userfaultfd_fops = {
+	.release	= userfaultfd_release,
+	.poll		= userfaultfd_poll,
+	.read		= userfaultfd_read,
+	.unlocked_ioctl	= userfaultfd_ioctl,
+	.compat_ioctl	= userfaultfd_ioctl,
+	.llseek		= noop_llseek,
+};
+
+SYSCALL_DEFINE1(userfaultfd, int, flags)
+{
+	struct userfaultfd_ctx *ctx;
+	int fd;
+
+	/* Check the UFFD_* constants for consistency.  */
+	BUILD_BUG_ON(UFFD_CLOEXEC != O_CLOEXEC);
+	BUILD_BUG_ON(UFFD_NONBLOCK != O_NONBLOCK);
+
+	if (flags & ~UFFD_SHARED_FCNTL_FLAGS)
+		return -EINVAL;
+	if (!current->mm)
+		return -EINVAL;
+
+	ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	init_waitqueue_head(&ctx->fault_pending_wqh);
+	init_waitqueue_head(&ctx->fault_wqh);
+	init_waitqueue_head(&ctx->fd_wqh);
+	atomic_set(&ctx->refcount, 1);
+	ctx->state = UFFD_STATE_WAIT_API;
+	ctx->released = false;
+	ctx->mm = current->mm;
+	/* Prevent the mm struct from being freed */
+	atomic_inc(&ctx->mm->mm_count);
+
+	fd = anon_inode_getfd("[userfaultfd]", &userfaultfd_fops, ctx,
+			      O_RDWR | (flags & UFFD_SHARED_FCNTL_FLAGS));
+	if (fd < 0) {
+		mmdrop(ctx->mm);
+		kfree(ctx);
+	}
+	return fd;
+}
@@ -42,6 +42,8 @@ enum bdi_stat_item {
 	BDI_WRITEBACK,
 	BDI_DIRTIED,
 	BDI_WRITTEN,
+	BDI_READAHEAD,
+	BDI_READAHEAD_WASTED,
 	NR_BDI_STAT_ITEMS
 };
 
@@ -80,6 +82,16 @@ struct backing_dev_info {
 	unsigned long write_bandwidth;	/* the estimated write bandwidth */
 	unsigned long avg_write_bandwidth; /* further smoothed write bw */
 
+	/*
+	 * Readahead throughput, re-calculated every 200ms, and the time
+	 * readers stall on pages under read I/O.  Their product is how
+	 * much must be read ahead to keep up with the readers.
+	 */
+	unsigned long ra_time_stamp;	/* last time ra bw is updated */
+	unsigned long ra_stamp;		/* pages read ahead at ra_time_stamp */
+	unsigned long ra_bandwidth;	/* pages read ahead per second */
+	unsigned long ra_latency;	/* average read stall, in us */
+
 	/*
 	 * The base dirty throttle rate, re-calculated on every 200ms.
 	 * All the bdi tasks' dirty rate will be curbed under it.
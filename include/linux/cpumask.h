@@ -147,6 +147,8 @@ static inline unsigned int cpumask_any_but(const struct cpumask *mask,
 	for ((cpu) = 0; (cpu) < 1; (cpu)++, (void)mask)
 #define for_each_cpu_and(cpu, mask, and)	\
 	for ((cpu) = 0; (cpu) < 1; (cpu)++, (void)mask, (void)and)
+#define for_each_cpu_wrap(cpu, mask, start)	\
+	for ((cpu) = 0; (cpu) < 1; (cpu)++, (void)mask, (void)(start))
 #else
 /**
  * cpumask_first - get the first cpu in a cpumask
@@ -191,6 +193,7 @@ static inline unsigned int cpumask_next_zero(int n, const struct cpumask *srcp)
 
 int cpumask_next_and(int n, const struct cpumask *, const struct cpumask *);
 int cpumask_any_but(const struct cpumask *mask, unsigned int cpu);
+int cpumask_next_wrap(int n, const struct cpumask *mask, int start, bool wrap);
 
 /**
  * for_each_cpu - iterate over every cpu in a mask
@@ -234,6 +237,23 @@ int cpumask_any_but(const struct cpumask *mask, unsigned int cpu);
 	for ((cpu) = -1;						\
 		(cpu) = cpumask_next_and((cpu), (mask), (and)),		\
 		(cpu) < nr_cpu_ids;)
+
+/**
+ * for_each_cpu_wrap - iterate over every cpu in a mask, starting at a cpu
+ * @cpu: the (optionally unsigned) integer iterator
+ * @mask: the cpumask pointer
+ * @start: the cpu to start at
+ *
+ * The cpus from @start to the end of the mask are visited first, then
+ * those from the beginning of the mask up to @start, so that concurrent
+ * searches starting from different cpus spread out.
+ *
+ * After the loop, cpu is >= nr_cpu_ids.
+ */
+#define for_each_cpu_wrap(cpu, mask, start)					\
+	for ((cpu) = cpumask_next_wrap((start)-1, (mask), (start), false);	\
+	     (cpu) < nr_cpu_ids;						\
+	     (cpu) = cpumask_next_wrap((cpu), (mask), (start), true))
 #endif /* SMP */
 
 #define CPU_BITS_NONE						\
@@ -104,15 +104,22 @@ full_name_hash(const unsigned char *name, unsigned int len)
  * large memory footprint increase).
  */
 #ifdef CONFIG_64BIT
-# define DNAME_INLINE_LEN 32 /* 192 bytes */
+# define __DNAME_INLINE_LEN 32 /* 192 bytes */
 #else
 # ifdef CONFIG_SMP
-#  define DNAME_INLINE_LEN 36 /* 128 bytes */
+#  define __DNAME_INLINE_LEN 36 /* 128 bytes */
 # else
-#  define DNAME_INLINE_LEN 40 /* 128 bytes */
+#  define __DNAME_INLINE_LEN 40 /* 128 bytes */
 # endif
 #endif
 
+/* the memory cgroup tag of d_lru comes out of the inline name */
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+# define DNAME_INLINE_LEN (__DNAME_INLINE_LEN - sizeof(unsigned short))
+#else
+# define DNAME_INLINE_LEN __DNAME_INLINE_LEN
+#endif
+
 struct dentry {
 	/* RCU lookup touched fields */
 	unsigned int d_flags;		/* protected by d_lock */
@@ -123,6 +130,9 @@ struct dentry {
 	struct inode *d_inode;		/* Where the name belongs to - NULL is
 					 * negative */
 	unsigned char d_iname[DNAME_INLINE_LEN];	/* small names */
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+	unsigned short d_memcg_id;	/* memory cgroup, for d_lru */
+#endif
 
 	/* Ref lookup also touches following */
 	unsigned int d_count;		/* protected by d_lock */
@@ -396,6 +396,7 @@ struct inodes_stat_t {
 #include <linux/rculist_bl.h>
 #include <linux/atomic.h>
 #include <linux/shrinker.h>
+#include <linux/list_lru.h>
 #include <linux/migrate_mode.h>
 
 #include <asm/byteorder.h>
@@ -648,6 +649,7 @@ struct address_space {
 	struct mutex		i_mmap_mutex;	/* protect tree, count, list */
 	/* Protected by tree_lock together with the radix tree */
 	unsigned long		nrpages;	/* number of total pages */
+	unsigned long		nrshadows;	/* number of shadow entries */
 	pgoff_t			writeback_index;/* writeback starts here */
 	const struct address_space_operations *a_ops;	/* methods */
 	unsigned long		flags;		/* error bits/gfp mask */
@@ -792,6 +794,7 @@ struct inode {
 	struct timespec		i_ctime;
 	spinlock_t		i_lock;	/* i_blocks, i_bytes, maybe i_size */
 	unsigned short          i_bytes;
+	unsigned short		i_memcg_id;	/* memory cgroup, for i_lru */
 	blkcnt_t		i_blocks;
 	loff_t			i_size;
 
@@ -942,6 +945,19 @@ struct fown_struct {
 	int signum;		/* posix.1b rt signal to be delivered on IO */
 };
 
+/*
+ * The windows of the other sequential streams read through the same file,
+ * most recently used first, so that interleaved streams do not keep
+ * restarting each other's readahead.
+ */
+#define RA_SAVED_STREAMS	3
+
+struct file_ra_stream {
+	pgoff_t start;
+	unsigned int size;
+	unsigned int async_size;
+};
+
 /*
  * Track a single file's readahead state
  */
@@ -954,6 +970,8 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	struct file_ra_stream streams[RA_SAVED_STREAMS];
 };
 
 /*
@@ -1437,14 +1455,9 @@ struct super_block {
 	struct list_head	s_files;
 #endif
 	struct list_head	s_mounts;	/* list of mounts; _not_ for fs use */
-	/* s_dentry_lru, s_nr_dentry_unused protected by dcache.c lru locks */
-	struct list_head	s_dentry_lru;	/* unused dentry lru */
-	int			s_nr_dentry_unused;	/* # of dentry on lru */
-
-	/* s_inode_lru_lock protects s_inode_lru and s_nr_inodes_unused */
-	spinlock_t		s_inode_lru_lock ____cacheline_aligned_in_smp;
-	struct list_head	s_inode_lru;		/* unused inode lru */
-	int			s_nr_inodes_unused;	/* # of inodes on lru */
+	/* unused dentries and inodes, per node and memory cgroup */
+	struct list_lru		s_dentry_lru;
+	struct list_lru		s_inode_lru;
 
 	struct block_device	*s_bdev;
 	struct backing_dev_info *s_bdi;
@@ -1499,8 +1512,10 @@ struct super_block {
 };
 
 /* superblock cache pruning functions */
-extern void prune_icache_sb(struct super_block *sb, int nr_to_scan);
-extern void prune_dcache_sb(struct super_block *sb, int nr_to_scan);
+extern long prune_icache_sb(struct super_block *sb, unsigned long nr_to_scan,
+			    nodemask_t *nodes, struct mem_cgroup *memcg);
+extern long prune_dcache_sb(struct super_block *sb, unsigned long nr_to_scan,
+			    nodemask_t *nodes, struct mem_cgroup *memcg);
 
 extern struct timespec current_fs_time(struct super_block *sb);
 
@@ -0,0 +1,139 @@
+/*
+ * include/linux/list_lru.h
+ *
+ * LRU lists of reclaimable kernel objects, such as unused dentries and
+ * inodes, kept per NUMA node and, with the memory controller, per memory
+ * cgroup, so that a shrinker can free the objects of just the nodes and
+ * the cgroup under reclaim.
+ */
+
+#ifndef _LINUX_LIST_LRU_H
+#define _LINUX_LIST_LRU_H
+
+#include <linux/list.h>
+#include <linux/nodemask.h>
+#include <linux/radix-tree.h>
+#include <linux/spinlock.h>
+
+struct mem_cgroup;
+
+/* what a list_lru_walk_cb did with the item */
+enum lru_status {
+	LRU_REMOVED,		/* item removed from the list */
+	LRU_REMOVED_RETRY,	/* item removed, but lock was dropped */
+	LRU_ROTATE,		/* item referenced, give it another pass */
+	LRU_SKIP,		/* item cannot be locked, skip it */
+	LRU_RETRY,		/* lock was dropped, list must be rescanned */
+};
+
+struct list_lru_one {
+	struct list_head	list;
+	long			nr_items;
+};
+
+struct list_lru_node {
+	spinlock_t		lock;
+	struct list_lru_one	lru;		/* objects of the root cgroup */
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+	struct radix_tree_root	memcg_lrus;	/* other cgroups, by css id */
+	long			nr_items;	/* objects of all cgroups */
+#endif
+} ____cacheline_aligned_in_smp;
+
+struct list_lru {
+	struct list_lru_node	*node;
+};
+
+int list_lru_init_key(struct list_lru *lru, struct lock_class_key *key);
+
+static inline int list_lru_init(struct list_lru *lru)
+{
+	return list_lru_init_key(lru, NULL);
+}
+
+void list_lru_destroy(struct list_lru *lru);
+
+/*
+ * list_lru_add, list_lru_del - add or remove an object from its LRU
+ * @lru: the list_lru
+ * @item: the list_head embedded in the object
+ * @memcg_id: the memory cgroup tag of the object
+ *
+ * The object is put on the list of the node its memory comes from and
+ * of the cgroup @memcg_id names (mem_cgroup_current_id() at allocation,
+ * 0 or a NULL @memcg_id for the root cgroup).  The tag may be reset to
+ * 0 if the cgroup is gone.  Both return true if the object was added or removed, false if
+ * it was already on, or not on, a list.
+ */
+bool list_lru_add(struct list_lru *lru, struct list_head *item,
+		  unsigned short *memcg_id);
+bool list_lru_del(struct list_lru *lru, struct list_head *item,
+		  unsigned short *memcg_id);
+
+/*
+ * The objects on the lists of @nid, or of the nodes in @nodes, that
+ * belong to @memcg; a NULL @memcg counts the objects of all cgroups.
+ */
+unsigned long list_lru_count_node(struct list_lru *lru, int nid,
+				  struct mem_cgroup *memcg);
+unsigned long list_lru_count_nodemask(struct list_lru *lru,
+				      const nodemask_t *nodes,
+				      struct mem_cgroup *memcg);
+
+static inline unsigned long list_lru_count(struct list_lru *lru)
+{
+	return list_lru_count_nodemask(lru, &node_possible_map, NULL);
+}
+
+/*
+ * Called on each object walked, with the list lock held.  An isolate
+ * function that takes the object off the list calls list_lru_isolate()
+ * or list_lru_isolate_move() and returns LRU_REMOVED.  If it drops
+ * @lock, it must retake it and return LRU_RETRY, or LRU_REMOVED_RETRY
+ * if it took the object off the list first.
+ */
+typedef enum lru_status (*list_lru_walk_cb)(struct list_head *item,
+					    struct list_lru_one *list,
+					    spinlock_t *lock, void *cb_arg);
+
+static inline void list_lru_isolate(struct list_lru_one *list,
+				    struct list_head *item)
+{
+	list_del_init(item);
+	list->nr_items--;
+}
+
+static inline void list_lru_isolate_move(struct list_lru_one *list,
+					 struct list_head *item,
+					 struct list_head *head)
+{
+	list_move(item, head);
+	list->nr_items--;
+}
+
+/*
+ * Walk up to @nr_to_walk objects, oldest first, from the lists of @nid,
+ * or of the nodes in @nodes, that belong to @memcg.  With a NULL @memcg
+ * the lists of all cgroups are walked, each in proportion to its size.
+ * Returns the number of objects removed.
+ */
+unsigned long list_lru_walk_node(struct list_lru *lru, int nid,
+				 struct mem_cgroup *memcg,
+				 list_lru_walk_cb isolate, void *cb_arg,
+				 unsigned long *nr_to_walk);
+unsigned long list_lru_walk_nodemask(struct list_lru *lru,
+				     const nodemask_t *nodes,
+				     struct mem_cgroup *memcg,
+				     list_lru_walk_cb isolate, void *cb_arg,
+				     unsigned long nr_to_walk);
+
+static inline unsigned long list_lru_walk(struct list_lru *lru,
+					  list_lru_walk_cb isolate,
+					  void *cb_arg,
+					  unsigned long nr_to_walk)
+{
+	return list_lru_walk_nodemask(lru, &node_possible_map, NULL,
+				      isolate, cb_arg, nr_to_walk);
+}
+
+#endif /* _LINUX_LIST_LRU_H */
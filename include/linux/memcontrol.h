@@ -87,6 +87,11 @@ extern struct mem_cgroup *try_get_mem_cgroup_from_mm(struct mm_struct *mm);
 extern struct mem_cgroup *parent_mem_cgroup(struct mem_cgroup *memcg);
 extern struct mem_cgroup *mem_cgroup_from_cont(struct cgroup *cont);
 
+extern unsigned short mem_cgroup_id(struct mem_cgroup *memcg);
+extern unsigned short mem_cgroup_current_id(void);
+extern struct mem_cgroup *mem_cgroup_get_by_id(unsigned short id);
+extern void mem_cgroup_put(struct mem_cgroup *memcg);
+
 static inline
 int mm_match_cgroup(const struct mm_struct *mm, const struct mem_cgroup *cgroup)
 {
@@ -174,6 +179,16 @@ void mem_cgroup_print_bad_page(struct page *page);
 #else /* CONFIG_CGROUP_MEM_RES_CTLR */
 struct mem_cgroup;
 
+static inline unsigned short mem_cgroup_id(struct mem_cgroup *memcg)
+{
+	return 0;
+}
+
+static inline unsigned short mem_cgroup_current_id(void)
+{
+	return 0;
+}
+
 static inline int mem_cgroup_newpage_charge(struct page *page,
 					struct mm_struct *mm, gfp_t gfp_mask)
 {
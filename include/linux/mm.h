@@ -194,6 +194,10 @@ struct vm_fault {
 					 * is set (which is also implied by
 					 * VM_FAULT_ERROR).
 					 */
+	/* for ->map_pages() only */
+	pgoff_t max_pgoff;		/* map pages for offset from pgoff till
+					 * max_pgoff inclusive */
+	pte_t *pte;			/* pte entry associated with ->pgoff */
 };
 
 /*
@@ -206,6 +210,14 @@ struct vm_operations_struct {
 	void (*close)(struct vm_area_struct * area);
 	int (*fault)(struct vm_area_struct *vma, struct vm_fault *vmf);
 
+	/*
+	 * map_pages() is called on a read fault, with the page table lock
+	 * held, to map the pages around the faulting address which can be
+	 * mapped without blocking.  It must not sleep, and may leave any
+	 * page unmapped, the faulting one included.
+	 */
+	void (*map_pages)(struct vm_area_struct *vma, struct vm_fault *vmf);
+
 	/* notification that a previously read-only page is about to become
 	 * writable, if an error is returned it will cause a SIGBUS */
 	int (*page_mkwrite)(struct vm_area_struct *vma, struct vm_fault *vmf);
@@ -587,9 +599,9 @@ static inline pte_t maybe_mkwrite(pte_t pte, struct vm_area_struct *vma)
  * we have run out of space and have to fall back to an
  * alternate (slower) way of determining the node.
  *
- * No sparsemem or sparsemem vmemmap: |       NODE     | ZONE | ... | FLAGS |
- * classic sparse with space for node:| SECTION | NODE | ZONE | ... | FLAGS |
- * classic sparse no space for node:  | SECTION |     ZONE    | ... | FLAGS |
+ * No sparsemem or sparsemem vmemmap: |       NODE     | ZONE | [LRU_GEN] | ... | FLAGS |
+ * classic sparse with space for node:| SECTION | NODE | ZONE | [LRU_GEN] | ... | FLAGS |
+ * classic sparse no space for node:  | SECTION |     ZONE    | [LRU_GEN] | ... | FLAGS |
  */
 #if defined(CONFIG_SPARSEMEM) && !defined(CONFIG_SPARSEMEM_VMEMMAP)
 #define SECTIONS_WIDTH		SECTIONS_SHIFT
@@ -599,7 +611,18 @@ static inline pte_t maybe_mkwrite(pte_t pte, struct vm_area_struct *vma)
 
 #define ZONES_WIDTH		ZONES_SHIFT
 
-#if SECTIONS_WIDTH+ZONES_WIDTH+NODES_SHIFT <= BITS_PER_LONG - NR_PAGEFLAGS
+/*
+ * With the multi-generational LRU, the generation of a page on an LRU
+ * list is kept below the zone field, as gen + 1 so that 0 means "not
+ * on a generation list".  Three bits cover MAX_NR_GENS.
+ */
+#ifdef CONFIG_LRU_GEN
+#define LRU_GEN_WIDTH		3
+#else
+#define LRU_GEN_WIDTH		0
+#endif
+
+#if SECTIONS_WIDTH+ZONES_WIDTH+LRU_GEN_WIDTH+NODES_SHIFT <= BITS_PER_LONG - NR_PAGEFLAGS
 #define NODES_WIDTH		NODES_SHIFT
 #else
 #ifdef CONFIG_SPARSEMEM_VMEMMAP
@@ -608,10 +631,11 @@ static inline pte_t maybe_mkwrite(pte_t pte, struct vm_area_struct *vma)
 #define NODES_WIDTH		0
 #endif
 
-/* Page flags: | [SECTION] | [NODE] | ZONE | ... | FLAGS | */
+/* Page flags: | [SECTION] | [NODE] | ZONE | [LRU_GEN] | ... | FLAGS | */
 #define SECTIONS_PGOFF		((sizeof(unsigned long)*8) - SECTIONS_WIDTH)
 #define NODES_PGOFF		(SECTIONS_PGOFF - NODES_WIDTH)
 #define ZONES_PGOFF		(NODES_PGOFF - ZONES_WIDTH)
+#define LRU_GEN_PGOFF		(ZONES_PGOFF - LRU_GEN_WIDTH)
 
 /*
  * We are going to use the flags for the page to node mapping if its in
@@ -643,14 +667,15 @@ static inline pte_t maybe_mkwrite(pte_t pte, struct vm_area_struct *vma)
 
 #define ZONEID_PGSHIFT		(ZONEID_PGOFF * (ZONEID_SHIFT != 0))
 
-#if SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
-#error SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
+#if SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH+LRU_GEN_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
+#error SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH+LRU_GEN_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
 #endif
 
 #define ZONES_MASK		((1UL << ZONES_WIDTH) - 1)
 #define NODES_MASK		((1UL << NODES_WIDTH) - 1)
 #define SECTIONS_MASK		((1UL << SECTIONS_WIDTH) - 1)
 #define ZONEID_MASK		((1UL << ZONEID_SHIFT) - 1)
+#define LRU_GEN_MASK		(((1UL << LRU_GEN_WIDTH) - 1) << LRU_GEN_PGOFF)
 
 static inline enum zone_type page_zonenum(const struct page *page)
 {
@@ -962,8 +987,19 @@ int invalidate_inode_page(struct page *page);
 #ifdef CONFIG_MMU
 extern int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 			unsigned long address, unsigned int flags);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags);
+#endif
 extern int fixup_user_fault(struct task_struct *tsk, struct mm_struct *mm,
 			    unsigned long address, unsigned int fault_flags);
+extern void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+			struct page *page, pte_t *pte, bool write, bool anon);
+
+extern unsigned long sysctl_fault_around_bytes;
+extern int fault_around_bytes_sysctl_handler(struct ctl_table *table,
+			int write, void __user *buffer, size_t *length,
+			loff_t *ppos);
 #else
 static inline int handle_mm_fault(struct mm_struct *mm,
 			struct vm_area_struct *vma, unsigned long address,
@@ -1360,7 +1396,7 @@ extern int vma_adjust(struct vm_area_struct *vma, unsigned long start,
 extern struct vm_area_struct *vma_merge(struct mm_struct *,
 	struct vm_area_struct *prev, unsigned long addr, unsigned long end,
 	unsigned long vm_flags, struct anon_vma *, struct file *, pgoff_t,
-	struct mempolicy *);
+	struct mempolicy *, struct vm_userfaultfd_ctx);
 extern struct anon_vma *find_mergeable_anon_vma(struct vm_area_struct *);
 extern int split_vma(struct mm_struct *,
 	struct vm_area_struct *, unsigned long addr, int new_below);
@@ -1416,9 +1452,13 @@ extern unsigned long do_brk(unsigned long, unsigned long);
 extern void truncate_inode_pages(struct address_space *, loff_t);
 extern void truncate_inode_pages_range(struct address_space *,
 				       loff_t lstart, loff_t lend);
+extern void clear_shadow_entries(struct address_space *mapping,
+				 pgoff_t start, pgoff_t end);
 
 /* generic vm_area_ops exported for stackable file systems */
 extern int filemap_fault(struct vm_area_struct *, struct vm_fault *);
+extern void filemap_map_pages(struct vm_area_struct *vma,
+		struct vm_fault *vmf);
 
 /* mm/page-writeback.c */
 int write_one_page(struct page *page, int wait);
@@ -1494,6 +1534,46 @@ static inline struct vm_area_struct *find_exact_vma(struct mm_struct *mm,
 	return vma;
 }
 
+/*
+ * Changes to an mm's vmas, made with mmap_sem held for write, are bracketed
+ * by these so that handle_speculative_fault() can notice it raced with them.
+ */
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static inline void mmap_seq_write_begin(struct mm_struct *mm)
+{
+	write_seqcount_begin(&mm->mmap_seq);
+}
+
+static inline void mmap_seq_write_end(struct mm_struct *mm)
+{
+	write_seqcount_end(&mm->mmap_seq);
+}
+#else
+static inline void mmap_seq_write_begin(struct mm_struct *mm)
+{
+}
+
+static inline void mmap_seq_write_end(struct mm_struct *mm)
+{
+}
+#endif
+
+/*
+ * Called when switching to @mm: the aging walk of the multi-generational
+ * LRU only visits the page tables of mm's which ran since the last walk.
+ */
+#ifdef CONFIG_LRU_GEN
+static inline void lru_gen_use_mm(struct mm_struct *mm)
+{
+	if (!mm->lru_gen_used)
+		mm->lru_gen_used = 1;
+}
+#else
+static inline void lru_gen_use_mm(struct mm_struct *mm)
+{
+}
+#endif
+
 #ifdef CONFIG_MMU
 pgprot_t vm_get_page_prot(unsigned long vm_flags);
 #else
@@ -2,6 +2,7 @@
 #define LINUX_MM_INLINE_H
 
 #include <linux/huge_mm.h>
+#include <linux/memcontrol.h>
 
 /**
  * page_is_file_cache - should the page be on a file LRU or anon LRU?
@@ -21,11 +22,164 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+/**
+ * page_lru_base_type - which LRU list type should a page be on?
+ * @page: the page to test
+ *
+ * Used for LRU list index arithmetic.
+ *
+ * Returns the base LRU type - file or anon - @page should be on.
+ */
+static inline enum lru_list page_lru_base_type(struct page *page)
+{
+	if (page_is_file_cache(page))
+		return LRU_INACTIVE_FILE;
+	return LRU_INACTIVE_ANON;
+}
+
+#ifdef CONFIG_LRU_GEN
+extern int lru_gen_requested;
+
+/*
+ * The generations live in the zone, so the multi-generational LRU is
+ * only used when the memory controller does not split up the lists.
+ */
+static inline bool lru_gen_enabled(void)
+{
+	return lru_gen_requested && mem_cgroup_disabled();
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+static inline int lru_gen_from_flags(unsigned long flags)
+{
+	return (int)((flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+/* Returns the generation of @page, or -1 if it is not on a generation list */
+static inline int page_lru_gen(struct page *page)
+{
+	return lru_gen_from_flags(page->flags);
+}
+
+/*
+ * Set the generation of @page to @gen, -1 taking it off the generation
+ * lists, and return the previous one.  The field shares page->flags with
+ * the atomic page flag operations, hence the cmpxchg.
+ */
+static inline int page_set_lru_gen(struct page *page, int gen)
+{
+	unsigned long old_flags, new_flags;
+
+	do {
+		old_flags = ACCESS_ONCE(page->flags);
+		new_flags = (old_flags & ~LRU_GEN_MASK) |
+			    ((gen + 1UL) << LRU_GEN_PGOFF);
+	} while (cmpxchg(&page->flags, old_flags, new_flags) != old_flags);
+
+	return lru_gen_from_flags(old_flags);
+}
+
+/*
+ * Pages added as active start out in the youngest generation and all
+ * others in the oldest one.  PG_active is not used by the generations,
+ * so every page is accounted as inactive in the zone counters.
+ */
+static inline void
+lru_gen_add_page(struct zone *zone, struct page *page, enum lru_list lru)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int type = is_file_lru(lru);
+	int nr_pages = hpage_nr_pages(page);
+	unsigned long seq;
+	int gen;
+
+	VM_BUG_ON(page_lru_gen(page) != -1);
+
+	if (is_active_lru(lru)) {
+		ClearPageActive(page);
+		lru -= LRU_ACTIVE;
+		seq = lrugen->max_seq;
+	} else
+		seq = lrugen->min_seq[type];
+
+	gen = lru_gen_from_seq(seq);
+	page_set_lru_gen(page, gen);
+	atomic_long_add(nr_pages, &lrugen->nr_pages[gen][type]);
+	list_add(&page->lru, &lrugen->lists[gen][type]);
+	__mod_zone_page_state(zone, NR_LRU_BASE + lru, nr_pages);
+}
+
+/*
+ * Take @page out of its generation, leaving the list and the zone
+ * counters to the caller.  Returns false if @page was not on a
+ * generation list.
+ */
+static inline bool lru_gen_del_page(struct zone *zone, struct page *page)
+{
+	int gen;
+
+	if (!(page->flags & LRU_GEN_MASK))
+		return false;
+
+	gen = page_set_lru_gen(page, -1);
+	atomic_long_sub(hpage_nr_pages(page),
+			&zone->lrugen.nr_pages[gen][page_is_file_cache(page)]);
+	return true;
+}
+
+extern bool lru_gen_promote_page(struct page *page);
+extern bool lru_gen_rotate_page(struct zone *zone, struct page *page);
+#else
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline int page_lru_gen(struct page *page)
+{
+	return -1;
+}
+
+static inline int page_set_lru_gen(struct page *page, int gen)
+{
+	return -1;
+}
+
+static inline void
+lru_gen_add_page(struct zone *zone, struct page *page, enum lru_list lru)
+{
+}
+
+static inline bool lru_gen_del_page(struct zone *zone, struct page *page)
+{
+	return false;
+}
+
+static inline bool lru_gen_promote_page(struct page *page)
+{
+	return false;
+}
+
+static inline bool lru_gen_rotate_page(struct zone *zone, struct page *page)
+{
+	return false;
+}
+#endif /* CONFIG_LRU_GEN */
+
 static inline void
 add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list lru)
 {
 	struct lruvec *lruvec;
 
+	if (lru_gen_enabled() && !is_unevictable_lru(lru)) {
+		lru_gen_add_page(zone, page, lru);
+		return;
+	}
+
 	lruvec = mem_cgroup_lru_add_list(zone, page, lru);
 	list_add(&page->lru, &lruvec->lists[lru]);
 	__mod_zone_page_state(zone, NR_LRU_BASE + lru, hpage_nr_pages(page));
@@ -34,26 +188,19 @@ add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list lru)
 static inline void
 del_page_from_lru_list(struct zone *zone, struct page *page, enum lru_list lru)
 {
+	/* Generation pages are always accounted as inactive, see above */
+	if (lru_gen_del_page(zone, page)) {
+		list_del(&page->lru);
+		__mod_zone_page_state(zone, NR_LRU_BASE + page_lru_base_type(page),
+				      -hpage_nr_pages(page));
+		return;
+	}
+
 	mem_cgroup_lru_del_list(page, lru);
 	list_del(&page->lru);
 	__mod_zone_page_state(zone, NR_LRU_BASE + lru, -hpage_nr_pages(page));
 }
 
-/**
- * page_lru_base_type - which LRU list type should a page be on?
- * @page: the page to test
- *
- * Used for LRU list index arithmetic.
- *
- * Returns the base LRU type - file or anon - @page should be on.
- */
-static inline enum lru_list page_lru_base_type(struct page *page)
-{
-	if (page_is_file_cache(page))
-		return LRU_INACTIVE_FILE;
-	return LRU_INACTIVE_ANON;
-}
-
 /**
  * page_off_lru - which LRU list was page on? clearing its lru flags.
  * @page: the page to test
@@ -11,6 +11,8 @@
 #include <linux/rwsem.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
+#include <linux/seqlock.h>
+#include <linux/workqueue.h>
 #include <linux/page-debug-flags.h>
 #include <asm/page.h>
 #include <asm/mmu.h>
@@ -191,6 +193,20 @@ struct vm_region {
 						* this region */
 };
 
+/*
+ * The userfaultfd a vma is registered with, if any; an empty struct
+ * without CONFIG_USERFAULTFD, so that vma_merge() callers need not care.
+ */
+#ifdef CONFIG_USERFAULTFD
+#define NULL_VM_UFFD_CTX ((struct vm_userfaultfd_ctx) { NULL, })
+struct vm_userfaultfd_ctx {
+	struct userfaultfd_ctx *ctx;
+};
+#else
+#define NULL_VM_UFFD_CTX ((struct vm_userfaultfd_ctx) {})
+struct vm_userfaultfd_ctx {};
+#endif
+
 /*
  * This struct defines a memory VMM memory area. There is one of these
  * per VM-area/task.  A VM area is any part of the process virtual memory
@@ -252,6 +268,7 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+	struct vm_userfaultfd_ctx vm_userfaultfd_ctx;
 };
 
 struct core_thread {
@@ -306,6 +323,9 @@ struct mm_struct {
 
 	spinlock_t page_table_lock;		/* Protects page tables and some counters */
 	struct rw_semaphore mmap_sem;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	seqcount_t mmap_seq;			/* Bumped by vma changes under mmap_sem */
+#endif
 
 	struct list_head mmlist;		/* List of maybe swapped mm's.	These are globally strung
 						 * together off init_mm.mmlist, and are protected
@@ -384,6 +404,19 @@ struct mm_struct {
 #endif
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	pgtable_t pmd_huge_pte; /* protected by page_table_lock */
+#endif
+	struct work_struct async_put_work;	/* see mmput_async() */
+#ifdef CONFIG_LRU_GEN
+	struct list_head lru_gen_list;	/* walked by LRU aging, see mm/vmscan.c */
+	int lru_gen_used;		/* ran since the last aging walk */
+#endif
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	/*
+	 * Reclaim cleared ptes of this mm and has yet to flush the TLBs:
+	 * a page table change under the page table lock must flush them
+	 * first, see flush_tlb_batched_pending().
+	 */
+	bool tlb_flush_batched;
 #endif
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
@@ -115,6 +115,9 @@ enum zone_stat_item {
 	NUMA_LOCAL,		/* allocation from local node */
 	NUMA_OTHER,		/* allocation from other node */
 #endif
+	WORKINGSET_REFAULT,	/* evicted file page faulted back in */
+	WORKINGSET_ACTIVATE,	/* ... and activated straight away */
+	WORKINGSET_NODERECLAIM,	/* radix tree node of shadows reclaimed */
 	NR_ANON_TRANSPARENT_HUGEPAGES,
 	NR_VM_ZONE_STAT_ITEMS };
 
@@ -163,6 +166,36 @@ struct lruvec {
 	struct list_head lists[NR_LRU_LISTS];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * With the multi-generational LRU, the evictable pages of a zone are
+ * sorted into generations instead of the active and inactive lists.
+ * Generations are identified by sequence numbers: max_seq is the
+ * youngest, shared by anon and file pages, and min_seq[] the oldest of
+ * each type.  A generation is mapped onto one of MAX_NR_GENS lists by
+ * its sequence number modulo MAX_NR_GENS.
+ *
+ * The generation a page belongs to is kept in page->flags (see
+ * LRU_GEN_PGOFF), so that aging can promote a page without taking the
+ * lru_lock.  The list a page sits on is therefore allowed to lag behind
+ * its generation; eviction sorts such pages as it finds them on the
+ * oldest list.
+ */
+#define MAX_NR_GENS		4
+/* The two youngest generations are never evicted from */
+#define MIN_NR_GENS		2
+
+struct lru_gen_struct {
+	unsigned long		max_seq;
+	unsigned long		min_seq[2];
+	/* creation time of each generation, in jiffies */
+	unsigned long		timestamps[MAX_NR_GENS];
+	struct list_head	lists[MAX_NR_GENS][2];
+	/* pages per generation, indexed like lists[] */
+	atomic_long_t		nr_pages[MAX_NR_GENS][2];
+};
+#endif
+
 /* Mask used at gathering information at once (see memcontrol.c) */
 #define LRU_ALL_FILE (BIT(LRU_INACTIVE_FILE) | BIT(LRU_ACTIVE_FILE))
 #define LRU_ALL_ANON (BIT(LRU_INACTIVE_ANON) | BIT(LRU_ACTIVE_ANON))
@@ -194,15 +227,28 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * The pcp-lists hold pages of orders up to PAGE_ALLOC_COSTLY_ORDER, with a
+ * list per order and migrate type.
+ */
+#define NR_PCP_ORDERS		(PAGE_ALLOC_COSTLY_ORDER + 1)
+#define NR_PCP_LISTS		(MIGRATE_PCPTYPES * NR_PCP_ORDERS)
+
 struct per_cpu_pages {
-	int count;		/* number of pages in the list */
+	int count;		/* number of base pages in the lists */
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
-	struct list_head lists[MIGRATE_PCPTYPES];
+	/* Lists of pages, one per order and migrate type, see pcp_list() */
+	struct list_head lists[NR_PCP_LISTS];
 };
 
+static inline struct list_head *pcp_list(struct per_cpu_pages *pcp,
+					 int migratetype, unsigned int order)
+{
+	return &pcp->lists[order * MIGRATE_PCPTYPES + migratetype];
+}
+
 struct per_cpu_pageset {
 	struct per_cpu_pages pcp;
 #ifdef CONFIG_NUMA
@@ -374,6 +420,9 @@ struct zone {
 	struct lruvec		lruvec;
 
 	struct zone_reclaim_stat reclaim_stat;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct	lrugen;
+#endif
 
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	unsigned long		flags;		   /* zone flags, see below */
@@ -387,6 +436,8 @@ struct zone {
 	 */
 	unsigned int inactive_ratio;
 
+	/* Evictions and activations, the clock of refault distances */
+	atomic_long_t		inactive_age;
 
 	ZONE_PADDING(_pad2_)
 	/* Rarely used or read-mostly fields */
@@ -665,6 +716,12 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+	int kcompactd_max_order;
+	enum zone_type kcompactd_classzone_idx;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
@@ -106,6 +106,9 @@ enum pageflags {
 #endif
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	PG_compound_lock,
+#endif
+#ifdef CONFIG_64BIT
+	PG_ra_unused,		/* Read ahead, not accessed since */
 #endif
 	__NR_PAGEFLAGS,
 
@@ -230,6 +233,17 @@ PAGEFLAG(MappedToDisk, mappedtodisk)
 PAGEFLAG(Reclaim, reclaim) TESTCLEARFLAG(Reclaim, reclaim)
 PAGEFLAG(Readahead, reclaim)		/* Reminder to do async read-ahead */
 
+/*
+ * PG_ra_unused counts the readahead pages reclaimed unused, for the bdi
+ * stats: a page flag to spare only on 64-bit.
+ */
+#ifdef CONFIG_64BIT
+PAGEFLAG(RaUnused, ra_unused)
+#else
+PAGEFLAG_FALSE(RaUnused) SETPAGEFLAG_NOOP(RaUnused)
+	CLEARPAGEFLAG_NOOP(RaUnused)
+#endif
+
 #ifdef CONFIG_HIGHMEM
 /*
  * Must use a macro here due to header dependency issues. page_zone() is not
@@ -189,6 +189,10 @@ extern void rcu_idle_enter(void);
 extern void rcu_idle_exit(void);
 extern void rcu_irq_enter(void);
 extern void rcu_irq_exit(void);
+#ifdef CONFIG_CONTEXT_TRACKING
+extern void rcu_user_enter(void);
+extern void rcu_user_exit(void);
+#endif
 
 /*
  * Infrastructure to implement the synchronize_() primitives in
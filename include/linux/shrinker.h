@@ -1,6 +1,10 @@
 #ifndef _LINUX_SHRINKER_H
 #define _LINUX_SHRINKER_H
 
+#include <linux/nodemask.h>
+
+struct mem_cgroup;
+
 /*
  * This struct is used to pass information from page reclaim to the shrinkers.
  * We consolidate the values for easier extention later.
@@ -10,6 +14,16 @@ struct shrink_control {
 
 	/* How many slab objects shrinker() should scan and try to reclaim */
 	unsigned long nr_to_scan;
+
+	/* Nodes under reclaim, for SHRINKER_NUMA_AWARE shrinkers */
+	nodemask_t nodes_to_scan;
+
+	/*
+	 * The memory cgroup under limit reclaim, for SHRINKER_MEMCG_AWARE
+	 * shrinkers, which should then only scan objects charged to it.
+	 * NULL for global reclaim.
+	 */
+	struct mem_cgroup *memcg;
 };
 
 /*
@@ -32,12 +46,18 @@ struct shrinker {
 	int (*shrink)(struct shrinker *, struct shrink_control *sc);
 	int seeks;	/* seeks to recreate an obj */
 	long batch;	/* reclaim batch size, 0 = default */
+	int flags;
 
 	/* These are for internal use */
 	struct list_head list;
 	atomic_long_t nr_in_batch; /* objs pending delete */
 };
 #define DEFAULT_SEEKS 2 /* A good number if you don't know better. */
+
+/* Flags */
+#define SHRINKER_NUMA_AWARE	(1 << 0)	/* honours nodes_to_scan */
+#define SHRINKER_MEMCG_AWARE	(1 << 1)	/* honours memcg */
+
 extern void register_shrinker(struct shrinker *);
 extern void unregister_shrinker(struct shrinker *);
 #endif
@@ -106,6 +106,16 @@ int kmem_cache_shrink(struct kmem_cache *);
 void kmem_cache_free(struct kmem_cache *, void *);
 unsigned int kmem_cache_size(struct kmem_cache *);
 
+/*
+ * Bulk allocation and freeing of objects, for callers that deal with
+ * bursts of them.  kmem_cache_alloc_bulk() allocates either all @size
+ * objects and returns @size, or none and returns 0.  It must not be
+ * called with interrupts disabled.  kmem_cache_free_bulk() skips NULL
+ * entries, and may clear the entries of the array.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *, gfp_t, size_t, void **);
+void kmem_cache_free_bulk(struct kmem_cache *, size_t, void **);
+
 /*
  * Please use this macro to create slab caches. Simply specify the
  * name of the structure and maybe some flags that are listed above.
@@ -0,0 +1,70 @@
+/*
+ * include/linux/userfaultfd_k.h
+ *
+ * The kernel side of userfaultfd: the hooks in the fault handlers and in
+ * the vma code, and the page installers behind UFFDIO_COPY and
+ * UFFDIO_ZEROPAGE.
+ */
+
+#ifndef _LINUX_USERFAULTFD_K_H
+#define _LINUX_USERFAULTFD_K_H
+
+#include <linux/userfaultfd.h>
+#include <linux/fcntl.h>
+#include <linux/mm.h>
+
+/*
+ * CAREFUL: Check include/asm-generic/fcntl.h when defining new flags,
+ * as for eventfd.
+ */
+#define UFFD_CLOEXEC O_CLOEXEC
+#define UFFD_NONBLOCK O_NONBLOCK
+
+#define UFFD_SHARED_FCNTL_FLAGS (O_CLOEXEC | O_NONBLOCK)
+#define UFFD_FLAGS_SET (UFFD_SHARED_FCNTL_FLAGS)
+
+#ifdef CONFIG_USERFAULTFD
+
+extern int handle_userfault(struct vm_area_struct *vma, unsigned long address,
+			    unsigned int flags);
+
+extern ssize_t mcopy_atomic(struct mm_struct *dst_mm, unsigned long dst_start,
+			    unsigned long src_start, unsigned long len);
+extern ssize_t mfill_zeropage(struct mm_struct *dst_mm, unsigned long start,
+			      unsigned long len);
+
+/* Only vmas registered with the same userfaultfd, or none, may merge */
+static inline bool is_mergeable_vm_userfaultfd_ctx(struct vm_area_struct *vma,
+					struct vm_userfaultfd_ctx vm_ctx)
+{
+	return vma->vm_userfaultfd_ctx.ctx == vm_ctx.ctx;
+}
+
+/* Are missing pages of the vma to be supplied by userspace? */
+static inline bool userfaultfd_missing(struct vm_area_struct *vma)
+{
+	return vma->vm_userfaultfd_ctx.ctx != NULL;
+}
+
+#else /* CONFIG_USERFAULTFD */
+
+static inline int handle_userfault(struct vm_area_struct *vma,
+				   unsigned long address, unsigned int flags)
+{
+	return VM_FAULT_SIGBUS;
+}
+
+static inline bool is_mergeable_vm_userfaultfd_ctx(struct vm_area_struct *vma,
+					struct vm_userfaultfd_ctx vm_ctx)
+{
+	return true;
+}
+
+static inline bool userfaultfd_missing(struct vm_area_struct *vma)
+{
+	return false;
+}
+
+#endif /* CONFIG_USERFAULTFD */
+
+#endif /* _LINUX_USERFAULTFD_K_H */
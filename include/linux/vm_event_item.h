@@ -23,8 +23,16 @@
 
 enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		FOR_ALL_ZONES(PGALLOC),
-		PGFREE, PGACTIVATE, PGDEACTIVATE,
+		PGFREE, PGACTIVATE, PGDEACTIVATE, PGLAZYFREE,
+		PCP_HIGH_ORDER_ALLOC, PCP_HIGH_ORDER_FREE, PCP_HIGH_ORDER_REFILL,
+		PGALLOC_BULK, PGALLOC_BULK_REFILL,
 		PGFAULT, PGMAJFAULT,
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+		SPF_SUCCESS, SPF_FALLBACK,
+#endif
+#ifdef CONFIG_MMU
+		FAULT_AROUND, FAULT_AROUND_PAGES,
+#endif
 		FOR_ALL_ZONES(PGREFILL),
 		FOR_ALL_ZONES(PGSTEAL),
 		FOR_ALL_ZONES(PGSCAN_KSWAPD),
@@ -35,13 +43,23 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		PGINODESTEAL, SLABS_SCANNED, KSWAPD_STEAL, KSWAPD_INODESTEAL,
 		KSWAPD_LOW_WMARK_HIT_QUICKLY, KSWAPD_HIGH_WMARK_HIT_QUICKLY,
 		KSWAPD_SKIP_CONGESTION_WAIT,
-		PAGEOUTRUN, ALLOCSTALL, PGROTATED,
+		PAGEOUTRUN, ALLOCSTALL, PGROTATED, PGLAZYFREED,
+#ifdef CONFIG_LRU_GEN
+		LRU_GEN_AGING, LRU_GEN_PROMOTED,
+#endif
 #ifdef CONFIG_COMPACTION
 		COMPACTBLOCKS, COMPACTPAGES, COMPACTPAGEFAILED,
 		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
+		KCOMPACTD_WAKE, KCOMPACTD_PROACTIVE, KCOMPACTD_MIGRATED,
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
+#endif
+#ifdef CONFIG_MMU
+		VMAP_TLB_FLUSH, VMAP_LAZY_PURGED,
+#endif
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+		TLB_BATCH_IPI_SENT, TLB_BATCH_IPI_SAVED,
 #endif
 		UNEVICTABLE_PGCULLED,	/* culled to noreclaim list */
 		UNEVICTABLE_PGSCANNED,	/* scanned for reclaimability */
@@ -0,0 +1,111 @@
+/*
+ * Context tracking: probe on high level context boundaries such as
+ * kernel and userspace, so that subsystems such as RCU can tell when
+ * a CPU runs in user mode without needing the tick for it.
+ *
+ * The probes are only set on the CPUs context_tracking_cpu_set() was
+ * called for, the full dynticks ones.  Tasks running on those CPUs
+ * are given TIF_NOHZ, which makes them take the slow syscall path of
+ * the arch, where user_exit() and user_enter() are called.
+ */
+#include <linux/context_tracking.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
+#include <linux/hardirq.h>
+
+DEFINE_PER_CPU(struct context_tracking, context_tracking);
+
+void context_tracking_cpu_set(int cpu)
+{
+	per_cpu(context_tracking.active, cpu) = true;
+}
+
+/**
+ * user_enter - inform the context tracking that the CPU is going to
+ *              enter user mode.
+ *
+ * This function must be called right before switching from kernel to
+ * user mode, when it's guaranteed the remaining kernel instructions to
+ * execute won't use any RCU read side critical section, because this
+ * function sets RCU in extended quiescent state.
+ */
+void user_enter(void)
+{
+	unsigned long flags;
+
+	/*
+	 * Some contexts may involve an exception occurring in an irq,
+	 * leading to that nesting:
+	 * rcu_irq_enter() rcu_user_exit() rcu_user_exit() rcu_irq_exit()
+	 * This would mess up the dyntick_nesting count though. And rcu_irq_*()
+	 * helpers are enough to protect RCU uses inside the exception. So
+	 * just return immediately if we detect we are in an IRQ.
+	 */
+	if (in_interrupt())
+		return;
+
+	WARN_ON_ONCE(!current->mm);
+
+	local_irq_save(flags);
+	if (__this_cpu_read(context_tracking.active) &&
+	    __this_cpu_read(context_tracking.state) != IN_USER) {
+		/*
+		 * At this stage, only low level arch entry code remains and
+		 * then we'll run in userspace. We can assume there won't be
+		 * any RCU read-side critical section until the next call to
+		 * user_exit() or rcu_irq_enter().
+		 */
+		rcu_user_enter();
+		__this_cpu_write(context_tracking.state, IN_USER);
+	}
+	local_irq_restore(flags);
+}
+
+/**
+ * user_exit - inform the context tracking that the CPU is
+ *             exiting user mode and entering the kernel.
+ *
+ * This function must be called after we entered the kernel from user
+ * mode, before any use of RCU read side critical section.  Calling it
+ * when the CPU is already in the kernel is harmless.
+ */
+void user_exit(void)
+{
+	unsigned long flags;
+
+	if (in_interrupt())
+		return;
+
+	local_irq_save(flags);
+	if (__this_cpu_read(context_tracking.state) == IN_USER) {
+		/*
+		 * We are going to run code that may use RCU. Inform
+		 * RCU core about that (ie: we may need the tick again).
+		 */
+		rcu_user_exit();
+		__this_cpu_write(context_tracking.state, IN_KERNEL);
+	}
+	local_irq_restore(flags);
+}
+
+/**
+ * context_tracking_task_switch - context switch the syscall callbacks
+ * @prev: the task that is being switched out
+ * @next: the task that is being switched in
+ *
+ * The context tracking uses the syscall slow path to implement its user-kernel
+ * boundaries probes on syscalls. This way it doesn't impact the syscall fast
+ * path on CPUs that don't do context tracking.
+ *
+ * But we need to clear the flag on the previous task because it may later
+ * migrate to some CPU that doesn't do the context tracking. As such the TIF
+ * flag may not be desired there.
+ */
+void context_tracking_task_switch(struct task_struct *prev,
+				  struct task_struct *next)
+{
+	if (__this_cpu_read(context_tracking.active)) {
+		clear_tsk_thread_flag(prev, TIF_NOHZ);
+		set_tsk_thread_flag(next, TIF_NOHZ);
+	}
+}
@@ -2485,6 +2485,14 @@ void perf_event_task_tick(void)
 	}
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/* The contexts on the rotation list are rotated and unthrottled by the tick */
+bool perf_event_can_stop_tick(void)
+{
+	return list_empty(&__get_cpu_var(rotation_list));
+}
+#endif
+
 static int event_enable_on_exec(struct perf_event *event,
 				struct perf_event_context *ctx)
 {
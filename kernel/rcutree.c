@@ -50,6 +50,7 @@
 #include <linux/wait.h>
 #include <linux/kthread.h>
 #include <linux/prefetch.h>
+#include <linux/context_tracking.h>
 
 #include "rcutree.h"
 #include <trace/events/rcu.h>
@@ -60,7 +61,7 @@
 
 static struct lock_class_key rcu_node_class[NUM_RCU_LVLS];
 
-#define RCU_STATE_INITIALIZER(structname) { \
+#define RCU_STATE_INITIALIZER(structname, sabbr) { \
 	.level = { &structname##_state.node[0] }, \
 	.levelcnt = { \
 		NUM_RCU_LVL_0,  /* root of hierarchy. */ \
@@ -77,12 +78,13 @@ static struct lock_class_key rcu_node_class[NUM_RCU_LVLS];
 	.n_force_qs = 0, \
 	.n_force_qs_ngp = 0, \
 	.name = #structname, \
+	.abbr = sabbr, \
 }
 
-struct rcu_state rcu_sched_state = RCU_STATE_INITIALIZER(rcu_sched);
+struct rcu_state rcu_sched_state = RCU_STATE_INITIALIZER(rcu_sched, 's');
 DEFINE_PER_CPU(struct rcu_data, rcu_sched_data);
 
-struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh);
+struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh, 'b');
 DEFINE_PER_CPU(struct rcu_data, rcu_bh_data);
 
 static struct rcu_state *rcu_state;
@@ -346,12 +348,15 @@ static int rcu_implicit_offline_qs(struct rcu_data *rdp)
  *
  * If the new value of the ->dynticks_nesting counter now is zero,
  * we really have entered idle, and must do the appropriate accounting.
+ * Unless @user is set, the extended quiescent state is that of the idle
+ * task and we check that it is the one running.
  * The caller must have disabled interrupts.
  */
-static void rcu_idle_enter_common(struct rcu_dynticks *rdtp, long long oldval)
+static void rcu_idle_enter_common(struct rcu_dynticks *rdtp, long long oldval,
+				  bool user)
 {
 	trace_rcu_dyntick("Start", oldval, 0);
-	if (!is_idle_task(current)) {
+	if (!user && !is_idle_task(current)) {
 		struct task_struct *idle = idle_task(smp_processor_id());
 
 		trace_rcu_dyntick("Error on entry: not idle task", oldval, 0);
@@ -390,10 +395,34 @@ void rcu_idle_enter(void)
 	rdtp = &__get_cpu_var(rcu_dynticks);
 	oldval = rdtp->dynticks_nesting;
 	rdtp->dynticks_nesting = 0;
-	rcu_idle_enter_common(rdtp, oldval);
+	rcu_idle_enter_common(rdtp, oldval, false);
 	local_irq_restore(flags);
 }
 
+#ifdef CONFIG_CONTEXT_TRACKING
+/**
+ * rcu_user_enter - inform RCU that we are resuming userspace
+ *
+ * Enter RCU idle mode right before resuming userspace on a CPU that
+ * does context tracking.  No use of RCU is permitted between this call
+ * and rcu_user_exit().  This way the CPU doesn't need the tick for RCU
+ * maintenance purposes while it runs in userspace.
+ */
+void rcu_user_enter(void)
+{
+	unsigned long flags;
+	long long oldval;
+	struct rcu_dynticks *rdtp;
+
+	local_irq_save(flags);
+	rdtp = &__get_cpu_var(rcu_dynticks);
+	oldval = rdtp->dynticks_nesting;
+	rdtp->dynticks_nesting = 0;
+	rcu_idle_enter_common(rdtp, oldval, true);
+	local_irq_restore(flags);
+}
+#endif /* #ifdef CONFIG_CONTEXT_TRACKING */
+
 /**
  * rcu_irq_exit - inform RCU that current CPU is exiting irq towards idle
  *
@@ -424,7 +453,7 @@ void rcu_irq_exit(void)
 	if (rdtp->dynticks_nesting)
 		trace_rcu_dyntick("--=", oldval, rdtp->dynticks_nesting);
 	else
-		rcu_idle_enter_common(rdtp, oldval);
+		rcu_idle_enter_common(rdtp, oldval, context_tracking_in_user());
 	local_irq_restore(flags);
 }
 
@@ -433,9 +462,12 @@ void rcu_irq_exit(void)
  *
  * If the new value of the ->dynticks_nesting counter was previously zero,
  * we really have exited idle, and must do the appropriate accounting.
+ * Unless @user is set, the extended quiescent state was that of the
+ * idle task and we check that it is the one running.
  * The caller must have disabled interrupts.
  */
-static void rcu_idle_exit_common(struct rcu_dynticks *rdtp, long long oldval)
+static void rcu_idle_exit_common(struct rcu_dynticks *rdtp, long long oldval,
+				 bool user)
 {
 	smp_mb__before_atomic_inc();  /* Force ordering w/previous sojourn. */
 	atomic_inc(&rdtp->dynticks);
@@ -444,7 +476,7 @@ static void rcu_idle_exit_common(struct rcu_dynticks *rdtp, long long oldval)
 	WARN_ON_ONCE(!(atomic_read(&rdtp->dynticks) & 0x1));
 	rcu_cleanup_after_idle(smp_processor_id());
 	trace_rcu_dyntick("End", oldval, rdtp->dynticks_nesting);
-	if (!is_idle_task(current)) {
+	if (!user && !is_idle_task(current)) {
 		struct task_struct *idle = idle_task(smp_processor_id());
 
 		trace_rcu_dyntick("Error on exit: not idle task",
@@ -478,10 +510,33 @@ void rcu_idle_exit(void)
 	oldval = rdtp->dynticks_nesting;
 	WARN_ON_ONCE(oldval != 0);
 	rdtp->dynticks_nesting = DYNTICK_TASK_NESTING;
-	rcu_idle_exit_common(rdtp, oldval);
+	rcu_idle_exit_common(rdtp, oldval, false);
 	local_irq_restore(flags);
 }
 
+#ifdef CONFIG_CONTEXT_TRACKING
+/**
+ * rcu_user_exit - inform RCU that we are exiting userspace
+ *
+ * Exit RCU idle mode while entering the kernel because it can
+ * run RCU read side critical sections anytime.
+ */
+void rcu_user_exit(void)
+{
+	unsigned long flags;
+	struct rcu_dynticks *rdtp;
+	long long oldval;
+
+	local_irq_save(flags);
+	rdtp = &__get_cpu_var(rcu_dynticks);
+	oldval = rdtp->dynticks_nesting;
+	WARN_ON_ONCE(oldval != 0);
+	rdtp->dynticks_nesting = DYNTICK_TASK_NESTING;
+	rcu_idle_exit_common(rdtp, oldval, true);
+	local_irq_restore(flags);
+}
+#endif /* #ifdef CONFIG_CONTEXT_TRACKING */
+
 /**
  * rcu_irq_enter - inform RCU that current CPU is entering irq away from idle
  *
@@ -515,7 +570,7 @@ void rcu_irq_enter(void)
 	if (oldval)
 		trace_rcu_dyntick("++=", oldval, rdtp->dynticks_nesting);
 	else
-		rcu_idle_exit_common(rdtp, oldval);
+		rcu_idle_exit_common(rdtp, oldval, context_tracking_in_user());
 	local_irq_restore(flags);
 }
 
@@ -1700,9 +1755,13 @@ static void invoke_rcu_core(void)
 	raise_softirq(RCU_SOFTIRQ);
 }
 
+/*
+ * Queue a callback on this CPU, or on its offloaded list if it has one
+ * and @offload is set.
+ */
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp)
+	   struct rcu_state *rsp, bool offload)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1722,6 +1781,13 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	/* Leave the callback to this CPU's kthread, if offloaded. */
+	if (offload && is_nocb_cpu(rdp->cpu) &&
+	    __call_rcu_nocb(rdp, head, flags)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	/* Add the callback to our list. */
 	*rdp->nxttail[RCU_NEXT_TAIL] = head;
 	rdp->nxttail[RCU_NEXT_TAIL] = &head->next;
@@ -1778,7 +1844,7 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
  */
 void call_rcu_sched(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state);
+	__call_rcu(head, func, &rcu_sched_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu_sched);
 
@@ -1787,7 +1853,7 @@ EXPORT_SYMBOL_GPL(call_rcu_sched);
  */
 void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_bh_state);
+	__call_rcu(head, func, &rcu_bh_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
@@ -1956,6 +2022,10 @@ static void rcu_barrier_func(void *type)
 	void (*call_rcu_func)(struct rcu_head *head,
 			      void (*func)(struct rcu_head *head));
 
+	/* rcu_nocb_barrier() takes care of the no-CBs CPUs */
+	if (is_nocb_cpu(cpu))
+		return;
+
 	atomic_inc(&rcu_barrier_cpu_count);
 	call_rcu_func = type;
 	call_rcu_func(head, rcu_barrier_callback);
@@ -1982,10 +2052,12 @@ static void _rcu_barrier(struct rcu_state *rsp,
 	 * did their increment, causing this function to return too
 	 * early.  Note that on_each_cpu() disables irqs, which prevents
 	 * any CPUs from coming online or going offline until each online
-	 * CPU has queued its RCU-barrier callback.
+	 * CPU has queued its RCU-barrier callback.  The no-CBs CPUs,
+	 * online or not, get theirs queued on their offloaded lists.
 	 */
 	atomic_set(&rcu_barrier_cpu_count, 1);
 	on_each_cpu(rcu_barrier_func, (void *)call_rcu_func, 1);
+	rcu_nocb_barrier(rsp);
 	if (atomic_dec_and_test(&rcu_barrier_cpu_count))
 		complete(&rcu_barrier_completion);
 	wait_for_completion(&rcu_barrier_completion);
@@ -2033,6 +2105,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -2270,6 +2343,7 @@ void __init rcu_init(void)
 	int cpu;
 
 	rcu_bootup_announce();
+	rcu_init_nocb();
 	rcu_init_one(&rcu_sched_state, &rcu_sched_data);
 	rcu_init_one(&rcu_bh_state, &rcu_bh_data);
 	__rcu_init_preempt();
@@ -26,6 +26,8 @@
 
 #include <linux/delay.h>
 #include <linux/stop_machine.h>
+#include <linux/bootmem.h>
+#include <linux/tick.h>
 
 #define RCU_KTHREAD_PRIO 1
 
@@ -72,7 +74,7 @@ static void __init rcu_bootup_announce_oddness(void)
 
 #ifdef CONFIG_TREE_PREEMPT_RCU
 
-struct rcu_state rcu_preempt_state = RCU_STATE_INITIALIZER(rcu_preempt);
+struct rcu_state rcu_preempt_state = RCU_STATE_INITIALIZER(rcu_preempt, 'p');
 DEFINE_PER_CPU(struct rcu_data, rcu_preempt_data);
 static struct rcu_state *rcu_state = &rcu_preempt_state;
 
@@ -671,7 +673,7 @@ static void rcu_preempt_do_callbacks(void)
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state);
+	__call_rcu(head, func, &rcu_preempt_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -2197,3 +2199,276 @@ static void rcu_prepare_for_idle(int cpu)
 }
 
 #endif /* #else #if !defined(CONFIG_RCU_FAST_NO_HZ) */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback processing from the boot-time-specified set of CPUs
+ * specified by rcu_nocb_mask.  For each CPU in the set, there is a
+ * kthread for each flavor of RCU that waits for the grace periods and
+ * invokes that CPU's callbacks, so that the CPU itself only queues them.
+ * These kthreads are not bound to any CPU: they may be left to the
+ * scheduler or bound to housekeeping CPUs from userspace.
+ *
+ * The callbacks are queued on a lockless list, ->nocb_head, whose
+ * kthread takes them all at once, waits for a grace period to elapse
+ * and invokes them in order.  The grace period is waited for through
+ * a callback that the kthread queues on the normal list of the CPU it
+ * runs on, even if that is itself a no-CBs CPU: otherwise the kthreads
+ * could end up waiting on one another.
+ */
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Add the specified callback to the specified CPU's offloaded list,
+ * returning true if the list was empty, in which case the kthread
+ * needs a wakeup.
+ */
+static bool rcu_nocb_enqueue(struct rcu_data *rdp, struct rcu_head *rhp)
+{
+	struct rcu_head **old_rhpp;
+
+	old_rhpp = xchg(&rdp->nocb_tail, &rhp->next);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	return old_rhpp == &rdp->nocb_head;
+}
+
+/*
+ * This is a helper for __call_rcu(), which invokes this when the
+ * current CPU is a no-CBs CPU, with interrupts disabled.  The kthread
+ * is woken from irq_work if the caller had interrupts disabled, as it
+ * might hold scheduler locks.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    unsigned long flags)
+{
+	if (!rcu_nocb_enqueue(rdp, rhp))
+		return true;
+
+	if (irqs_disabled_flags(flags))
+		irq_work_queue(&rdp->nocb_wake_work);
+	else
+		wake_up(&rdp->nocb_wq);
+	return true;
+}
+
+static void rcu_nocb_wake_work(struct irq_work *work)
+{
+	struct rcu_data *rdp = container_of(work, struct rcu_data,
+					    nocb_wake_work);
+
+	wake_up(&rdp->nocb_wq);
+}
+
+/*
+ * Queue an rcu_barrier() callback on each no-CBs CPU, whether online
+ * or not, as their kthreads may still have callbacks to invoke after
+ * they went offline.  rcu_barrier_func() skips these CPUs.
+ */
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+	struct rcu_head *head;
+	int cpu;
+
+	if (!have_rcu_nocb_mask)
+		return;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		struct rcu_data *rdp = per_cpu_ptr(rsp->rda, cpu);
+
+		head = &per_cpu(rcu_barrier_head, cpu);
+		debug_rcu_head_queue(head);
+		head->func = rcu_barrier_callback;
+		head->next = NULL;
+		atomic_inc(&rcu_barrier_cpu_count);
+		smp_mb(); /* Order prior callbacks against the barrier. */
+		if (rcu_nocb_enqueue(rdp, head))
+			wake_up(&rdp->nocb_wq);
+	}
+}
+
+struct rcu_nocb_gp {
+	struct rcu_head head;
+	struct completion completion;
+};
+
+static void rcu_nocb_gp_done(struct rcu_head *head)
+{
+	struct rcu_nocb_gp *gp = container_of(head, struct rcu_nocb_gp, head);
+
+	complete(&gp->completion);
+}
+
+/* Wait for a grace period of the flavor of RCU of this kthread. */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	struct rcu_nocb_gp gp;
+
+	init_rcu_head_on_stack(&gp.head);
+	init_completion(&gp.completion);
+	__call_rcu(&gp.head, rcu_nocb_gp_done, rdp->rsp, false);
+	wait_for_completion(&gp.completion);
+	destroy_rcu_head_on_stack(&gp.head);
+}
+
+/*
+ * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
+ * callbacks queued by the corresponding no-CBs CPU.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	int c;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	/* Each pass through this loop invokes one batch of callbacks */
+	for (;;) {
+		wait_event_interruptible(rdp->nocb_wq,
+					 ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list)
+			continue;
+
+		/* Extract the queued callbacks and wait for a grace period. */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		rcu_nocb_wait_gp(rdp);
+
+		/* Each pass through the following loop invokes a callback. */
+		c = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for enqueuing to complete, if needed. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = ACCESS_ONCE(list->next);
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			__rcu_reclaim(rdp->rsp->name, list);
+			local_bh_enable();
+			c++;
+			list = next;
+		}
+		rdp->n_cbs_invoked += c;
+		cond_resched();
+	}
+	return 0;
+}
+
+/* Initialize the offloaded list and wait queue of each CPU. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+	init_irq_work(&rdp->nocb_wake_work, rcu_nocb_wake_work);
+}
+
+/*
+ * Add the full dynticks CPUs to the no-CBs CPUs, and remove the boot
+ * CPU, which keeps invoking its callbacks so that grace periods can
+ * be waited for by the kthreads.
+ */
+static void __init rcu_init_nocb(void)
+{
+	char buf[256];
+	int cpu = smp_processor_id();
+
+#ifdef CONFIG_NO_HZ_FULL
+	if (tick_nohz_full_running) {
+		if (!have_rcu_nocb_mask &&
+		    zalloc_cpumask_var(&rcu_nocb_mask, GFP_NOWAIT))
+			have_rcu_nocb_mask = true;
+		if (have_rcu_nocb_mask)
+			cpumask_or(rcu_nocb_mask, rcu_nocb_mask,
+				   tick_nohz_full_mask);
+	}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
+	if (!have_rcu_nocb_mask)
+		return;
+	if (cpumask_test_cpu(cpu, rcu_nocb_mask)) {
+		printk(KERN_INFO "\tRCU callbacks of boot CPU %d not offloaded.\n",
+		       cpu);
+		cpumask_clear_cpu(cpu, rcu_nocb_mask);
+	}
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	printk(KERN_INFO "\tOffload RCU callbacks from CPUs: %s.\n", buf);
+}
+
+/* Spawn the kthreads that invoke the callbacks of the no-CBs CPUs. */
+static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct task_struct *t;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		t = kthread_run(rcu_nocb_kthread, rdp,
+				"rcuo%c/%d", rsp->abbr, cpu);
+		BUG_ON(IS_ERR(t));
+		ACCESS_ONCE(rdp->nocb_kthread) = t;
+	}
+}
+
+static int __init rcu_spawn_all_nocb_kthreads(void)
+{
+	if (!have_rcu_nocb_mask)
+		return 0;
+	rcu_spawn_nocb_kthreads(&rcu_sched_state);
+	rcu_spawn_nocb_kthreads(&rcu_bh_state);
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads(&rcu_preempt_state);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+	return 0;
+}
+early_initcall(rcu_spawn_all_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    unsigned long flags)
+{
+	return false;
+}
+
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+static void __init rcu_init_nocb(void)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
@@ -105,6 +105,20 @@ int rt_mutex_getprio(struct task_struct *task)
 		   task->normal_prio);
 }
 
+/*
+ * Return the task whose priority @task is boosted to, if any; the
+ * deadline scheduler runs a boosted task with that task's parameters.
+ *
+ * task->pi_lock must be held.
+ */
+struct task_struct *rt_mutex_get_top_task(struct task_struct *task)
+{
+	if (likely(!task_has_pi_waiters(task)))
+		return NULL;
+
+	return task_top_pi_waiter(task)->task;
+}
+
 /*
  * Adjust the priority of a task, after its pi_waiters got modified.
  *
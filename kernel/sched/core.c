@@ -66,6 +66,7 @@
 #include <linux/pagemap.h>
 #include <linux/hrtimer.h>
 #include <linux/tick.h>
+#include <linux/context_tracking.h>
 #include <linux/debugfs.h>
 #include <linux/ctype.h>
 #include <linux/ftrace.h>
@@ -300,9 +301,12 @@ static inline struct rq *__task_rq_lock(struct task_struct *p)
 	for (;;) {
 		rq = task_rq(p);
 		raw_spin_lock(&rq->lock);
-		if (likely(rq == task_rq(p)))
+		if (likely(rq == task_rq(p) && !task_on_rq_migrating(p)))
 			return rq;
 		raw_spin_unlock(&rq->lock);
+
+		while (unlikely(task_on_rq_migrating(p)))
+			cpu_relax();
 	}
 }
 
@@ -319,10 +323,13 @@ static struct rq *task_rq_lock(struct task_struct *p, unsigned long *flags)
 		raw_spin_lock_irqsave(&p->pi_lock, *flags);
 		rq = task_rq(p);
 		raw_spin_lock(&rq->lock);
-		if (likely(rq == task_rq(p)))
+		if (likely(rq == task_rq(p) && !task_on_rq_migrating(p)))
 			return rq;
 		raw_spin_unlock(&rq->lock);
 		raw_spin_unlock_irqrestore(&p->pi_lock, *flags);
+
+		while (unlikely(task_on_rq_migrating(p)))
+			cpu_relax();
 	}
 }
 
@@ -571,12 +578,12 @@ unlock:
  * idle CPU then this timer might expire before the next timer event
  * which is scheduled to wake up that CPU. In case of a completely
  * idle system the next event might even be infinite time into the
- * future. wake_up_idle_cpu() ensures that the CPU is woken up and
+ * future. wake_up_nohz_cpu() ensures that the CPU is woken up and
  * leaves the inner idle loop so the newly added timer is taken into
  * account when the CPU goes back to idle and evaluates the timer
  * wheel for the next timer event.
  */
-void wake_up_idle_cpu(int cpu)
+static void wake_up_idle_cpu(int cpu)
 {
 	struct rq *rq = cpu_rq(cpu);
 
@@ -606,6 +613,22 @@ void wake_up_idle_cpu(int cpu)
 		smp_send_reschedule(cpu);
 }
 
+static bool wake_up_full_nohz_cpu(int cpu)
+{
+	if (tick_nohz_full_cpu(cpu)) {
+		tick_nohz_full_kick_cpu(cpu);
+		return true;
+	}
+
+	return false;
+}
+
+void wake_up_nohz_cpu(int cpu)
+{
+	if (!wake_up_full_nohz_cpu(cpu))
+		wake_up_idle_cpu(cpu);
+}
+
 static inline bool got_nohz_idle_kick(void)
 {
 	int cpu = smp_processor_id();
@@ -1006,7 +1029,9 @@ static inline int normal_prio(struct task_struct *p)
 {
 	int prio;
 
-	if (task_has_rt_policy(p))
+	if (task_has_dl_policy(p))
+		prio = MAX_DL_PRIO-1;
+	else if (task_has_rt_policy(p))
 		prio = MAX_RT_PRIO-1 - p->rt_priority;
 	else
 		prio = __normal_prio(p);
@@ -1024,9 +1049,9 @@ static int effective_prio(struct task_struct *p)
 {
 	p->normal_prio = normal_prio(p);
 	/*
-	 * If we are RT tasks or we were boosted to RT priority,
-	 * keep the priority unchanged. Otherwise, update priority
-	 * to the normal priority:
+	 * If we are RT or -deadline tasks or we were boosted to RT or
+	 * -deadline priority, keep the priority unchanged. Otherwise,
+	 * update priority to the normal priority:
 	 */
 	if (!rt_prio(p->prio))
 		return p->normal_prio;
@@ -1050,7 +1075,7 @@ static inline void check_class_changed(struct rq *rq, struct task_struct *p,
 		if (prev_class->switched_from)
 			prev_class->switched_from(rq, p);
 		p->sched_class->switched_to(rq, p);
-	} else if (oldprio != p->prio)
+	} else if (oldprio != p->prio || dl_task(p))
 		p->sched_class->prio_changed(rq, p, oldprio);
 }
 
@@ -1109,6 +1134,8 @@ void set_task_cpu(struct task_struct *p, unsigned int new_cpu)
 	trace_sched_migrate_task(p, new_cpu);
 
 	if (task_cpu(p) != new_cpu) {
+		if (p->sched_class->migrate_task_rq)
+			p->sched_class->migrate_task_rq(p, new_cpu);
 		p->se.nr_migrations++;
 		perf_sw_event(PERF_COUNT_SW_CPU_MIGRATIONS, 1, NULL, 0);
 	}
@@ -1366,7 +1393,7 @@ ttwu_stat(struct task_struct *p, int cpu, int wake_flags)
 static void ttwu_activate(struct rq *rq, struct task_struct *p, int en_flags)
 {
 	activate_task(rq, p, en_flags);
-	p->on_rq = 1;
+	p->on_rq = TASK_ON_RQ_QUEUED;
 
 	/* if a worker is waking up, notify workqueue */
 	if (p->flags & PF_WQ_WORKER)
@@ -1433,6 +1460,196 @@ static int ttwu_remote(struct task_struct *p, int wake_flags)
 	return ret;
 }
 
+#ifdef CONFIG_SCHED_CORE
+/*
+ * Core scheduling: the tasks of a group with cpu.core_tag set, or of its
+ * children, only share a core with each other.  The group is the cookie
+ * of these tasks; other tasks have a cookie of 0 and may share a core
+ * with each other.
+ *
+ * Each cpu still picks the next task from its own runqueue, and then
+ * checks it against the owner of the core, the cookie of what the busy
+ * siblings run.  A task of another cookie takes the core over, kicking
+ * the siblings out of what they run, if it is rt and they are not or if
+ * the owner has had the core for a latency period.  Otherwise this cpu
+ * runs a fair task of the owner's cookie instead, or stays idle: it is "forced idle"
+ * until the owner changes or the core has nothing left to run.
+ */
+struct jump_label_key __sched_core_enabled;
+
+static inline bool sched_core_enabled(void)
+{
+	return static_branch(&__sched_core_enabled);
+}
+
+static inline unsigned long sched_core_cookie(struct task_struct *p)
+{
+	return task_group(p)->core_cookie;
+}
+
+/*
+ * Make a sibling pick again.  We hold our own rq->lock, so we cannot
+ * take the sibling's one to resched its current task: let it do it
+ * from the IPI.
+ */
+static void sched_core_kick(struct rq *rq)
+{
+	rq->core_kick = 1;
+	smp_send_reschedule(cpu_of(rq));
+}
+
+static inline void sched_core_ipi(void)
+{
+	struct rq *rq = this_rq();
+
+	if (rq->core_kick) {
+		rq->core_kick = 0;
+		set_need_resched();
+	}
+}
+
+static struct task_struct *
+sched_core_pick(struct rq *rq, struct task_struct *p)
+{
+	struct rq *core = rq->core, *srq;
+	int i, cpu = cpu_of(rq);
+	unsigned long cookie = 0, owner;
+	bool busy = false, rt = false, changed = false;
+
+	update_rq_clock(rq);
+	raw_spin_lock(&core->core_lock);
+
+	if (rq->core_forceidle) {
+		rq->core_forceidle_sum += rq->clock - rq->core_forceidle_start;
+		rq->core_forceidle = 0;
+	}
+	rq->core_busy = 0;
+	owner = core->core_owner;
+
+	for_each_cpu(i, cpu_smt_mask(cpu)) {
+		srq = cpu_rq(i);
+		if (srq == rq || !srq->core_busy)
+			continue;
+		busy = true;
+		rt |= srq->core_rt;
+	}
+
+	/* The idle and stop tasks may run next to anything */
+	if (p == rq->idle || p->sched_class == &stop_sched_class)
+		goto kick;
+
+	cookie = sched_core_cookie(p);
+	if (!busy || cookie == owner)
+		goto take;
+
+	if (rt_prio(p->prio) > rt ||
+	    (rt_prio(p->prio) == rt &&
+	     rq->clock - core->core_owner_start > sysctl_sched_latency))
+		goto take;
+
+	/* An untagged owner lets the untagged tasks here run */
+	p->sched_class->put_prev_task(rq, p);
+	p = pick_next_task_fair_cookie(rq, owner);
+	if (p) {
+		cookie = owner;
+		goto take;
+	}
+
+	p = idle_sched_class.pick_next_task(rq);
+	rq->core_forceidle = 1;
+	rq->core_forceidle_start = rq->clock;
+	goto unlock;
+
+take:
+	if (!busy || cookie != owner) {
+		changed = cookie != owner;
+		core->core_owner = cookie;
+		if (changed)
+			core->core_owner_start = rq->clock;
+	}
+	rq->core_cookie = cookie;
+	rq->core_rt = rt_prio(p->prio);
+	rq->core_busy = 1;
+
+kick:
+	/*
+	 * Kick the siblings that run another cookie than the new owner, and
+	 * those forced idle when the owner changed or the core became free.
+	 */
+	for_each_cpu(i, cpu_smt_mask(cpu)) {
+		srq = cpu_rq(i);
+		if (srq == rq)
+			continue;
+		if (srq->core_forceidle ? changed || (!busy && !rq->core_busy) :
+		    changed && srq->core_busy && srq->core_cookie != cookie)
+			sched_core_kick(srq);
+	}
+unlock:
+	raw_spin_unlock(&core->core_lock);
+
+	return p;
+}
+
+/*
+ * Charge the time the siblings of this cpu are forced idle to the task
+ * that we run, which causes it, and hand the core over to them once the
+ * owner has had it for long enough.
+ */
+static void sched_core_tick(struct rq *rq)
+{
+	struct rq *core = rq->core, *srq;
+	struct task_struct *curr = rq->curr;
+	struct task_group *tg;
+	int i, nr_busy = 0, nr_forceidle = 0;
+	u64 delta;
+
+	if (!sched_core_enabled())
+		return;
+
+	delta = rq->clock - rq->core_tick;
+	rq->core_tick = rq->clock;
+
+	raw_spin_lock(&core->core_lock);
+	if (!rq->core_busy)
+		goto unlock;
+
+	for_each_cpu(i, cpu_smt_mask(cpu_of(rq))) {
+		srq = cpu_rq(i);
+		nr_busy += srq->core_busy;
+		nr_forceidle += srq->core_forceidle;
+	}
+	if (!nr_forceidle)
+		goto unlock;
+
+	delta = div_u64(delta * nr_forceidle, nr_busy);
+	schedstat_add(&curr->se, statistics.core_forceidle_sum, delta);
+	for (tg = task_group(curr); tg; tg = tg->parent)
+		atomic64_add(delta, &tg->core_forceidle_sum);
+
+	if (rq->clock - core->core_owner_start > sysctl_sched_latency) {
+		for_each_cpu(i, cpu_smt_mask(cpu_of(rq))) {
+			srq = cpu_rq(i);
+			if (srq->core_forceidle)
+				sched_core_kick(srq);
+		}
+	}
+unlock:
+	raw_spin_unlock(&core->core_lock);
+}
+
+static void __cpuinit sched_core_cpu_online(int cpu)
+{
+	struct rq *core = cpu_rq(cpumask_first(cpu_smt_mask(cpu)));
+	int i;
+
+	for_each_cpu(i, cpu_smt_mask(cpu))
+		cpu_rq(i)->core = core;
+}
+#else
+static inline void sched_core_ipi(void) { }
+static inline void sched_core_tick(struct rq *rq) { }
+#endif /* CONFIG_SCHED_CORE */
+
 #ifdef CONFIG_SMP
 static void sched_ttwu_pending(void)
 {
@@ -1453,7 +1670,10 @@ static void sched_ttwu_pending(void)
 
 void scheduler_ipi(void)
 {
-	if (llist_empty(&this_rq()->wake_list) && !got_nohz_idle_kick())
+	sched_core_ipi();
+
+	if (llist_empty(&this_rq()->wake_list) && !got_nohz_idle_kick() &&
+	    !tick_nohz_full_cpu(smp_processor_id()))
 		return;
 
 	/*
@@ -1468,6 +1688,8 @@ void scheduler_ipi(void)
 	 * Arguably we should visit all archs and update all handlers,
 	 * however a fair share of IPIs are still resched only so this would
 	 * somewhat pessimize the simple resched case.
+	 *
+	 * A full dynticks CPU also needs irq_exit() to re-evaluate its tick.
 	 */
 	irq_enter();
 	sched_ttwu_pending();
@@ -1665,6 +1887,25 @@ int wake_up_state(struct task_struct *p, unsigned int state)
 	return try_to_wake_up(p, state, 0);
 }
 
+/*
+ * Reset the -deadline parameters of a task that is not, or no longer,
+ * SCHED_DEADLINE, so that no bandwidth is accounted to it.
+ */
+static void __dl_clear_params(struct task_struct *p)
+{
+	struct sched_dl_entity *dl_se = &p->dl;
+
+	dl_se->dl_runtime = dl_se->runtime = 0;
+	dl_se->dl_deadline = dl_se->deadline = 0;
+	dl_se->dl_period = 0;
+	dl_se->flags = 0;
+	dl_se->dl_bw = 0;
+
+	dl_se->dl_throttled = 0;
+	dl_se->dl_new = 1;
+	dl_se->dl_boosted = 0;
+}
+
 /*
  * Perform scheduler related setup for a newly forked process p.
  * p is forked by current.
@@ -1683,10 +1924,21 @@ static void __sched_fork(struct task_struct *p)
 	p->se.vruntime			= 0;
 	INIT_LIST_HEAD(&p->se.group_node);
 
+#ifdef CONFIG_SMP
+	p->se.avg.runnable_avg_period	= 0;
+	p->se.avg.runnable_avg_sum	= 0;
+	p->se.avg.decay_count		= 0;
+	p->se.avg.load_avg_contrib	= 0;
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
 
+	RB_CLEAR_NODE(&p->dl.rb_node);
+	hrtimer_init(&p->dl.dl_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	__dl_clear_params(p);
+
 	INIT_LIST_HEAD(&p->rt.run_list);
 
 #ifdef CONFIG_PREEMPT_NOTIFIERS
@@ -1697,7 +1949,7 @@ static void __sched_fork(struct task_struct *p)
 /*
  * fork()/clone()-time setup:
  */
-void sched_fork(struct task_struct *p)
+int sched_fork(struct task_struct *p)
 {
 	unsigned long flags;
 	int cpu = get_cpu();
@@ -1719,7 +1971,7 @@ void sched_fork(struct task_struct *p)
 	 * Revert to default priority/policy on fork if requested.
 	 */
 	if (unlikely(p->sched_reset_on_fork)) {
-		if (task_has_rt_policy(p)) {
+		if (task_has_dl_policy(p) || task_has_rt_policy(p)) {
 			p->policy = SCHED_NORMAL;
 			p->static_prio = NICE_TO_PRIO(0);
 			p->rt_priority = 0;
@@ -1736,7 +1988,14 @@ void sched_fork(struct task_struct *p)
 		p->sched_reset_on_fork = 0;
 	}
 
-	if (!rt_prio(p->prio))
+	/*
+	 * A -deadline task cannot fork: the bandwidth it was admitted
+	 * with cannot be shared with, nor handed out to, its child.
+	 */
+	if (dl_prio(p->prio)) {
+		put_cpu();
+		return -EAGAIN;
+	} else if (!rt_prio(p->prio))
 		p->sched_class = &fair_sched_class;
 
 	if (p->sched_class->task_fork)
@@ -1766,9 +2025,11 @@ void sched_fork(struct task_struct *p)
 #endif
 #ifdef CONFIG_SMP
 	plist_node_init(&p->pushable_tasks, MAX_PRIO);
+	RB_CLEAR_NODE(&p->pushable_dl_tasks);
 #endif
 
 	put_cpu();
+	return 0;
 }
 
 /*
@@ -1795,7 +2056,7 @@ void wake_up_new_task(struct task_struct *p)
 
 	rq = __task_rq_lock(p);
 	activate_task(rq, p, 0);
-	p->on_rq = 1;
+	p->on_rq = TASK_ON_RQ_QUEUED;
 	trace_sched_wakeup_new(p, true);
 	check_preempt_curr(rq, p, WF_FORK);
 #ifdef CONFIG_SMP
@@ -1938,6 +2199,9 @@ static void finish_task_switch(struct rq *rq, struct task_struct *prev)
 	if (mm)
 		mmdrop(mm);
 	if (unlikely(prev_state == TASK_DEAD)) {
+		if (prev->sched_class->task_dead)
+			prev->sched_class->task_dead(prev);
+
 		/*
 		 * Remove function-return probe instances associated with this
 		 * task and put them back on the free list.
@@ -2033,8 +2297,10 @@ context_switch(struct rq *rq, struct task_struct *prev,
 		next->active_mm = oldmm;
 		atomic_inc(&oldmm->mm_count);
 		enter_lazy_tlb(oldmm, next);
-	} else
+	} else {
 		switch_mm(oldmm, mm, next);
+		lru_gen_use_mm(mm);
+	}
 
 	if (!prev->mm) {
 		prev->active_mm = NULL;
@@ -2050,6 +2316,7 @@ context_switch(struct rq *rq, struct task_struct *prev,
 	spin_release(&rq->lock.dep_map, 1, _THIS_IP_);
 #endif
 
+	context_tracking_task_switch(prev, next);
 	/* Here we just switch the register state and the stack. */
 	switch_to(prev, next, prev);
 
@@ -2457,7 +2724,12 @@ decay_load_missed(unsigned long load, unsigned long missed_updates, int idx)
  */
 void update_cpu_load(struct rq *this_rq)
 {
+#ifdef CONFIG_SMP
+	/* the balancer compares cpu_load[] against runnable averages */
+	unsigned long this_load = this_rq->cfs.runnable_load_avg;
+#else
 	unsigned long this_load = this_rq->load.weight;
+#endif
 	unsigned long curr_jiffies = jiffies;
 	unsigned long pending_updates;
 	int i, scale;
@@ -2997,6 +3269,7 @@ void scheduler_tick(void)
 	update_rq_clock(rq);
 	update_cpu_load_active(rq);
 	curr->sched_class->task_tick(rq, curr, 0);
+	sched_core_tick(rq);
 	raw_spin_unlock(&rq->lock);
 
 	perf_event_task_tick();
@@ -3005,7 +3278,52 @@ void scheduler_tick(void)
 	rq->idle_balance = idle_cpu(cpu);
 	trigger_load_balance(rq, cpu);
 #endif
+	rq_last_tick_reset(rq);
+}
+
+#ifdef CONFIG_NO_HZ_FULL
+/**
+ * scheduler_tick_max_deferment
+ *
+ * Keep at least one tick per second when a single
+ * active task is running because the scheduler doesn't
+ * yet completely support full dynticks environment.
+ *
+ * This makes sure that uptime, CFS vruntime, load
+ * balancing, etc... continue to move forward, even
+ * with a very low granularity.
+ */
+u64 scheduler_tick_max_deferment(void)
+{
+	struct rq *rq = this_rq();
+	unsigned long next, now = ACCESS_ONCE(jiffies);
+
+	next = rq->last_sched_tick + HZ;
+
+	if (time_before_eq(next, now))
+		return 0;
+
+	return jiffies_to_usecs(next - now) * NSEC_PER_USEC;
+}
+
+bool sched_can_stop_tick(void)
+{
+	struct rq *rq = this_rq();
+
+	/* Make sure rq->nr_running update is visible after the IPI */
+	smp_rmb();
+
+	/* A deadline task needs the tick to enforce its runtime */
+	if (rq->dl.dl_nr_running)
+		return false;
+
+	/* More than one running task need preemption */
+	if (rq->nr_running > 1)
+		return false;
+
+	return true;
 }
+#endif
 
 notrace unsigned long get_parent_ip(unsigned long addr)
 {
@@ -3199,6 +3517,10 @@ need_resched:
 
 	put_prev_task(rq, prev);
 	next = pick_next_task(rq);
+#ifdef CONFIG_SCHED_CORE
+	if (sched_core_enabled())
+		next = sched_core_pick(rq, next);
+#endif
 	clear_tsk_need_resched(prev);
 	rq->skip_clock_update = 0;
 
@@ -3247,6 +3569,21 @@ asmlinkage void __sched schedule(void)
 }
 EXPORT_SYMBOL(schedule);
 
+#ifdef CONFIG_CONTEXT_TRACKING
+asmlinkage void __sched schedule_user(void)
+{
+	/*
+	 * If we come here after a random call to set_need_resched(),
+	 * or we have been woken up remotely but the IPI has not yet arrived,
+	 * we haven't yet exited the RCU idle mode. Do it here manually until
+	 * we find a better solution.
+	 */
+	user_exit();
+	schedule();
+	user_enter();
+}
+#endif
+
 #ifdef CONFIG_MUTEX_SPIN_ON_OWNER
 
 static inline bool owner_running(struct mutex *lock, struct task_struct *owner)
@@ -3760,15 +4097,17 @@ EXPORT_SYMBOL(sleep_on_timeout);
  */
 void rt_mutex_setprio(struct task_struct *p, int prio)
 {
-	int oldprio, on_rq, running;
+	int oldprio, on_rq, running, enqueue_flag = 0;
 	struct rq *rq;
 	const struct sched_class *prev_class;
+	struct task_struct *pi_task;
 
-	BUG_ON(prio < 0 || prio > MAX_PRIO);
+	BUG_ON(prio < MAX_DL_PRIO-1 || prio > MAX_PRIO);
 
 	rq = __task_rq_lock(p);
 
 	trace_sched_pi_setprio(p, prio);
+	pi_task = rt_mutex_get_top_task(p);
 	oldprio = p->prio;
 	prev_class = p->sched_class;
 	on_rq = p->on_rq;
@@ -3778,17 +4117,42 @@ void rt_mutex_setprio(struct task_struct *p, int prio)
 	if (running)
 		p->sched_class->put_prev_task(rq, p);
 
-	if (rt_prio(prio))
+	/*
+	 * Boosting condition are:
+	 * 1. -rt task is running and holds mutex A
+	 *      --> -dl task blocks on mutex A
+	 *
+	 * 2. -dl task is running and holds mutex A
+	 *      --> -dl task blocks on mutex A and could preempt the
+	 *          running task
+	 */
+	if (dl_prio(prio)) {
+		if (!dl_prio(p->normal_prio) ||
+		    (pi_task && dl_entity_preempt(&pi_task->dl, &p->dl))) {
+			p->dl.dl_boosted = 1;
+			p->dl.dl_throttled = 0;
+			enqueue_flag = ENQUEUE_REPLENISH;
+		} else
+			p->dl.dl_boosted = 0;
+		p->sched_class = &dl_sched_class;
+	} else if (rt_prio(prio)) {
+		if (dl_prio(oldprio))
+			p->dl.dl_boosted = 0;
+		if (oldprio < prio)
+			enqueue_flag = ENQUEUE_HEAD;
 		p->sched_class = &rt_sched_class;
-	else
+	} else {
+		if (dl_prio(oldprio))
+			p->dl.dl_boosted = 0;
 		p->sched_class = &fair_sched_class;
+	}
 
 	p->prio = prio;
 
 	if (running)
 		p->sched_class->set_curr_task(rq);
 	if (on_rq)
-		enqueue_task(rq, p, oldprio < prio ? ENQUEUE_HEAD : 0);
+		enqueue_task(rq, p, enqueue_flag);
 
 	check_class_changed(rq, p, prev_class, oldprio);
 	__task_rq_unlock(rq);
@@ -3815,7 +4179,7 @@ void set_user_nice(struct task_struct *p, long nice)
 	 * it wont have any effect on scheduling until the task is
 	 * SCHED_FIFO/SCHED_RR:
 	 */
-	if (task_has_rt_policy(p)) {
+	if (task_has_dl_policy(p) || task_has_rt_policy(p)) {
 		p->static_prio = NICE_TO_PRIO(nice);
 		goto out_unlock;
 	}
@@ -3962,22 +4326,152 @@ static struct task_struct *find_process_by_pid(pid_t pid)
 	return pid ? find_task_by_vpid(pid) : current;
 }
 
-/* Actually do priority change: must hold rq lock. */
+/*
+ * This function initializes the sched_dl_entity of a newly becoming
+ * SCHED_DEADLINE task.
+ *
+ * Only the static values are considered here, the actual runtime and the
+ * absolute deadline will be properly calculated when the task is enqueued
+ * for the first time with its new policy.
+ */
 static void
-__setscheduler(struct rq *rq, struct task_struct *p, int policy, int prio)
+__setparam_dl(struct task_struct *p, const struct sched_attr *attr)
+{
+	struct sched_dl_entity *dl_se = &p->dl;
+
+	init_dl_task_timer(dl_se);
+	dl_se->dl_runtime = attr->sched_runtime;
+	dl_se->dl_deadline = attr->sched_deadline;
+	dl_se->dl_period = attr->sched_period ?: dl_se->dl_deadline;
+	dl_se->flags = attr->sched_flags;
+	dl_se->dl_bw = to_ratio(dl_se->dl_period, dl_se->dl_runtime);
+	dl_se->dl_throttled = 0;
+	dl_se->dl_new = 1;
+}
+
+/* Actually do priority change: must hold rq lock. */
+static void __setscheduler(struct rq *rq, struct task_struct *p,
+			   const struct sched_attr *attr)
 {
+	int policy = attr->sched_policy;
+
 	p->policy = policy;
-	p->rt_priority = prio;
+
+	if (dl_policy(policy))
+		__setparam_dl(p, attr);
+	else {
+		/* No bandwidth is accounted to !SCHED_DEADLINE tasks */
+		p->dl.dl_bw = 0;
+		if (fair_policy(policy))
+			p->static_prio = NICE_TO_PRIO(attr->sched_nice);
+	}
+
+	/*
+	 * __sched_setscheduler() ensures attr->sched_priority == 0 when
+	 * !rt_policy. Always setting this ensures that things like
+	 * getparam()/getattr() don't report silly values for !rt tasks.
+	 */
+	p->rt_priority = attr->sched_priority;
 	p->normal_prio = normal_prio(p);
 	/* we are holding p->pi_lock already */
 	p->prio = rt_mutex_getprio(p);
-	if (rt_prio(p->prio))
+
+	if (dl_prio(p->prio))
+		p->sched_class = &dl_sched_class;
+	else if (rt_prio(p->prio))
 		p->sched_class = &rt_sched_class;
 	else
 		p->sched_class = &fair_sched_class;
+
 	set_load_weight(p);
 }
 
+static void
+__getparam_dl(struct task_struct *p, struct sched_attr *attr)
+{
+	struct sched_dl_entity *dl_se = &p->dl;
+
+	attr->sched_priority = p->rt_priority;
+	attr->sched_runtime = dl_se->dl_runtime;
+	attr->sched_deadline = dl_se->dl_deadline;
+	attr->sched_period = dl_se->dl_period;
+}
+
+/*
+ * This function validates the new parameters of a -deadline task.
+ * We ask for the deadline not being zero, and greater or equal
+ * than the runtime, as well as the period of being zero or
+ * greater than deadline. Furthermore, we have to be sure that
+ * user parameters are above the internal resolution (1us); we
+ * check sched_runtime only since it is always the smaller one.
+ * Deadline and period are compared with wrapping arithmetic, so
+ * their top bit must be clear.
+ */
+static bool
+__checkparam_dl(const struct sched_attr *attr)
+{
+	if (attr->sched_deadline == 0)
+		return false;
+
+	if (attr->sched_runtime < (1ULL << DL_SCALE))
+		return false;
+
+	if (attr->sched_deadline & (1ULL << 63) ||
+	    attr->sched_period & (1ULL << 63))
+		return false;
+
+	if ((attr->sched_period && attr->sched_period < attr->sched_deadline) ||
+	    attr->sched_deadline < attr->sched_runtime)
+		return false;
+
+	return true;
+}
+
+/*
+ * We must be sure that accepting a new task (or allowing changing the
+ * parameters of an existing one) is consistent with the bandwidth
+ * constraints. If yes, this function also accordingly updates the currently
+ * allocated bandwidth to reflect the new situation.
+ *
+ * This function is called while holding p's rq->lock.
+ */
+static int dl_overflow(struct task_struct *p, int policy,
+		       const struct sched_attr *attr)
+{
+	struct dl_bw *dl_b = dl_bw_of(task_cpu(p));
+	u64 period = attr->sched_period ?: attr->sched_deadline;
+	u64 runtime = attr->sched_runtime;
+	u64 new_bw = dl_policy(policy) ? to_ratio(period, runtime) : 0;
+	int cpus, err = -1;
+
+	if (new_bw == p->dl.dl_bw)
+		return 0;
+
+	/*
+	 * Either if a task, enters, leave, or stays -deadline but changes
+	 * its parameters, we may need to update accordingly the total
+	 * allocated bandwidth of the container.
+	 */
+	raw_spin_lock(&dl_b->lock);
+	cpus = dl_bw_cpus(task_cpu(p));
+	if (dl_policy(policy) && !task_has_dl_policy(p) &&
+	    !__dl_overflow(dl_b, cpus, 0, new_bw)) {
+		__dl_add(dl_b, new_bw);
+		err = 0;
+	} else if (dl_policy(policy) && task_has_dl_policy(p) &&
+		   !__dl_overflow(dl_b, cpus, p->dl.dl_bw, new_bw)) {
+		__dl_clear(dl_b, p->dl.dl_bw);
+		__dl_add(dl_b, new_bw);
+		err = 0;
+	} else if (!dl_policy(policy) && task_has_dl_policy(p)) {
+		__dl_clear(dl_b, p->dl.dl_bw);
+		err = 0;
+	}
+	raw_spin_unlock(&dl_b->lock);
+
+	return err;
+}
+
 /*
  * check the target process has a UID that matches the current process's
  */
@@ -3997,10 +4491,11 @@ static bool check_same_owner(struct task_struct *p)
 	return match;
 }
 
-static int __sched_setscheduler(struct task_struct *p, int policy,
-				const struct sched_param *param, bool user)
+static int __sched_setscheduler(struct task_struct *p,
+				const struct sched_attr *attr, bool user)
 {
 	int retval, oldprio, oldpolicy = -1, on_rq, running;
+	int policy = attr->sched_policy;
 	unsigned long flags;
 	const struct sched_class *prev_class;
 	struct rq *rq;
@@ -4014,31 +4509,40 @@ recheck:
 		reset_on_fork = p->sched_reset_on_fork;
 		policy = oldpolicy = p->policy;
 	} else {
-		reset_on_fork = !!(policy & SCHED_RESET_ON_FORK);
-		policy &= ~SCHED_RESET_ON_FORK;
+		reset_on_fork = !!(attr->sched_flags & SCHED_FLAG_RESET_ON_FORK);
 
-		if (policy != SCHED_FIFO && policy != SCHED_RR &&
+		if (policy != SCHED_DEADLINE &&
+				policy != SCHED_FIFO && policy != SCHED_RR &&
 				policy != SCHED_NORMAL && policy != SCHED_BATCH &&
 				policy != SCHED_IDLE)
 			return -EINVAL;
 	}
 
+	if (attr->sched_flags & ~(SCHED_FLAG_RESET_ON_FORK))
+		return -EINVAL;
+
 	/*
 	 * Valid priorities for SCHED_FIFO and SCHED_RR are
 	 * 1..MAX_USER_RT_PRIO-1, valid priority for SCHED_NORMAL,
-	 * SCHED_BATCH and SCHED_IDLE is 0.
+	 * SCHED_BATCH, SCHED_IDLE and SCHED_DEADLINE is 0.
 	 */
-	if (param->sched_priority < 0 ||
-	    (p->mm && param->sched_priority > MAX_USER_RT_PRIO-1) ||
-	    (!p->mm && param->sched_priority > MAX_RT_PRIO-1))
+	if ((p->mm && attr->sched_priority > MAX_USER_RT_PRIO-1) ||
+	    (!p->mm && attr->sched_priority > MAX_RT_PRIO-1))
 		return -EINVAL;
-	if (rt_policy(policy) != (param->sched_priority != 0))
+	if ((dl_policy(policy) && !__checkparam_dl(attr)) ||
+	    (rt_policy(policy) != (attr->sched_priority != 0)))
 		return -EINVAL;
 
 	/*
 	 * Allow unprivileged RT tasks to decrease priority:
 	 */
 	if (user && !capable(CAP_SYS_NICE)) {
+		if (fair_policy(policy)) {
+			if (attr->sched_nice < TASK_NICE(p) &&
+			    !can_nice(p, attr->sched_nice))
+				return -EPERM;
+		}
+
 		if (rt_policy(policy)) {
 			unsigned long rlim_rtprio =
 					task_rlimit(p, RLIMIT_RTPRIO);
@@ -4048,11 +4552,20 @@ recheck:
 				return -EPERM;
 
 			/* can't increase priority */
-			if (param->sched_priority > p->rt_priority &&
-			    param->sched_priority > rlim_rtprio)
+			if (attr->sched_priority > p->rt_priority &&
+			    attr->sched_priority > rlim_rtprio)
 				return -EPERM;
 		}
 
+		/*
+		 * Can't set/change SCHED_DEADLINE policy at all for now
+		 * (safest behavior); in the future we would like to allow
+		 * unprivileged DL tasks to increase their relative deadline
+		 * or reduce their runtime (both ways reducing utilization)
+		 */
+		if (dl_policy(policy))
+			return -EPERM;
+
 		/*
 		 * Treat SCHED_IDLE as nice 20. Only allow a switch to
 		 * SCHED_NORMAL if the RLIMIT_NICE would normally permit it.
@@ -4097,13 +4610,19 @@ recheck:
 	/*
 	 * If not changing anything there's no need to proceed further:
 	 */
-	if (unlikely(policy == p->policy && (!rt_policy(policy) ||
-			param->sched_priority == p->rt_priority))) {
+	if (unlikely(policy == p->policy)) {
+		if (fair_policy(policy) && attr->sched_nice != TASK_NICE(p))
+			goto change;
+		if (rt_policy(policy) && attr->sched_priority != p->rt_priority)
+			goto change;
+		if (dl_policy(policy))
+			goto change;
 
 		__task_rq_unlock(rq);
 		raw_spin_unlock_irqrestore(&p->pi_lock, flags);
 		return 0;
 	}
+change:
 
 #ifdef CONFIG_RT_GROUP_SCHED
 	if (user) {
@@ -4119,6 +4638,22 @@ recheck:
 		}
 	}
 #endif
+#ifdef CONFIG_SMP
+	if (user && dl_policy(policy)) {
+		const struct cpumask *span = rq->rd->span;
+
+		/*
+		 * Don't allow tasks with an affinity mask smaller than
+		 * the entire root_domain to become SCHED_DEADLINE. We
+		 * will also fail if there's no bandwidth available.
+		 */
+		if (!cpumask_subset(span, &p->cpus_allowed) ||
+		    rq->rd->dl_bw.bw == 0) {
+			task_rq_unlock(rq, p, &flags);
+			return -EPERM;
+		}
+	}
+#endif
 
 	/* recheck policy now with rq lock held */
 	if (unlikely(oldpolicy != -1 && oldpolicy != p->policy)) {
@@ -4126,6 +4661,17 @@ recheck:
 		task_rq_unlock(rq, p, &flags);
 		goto recheck;
 	}
+
+	/*
+	 * If setscheduling to SCHED_DEADLINE (or changing the parameters
+	 * of a SCHED_DEADLINE task) we need to check if enough bandwidth
+	 * is available.
+	 */
+	if ((dl_policy(policy) || task_has_dl_policy(p)) &&
+	    dl_overflow(p, policy, attr)) {
+		task_rq_unlock(rq, p, &flags);
+		return -EBUSY;
+	}
 	on_rq = p->on_rq;
 	running = task_current(rq, p);
 	if (on_rq)
@@ -4137,7 +4683,7 @@ recheck:
 
 	oldprio = p->prio;
 	prev_class = p->sched_class;
-	__setscheduler(rq, p, policy, param->sched_priority);
+	__setscheduler(rq, p, attr);
 
 	if (running)
 		p->sched_class->set_curr_task(rq);
@@ -4160,13 +4706,47 @@ recheck:
  *
  * NOTE that the task may be already dead.
  */
+static int _sched_setscheduler(struct task_struct *p, int policy,
+			       const struct sched_param *param, bool check)
+{
+	struct sched_attr attr = {
+		.sched_policy   = policy,
+		.sched_priority = param->sched_priority,
+		.sched_nice	= PRIO_TO_NICE(p->static_prio),
+	};
+
+	/*
+	 * Fixup the legacy SCHED_RESET_ON_FORK hack
+	 */
+	if (policy >= 0 && (policy & SCHED_RESET_ON_FORK)) {
+		attr.sched_flags |= SCHED_FLAG_RESET_ON_FORK;
+		policy &= ~SCHED_RESET_ON_FORK;
+		attr.sched_policy = policy;
+	}
+
+	return __sched_setscheduler(p, &attr, check);
+}
+
 int sched_setscheduler(struct task_struct *p, int policy,
 		       const struct sched_param *param)
 {
-	return __sched_setscheduler(p, policy, param, true);
+	return _sched_setscheduler(p, policy, param, true);
 }
 EXPORT_SYMBOL_GPL(sched_setscheduler);
 
+/**
+ * sched_setattr - change the scheduling policy and its parameters of a thread.
+ * @p: the task in question.
+ * @attr: structure containing the new policy and its parameters.
+ *
+ * NOTE that the task may be already dead.
+ */
+int sched_setattr(struct task_struct *p, const struct sched_attr *attr)
+{
+	return __sched_setscheduler(p, attr, true);
+}
+EXPORT_SYMBOL_GPL(sched_setattr);
+
 /**
  * sched_setscheduler_nocheck - change the scheduling policy and/or RT priority of a thread from kernelspace.
  * @p: the task in question.
@@ -4181,7 +4761,7 @@ EXPORT_SYMBOL_GPL(sched_setscheduler);
 int sched_setscheduler_nocheck(struct task_struct *p, int policy,
 			       const struct sched_param *param)
 {
-	return __sched_setscheduler(p, policy, param, false);
+	return _sched_setscheduler(p, policy, param, false);
 }
 
 static int
@@ -4206,25 +4786,98 @@ do_sched_setscheduler(pid_t pid, int policy, struct sched_param __user *param)
 	return retval;
 }
 
-/**
- * sys_sched_setscheduler - set/change the scheduler policy and RT priority
- * @pid: the pid in question.
- * @policy: new policy.
- * @param: structure containing the new RT priority.
+/*
+ * Mimics kernel/events/core.c perf_copy_attr().
  */
-SYSCALL_DEFINE3(sched_setscheduler, pid_t, pid, int, policy,
-		struct sched_param __user *, param)
+static int sched_copy_attr(struct sched_attr __user *uattr,
+			   struct sched_attr *attr)
 {
-	/* negative values for policy are not valid */
-	if (policy < 0)
-		return -EINVAL;
+	u32 size;
+	int ret;
 
-	return do_sched_setscheduler(pid, policy, param);
-}
+	if (!access_ok(VERIFY_WRITE, uattr, SCHED_ATTR_SIZE_VER0))
+		return -EFAULT;
 
-/**
- * sys_sched_setparam - set/change the RT priority of a thread
- * @pid: the pid in question.
+	/*
+	 * zero the full structure, so that a short copy will be nice.
+	 */
+	memset(attr, 0, sizeof(*attr));
+
+	ret = get_user(size, &uattr->size);
+	if (ret)
+		return ret;
+
+	if (size > PAGE_SIZE)	/* silly large */
+		goto err_size;
+
+	if (!size)		/* abi compat */
+		size = SCHED_ATTR_SIZE_VER0;
+
+	if (size < SCHED_ATTR_SIZE_VER0)
+		goto err_size;
+
+	/*
+	 * If we're handed a bigger struct than we know of,
+	 * ensure all the unknown bits are 0 - i.e. new
+	 * user-space does not rely on any kernel feature
+	 * extensions we dont know about yet.
+	 */
+	if (size > sizeof(*attr)) {
+		unsigned char __user *addr;
+		unsigned char __user *end;
+		unsigned char val;
+
+		addr = (void __user *)uattr + sizeof(*attr);
+		end  = (void __user *)uattr + size;
+
+		for (; addr < end; addr++) {
+			ret = get_user(val, addr);
+			if (ret)
+				return ret;
+			if (val)
+				goto err_size;
+		}
+		size = sizeof(*attr);
+	}
+
+	ret = copy_from_user(attr, uattr, size);
+	if (ret)
+		return -EFAULT;
+
+	/*
+	 * Be lenient about out-of-range nice values, as setpriority()
+	 * and nice() are.
+	 */
+	attr->sched_nice = clamp(attr->sched_nice, -20, 19);
+
+out:
+	return ret;
+
+err_size:
+	put_user(sizeof(*attr), &uattr->size);
+	ret = -E2BIG;
+	goto out;
+}
+
+/**
+ * sys_sched_setscheduler - set/change the scheduler policy and RT priority
+ * @pid: the pid in question.
+ * @policy: new policy.
+ * @param: structure containing the new RT priority.
+ */
+SYSCALL_DEFINE3(sched_setscheduler, pid_t, pid, int, policy,
+		struct sched_param __user *, param)
+{
+	/* negative values for policy are not valid */
+	if (policy < 0)
+		return -EINVAL;
+
+	return do_sched_setscheduler(pid, policy, param);
+}
+
+/**
+ * sys_sched_setparam - set/change the RT priority of a thread
+ * @pid: the pid in question.
  * @param: structure containing the new RT priority.
  */
 SYSCALL_DEFINE2(sched_setparam, pid_t, pid, struct sched_param __user *, param)
@@ -4232,6 +4885,40 @@ SYSCALL_DEFINE2(sched_setparam, pid_t, pid, struct sched_param __user *, param)
 	return do_sched_setscheduler(pid, -1, param);
 }
 
+/**
+ * sys_sched_setattr - same as above, but with extended sched_attr
+ * @pid: the pid in question.
+ * @uattr: structure containing the extended parameters.
+ * @flags: for future extension, must be 0.
+ */
+SYSCALL_DEFINE3(sched_setattr, pid_t, pid, struct sched_attr __user *, uattr,
+		unsigned int, flags)
+{
+	struct sched_attr attr;
+	struct task_struct *p;
+	int retval;
+
+	if (!uattr || pid < 0 || flags)
+		return -EINVAL;
+
+	retval = sched_copy_attr(uattr, &attr);
+	if (retval)
+		return retval;
+
+	/* negative values for policy are not valid */
+	if ((int)attr.sched_policy < 0)
+		return -EINVAL;
+
+	rcu_read_lock();
+	retval = -ESRCH;
+	p = find_process_by_pid(pid);
+	if (p != NULL)
+		retval = sched_setattr(p, &attr);
+	rcu_read_unlock();
+
+	return retval;
+}
+
 /**
  * sys_sched_getscheduler - get the policy (scheduling class) of a thread
  * @pid: the pid in question.
@@ -4296,6 +4983,95 @@ out_unlock:
 	return retval;
 }
 
+static int sched_read_attr(struct sched_attr __user *uattr,
+			   struct sched_attr *attr,
+			   unsigned int usize)
+{
+	int ret;
+
+	if (!access_ok(VERIFY_WRITE, uattr, usize))
+		return -EFAULT;
+
+	/*
+	 * If we're handed a smaller struct than we know of,
+	 * ensure all the unknown bits are 0 - i.e. old
+	 * user-space does not get uncomplete information.
+	 */
+	if (usize < sizeof(*attr)) {
+		unsigned char *addr;
+		unsigned char *end;
+
+		addr = (void *)attr + usize;
+		end  = (void *)attr + sizeof(*attr);
+
+		for (; addr < end; addr++) {
+			if (*addr)
+				return -EFBIG;
+		}
+
+		attr->size = usize;
+	}
+
+	ret = copy_to_user(uattr, attr, attr->size);
+	if (ret)
+		return -EFAULT;
+
+	return 0;
+}
+
+/**
+ * sys_sched_getattr - similar to sched_getparam, but with sched_attr
+ * @pid: the pid in question.
+ * @uattr: structure containing the extended parameters.
+ * @size: sizeof(attr) for fwd/bwd comp.
+ * @flags: for future extension, must be 0.
+ */
+SYSCALL_DEFINE4(sched_getattr, pid_t, pid, struct sched_attr __user *, uattr,
+		unsigned int, size, unsigned int, flags)
+{
+	struct sched_attr attr = {
+		.size = sizeof(struct sched_attr),
+	};
+	struct task_struct *p;
+	int retval;
+
+	if (!uattr || pid < 0 || size > PAGE_SIZE ||
+	    size < SCHED_ATTR_SIZE_VER0 || flags)
+		return -EINVAL;
+
+	rcu_read_lock();
+	p = find_process_by_pid(pid);
+	retval = -ESRCH;
+	if (!p)
+		goto out_unlock;
+
+	retval = security_task_getscheduler(p);
+	if (retval)
+		goto out_unlock;
+
+	attr.sched_policy = p->policy;
+	if (p->sched_reset_on_fork)
+		attr.sched_flags |= SCHED_FLAG_RESET_ON_FORK;
+	if (task_has_dl_policy(p))
+		__getparam_dl(p, &attr);
+	else if (task_has_rt_policy(p))
+		attr.sched_priority = p->rt_priority;
+	else
+		attr.sched_nice = TASK_NICE(p);
+
+	rcu_read_unlock();
+
+	/*
+	 * This one might sleep, we cannot do it with a spinlock held ...
+	 */
+	retval = sched_read_attr(uattr, &attr, size);
+	return retval;
+
+out_unlock:
+	rcu_read_unlock();
+	return retval;
+}
+
 long sched_setaffinity(pid_t pid, const struct cpumask *in_mask)
 {
 	cpumask_var_t cpus_allowed, new_mask;
@@ -4334,6 +5110,26 @@ long sched_setaffinity(pid_t pid, const struct cpumask *in_mask)
 
 	cpuset_cpus_allowed(p, cpus_allowed);
 	cpumask_and(new_mask, in_mask, cpus_allowed);
+
+	/*
+	 * Since bandwidth control happens on root_domain basis,
+	 * if admission test is enabled, we only admit -deadline
+	 * tasks allowed to run on all the CPUs in the task's
+	 * root_domain.
+	 */
+#ifdef CONFIG_SMP
+	if (task_has_dl_policy(p)) {
+		const struct cpumask *span;
+
+		rcu_read_lock_sched();
+		span = task_rq(p)->rd->span;
+		if (!cpumask_subset(span, new_mask))
+			retval = -EBUSY;
+		rcu_read_unlock_sched();
+		if (retval)
+			goto out_unlock;
+	}
+#endif
 again:
 	retval = set_cpus_allowed_ptr(p, new_mask);
 
@@ -4678,6 +5474,7 @@ SYSCALL_DEFINE1(sched_get_priority_max, int, policy)
 	case SCHED_RR:
 		ret = MAX_USER_RT_PRIO-1;
 		break;
+	case SCHED_DEADLINE:
 	case SCHED_NORMAL:
 	case SCHED_BATCH:
 	case SCHED_IDLE:
@@ -4703,6 +5500,7 @@ SYSCALL_DEFINE1(sched_get_priority_min, int, policy)
 	case SCHED_RR:
 		ret = 1;
 		break;
+	case SCHED_DEADLINE:
 	case SCHED_NORMAL:
 	case SCHED_BATCH:
 	case SCHED_IDLE:
@@ -4992,7 +5790,7 @@ static int __migrate_task(struct task_struct *p, int src_cpu, int dest_cpu)
 	 * If we're not on a rq, the next wake-up will ensure we're
 	 * placed properly.
 	 */
-	if (p->on_rq) {
+	if (task_on_rq_queued(p)) {
 		dequeue_task(rq_src, p, 0);
 		set_task_cpu(p, dest_cpu);
 		enqueue_task(rq_dest, p, 0);
@@ -5383,6 +6181,15 @@ static int __cpuinit sched_cpu_active(struct notifier_block *nfb,
 {
 	switch (action & ~CPU_TASKS_FROZEN) {
 	case CPU_ONLINE:
+#ifdef CONFIG_SCHED_SMT
+		/* Only look for idle cores once there are cores with siblings */
+		if (cpumask_weight(cpu_smt_mask((long)hcpu)) > 1 &&
+		    !jump_label_enabled(&sched_smt_present))
+			jump_label_inc(&sched_smt_present);
+#endif
+#ifdef CONFIG_SCHED_CORE
+		sched_core_cpu_online((long)hcpu);
+#endif
 	case CPU_DOWN_FAILED:
 		set_cpu_active((long)hcpu, true);
 		return NOTIFY_OK;
@@ -5603,6 +6410,7 @@ static void free_rootdomain(struct rcu_head *rcu)
 	struct root_domain *rd = container_of(rcu, struct root_domain, rcu);
 
 	cpupri_cleanup(&rd->cpupri);
+	free_cpumask_var(rd->dlo_mask);
 	free_cpumask_var(rd->rto_mask);
 	free_cpumask_var(rd->online);
 	free_cpumask_var(rd->span);
@@ -5656,11 +6464,17 @@ static int init_rootdomain(struct root_domain *rd)
 		goto free_span;
 	if (!alloc_cpumask_var(&rd->rto_mask, GFP_KERNEL))
 		goto free_online;
+	if (!alloc_cpumask_var(&rd->dlo_mask, GFP_KERNEL))
+		goto free_rto_mask;
+
+	init_dl_bw(&rd->dl_bw);
 
 	if (cpupri_init(&rd->cpupri) != 0)
-		goto free_rto_mask;
+		goto free_dlo_mask;
 	return 0;
 
+free_dlo_mask:
+	free_cpumask_var(rd->dlo_mask);
 free_rto_mask:
 	free_cpumask_var(rd->rto_mask);
 free_online:
@@ -5733,6 +6547,8 @@ static void free_sched_domain(struct rcu_head *rcu)
 		kfree(sd->groups->sgp);
 		kfree(sd->groups);
 	}
+	if (sd->shared && atomic_dec_and_test(&sd->shared->ref))
+		kfree(sd->shared);
 	kfree(sd);
 }
 
@@ -5755,21 +6571,27 @@ static void destroy_sched_domains(struct sched_domain *sd, int cpu)
  * Also keep a unique ID per domain (we use the first cpu number in
  * the cpumask of the domain), this allows us to quickly tell if
  * two cpus are in the same cache domain, see ttwu_share_cache().
+ * The state the cpus of that domain share is sd_llc_shared.
  */
 DEFINE_PER_CPU(struct sched_domain *, sd_llc);
 DEFINE_PER_CPU(int, sd_llc_id);
+DEFINE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
 
 static void update_top_cache_domain(int cpu)
 {
+	struct sched_domain_shared *sds = NULL;
 	struct sched_domain *sd;
 	int id = cpu;
 
 	sd = highest_flag_domain(cpu, SD_SHARE_PKG_RESOURCES);
-	if (sd)
+	if (sd) {
 		id = cpumask_first(sched_domain_span(sd));
+		sds = sd->shared;
+	}
 
 	rcu_assign_pointer(per_cpu(sd_llc, cpu), sd);
 	per_cpu(sd_llc_id, cpu) = id;
+	rcu_assign_pointer(per_cpu(sd_llc_shared, cpu), sds);
 }
 
 /*
@@ -5925,6 +6747,7 @@ struct sd_data {
 	struct sched_domain **__percpu sd;
 	struct sched_group **__percpu sg;
 	struct sched_group_power **__percpu sgp;
+	struct sched_domain_shared **__percpu sds;
 };
 
 struct s_data {
@@ -6243,14 +7066,10 @@ static void claim_allocations(int cpu, struct sched_domain *sd)
 
 	if (atomic_read(&(*per_cpu_ptr(sdd->sgp, cpu))->ref))
 		*per_cpu_ptr(sdd->sgp, cpu) = NULL;
-}
 
-#ifdef CONFIG_SCHED_SMT
-static const struct cpumask *cpu_smt_mask(int cpu)
-{
-	return topology_thread_cpumask(cpu);
+	if (atomic_read(&(*per_cpu_ptr(sdd->sds, cpu))->ref))
+		*per_cpu_ptr(sdd->sds, cpu) = NULL;
 }
-#endif
 
 /*
  * Topology list, bottom-up.
@@ -6295,10 +7114,15 @@ static int __sdt_alloc(const struct cpumask *cpu_map)
 		if (!sdd->sgp)
 			return -ENOMEM;
 
+		sdd->sds = alloc_percpu(struct sched_domain_shared *);
+		if (!sdd->sds)
+			return -ENOMEM;
+
 		for_each_cpu(j, cpu_map) {
 			struct sched_domain *sd;
 			struct sched_group *sg;
 			struct sched_group_power *sgp;
+			struct sched_domain_shared *sds;
 
 		       	sd = kzalloc_node(sizeof(struct sched_domain) + cpumask_size(),
 					GFP_KERNEL, cpu_to_node(j));
@@ -6320,6 +7144,13 @@ static int __sdt_alloc(const struct cpumask *cpu_map)
 				return -ENOMEM;
 
 			*per_cpu_ptr(sdd->sgp, j) = sgp;
+
+			sds = kzalloc_node(sizeof(struct sched_domain_shared),
+					GFP_KERNEL, cpu_to_node(j));
+			if (!sds)
+				return -ENOMEM;
+
+			*per_cpu_ptr(sdd->sds, j) = sds;
 		}
 	}
 
@@ -6341,10 +7172,13 @@ static void __sdt_free(const struct cpumask *cpu_map)
 			kfree(*per_cpu_ptr(sdd->sd, j));
 			kfree(*per_cpu_ptr(sdd->sg, j));
 			kfree(*per_cpu_ptr(sdd->sgp, j));
+			if (sdd->sds)
+				kfree(*per_cpu_ptr(sdd->sds, j));
 		}
 		free_percpu(sdd->sd);
 		free_percpu(sdd->sg);
 		free_percpu(sdd->sgp);
+		free_percpu(sdd->sds);
 	}
 }
 
@@ -6359,6 +7193,15 @@ struct sched_domain *build_sched_domain(struct sched_domain_topology_level *tl,
 
 	set_domain_attribute(sd, attr);
 	cpumask_and(sched_domain_span(sd), cpu_map, tl->mask(cpu));
+	/*
+	 * The cpus sharing a cache share the state of the idle cpu search,
+	 * kept with the first one.
+	 */
+	if (sd->flags & SD_SHARE_PKG_RESOURCES) {
+		sd->shared = *per_cpu_ptr(tl->data.sds,
+					  cpumask_first(sched_domain_span(sd)));
+		atomic_inc(&sd->shared->ref);
+	}
 	if (child) {
 		sd->level = child->level + 1;
 		sched_domain_level_max = max(sched_domain_level_max, sd->level);
@@ -6782,6 +7625,7 @@ void __init sched_init_smp(void)
 	free_cpumask_var(non_isolated_cpus);
 
 	init_sched_rt_class();
+	init_sched_dl_class();
 }
 #else
 void __init sched_init_smp(void)
@@ -6801,9 +7645,13 @@ int in_sched_functions(unsigned long addr)
 
 #ifdef CONFIG_CGROUP_SCHED
 struct task_group root_task_group;
+#ifdef CONFIG_SCHED_LATENCY_HIST
+static DEFINE_PER_CPU(struct sched_lat_hist, root_lat_hist);
+#endif
 #endif
 
 DECLARE_PER_CPU(cpumask_var_t, load_balance_tmpmask);
+DECLARE_PER_CPU(cpumask_var_t, select_idle_mask);
 
 void __init sched_init(void)
 {
@@ -6817,7 +7665,7 @@ void __init sched_init(void)
 	alloc_size += 2 * nr_cpu_ids * sizeof(void **);
 #endif
 #ifdef CONFIG_CPUMASK_OFFSTACK
-	alloc_size += num_possible_cpus() * cpumask_size();
+	alloc_size += 2 * num_possible_cpus() * cpumask_size();
 #endif
 	if (alloc_size) {
 		ptr = (unsigned long)kzalloc(alloc_size, GFP_NOWAIT);
@@ -6842,17 +7690,23 @@ void __init sched_init(void)
 		for_each_possible_cpu(i) {
 			per_cpu(load_balance_tmpmask, i) = (void *)ptr;
 			ptr += cpumask_size();
+			per_cpu(select_idle_mask, i) = (void *)ptr;
+			ptr += cpumask_size();
 		}
 #endif /* CONFIG_CPUMASK_OFFSTACK */
 	}
 
-#ifdef CONFIG_SMP
-	init_defrootdomain();
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	root_task_group.lat_hist = &root_lat_hist;
 #endif
 
 	init_rt_bandwidth(&def_rt_bandwidth,
 			global_rt_period(), global_rt_runtime());
 
+#ifdef CONFIG_SMP
+	init_defrootdomain();
+#endif
+
 #ifdef CONFIG_RT_GROUP_SCHED
 	init_rt_bandwidth(&root_task_group.rt_bandwidth,
 			global_rt_period(), global_rt_runtime());
@@ -6877,11 +7731,16 @@ void __init sched_init(void)
 
 		rq = cpu_rq(i);
 		raw_spin_lock_init(&rq->lock);
+#ifdef CONFIG_SCHED_CORE
+		rq->core = rq;
+		raw_spin_lock_init(&rq->core_lock);
+#endif
 		rq->nr_running = 0;
 		rq->calc_load_active = 0;
 		rq->calc_load_update = jiffies + LOAD_FREQ;
 		init_cfs_rq(&rq->cfs);
 		init_rt_rq(&rq->rt, rq);
+		init_dl_rq(&rq->dl, rq);
 #ifdef CONFIG_FAIR_GROUP_SCHED
 		root_task_group.shares = ROOT_TASK_GROUP_LOAD;
 		INIT_LIST_HEAD(&rq->leaf_cfs_rq_list);
@@ -7022,13 +7881,21 @@ EXPORT_SYMBOL(__might_sleep);
 static void normalize_task(struct rq *rq, struct task_struct *p)
 {
 	const struct sched_class *prev_class = p->sched_class;
+	struct sched_attr attr = {
+		.sched_policy = SCHED_NORMAL,
+		.sched_nice = PRIO_TO_NICE(p->static_prio),
+	};
 	int old_prio = p->prio;
 	int on_rq;
 
+	/* Give the bandwidth of a -deadline task back */
+	if (task_has_dl_policy(p))
+		dl_overflow(p, SCHED_NORMAL, &attr);
+
 	on_rq = p->on_rq;
 	if (on_rq)
 		dequeue_task(rq, p, 0);
-	__setscheduler(rq, p, SCHED_NORMAL, 0);
+	__setscheduler(rq, p, &attr);
 	if (on_rq) {
 		enqueue_task(rq, p, 0);
 		resched_task(rq->curr);
@@ -7058,7 +7925,7 @@ void normalize_rt_tasks(void)
 		p->se.statistics.block_start	= 0;
 #endif
 
-		if (!rt_task(p)) {
+		if (!dl_task(p) && !rt_task(p)) {
 			/*
 			 * Renice negative nice level userspace
 			 * tasks back to 0:
@@ -7133,8 +8000,146 @@ void set_curr_task(int cpu, struct task_struct *p)
 /* task_group_lock serializes the addition/removal of task groups */
 static DEFINE_SPINLOCK(task_group_lock);
 
+#ifdef CONFIG_SCHED_CORE
+/* serializes the tagging of groups */
+static DEFINE_MUTEX(sched_core_mutex);
+static int sched_core_count;
+
+static void sched_core_get(void)
+{
+	unsigned long flags;
+	int cpu;
+
+	/*
+	 * The core state went stale while core scheduling was off, start
+	 * over from an empty core.
+	 */
+	if (!sched_core_count++) {
+		for_each_possible_cpu(cpu) {
+			struct rq *rq = cpu_rq(cpu);
+
+			raw_spin_lock_irqsave(&rq->lock, flags);
+			raw_spin_lock(&rq->core->core_lock);
+			rq->core_busy = 0;
+			rq->core_forceidle = 0;
+			rq->core_tick = rq->clock;
+			raw_spin_unlock(&rq->core->core_lock);
+			raw_spin_unlock_irqrestore(&rq->lock, flags);
+		}
+	}
+	jump_label_inc(&__sched_core_enabled);
+}
+
+static void sched_core_put(void)
+{
+	jump_label_dec(&__sched_core_enabled);
+	sched_core_count--;
+}
+
+/* Make every cpu check what it runs against the new cookies */
+static void sched_core_resched_all(void)
+{
+	unsigned long flags;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		raw_spin_lock_irqsave(&rq->lock, flags);
+		resched_task(rq->curr);
+		raw_spin_unlock_irqrestore(&rq->lock, flags);
+	}
+}
+
+static int tg_set_core_cookie(struct task_group *tg, void *data)
+{
+	if (tg->core_tagged)
+		tg->core_cookie = (unsigned long)tg;
+	else
+		tg->core_cookie = tg->parent->core_cookie;
+
+	return 0;
+}
+
+static int sched_core_tag(struct task_group *tg, int tagged)
+{
+	unsigned long flags;
+
+	if (tg == &root_task_group)
+		return -EINVAL;
+
+	mutex_lock(&sched_core_mutex);
+	if (tg->core_tagged == tagged)
+		goto out;
+
+	if (tagged)
+		sched_core_get();
+
+	spin_lock_irqsave(&task_group_lock, flags);
+	tg->core_tagged = tagged;
+	walk_tg_tree_from(tg, tg_set_core_cookie, tg_nop, NULL);
+	spin_unlock_irqrestore(&task_group_lock, flags);
+
+	if (!tagged)
+		sched_core_put();
+
+	sched_core_resched_all();
+out:
+	mutex_unlock(&sched_core_mutex);
+
+	return 0;
+}
+
+/* A core may still be owned by the group, which is about to go away */
+static void sched_core_destroy_group(struct task_group *tg)
+{
+	unsigned long flags;
+	int cpu;
+
+	if (!tg->core_tagged)
+		return;
+
+	mutex_lock(&sched_core_mutex);
+	sched_core_put();
+	mutex_unlock(&sched_core_mutex);
+
+	for_each_possible_cpu(cpu) {
+		struct rq *core = cpu_rq(cpu)->core;
+
+		raw_spin_lock_irqsave(&core->core_lock, flags);
+		if (core->core_owner == (unsigned long)tg)
+			core->core_owner = 0;
+		raw_spin_unlock_irqrestore(&core->core_lock, flags);
+	}
+}
+#else
+static inline void sched_core_destroy_group(struct task_group *tg) { }
+#endif /* CONFIG_SCHED_CORE */
+
+#ifdef CONFIG_SCHED_LATENCY_HIST
+static int alloc_lat_hist(struct task_group *tg)
+{
+	tg->lat_hist = alloc_percpu(struct sched_lat_hist);
+
+	return tg->lat_hist != NULL;
+}
+
+static void free_lat_hist(struct task_group *tg)
+{
+	free_percpu(tg->lat_hist);
+}
+#else
+static inline int alloc_lat_hist(struct task_group *tg)
+{
+	return 1;
+}
+
+static inline void free_lat_hist(struct task_group *tg) { }
+#endif /* CONFIG_SCHED_LATENCY_HIST */
+
 static void free_sched_group(struct task_group *tg)
 {
+	free_lat_hist(tg);
 	free_fair_sched_group(tg);
 	free_rt_sched_group(tg);
 	autogroup_free(tg);
@@ -7157,6 +8162,9 @@ struct task_group *sched_create_group(struct task_group *parent)
 	if (!alloc_rt_sched_group(tg, parent))
 		goto err;
 
+	if (!alloc_lat_hist(tg))
+		goto err;
+
 	spin_lock_irqsave(&task_group_lock, flags);
 	list_add_rcu(&tg->list, &task_groups);
 
@@ -7165,6 +8173,9 @@ struct task_group *sched_create_group(struct task_group *parent)
 	tg->parent = parent;
 	INIT_LIST_HEAD(&tg->children);
 	list_add_rcu(&tg->siblings, &parent->children);
+#ifdef CONFIG_SCHED_CORE
+	tg->core_cookie = parent->core_cookie;
+#endif
 	spin_unlock_irqrestore(&task_group_lock, flags);
 
 	return tg;
@@ -7191,6 +8202,8 @@ void sched_destroy_group(struct task_group *tg)
 	for_each_possible_cpu(i)
 		unregister_fair_sched_group(tg, i);
 
+	sched_core_destroy_group(tg);
+
 	spin_lock_irqsave(&task_group_lock, flags);
 	list_del_rcu(&tg->list);
 	list_del_rcu(&tg->siblings);
@@ -7233,19 +8246,31 @@ void sched_move_task(struct task_struct *tsk)
 	if (on_rq)
 		enqueue_task(rq, tsk, 0);
 
+#ifdef CONFIG_SCHED_CORE
+	/* The task may not fit with what the siblings run anymore */
+	if (unlikely(running) && sched_core_enabled())
+		resched_task(tsk);
+#endif
+
 	task_rq_unlock(rq, tsk, &flags);
 }
 #endif /* CONFIG_CGROUP_SCHED */
 
-#if defined(CONFIG_RT_GROUP_SCHED) || defined(CONFIG_CFS_BANDWIDTH)
-static unsigned long to_ratio(u64 period, u64 runtime)
+unsigned long to_ratio(u64 period, u64 runtime)
 {
 	if (runtime == RUNTIME_INF)
 		return 1ULL << 20;
 
+	/*
+	 * Doing this here saves a lot of checks in all
+	 * the calling paths, and returning zero seems
+	 * safe for them anyway.
+	 */
+	if (period == 0)
+		return 0;
+
 	return div64_u64(runtime << 20, period);
 }
-#endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
 /*
@@ -7486,6 +8511,75 @@ static int sched_rt_global_constraints(void)
 }
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+/*
+ * The bandwidth -deadline tasks can reserve is capped by the global rt
+ * runtime and period: refuse to lower that below what has already been
+ * admitted in any root domain.
+ */
+static int sched_dl_global_constraints(void)
+{
+	u64 runtime, period, new_bw;
+	unsigned long flags;
+	int cpu, ret = 0;
+
+	if (sysctl_sched_rt_period <= 0)
+		return -EINVAL;
+
+	runtime = global_rt_runtime();
+	period = global_rt_period();
+	if (runtime == RUNTIME_INF)
+		return 0;
+
+	new_bw = to_ratio(period, runtime);
+
+	/*
+	 * Cycling on all the cpus visits each root domain several times,
+	 * but it is simpler than walking the root domains, and this is
+	 * not a fast path.
+	 */
+	for_each_possible_cpu(cpu) {
+		struct dl_bw *dl_b;
+
+		rcu_read_lock_sched();
+		dl_b = dl_bw_of(cpu);
+
+		raw_spin_lock_irqsave(&dl_b->lock, flags);
+		if (new_bw * dl_bw_cpus(cpu) < dl_b->total_bw)
+			ret = -EBUSY;
+		raw_spin_unlock_irqrestore(&dl_b->lock, flags);
+
+		rcu_read_unlock_sched();
+
+		if (ret)
+			break;
+	}
+
+	return ret;
+}
+
+static void sched_dl_do_global(void)
+{
+	u64 new_bw = -1;
+	unsigned long flags;
+	int cpu;
+
+	if (global_rt_runtime() != RUNTIME_INF)
+		new_bw = to_ratio(global_rt_period(), global_rt_runtime());
+
+	for_each_possible_cpu(cpu) {
+		struct dl_bw *dl_b;
+
+		rcu_read_lock_sched();
+		dl_b = dl_bw_of(cpu);
+
+		raw_spin_lock_irqsave(&dl_b->lock, flags);
+		dl_b->bw = new_bw;
+		raw_spin_unlock_irqrestore(&dl_b->lock, flags);
+
+		rcu_read_unlock_sched();
+	}
+}
+
 int sched_rt_handler(struct ctl_table *table, int write,
 		void __user *buffer, size_t *lenp,
 		loff_t *ppos)
@@ -7501,7 +8595,9 @@ int sched_rt_handler(struct ctl_table *table, int write,
 	ret = proc_dointvec(table, write, buffer, lenp, ppos);
 
 	if (!ret && write) {
-		ret = sched_rt_global_constraints();
+		ret = sched_dl_global_constraints();
+		if (!ret)
+			ret = sched_rt_global_constraints();
 		if (ret) {
 			sysctl_sched_rt_period = old_period;
 			sysctl_sched_rt_runtime = old_runtime;
@@ -7509,6 +8605,7 @@ int sched_rt_handler(struct ctl_table *table, int write,
 			def_rt_bandwidth.rt_runtime = global_rt_runtime();
 			def_rt_bandwidth.rt_period =
 				ns_to_ktime(global_rt_period());
+			sched_dl_do_global();
 		}
 	}
 	mutex_unlock(&mutex);
@@ -7516,6 +8613,39 @@ int sched_rt_handler(struct ctl_table *table, int write,
 	return ret;
 }
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+struct jump_label_key __sched_lat_hist;
+unsigned int sysctl_sched_latency_hist;
+/* clock at which the histograms were last enabled */
+u64 sched_lat_hist_start;
+
+int sched_latency_hist_handler(struct ctl_table *table, int write,
+		void __user *buffer, size_t *lenp,
+		loff_t *ppos)
+{
+	unsigned int old;
+	int ret;
+	static DEFINE_MUTEX(mutex);
+
+	mutex_lock(&mutex);
+	old = sysctl_sched_latency_hist;
+
+	ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+
+	if (!ret && write && sysctl_sched_latency_hist != old) {
+		if (sysctl_sched_latency_hist) {
+			sched_lat_hist_start = local_clock();
+			jump_label_inc(&__sched_lat_hist);
+		} else {
+			jump_label_dec(&__sched_lat_hist);
+		}
+	}
+	mutex_unlock(&mutex);
+
+	return ret;
+}
+#endif /* CONFIG_SCHED_LATENCY_HIST */
+
 #ifdef CONFIG_CGROUP_SCHED
 
 /* return corresponding task_group object of a cgroup */
@@ -7615,7 +8745,8 @@ const u64 min_cfs_quota_period = 1 * NSEC_PER_MSEC; /* 1ms */
 
 static int __cfs_schedulable(struct task_group *tg, u64 period, u64 runtime);
 
-static int tg_set_cfs_bandwidth(struct task_group *tg, u64 period, u64 quota)
+static int tg_set_cfs_bandwidth(struct task_group *tg, u64 period, u64 quota,
+				u64 burst)
 {
 	int i, ret = 0, runtime_enabled, runtime_was_enabled;
 	struct cfs_bandwidth *cfs_b = &tg->cfs_bandwidth;
@@ -7639,6 +8770,13 @@ static int tg_set_cfs_bandwidth(struct task_group *tg, u64 period, u64 quota)
 	if (period > max_cfs_quota_period)
 		return -EINVAL;
 
+	/*
+	 * The credit a group can accumulate is bounded by its quota, so that
+	 * a burst at most doubles what it may consume in one period.
+	 */
+	if (quota != RUNTIME_INF && burst > quota)
+		return -EINVAL;
+
 	mutex_lock(&cfs_constraints_mutex);
 	ret = __cfs_schedulable(tg, period, quota);
 	if (ret)
@@ -7650,7 +8788,11 @@ static int tg_set_cfs_bandwidth(struct task_group *tg, u64 period, u64 quota)
 	raw_spin_lock_irq(&cfs_b->lock);
 	cfs_b->period = ns_to_ktime(period);
 	cfs_b->quota = quota;
+	cfs_b->burst = burst;
 
+	/* start over from a single quota, without any credit */
+	cfs_b->runtime = 0;
+	cfs_b->runtime_snap = 0;
 	__refill_cfs_bandwidth_runtime(cfs_b);
 	/* restart the period timer (if active) to handle new period expiry */
 	if (runtime_enabled && cfs_b->timer_active) {
@@ -7680,15 +8822,16 @@ out_unlock:
 
 int tg_set_cfs_quota(struct task_group *tg, long cfs_quota_us)
 {
-	u64 quota, period;
+	u64 quota, period, burst;
 
 	period = ktime_to_ns(tg->cfs_bandwidth.period);
+	burst = tg->cfs_bandwidth.burst;
 	if (cfs_quota_us < 0)
 		quota = RUNTIME_INF;
 	else
 		quota = (u64)cfs_quota_us * NSEC_PER_USEC;
 
-	return tg_set_cfs_bandwidth(tg, period, quota);
+	return tg_set_cfs_bandwidth(tg, period, quota, burst);
 }
 
 long tg_get_cfs_quota(struct task_group *tg)
@@ -7706,12 +8849,13 @@ long tg_get_cfs_quota(struct task_group *tg)
 
 int tg_set_cfs_period(struct task_group *tg, long cfs_period_us)
 {
-	u64 quota, period;
+	u64 quota, period, burst;
 
 	period = (u64)cfs_period_us * NSEC_PER_USEC;
 	quota = tg->cfs_bandwidth.quota;
+	burst = tg->cfs_bandwidth.burst;
 
-	return tg_set_cfs_bandwidth(tg, period, quota);
+	return tg_set_cfs_bandwidth(tg, period, quota, burst);
 }
 
 long tg_get_cfs_period(struct task_group *tg)
@@ -7724,6 +8868,30 @@ long tg_get_cfs_period(struct task_group *tg)
 	return cfs_period_us;
 }
 
+int tg_set_cfs_burst(struct task_group *tg, long cfs_burst_us)
+{
+	u64 quota, period, burst;
+
+	if (cfs_burst_us < 0)
+		return -EINVAL;
+
+	period = ktime_to_ns(tg->cfs_bandwidth.period);
+	quota = tg->cfs_bandwidth.quota;
+	burst = (u64)cfs_burst_us * NSEC_PER_USEC;
+
+	return tg_set_cfs_bandwidth(tg, period, quota, burst);
+}
+
+long tg_get_cfs_burst(struct task_group *tg)
+{
+	u64 burst_us;
+
+	burst_us = tg->cfs_bandwidth.burst;
+	do_div(burst_us, NSEC_PER_USEC);
+
+	return burst_us;
+}
+
 static s64 cpu_cfs_quota_read_s64(struct cgroup *cgrp, struct cftype *cft)
 {
 	return tg_get_cfs_quota(cgroup_tg(cgrp));
@@ -7746,6 +8914,17 @@ static int cpu_cfs_period_write_u64(struct cgroup *cgrp, struct cftype *cftype,
 	return tg_set_cfs_period(cgroup_tg(cgrp), cfs_period_us);
 }
 
+static u64 cpu_cfs_burst_read_u64(struct cgroup *cgrp, struct cftype *cft)
+{
+	return tg_get_cfs_burst(cgroup_tg(cgrp));
+}
+
+static int cpu_cfs_burst_write_u64(struct cgroup *cgrp, struct cftype *cftype,
+				u64 cfs_burst_us)
+{
+	return tg_set_cfs_burst(cgroup_tg(cgrp), cfs_burst_us);
+}
+
 struct cfs_schedulable_data {
 	struct task_group *tg;
 	u64 period, quota;
@@ -7833,6 +9012,8 @@ static int cpu_stats_show(struct cgroup *cgrp, struct cftype *cft,
 	cb->fill(cb, "nr_periods", cfs_b->nr_periods);
 	cb->fill(cb, "nr_throttled", cfs_b->nr_throttled);
 	cb->fill(cb, "throttled_time", cfs_b->throttled_time);
+	cb->fill(cb, "nr_bursts", cfs_b->nr_burst);
+	cb->fill(cb, "burst_time", cfs_b->burst_time);
 
 	return 0;
 }
@@ -7863,6 +9044,82 @@ static u64 cpu_rt_period_read_uint(struct cgroup *cgrp, struct cftype *cft)
 }
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+#ifdef CONFIG_SCHED_CORE
+static u64 cpu_core_tag_read_u64(struct cgroup *cgrp, struct cftype *cft)
+{
+	return cgroup_tg(cgrp)->core_tagged;
+}
+
+static int cpu_core_tag_write_u64(struct cgroup *cgrp, struct cftype *cft,
+				  u64 tagged)
+{
+	if (tagged > 1)
+		return -ERANGE;
+
+	return sched_core_tag(cgroup_tg(cgrp), tagged);
+}
+
+static u64 cpu_core_forceidle_read_u64(struct cgroup *cgrp, struct cftype *cft)
+{
+	return atomic64_read(&cgroup_tg(cgrp)->core_forceidle_sum);
+}
+#endif /* CONFIG_SCHED_CORE */
+
+#ifdef CONFIG_SCHED_LATENCY_HIST
+enum {
+	SCHED_LAT_HIST_WAKEUP,
+	SCHED_LAT_HIST_WAIT,
+};
+
+static u64 *lat_hist_slots(struct task_group *tg, int cpu, int type)
+{
+	struct sched_lat_hist *hist = per_cpu_ptr(tg->lat_hist, cpu);
+
+	return type == SCHED_LAT_HIST_WAKEUP ? hist->wakeup : hist->wait;
+}
+
+/* One line per cpu, with the counts of the slots in increasing order */
+static int cpu_lat_hist_show(struct cgroup *cgrp, struct cftype *cft,
+			     struct seq_file *m)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+	int cpu, i;
+
+	for_each_online_cpu(cpu) {
+		u64 *slots = lat_hist_slots(tg, cpu, cft->private);
+
+		seq_printf(m, "cpu%d", cpu);
+		for (i = 0; i < SCHED_LAT_HIST_SLOTS; i++)
+			seq_printf(m, " %llu", (unsigned long long)slots[i]);
+		seq_putc(m, '\n');
+	}
+
+	return 0;
+}
+
+/* Writing 0 clears the histogram */
+static int cpu_lat_hist_reset(struct cgroup *cgrp, struct cftype *cft,
+			      u64 val)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+	int cpu;
+
+	if (val)
+		return -EINVAL;
+
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		raw_spin_lock_irq(&rq->lock);
+		memset(lat_hist_slots(tg, cpu, cft->private), 0,
+		       SCHED_LAT_HIST_SLOTS * sizeof(u64));
+		raw_spin_unlock_irq(&rq->lock);
+	}
+
+	return 0;
+}
+#endif /* CONFIG_SCHED_LATENCY_HIST */
+
 static struct cftype cpu_files[] = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	{
@@ -7882,6 +9139,11 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_cfs_period_read_u64,
 		.write_u64 = cpu_cfs_period_write_u64,
 	},
+	{
+		.name = "cfs_burst_us",
+		.read_u64 = cpu_cfs_burst_read_u64,
+		.write_u64 = cpu_cfs_burst_write_u64,
+	},
 	{
 		.name = "stat",
 		.read_map = cpu_stats_show,
@@ -7899,6 +9161,31 @@ static struct cftype cpu_files[] = {
 		.write_u64 = cpu_rt_period_write_uint,
 	},
 #endif
+#ifdef CONFIG_SCHED_CORE
+	{
+		.name = "core_tag",
+		.read_u64 = cpu_core_tag_read_u64,
+		.write_u64 = cpu_core_tag_write_u64,
+	},
+	{
+		.name = "core_forceidle_time",
+		.read_u64 = cpu_core_forceidle_read_u64,
+	},
+#endif
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	{
+		.name = "wakeup_latency_hist",
+		.read_seq_string = cpu_lat_hist_show,
+		.write_u64 = cpu_lat_hist_reset,
+		.private = SCHED_LAT_HIST_WAKEUP,
+	},
+	{
+		.name = "wait_latency_hist",
+		.read_seq_string = cpu_lat_hist_show,
+		.write_u64 = cpu_lat_hist_reset,
+		.private = SCHED_LAT_HIST_WAIT,
+	},
+#endif
 };
 
 static int cpu_cgroup_populate(struct cgroup_subsys *ss, struct cgroup *cont)
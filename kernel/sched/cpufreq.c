@@ -0,0 +1,28 @@
+/*
+ * Scheduler code and data structures related to cpufreq.
+ */
+
+#include <linux/module.h>
+
+#include "sched.h"
+
+DEFINE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_set_update_util_data - set the utilisation hook of a cpu
+ * @cpu: the cpu to set the hook of
+ * @data: the hook, or NULL to remove it
+ *
+ * The scheduler calls @data->func from cpufreq_update_util() on @cpu,
+ * with its rq->lock held, so it must not sleep.  Since it is called under
+ * rcu_read_lock_sched(), callers removing a hook must synchronize_sched()
+ * before freeing it.
+ */
+void cpufreq_set_update_util_data(int cpu, struct update_util_data *data)
+{
+	if (WARN_ON(data && !data->func))
+		return;
+
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+}
+EXPORT_SYMBOL_GPL(cpufreq_set_update_util_data);
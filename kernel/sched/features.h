@@ -66,5 +66,13 @@ SCHED_FEAT(NONTASK_POWER, true)
  */
 SCHED_FEAT(TTWU_QUEUE, true)
 
+/*
+ * When looking for an idle cpu to wake a task on, give up if the average
+ * idle time of this cpu is shorter than the average scan cost
+ * (SIS_AVG_CPU), or scan a number of cpus proportional to it (SIS_PROP).
+ */
+SCHED_FEAT(SIS_AVG_CPU, false)
+SCHED_FEAT(SIS_PROP, true)
+
 SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
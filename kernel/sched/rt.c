@@ -880,6 +880,10 @@ static void update_curr_rt(struct rq *rq)
 	if (curr->sched_class != &rt_sched_class)
 		return;
 
+	/* rt tasks run at the highest frequency */
+	if (cpu_of(rq) == smp_processor_id())
+		cpufreq_update_util(rq->clock, ULONG_MAX, 0);
+
 	delta_exec = rq->clock_task - curr->se.exec_start;
 	if (unlikely((s64)delta_exec < 0))
 		delta_exec = 0;
@@ -3,6 +3,8 @@
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/stop_machine.h>
+#include <linux/tick.h>
+#include <linux/jump_label.h>
 
 #include "cpupri.h"
 
@@ -59,6 +61,35 @@ static inline int task_has_rt_policy(struct task_struct *p)
 	return rt_policy(p->policy);
 }
 
+static inline int fair_policy(int policy)
+{
+	return policy == SCHED_NORMAL || policy == SCHED_BATCH;
+}
+
+static inline int dl_policy(int policy)
+{
+	return unlikely(policy == SCHED_DEADLINE);
+}
+
+static inline int task_has_dl_policy(struct task_struct *p)
+{
+	return dl_policy(p->policy);
+}
+
+static inline bool dl_time_before(u64 a, u64 b)
+{
+	return (s64)(a - b) < 0;
+}
+
+/*
+ * Tells if entity @a should preempt entity @b.
+ */
+static inline bool
+dl_entity_preempt(struct sched_dl_entity *a, struct sched_dl_entity *b)
+{
+	return dl_time_before(a->deadline, b->deadline);
+}
+
 /*
  * This is the priority-queue data structure of the RT scheduling class:
  */
@@ -75,6 +106,46 @@ struct rt_bandwidth {
 	struct hrtimer		rt_period_timer;
 };
 
+/*
+ * The bandwidth -deadline tasks may reserve: bw is the limit, total_bw
+ * what the admitted tasks add up to, both as fractions of a cpu scaled
+ * by 2^20 (see to_ratio()) and summed over the cpus they can run on.
+ * bw is -1 when there is no limit.
+ *
+ * It is kept per root_domain, as -deadline tasks are scheduled globally
+ * across the cpus of a root_domain, and per cpu on UP.
+ */
+struct dl_bw {
+	raw_spinlock_t lock;
+	u64 bw, total_bw;
+};
+
+/*
+ * -deadline times are scaled down by 2^DL_SCALE (about a microsecond)
+ * where their products could overflow, which is also the smallest
+ * runtime that can be asked for.
+ */
+#define DL_SCALE		10
+
+static inline
+void __dl_clear(struct dl_bw *dl_b, u64 tsk_bw)
+{
+	dl_b->total_bw -= tsk_bw;
+}
+
+static inline
+void __dl_add(struct dl_bw *dl_b, u64 tsk_bw)
+{
+	dl_b->total_bw += tsk_bw;
+}
+
+static inline
+bool __dl_overflow(struct dl_bw *dl_b, int cpus, u64 old_bw, u64 new_bw)
+{
+	return dl_b->bw != -1 &&
+	       dl_b->bw * cpus < dl_b->total_bw - old_bw + new_bw;
+}
+
 extern struct mutex sched_domains_mutex;
 
 #ifdef CONFIG_CGROUP_SCHED
@@ -90,21 +161,39 @@ struct cfs_bandwidth {
 #ifdef CONFIG_CFS_BANDWIDTH
 	raw_spinlock_t lock;
 	ktime_t period;
-	u64 quota, runtime;
+	u64 quota, runtime, burst;
 	s64 hierarchal_quota;
 	u64 runtime_expires;
+	u64 runtime_snap;
 
 	int idle, timer_active;
 	struct hrtimer period_timer, slack_timer;
 	struct list_head throttled_cfs_rq;
 
 	/* statistics */
-	int nr_periods, nr_throttled;
-	u64 throttled_time;
+	int nr_periods, nr_throttled, nr_burst;
+	u64 throttled_time, burst_time;
 #endif
 };
 
 /* task group related information */
+#ifdef CONFIG_SCHED_LATENCY_HIST
+/*
+ * Log-scale histograms of scheduling latencies: slot 0 counts those below
+ * 1us, slot n those from 2^(n-1)us to 2^n us, and the last slot all the
+ * longer ones.
+ */
+#define SCHED_LAT_HIST_SLOTS	24
+
+struct sched_lat_hist {
+	u64 wakeup[SCHED_LAT_HIST_SLOTS];	/* from wakeup to running */
+	u64 wait[SCHED_LAT_HIST_SLOTS];		/* runnable, not running */
+};
+
+extern struct jump_label_key __sched_lat_hist;
+extern u64 sched_lat_hist_start;
+#endif
+
 struct task_group {
 	struct cgroup_subsys_state css;
 
@@ -115,7 +204,10 @@ struct task_group {
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
 
-	atomic_t load_weight;
+#ifdef CONFIG_SMP
+	atomic64_t load_avg;
+	atomic_t runnable_avg;
+#endif
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -136,6 +228,18 @@ struct task_group {
 	struct autogroup *autogroup;
 #endif
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	struct sched_lat_hist __percpu *lat_hist;
+#endif
+
+#ifdef CONFIG_SCHED_CORE
+	int core_tagged;
+	/* the nearest tagged group, ourselves included, 0 if none */
+	unsigned long core_cookie;
+	/* time the siblings of our tasks were forced idle */
+	atomic64_t core_forceidle_sum;
+#endif
+
 	struct cfs_bandwidth cfs_bandwidth;
 };
 
@@ -229,6 +333,24 @@ struct cfs_rq {
 	unsigned int nr_spread_over;
 #endif
 
+#ifdef CONFIG_SMP
+	/*
+	 * CFS load tracking
+	 *
+	 * Under CFS, load is tracked on a per-entity basis and aggregated
+	 * up.  runnable_load_avg is the sum of the load contributions of the
+	 * entities queued here, blocked_load_avg that of the entities which
+	 * went to sleep on this cfs_rq and whose contribution is decayed
+	 * along with it, decay_counter counting the periods of that decay.
+	 * removed_load is the contribution of blocked entities which have
+	 * since migrated away, collected without our rq->lock.
+	 */
+	unsigned long runnable_load_avg, blocked_load_avg;
+	atomic64_t decay_counter;
+	u64 last_decay;
+	atomic_long_t removed_load;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	/* cpu runqueue to which this cfs_rq is attached */
 
@@ -251,7 +373,7 @@ struct cfs_rq {
 	unsigned long task_weight;
 
 	/*
-	 *   h_load = weight * f(tg)
+	 *   h_load = runnable_load_avg * f(tg)
 	 *
 	 * Where f(tg) is the recursive weight fraction assigned to
 	 * this group.
@@ -259,17 +381,11 @@ struct cfs_rq {
 	unsigned long h_load;
 
 	/*
-	 * Maintaining per-cpu shares distribution for group scheduling
-	 *
-	 * load_stamp is the last time we updated the load average
-	 * load_last is the last time we updated the load average and saw load
-	 * load_unacc_exec_time is currently unaccounted execution time
+	 * This cpu's share of tg->load_avg and tg->runnable_avg, as last
+	 * folded into them.
 	 */
-	u64 load_avg;
-	u64 load_period;
-	u64 load_stamp, load_last, load_unacc_exec_time;
-
-	unsigned long load_contribution;
+	unsigned long tg_load_contrib;
+	u32 tg_runnable_contrib;
 #endif /* CONFIG_SMP */
 #ifdef CONFIG_CFS_BANDWIDTH
 	int runtime_enabled;
@@ -277,6 +393,8 @@ struct cfs_rq {
 	s64 runtime_remaining;
 
 	u64 throttled_timestamp;
+	/* clock_task time spent throttled, which load tracking skips */
+	u64 throttled_clock_task, throttled_clock_task_time;
 	int throttled, throttle_count;
 	struct list_head throttled_list;
 #endif /* CONFIG_CFS_BANDWIDTH */
@@ -321,6 +439,41 @@ struct rt_rq {
 #endif
 };
 
+/* Deadline class' related fields in a runqueue */
+struct dl_rq {
+	/* runqueue is an rbtree, ordered by deadline */
+	struct rb_root rb_root;
+	struct rb_node *rb_leftmost;
+
+	unsigned long dl_nr_running;
+
+#ifdef CONFIG_SMP
+	/*
+	 * The earliest and second earliest deadline queued on this rq,
+	 * 0 if there is none. Caching these facilitates the decision
+	 * whether or not a ready but not running task should migrate
+	 * somewhere else.
+	 */
+	struct {
+		u64 curr;
+		u64 next;
+	} earliest_dl;
+
+	unsigned long dl_nr_migratory;
+	int overloaded;
+
+	/*
+	 * Tasks on this rq that can be pushed away. They are kept in
+	 * an rb-tree, ordered by tasks' deadlines, with caching
+	 * of the leftmost (earliest deadline) element.
+	 */
+	struct rb_root pushable_dl_tasks_root;
+	struct rb_node *pushable_dl_tasks_leftmost;
+#else
+	struct dl_bw dl_bw;
+#endif
+};
+
 #ifdef CONFIG_SMP
 
 /*
@@ -344,6 +497,14 @@ struct root_domain {
 	 */
 	cpumask_var_t rto_mask;
 	struct cpupri cpupri;
+
+	/*
+	 * The bit corresponding to a CPU gets set here if such CPU has more
+	 * than one runnable -deadline task (as it is below for RT tasks).
+	 */
+	cpumask_var_t dlo_mask;
+	atomic_t dlo_count;
+	struct dl_bw dl_bw;
 };
 
 extern struct root_domain def_root_domain;
@@ -372,6 +533,9 @@ struct rq {
 #ifdef CONFIG_NO_HZ
 	u64 nohz_stamp;
 	unsigned long nohz_flags;
+#endif
+#ifdef CONFIG_NO_HZ_FULL
+	unsigned long last_sched_tick;
 #endif
 	int skip_clock_update;
 
@@ -382,6 +546,7 @@ struct rq {
 
 	struct cfs_rq cfs;
 	struct rt_rq rt;
+	struct dl_rq dl;
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
@@ -428,6 +593,9 @@ struct rq {
 	u64 age_stamp;
 	u64 idle_stamp;
 	u64 avg_idle;
+
+	/* how often this cpu has had anything to run */
+	struct sched_avg avg;
 #endif
 
 #ifdef CONFIG_IRQ_TIME_ACCOUNTING
@@ -469,11 +637,34 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* select_idle_sibling() stats */
+	unsigned int sis_search;
+	unsigned int sis_scanned;
+	unsigned int sis_failed;
 #endif
 
 #ifdef CONFIG_SMP
 	struct llist_head wake_list;
 #endif
+
+#ifdef CONFIG_SCHED_CORE
+	/* the rq of the first sibling, which holds the core-wide state */
+	struct rq *core;
+	raw_spinlock_t core_lock;
+	unsigned long core_owner;
+	u64 core_owner_start;
+
+	/* what this cpu runs, protected by the core_lock */
+	unsigned long core_cookie;
+	unsigned char core_busy;
+	unsigned char core_rt;
+	unsigned char core_forceidle;
+	unsigned char core_kick;
+	u64 core_forceidle_start;
+	u64 core_forceidle_sum;
+	u64 core_tick;
+#endif
 };
 
 static inline int cpu_of(struct rq *rq)
@@ -536,6 +727,25 @@ static inline struct sched_domain *highest_flag_domain(int cpu, int flag)
 
 DECLARE_PER_CPU(struct sched_domain *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_id);
+DECLARE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
+
+#ifdef CONFIG_SCHED_SMT
+static inline const struct cpumask *cpu_smt_mask(int cpu)
+{
+	return topology_thread_cpumask(cpu);
+}
+
+extern struct jump_label_key sched_smt_present;
+
+extern void update_idle_core(struct rq *rq);
+#else
+static inline void update_idle_core(struct rq *rq) { }
+#endif
+
+#ifdef CONFIG_SCHED_CORE
+extern struct task_struct *pick_next_task_fair_cookie(struct rq *rq,
+						      unsigned long cookie);
+#endif
 
 #endif /* CONFIG_SMP */
 
@@ -669,7 +879,50 @@ static inline u64 global_rt_runtime(void)
 	return (u64)sysctl_sched_rt_runtime * NSEC_PER_USEC;
 }
 
+/*
+ * The -deadline bandwidth accounting of cpu @i, and the number of cpus
+ * it is shared by.
+ */
+#ifdef CONFIG_SMP
+static inline struct dl_bw *dl_bw_of(int i)
+{
+	return &cpu_rq(i)->rd->dl_bw;
+}
+
+static inline int dl_bw_cpus(int i)
+{
+	return cpumask_weight(cpu_rq(i)->rd->span);
+}
+#else
+static inline struct dl_bw *dl_bw_of(int i)
+{
+	return &cpu_rq(i)->dl.dl_bw;
+}
+
+static inline int dl_bw_cpus(int i)
+{
+	return 1;
+}
+#endif
+
 
+/*
+ * task_struct::on_rq states.  A runnable task the load balancer is moving
+ * is off the runqueue of its old cpu, but not yet on that of the new one;
+ * task_rq_lock() waits for it to get there.
+ */
+#define TASK_ON_RQ_QUEUED	1
+#define TASK_ON_RQ_MIGRATING	2
+
+static inline int task_on_rq_queued(struct task_struct *p)
+{
+	return p->on_rq == TASK_ON_RQ_QUEUED;
+}
+
+static inline int task_on_rq_migrating(struct task_struct *p)
+{
+	return p->on_rq == TASK_ON_RQ_MIGRATING;
+}
 
 static inline int task_current(struct rq *rq, struct task_struct *p)
 {
@@ -852,6 +1105,7 @@ enum cpuacct_stat_index {
    for (class = sched_class_highest; class; class = class->next)
 
 extern const struct sched_class stop_sched_class;
+extern const struct sched_class dl_sched_class;
 extern const struct sched_class rt_sched_class;
 extern const struct sched_class fair_sched_class;
 extern const struct sched_class idle_sched_class;
@@ -875,6 +1129,7 @@ extern void sched_init_granularity(void);
 extern void update_max_interval(void);
 extern void update_group_power(struct sched_domain *sd, int cpu);
 extern int update_runtime(struct notifier_block *nfb, unsigned long action, void *hcpu);
+extern void init_sched_dl_class(void);
 extern void init_sched_rt_class(void);
 extern void init_sched_fair_class(void);
 
@@ -884,6 +1139,11 @@ extern void resched_cpu(int cpu);
 extern struct rt_bandwidth def_rt_bandwidth;
 extern void init_rt_bandwidth(struct rt_bandwidth *rt_b, u64 period, u64 runtime);
 
+extern void init_dl_bw(struct dl_bw *dl_b);
+extern void init_dl_task_timer(struct sched_dl_entity *dl_se);
+
+unsigned long to_ratio(u64 period, u64 runtime);
+
 extern void update_cpu_load(struct rq *this_rq);
 
 #ifdef CONFIG_CGROUP_CPUACCT
@@ -925,6 +1185,16 @@ static inline void cpuacct_charge(struct task_struct *tsk, u64 cputime) {}
 static inline void inc_nr_running(struct rq *rq)
 {
 	rq->nr_running++;
+
+#ifdef CONFIG_NO_HZ_FULL
+	if (rq->nr_running == 2) {
+		if (tick_nohz_full_cpu(rq->cpu)) {
+			/* Order rq->nr_running write against the IPI */
+			smp_wmb();
+			tick_nohz_full_kick_cpu(rq->cpu);
+		}
+	}
+#endif
 }
 
 static inline void dec_nr_running(struct rq *rq)
@@ -932,6 +1202,42 @@ static inline void dec_nr_running(struct rq *rq)
 	rq->nr_running--;
 }
 
+#ifdef CONFIG_SMP
+extern void idle_enter_fair(struct rq *this_rq);
+extern void idle_exit_fair(struct rq *this_rq);
+#else
+static inline void idle_enter_fair(struct rq *rq) { }
+static inline void idle_exit_fair(struct rq *rq) { }
+#endif
+
+#ifdef CONFIG_CPU_FREQ
+DECLARE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/*
+ * Pass the utilisation of this cpu on to the cpufreq governor, if it
+ * wants it.  Called on the cpu itself, with its rq->lock held.
+ */
+static inline void cpufreq_update_util(u64 time, unsigned long util,
+				       unsigned long max)
+{
+	struct update_util_data *data;
+
+	data = rcu_dereference_sched(__get_cpu_var(cpufreq_update_util_data));
+	if (data)
+		data->func(data, time, util, max);
+}
+#else
+static inline void cpufreq_update_util(u64 time, unsigned long util,
+				       unsigned long max) { }
+#endif
+
+static inline void rq_last_tick_reset(struct rq *rq)
+{
+#ifdef CONFIG_NO_HZ_FULL
+	rq->last_sched_tick = jiffies;
+#endif
+}
+
 extern void update_rq_clock(struct rq *rq);
 
 extern void activate_task(struct rq *rq, struct task_struct *p, int flags);
@@ -1151,6 +1457,7 @@ extern void print_rt_stats(struct seq_file *m, int cpu);
 
 extern void init_cfs_rq(struct cfs_rq *cfs_rq);
 extern void init_rt_rq(struct rt_rq *rt_rq, struct rq *rq);
+extern void init_dl_rq(struct dl_rq *dl_rq, struct rq *rq);
 extern void unthrottle_offline_cfs_rqs(struct rq *rq);
 
 extern void account_cfs_bandwidth_used(int enabled, int was_enabled);
@@ -756,6 +756,15 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	    !tbase_get_deferrable(timer->base))
 		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
+	/*
+	 * A full dynticks CPU may have stopped its tick while running a
+	 * task: make it take the new timer into account.  This CPU only
+	 * needs that if its tick is stopped already, otherwise the timer
+	 * is seen when it next decides whether to stop it.
+	 */
+	if (!tbase_get_deferrable(timer->base) && tick_nohz_full_cpu(cpu) &&
+	    (cpu != smp_processor_id() || tick_nohz_tick_stopped()))
+		tick_nohz_full_kick_cpu(cpu);
 
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
@@ -926,7 +935,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	 * makes sure that a CPU on the way to idle can not evaluate
 	 * the timer wheel.
 	 */
-	wake_up_idle_cpu(cpu);
+	wake_up_nohz_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
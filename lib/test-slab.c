@@ -0,0 +1,410 @@
+/*
+ * Measure the cost of allocating and freeing slab objects, to compare
+ * slab allocators and their tunables.
+ *
+ * For each object size and batch size, a thread bound to each of 1, 2,
+ * 4, ... cpus allocates nr_objects objects, one at a time or with
+ * kmem_cache_alloc_bulk(), and then frees either its own objects, those
+ * of a thread on another cpu, or those of a thread on another node.  The
+ * cycles per object are printed, averaged and at worst over the threads,
+ * together with how much slower the average is than with a single
+ * thread freeing its own objects, which is the cost of contention on the
+ * allocator's shared locks and cache lines.
+ *
+ * Loading the module runs the tests; it then fails to load so that it can
+ * be run again.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/timex.h>
+#include <linux/vmalloc.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpu.h>
+#include <linux/atomic.h>
+#include <linux/math64.h>
+
+static unsigned int nr_objects = 8192;
+module_param(nr_objects, uint, 0444);
+MODULE_PARM_DESC(nr_objects, "Number of objects allocated per thread");
+
+static unsigned int max_threads;
+module_param(max_threads, uint, 0444);
+MODULE_PARM_DESC(max_threads, "Largest number of threads (default: all cpus)");
+
+static const unsigned int test_sizes[] = { 16, 64, 256, 1024, 4096 };
+/* A batch of 1 uses kmem_cache_alloc() and kmem_cache_free() */
+static const unsigned int test_batches[] = { 1, 16, 64, 256 };
+
+enum test_slab_mode {
+	TEST_LOCAL,		/* free own objects */
+	TEST_REMOTE_CPU,	/* free those of a thread on another cpu */
+	TEST_REMOTE_NODE,	/* free those of a thread on another node */
+	NR_TEST_MODES
+};
+
+static const char * const test_mode_names[] = {
+	[TEST_LOCAL]		= "local",
+	[TEST_REMOTE_CPU]	= "remote cpu",
+	[TEST_REMOTE_NODE]	= "remote node",
+};
+
+struct test_slab_run;
+
+struct test_slab_thread {
+	struct test_slab_run *run;
+	int cpu;
+	void **objs;
+	unsigned int nr_alloced;
+	struct test_slab_thread *victim;	/* whose objects to free */
+	cycles_t alloc, free;
+};
+
+/* Cycles per object, averaged over the threads and for the slowest one */
+struct test_slab_result {
+	unsigned long alloc, free;
+	unsigned long alloc_max, free_max;
+};
+
+struct test_slab_run {
+	struct kmem_cache *s;
+	unsigned int batch;
+	unsigned int nr_threads;
+	atomic_t started;
+	atomic_t alloced;
+	atomic_t running;
+	struct completion done;
+};
+
+/* The cpus to run threads on, alternating between the nodes */
+static int *test_cpus;
+static struct test_slab_thread *test_threads;
+
+static void test_slab_sync(atomic_t *count, unsigned int nr_threads)
+{
+	atomic_inc(count);
+	while (atomic_read(count) < nr_threads)
+		cpu_relax();
+}
+
+static unsigned int test_slab_alloc(struct test_slab_run *run, void **objs)
+{
+	unsigned int i, nr;
+
+	if (run->batch == 1) {
+		for (i = 0; i < nr_objects; i++) {
+			objs[i] = kmem_cache_alloc(run->s, GFP_KERNEL);
+			if (!objs[i])
+				break;
+		}
+		return i;
+	}
+
+	for (i = 0; i < nr_objects; i += nr) {
+		nr = min(run->batch, nr_objects - i);
+		if (!kmem_cache_alloc_bulk(run->s, GFP_KERNEL, nr, objs + i))
+			break;
+	}
+	return i;
+}
+
+static void test_slab_free(struct test_slab_run *run, void **objs,
+			   unsigned int nr_objs)
+{
+	unsigned int i, nr;
+
+	if (run->batch == 1) {
+		for (i = 0; i < nr_objs; i++)
+			kmem_cache_free(run->s, objs[i]);
+		return;
+	}
+
+	for (i = 0; i < nr_objs; i += nr) {
+		nr = min(run->batch, nr_objs - i);
+		kmem_cache_free_bulk(run->s, nr, objs + i);
+	}
+}
+
+static int test_slab_thread(void *arg)
+{
+	struct test_slab_thread *t = arg;
+	struct test_slab_run *run = t->run;
+	cycles_t start;
+
+	test_slab_sync(&run->started, run->nr_threads);
+
+	start = get_cycles();
+	t->nr_alloced = test_slab_alloc(run, t->objs);
+	t->alloc = get_cycles() - start;
+
+	/* The victim's objects must all be there before freeing them */
+	test_slab_sync(&run->alloced, run->nr_threads);
+
+	start = get_cycles();
+	test_slab_free(run, t->victim->objs, t->victim->nr_alloced);
+	t->free = get_cycles() - start;
+
+	if (atomic_dec_and_test(&run->running))
+		complete(&run->done);
+	return 0;
+}
+
+/*
+ * Pick the thread whose objects each thread frees.  The victims must be a
+ * permutation of the threads, or some objects would be freed twice and
+ * others never.  On another cpu, each thread frees those of the next one.
+ * On another node, the threads are paired off across nodes and swap their
+ * objects.  Returns false if the mode cannot be tested with this many
+ * threads.
+ */
+static bool test_slab_victims(unsigned int nr_threads,
+			      enum test_slab_mode mode)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < nr_threads; i++)
+		test_threads[i].victim = NULL;
+
+	switch (mode) {
+	case TEST_LOCAL:
+		for (i = 0; i < nr_threads; i++)
+			test_threads[i].victim = &test_threads[i];
+		break;
+	case TEST_REMOTE_CPU:
+		if (nr_threads < 2)
+			return false;
+		for (i = 0; i < nr_threads; i++)
+			test_threads[i].victim =
+				&test_threads[(i + 1) % nr_threads];
+		break;
+	default:
+		for (i = 0; i < nr_threads; i++) {
+			struct test_slab_thread *t = &test_threads[i];
+
+			if (t->victim)
+				continue;
+			for (j = i + 1; j < nr_threads; j++) {
+				struct test_slab_thread *v = &test_threads[j];
+
+				if (!v->victim &&
+				    cpu_to_node(v->cpu) != cpu_to_node(t->cpu)) {
+					t->victim = v;
+					v->victim = t;
+					break;
+				}
+			}
+			if (!t->victim)
+				return false;
+		}
+		break;
+	}
+
+	/* Each thread must be the victim of exactly one */
+	for (i = 0; i < nr_threads; i++) {
+		unsigned int n = 0;
+
+		for (j = 0; j < nr_threads; j++)
+			if (test_threads[j].victim == &test_threads[i])
+				n++;
+		if (WARN_ON(n != 1))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Run one test.  Returns false if the mode cannot be tested with this
+ * many threads, or if allocations failed.
+ */
+static bool test_slab_run(struct kmem_cache *s, unsigned int batch,
+			  unsigned int nr_threads, enum test_slab_mode mode,
+			  struct test_slab_result *res)
+{
+	struct test_slab_run run = {
+		.s = s,
+		.batch = batch,
+		.nr_threads = nr_threads,
+		.started = ATOMIC_INIT(0),
+		.alloced = ATOMIC_INIT(0),
+		.running = ATOMIC_INIT(nr_threads),
+	};
+	cycles_t alloc = 0, free = 0, alloc_max = 0, free_max = 0;
+	unsigned int i, j;
+	bool ok = true;
+
+	if (!test_slab_victims(nr_threads, mode))
+		return false;
+
+	init_completion(&run.done);
+	for (i = 0; i < nr_threads; i++) {
+		struct test_slab_thread *t = &test_threads[i];
+		struct task_struct *task;
+
+		t->run = &run;
+		task = kthread_create(test_slab_thread, t, "test_slab/%d",
+				      t->cpu);
+		if (IS_ERR(task)) {
+			/* Stand in for the missing threads */
+			for (j = i; j < nr_threads; j++) {
+				test_threads[j].nr_alloced = 0;
+				test_threads[j].alloc = 0;
+				test_threads[j].free = 0;
+			}
+			atomic_add(nr_threads - i, &run.started);
+			atomic_add(nr_threads - i, &run.alloced);
+			if (atomic_sub_and_test(nr_threads - i, &run.running))
+				complete(&run.done);
+			ok = false;
+			break;
+		}
+		kthread_bind(task, t->cpu);
+		wake_up_process(task);
+	}
+	wait_for_completion(&run.done);
+
+	/* Free what the threads that did not start would have freed */
+	for (j = i; j < nr_threads; j++)
+		test_slab_free(&run, test_threads[j].victim->objs,
+			       test_threads[j].victim->nr_alloced);
+
+	for (i = 0; i < nr_threads; i++) {
+		struct test_slab_thread *t = &test_threads[i];
+
+		if (t->nr_alloced < nr_objects)
+			ok = false;
+		alloc += t->alloc;
+		free += t->free;
+		alloc_max = max(alloc_max, t->alloc);
+		free_max = max(free_max, t->free);
+	}
+	res->alloc = div64_u64(alloc, (u64)nr_threads * nr_objects);
+	res->free = div64_u64(free, (u64)nr_threads * nr_objects);
+	res->alloc_max = div64_u64(alloc_max, nr_objects);
+	res->free_max = div64_u64(free_max, nr_objects);
+
+	return ok;
+}
+
+/* 1, 2, 4, ... threads, and finally max_threads */
+static unsigned int test_slab_next_threads(unsigned int nr_threads)
+{
+	if (nr_threads == max_threads)
+		return max_threads + 1;
+	return min(nr_threads * 2, max_threads);
+}
+
+static void test_slab_size(unsigned int size)
+{
+	struct kmem_cache *s;
+	struct test_slab_result res;
+	unsigned int i, nr_threads, mode;
+
+	s = kmem_cache_create("test_slab", size, 0, 0, NULL);
+	if (!s)
+		return;
+
+	/* Populate the cache so that page allocation is not timed */
+	test_slab_run(s, 1, 1, TEST_LOCAL, &res);
+
+	for (i = 0; i < ARRAY_SIZE(test_batches); i++) {
+		unsigned long base_alloc = 0, base_free = 0;
+
+		for (nr_threads = 1; nr_threads <= max_threads;
+		     nr_threads = test_slab_next_threads(nr_threads)) {
+			for (mode = 0; mode < NR_TEST_MODES; mode++) {
+				unsigned long alloc_x, free_x;
+
+				if (!test_slab_run(s, test_batches[i],
+						   nr_threads, mode, &res))
+					continue;
+
+				/* Slowdown against one thread, in percent */
+				if (!base_alloc) {
+					base_alloc = max(res.alloc, 1UL);
+					base_free = max(res.free, 1UL);
+				}
+				alloc_x = res.alloc * 100 / base_alloc;
+				free_x = res.free * 100 / base_free;
+
+				printk(KERN_INFO "test_slab: size %4u batch "
+				       "%3u threads %3u %-11s: alloc %5lu "
+				       "(max %5lu, x%lu.%02lu) free %5lu "
+				       "(max %5lu, x%lu.%02lu)\n",
+				       size, test_batches[i], nr_threads,
+				       test_mode_names[mode],
+				       res.alloc, res.alloc_max,
+				       alloc_x / 100, alloc_x % 100,
+				       res.free, res.free_max,
+				       free_x / 100, free_x % 100);
+			}
+		}
+	}
+
+	kmem_cache_destroy(s);
+}
+
+static int __init test_slab_init(void)
+{
+	unsigned int i, nr_cpus = 0;
+	int ret = -EAGAIN;
+	int node, cpu;
+
+	if (!nr_objects)
+		return -EINVAL;
+
+	get_online_cpus();
+	if (!max_threads || max_threads > num_online_cpus())
+		max_threads = num_online_cpus();
+
+	test_cpus = kcalloc(max_threads, sizeof(int), GFP_KERNEL);
+	test_threads = kcalloc(max_threads, sizeof(*test_threads), GFP_KERNEL);
+	if (!test_cpus || !test_threads) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* Take a cpu of each node in turn */
+	for (i = 0; nr_cpus < max_threads && i < nr_cpu_ids; i++) {
+		for_each_node(node) {
+			unsigned int n = 0;
+
+			for_each_cpu_and(cpu, cpumask_of_node(node),
+					 cpu_online_mask) {
+				if (n++ != i)
+					continue;
+				if (nr_cpus < max_threads)
+					test_cpus[nr_cpus++] = cpu;
+				break;
+			}
+		}
+	}
+
+	max_threads = nr_cpus;
+	for (i = 0; i < max_threads; i++) {
+		test_threads[i].cpu = test_cpus[i];
+		test_threads[i].objs = vmalloc(nr_objects * sizeof(void *));
+		if (!test_threads[i].objs) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	printk(KERN_INFO "test_slab: cycles per object, %u objects per "
+	       "thread, on up to %u cpus of %u nodes\n", nr_objects,
+	       max_threads, num_online_nodes());
+	for (i = 0; i < ARRAY_SIZE(test_sizes); i++)
+		test_slab_size(test_sizes[i]);
+
+out:
+	if (test_threads)
+		for (i = 0; i < max_threads; i++)
+			vfree(test_threads[i].objs);
+	kfree(test_threads);
+	kfree(test_cpus);
+	put_online_cpus();
+	return ret;
+}
+module_init(test_slab_init);
+MODULE_LICENSE("GPL");
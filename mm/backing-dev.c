@@ -100,6 +100,10 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "BdiDirtied:         %10lu kB\n"
 		   "BdiWritten:         %10lu kB\n"
 		   "BdiWriteBandwidth:  %10lu kBps\n"
+		   "BdiReadahead:       %10lu kB\n"
+		   "BdiReadaheadWasted: %10lu kB\n"
+		   "BdiReadBandwidth:   %10lu kBps\n"
+		   "BdiReadLatency:     %10lu us\n"
 		   "b_dirty:            %10lu\n"
 		   "b_io:               %10lu\n"
 		   "b_more_io:          %10lu\n"
@@ -113,6 +117,10 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   (unsigned long) K(bdi_stat(bdi, BDI_DIRTIED)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
 		   (unsigned long) K(bdi->write_bandwidth),
+		   (unsigned long) K(bdi_stat(bdi, BDI_READAHEAD)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_READAHEAD_WASTED)),
+		   (unsigned long) K(bdi->ra_bandwidth),
+		   bdi->ra_latency,
 		   nr_dirty,
 		   nr_io,
 		   nr_more_io,
@@ -700,6 +708,11 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->write_bandwidth = INIT_BW;
 	bdi->avg_write_bandwidth = INIT_BW;
 
+	bdi->ra_time_stamp = jiffies;
+	bdi->ra_stamp = 0;
+	bdi->ra_bandwidth = 0;
+	bdi->ra_latency = 0;
+
 	err = prop_local_init_percpu(&bdi->completions);
 
 	if (err) {
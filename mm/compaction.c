@@ -14,6 +14,9 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/cpu.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -35,11 +38,78 @@ struct compact_control {
 	unsigned long migrate_pfn;	/* isolate_migratepages search base */
 	bool sync;			/* Synchronous migration */
 
+	bool proactive;			/* Stop at the proactive low mark */
+	unsigned long nr_migrated;	/* Number of pages migrated */
+
 	unsigned int order;		/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
 	struct zone *zone;
 };
 
+/*
+ * Proactive compaction aims at keeping the free memory of a node in blocks
+ * of this order, which is what huge page allocations need.
+ */
+#define COMPACTION_HPAGE_ORDER	pageblock_order
+
+/*
+ * How hard kcompactd works to keep free memory unfragmented, from 0 (no
+ * proactive compaction) to 100.
+ */
+int sysctl_compaction_proactiveness = 20;
+
+/*
+ * The fragmentation score of a zone is the share of its free memory that
+ * is in blocks too small for COMPACTION_HPAGE_ORDER, weighted by the share
+ * of the node's memory the zone holds, so that the zone scores of a node
+ * add up to a value between 0 and 100.
+ */
+static unsigned int fragmentation_score_zone(struct zone *zone)
+{
+	u64 score;
+
+	score = (u64)zone->present_pages *
+			extfrag_for_order(zone, COMPACTION_HPAGE_ORDER);
+	return div64_u64(score, zone->zone_pgdat->node_present_pages + 1);
+}
+
+static unsigned int fragmentation_score_node(pg_data_t *pgdat)
+{
+	unsigned int score = 0;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (populated_zone(zone))
+			score += fragmentation_score_zone(zone);
+	}
+
+	return score;
+}
+
+/*
+ * Proactive compaction starts when the score of a node is above the high
+ * mark and stops when it is back at the low mark.
+ */
+static unsigned int fragmentation_score_wmark(bool low)
+{
+	unsigned int wmark_low = 100 - sysctl_compaction_proactiveness;
+
+	return low ? wmark_low : min(wmark_low + 10, 100U);
+}
+
+static bool should_proactive_compact_node(pg_data_t *pgdat)
+{
+	/* Leave the node alone while kswapd is reclaiming from it */
+	if (!sysctl_compaction_proactiveness ||
+	    (pgdat->kswapd && pgdat->kswapd->state == TASK_RUNNING))
+		return false;
+
+	return fragmentation_score_node(pgdat) >
+				fragmentation_score_wmark(false);
+}
+
 static unsigned long release_freepages(struct list_head *freelist)
 {
 	struct page *page, *next;
@@ -464,10 +534,17 @@ static int compact_finished(struct zone *zone,
 
 	/*
 	 * order == -1 is expected when compacting via
-	 * /proc/sys/vm/compact_memory
+	 * /proc/sys/vm/compact_memory or proactively by kcompactd, which
+	 * stops at a pageblock boundary once the node is defragmented enough
 	 */
-	if (cc->order == -1)
+	if (cc->order == -1) {
+		if (cc->proactive &&
+		    !(cc->migrate_pfn & (pageblock_nr_pages - 1)) &&
+		    fragmentation_score_node(zone->zone_pgdat) <=
+					fragmentation_score_wmark(true))
+			return COMPACT_PARTIAL;
 		return COMPACT_CONTINUE;
+	}
 
 	/* Compaction run is not finished if the watermark is not met */
 	watermark = low_wmark_pages(zone);
@@ -585,6 +662,7 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 
 		count_vm_event(COMPACTBLOCKS);
 		count_vm_events(COMPACTPAGES, nr_migrate - nr_remaining);
+		cc->nr_migrated += nr_migrate - nr_remaining;
 		if (nr_remaining)
 			count_vm_events(COMPACTPAGEFAILED, nr_remaining);
 		trace_mm_compaction_migratepages(nr_migrate - nr_remaining,
@@ -745,6 +823,317 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/* Wake kcompactd so that a changed proactiveness takes effect at once */
+int sysctl_compaction_proactiveness_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret, nid;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	for_each_node_state(nid, N_HIGH_MEMORY) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		if (pgdat->kcompactd)
+			wake_up_interruptible(&pgdat->kcompactd_wait);
+	}
+
+	return 0;
+}
+
+/* How often kcompactd checks whether to compact proactively */
+#define KCOMPACTD_PROACTIVE_INTERVAL	msecs_to_jiffies(500)
+
+static bool kcompactd_work_requested(pg_data_t *pgdat)
+{
+	return pgdat->kcompactd_max_order > 0 || kthread_should_stop();
+}
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= pgdat->kcompactd_classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_suitable(zone, pgdat->kcompactd_max_order) ==
+							COMPACT_CONTINUE)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Compact the zones of a node for the order kswapd was woken for, the way
+ * direct compaction would, but from the node's own kcompactd thread.
+ */
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int zoneid;
+	struct zone *zone;
+	int classzone_idx = pgdat->kcompactd_classzone_idx;
+	struct compact_control cc = {
+		.order = pgdat->kcompactd_max_order,
+		.migratetype = MIGRATE_MOVABLE,
+		.sync = true,
+	};
+
+	count_vm_event(KCOMPACTD_WAKE);
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		int status;
+
+		zone = &pgdat->node_zones[zoneid];
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_deferred(zone))
+			continue;
+
+		if (compaction_suitable(zone, cc.order) != COMPACT_CONTINUE)
+			continue;
+
+		if (kthread_should_stop())
+			break;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		status = compact_zone(zone, &cc);
+
+		if (zone_watermark_ok(zone, cc.order, low_wmark_pages(zone),
+				      0, 0)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+		} else if (status == COMPACT_COMPLETE) {
+			/*
+			 * The whole zone was scanned without freeing a page of
+			 * the order, so back off like direct compaction does.
+			 */
+			defer_compaction(zone);
+		}
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+
+	count_vm_events(KCOMPACTD_MIGRATED, cc.nr_migrated);
+
+	/*
+	 * Leave a request for a larger order or a lower zone that came in
+	 * meanwhile for the next round.
+	 */
+	if (pgdat->kcompactd_max_order <= cc.order)
+		pgdat->kcompactd_max_order = 0;
+	if (pgdat->kcompactd_classzone_idx >= classzone_idx)
+		pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+}
+
+/*
+ * Compact the zones of a node until its fragmentation score is back at
+ * the proactive low mark, regardless of any pending allocation.
+ */
+static void proactive_compact_node(pg_data_t *pgdat)
+{
+	int zoneid;
+	struct zone *zone;
+	struct compact_control cc = {
+		.order = -1,
+		.sync = true,
+		.proactive = true,
+	};
+
+	count_vm_event(KCOMPACTD_PROACTIVE);
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+		if (!populated_zone(zone))
+			continue;
+
+		/* Migration needs free pages to copy into */
+		if (!zone_watermark_ok(zone, 0, low_wmark_pages(zone) +
+				(2UL << COMPACTION_HPAGE_ORDER), 0, 0))
+			continue;
+
+		if (kthread_should_stop())
+			break;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		compact_zone(zone, &cc);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+
+	count_vm_events(KCOMPACTD_MIGRATED, cc.nr_migrated);
+}
+
+/*
+ * The background compaction daemon, one per node.  It is woken by kswapd
+ * to compact for the high-order allocation kswapd reclaimed for, and
+ * wakes up periodically to compact proactively when the free memory of
+ * the node gets too fragmented.
+ */
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	struct task_struct *tsk = current;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	unsigned int proactive_defer = 0;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+	while (!kthread_should_stop()) {
+		long timeout = MAX_SCHEDULE_TIMEOUT;
+
+		if (sysctl_compaction_proactiveness)
+			timeout = KCOMPACTD_PROACTIVE_INTERVAL;
+
+		if (wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				kcompactd_work_requested(pgdat), timeout)) {
+			if (kthread_should_stop())
+				break;
+			kcompactd_do_work(pgdat);
+			continue;
+		}
+
+		/*
+		 * Timed out: compact proactively, unless the last proactive
+		 * round did not lower the score, in which case further rounds
+		 * are unlikely to do better for a while either.
+		 */
+		if (proactive_defer) {
+			proactive_defer--;
+			continue;
+		}
+
+		if (should_proactive_compact_node(pgdat)) {
+			unsigned int prev_score, score;
+
+			prev_score = fragmentation_score_node(pgdat);
+			proactive_compact_node(pgdat);
+			score = fragmentation_score_node(pgdat);
+			if (score >= prev_score)
+				proactive_defer = 1 << COMPACT_MAX_DEFER_SHIFT;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Called when kswapd goes to sleep after reclaiming for a high-order
+ * allocation: compaction has a chance now to assemble the page.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+
+	if (pgdat->kcompactd_classzone_idx > classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!pgdat->kcompactd || !waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	if (!kcompactd_node_suitable(pgdat))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ * On node-hot-add, kcompactd will moved to proper cpus if cpus are hot-added.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		ret = -1;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+/*
+ * As with kswapd, restore the cpu binding of kcompactd when the first
+ * cpu of its node comes back.
+ */
+static int __devinit kcompactd_cpu_callback(struct notifier_block *nfb,
+					    unsigned long action, void *hcpu)
+{
+	int nid;
+
+	if (action == CPU_ONLINE || action == CPU_ONLINE_FROZEN) {
+		for_each_node_state(nid, N_HIGH_MEMORY) {
+			pg_data_t *pgdat = NODE_DATA(nid);
+			const struct cpumask *mask;
+
+			mask = cpumask_of_node(pgdat->node_id);
+
+			if (pgdat->kcompactd &&
+			    cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
+				set_cpus_allowed_ptr(pgdat->kcompactd, mask);
+		}
+	}
+	return NOTIFY_OK;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	hotcpu_notifier(kcompactd_cpu_callback, 0);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct device *dev,
 			struct device_attribute *attr,
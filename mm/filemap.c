@@ -106,12 +106,76 @@
  *    ->i_mmap_mutex
  */
 
+static void page_cache_tree_delete(struct address_space *mapping,
+				   struct page *page, void *shadow)
+{
+	struct radix_tree_root *root = &mapping->page_tree;
+	struct radix_tree_node *node;
+	unsigned long index = page->index;
+	void **slot;
+	int tag;
+
+	__radix_tree_lookup(root, index, &node, &slot);
+	/*
+	 * An entry stored directly in the root is counted as a page
+	 * once the tree grows a node above it, so a page that is alone
+	 * in the tree leaves no shadow entry behind.
+	 */
+	if (!node)
+		shadow = NULL;
+
+	/*
+	 * A shadow entry is left in the slot of the evicted page, so
+	 * that a refault can tell how long the page was gone.  The
+	 * entry must not carry the page's tags: tagged lookups do not
+	 * expect to find exceptional entries.
+	 */
+	for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++) {
+		if (radix_tree_tagged(root, tag))
+			radix_tree_tag_clear(root, index, tag);
+	}
+	radix_tree_replace_slot(slot, shadow);
+
+	if (shadow) {
+		mapping->nrshadows++;
+		/*
+		 * Make sure the nrshadows update is committed before
+		 * the nrpages update, so that a final truncate racing
+		 * with reclaim does not see both counters at 0 and
+		 * miss the shadow entry.
+		 */
+		smp_wmb();
+	}
+
+	if (!node)
+		return;
+	workingset_node_pages_dec(node);
+	if (shadow)
+		workingset_node_shadows_inc(node);
+	else if (__radix_tree_delete_node(root, node))
+		return;
+
+	/*
+	 * Hand a node that is left with only shadow entries to the
+	 * shadow node shrinker.  node->private_list is protected by
+	 * the tree_lock, so the list_empty() test saves taking the
+	 * list_lru lock when the node is already on the list.
+	 */
+	if (!workingset_node_pages(node) &&
+	    list_empty(&node->private_list)) {
+		node->private_data = mapping;
+		list_lru_add(&workingset_shadow_nodes, &node->private_list,
+			     NULL);
+	}
+}
+
 /*
  * Delete a page from the page cache and free it. Caller has to make
  * sure the page is locked and that nobody else uses it - or that usage
- * is safe.  The caller must hold the mapping's tree_lock.
+ * is safe.  The caller must hold the mapping's tree_lock.  If @shadow
+ * is given, it is left in the page's slot for refault detection.
  */
-void __delete_from_page_cache(struct page *page)
+void __delete_from_page_cache(struct page *page, void *shadow)
 {
 	struct address_space *mapping = page->mapping;
 
@@ -125,7 +189,7 @@ void __delete_from_page_cache(struct page *page)
 	else
 		cleancache_flush_page(mapping, page);
 
-	radix_tree_delete(&mapping->page_tree, page->index);
+	page_cache_tree_delete(mapping, page, shadow);
 	page->mapping = NULL;
 	/* Leave page->index set: truncation lookup relies upon it */
 	mapping->nrpages--;
@@ -164,7 +228,7 @@ void delete_from_page_cache(struct page *page)
 
 	freepage = mapping->a_ops->freepage;
 	spin_lock_irq(&mapping->tree_lock);
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -411,8 +475,8 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 		new->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		__delete_from_page_cache(old);
-		error = radix_tree_insert(&mapping->page_tree, offset, new);
+		__delete_from_page_cache(old, NULL);
+		error = page_cache_tree_insert(mapping, offset, new, NULL);
 		BUG_ON(error);
 		mapping->nrpages++;
 		__inc_zone_page_state(new, NR_FILE_PAGES);
@@ -432,17 +496,59 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 EXPORT_SYMBOL_GPL(replace_page_cache_page);
 
 /**
- * add_to_page_cache_locked - add a locked page to the pagecache
- * @page:	page to add
+ * page_cache_tree_insert - insert a page into the page cache radix tree
  * @mapping:	the page's address_space
  * @offset:	page index
- * @gfp_mask:	page allocation mode
+ * @page:	page to insert
+ * @shadowp:	where to store the replaced shadow entry, or NULL
  *
- * This function is used to add a page to the pagecache. It must be locked.
- * This function does not add the page to the LRU.  The caller must do that.
+ * Inserts @page at @offset, replacing the shadow entry left there by
+ * an earlier eviction, if any.  Returns -EEXIST if a page is already
+ * present.  The caller must hold the mapping's tree_lock and have
+ * preloaded the radix tree.
  */
-int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
-		pgoff_t offset, gfp_t gfp_mask)
+int page_cache_tree_insert(struct address_space *mapping, pgoff_t offset,
+			   struct page *page, void **shadowp)
+{
+	struct radix_tree_node *node;
+	void **slot;
+	int error;
+
+	error = __radix_tree_create(&mapping->page_tree, offset, &node, &slot);
+	if (error)
+		return error;
+	if (*slot) {
+		void *p;
+
+		p = radix_tree_deref_slot_protected(slot, &mapping->tree_lock);
+		if (!radix_tree_exceptional_entry(p))
+			return -EEXIST;
+		if (shadowp)
+			*shadowp = p;
+		mapping->nrshadows--;
+		if (node)
+			workingset_node_shadows_dec(node);
+	}
+	radix_tree_replace_slot(slot, page);
+	if (node) {
+		workingset_node_pages_inc(node);
+		/*
+		 * A node holding pages is no business of the shadow
+		 * node shrinker.  As in page_cache_tree_delete(), the
+		 * list_empty() test is safe under the tree_lock.
+		 */
+		if (!list_empty(&node->private_list))
+			list_lru_del(&workingset_shadow_nodes,
+				     &node->private_list, NULL);
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(page_cache_tree_insert);
+
+static int __add_to_page_cache_locked(struct page *page,
+				      struct address_space *mapping,
+				      pgoff_t offset, gfp_t gfp_mask,
+				      void **shadowp)
 {
 	int error;
 
@@ -461,7 +567,7 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 		page->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		error = radix_tree_insert(&mapping->page_tree, offset, page);
+		error = page_cache_tree_insert(mapping, offset, page, shadowp);
 		if (likely(!error)) {
 			mapping->nrpages++;
 			__inc_zone_page_state(page, NR_FILE_PAGES);
@@ -479,17 +585,50 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 out:
 	return error;
 }
+
+/**
+ * add_to_page_cache_locked - add a locked page to the pagecache
+ * @page:	page to add
+ * @mapping:	the page's address_space
+ * @offset:	page index
+ * @gfp_mask:	page allocation mode
+ *
+ * This function is used to add a page to the pagecache. It must be locked.
+ * This function does not add the page to the LRU.  The caller must do that.
+ */
+int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
+		pgoff_t offset, gfp_t gfp_mask)
+{
+	return __add_to_page_cache_locked(page, mapping, offset,
+					  gfp_mask, NULL);
+}
 EXPORT_SYMBOL(add_to_page_cache_locked);
 
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, gfp_t gfp_mask)
 {
+	void *shadow = NULL;
 	int ret;
 
-	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
-	if (ret == 0)
+	__set_page_locked(page);
+	ret = __add_to_page_cache_locked(page, mapping, offset,
+					 gfp_mask, &shadow);
+	if (unlikely(ret)) {
+		__clear_page_locked(page);
+		return ret;
+	}
+	/*
+	 * A page that was evicted recently enough that it would have
+	 * stayed resident with a larger inactive list goes straight
+	 * onto the active list, instead of being evicted again before
+	 * it gets used a second time.
+	 */
+	if (shadow && workingset_refault(shadow)) {
+		lru_cache_add_lru(page, LRU_ACTIVE_FILE);
+		workingset_activation(page);
+	} else
 		lru_cache_add_file(page);
-	return ret;
+	return 0;
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
@@ -665,14 +804,19 @@ int __lock_page_or_retry(struct page *page, struct mm_struct *mm,
 }
 
 /**
- * find_get_page - find and get a page reference
+ * find_get_entry - find and get a page cache entry
  * @mapping: the address_space to search
- * @offset: the page index
+ * @offset: the page cache index
  *
- * Is there a pagecache struct page at the given (mapping, offset) tuple?
- * If yes, increment its refcount and return it; if no, return NULL.
+ * Looks up the page cache slot at @mapping & @offset.  If there is a
+ * page cache page, it is returned with an increased refcount.
+ *
+ * If the slot holds a shadow entry of a previously evicted page, or a
+ * swap entry from shmem/tmpfs, it is returned.
+ *
+ * Otherwise, %NULL is returned.
  */
-struct page *find_get_page(struct address_space *mapping, pgoff_t offset)
+struct page *find_get_entry(struct address_space *mapping, pgoff_t offset)
 {
 	void **pagep;
 	struct page *page;
@@ -689,9 +833,9 @@ repeat:
 			if (radix_tree_deref_retry(page))
 				goto repeat;
 			/*
-			 * Otherwise, shmem/tmpfs must be storing a swap entry
-			 * here as an exceptional entry: so return it without
-			 * attempting to raise page count.
+			 * A shadow entry of a recently evicted page,
+			 * or a swap entry from shmem/tmpfs.  Return
+			 * it without attempting to raise page count.
 			 */
 			goto out;
 		}
@@ -713,24 +857,48 @@ out:
 
 	return page;
 }
-EXPORT_SYMBOL(find_get_page);
+EXPORT_SYMBOL(find_get_entry);
 
 /**
- * find_lock_page - locate, pin and lock a pagecache page
+ * find_get_page - find and get a page reference
  * @mapping: the address_space to search
  * @offset: the page index
  *
- * Locates the desired pagecache page, locks it, increments its reference
- * count and returns its address.
+ * Is there a pagecache struct page at the given (mapping, offset) tuple?
+ * If yes, increment its refcount and return it; if no, return NULL.
+ */
+struct page *find_get_page(struct address_space *mapping, pgoff_t offset)
+{
+	struct page *page = find_get_entry(mapping, offset);
+
+	if (radix_tree_exceptional_entry(page))
+		page = NULL;
+	return page;
+}
+EXPORT_SYMBOL(find_get_page);
+
+/**
+ * find_lock_entry - locate, pin and lock a page cache entry
+ * @mapping: the address_space to search
+ * @offset: the page cache index
  *
- * Returns zero if the page was not present. find_lock_page() may sleep.
+ * Looks up the page cache slot at @mapping & @offset.  If there is a
+ * page cache page, it is returned locked and with an increased
+ * refcount.
+ *
+ * If the slot holds a shadow entry of a previously evicted page, or a
+ * swap entry from shmem/tmpfs, it is returned.
+ *
+ * Otherwise, %NULL is returned.
+ *
+ * find_lock_entry() may sleep.
  */
-struct page *find_lock_page(struct address_space *mapping, pgoff_t offset)
+struct page *find_lock_entry(struct address_space *mapping, pgoff_t offset)
 {
 	struct page *page;
 
 repeat:
-	page = find_get_page(mapping, offset);
+	page = find_get_entry(mapping, offset);
 	if (page && !radix_tree_exception(page)) {
 		lock_page(page);
 		/* Has the page been truncated? */
@@ -743,6 +911,26 @@ repeat:
 	}
 	return page;
 }
+EXPORT_SYMBOL(find_lock_entry);
+
+/**
+ * find_lock_page - locate, pin and lock a pagecache page
+ * @mapping: the address_space to search
+ * @offset: the page index
+ *
+ * Locates the desired pagecache page, locks it, increments its reference
+ * count and returns its address.
+ *
+ * Returns zero if the page was not present. find_lock_page() may sleep.
+ */
+struct page *find_lock_page(struct address_space *mapping, pgoff_t offset)
+{
+	struct page *page = find_lock_entry(mapping, offset);
+
+	if (radix_tree_exceptional_entry(page))
+		page = NULL;
+	return page;
+}
 EXPORT_SYMBOL(find_lock_page);
 
 /**
@@ -839,9 +1027,9 @@ repeat:
 				goto restart;
 			}
 			/*
-			 * Otherwise, shmem/tmpfs must be storing a swap entry
-			 * here as an exceptional entry: so skip over it -
-			 * we only reach this from invalidate_mapping_pages().
+			 * Otherwise, this is a shadow entry of an evicted
+			 * page, or shmem/tmpfs is storing a swap entry
+			 * here as an exceptional entry: so skip over it.
 			 */
 			nr_skip++;
 			continue;
@@ -866,6 +1054,26 @@ repeat:
 	 */
 	if (unlikely(!ret && nr_found > nr_skip))
 		goto restart;
+	/*
+	 * Likewise if the whole gang were exceptional entries: carry on
+	 * behind the last of them, as there may be pages further on.
+	 */
+	if (unlikely(!ret && nr_skip)) {
+		unsigned long index = start;
+		void **slot;
+
+		for (i = 0; i < nr_skip; i++) {
+			if (!radix_tree_gang_lookup_slot(&mapping->page_tree,
+							 &slot, &index, index, 1))
+				break;
+			if (!++index)
+				break;
+		}
+		if (i == nr_skip && index) {
+			start = index;
+			goto restart;
+		}
+	}
 	rcu_read_unlock();
 	return ret;
 }
@@ -911,9 +1119,10 @@ repeat:
 				goto restart;
 			}
 			/*
-			 * Otherwise, shmem/tmpfs must be storing a swap entry
-			 * here as an exceptional entry: so stop looking for
-			 * contiguous pages.
+			 * Otherwise, this is a shadow entry of an evicted
+			 * page, or shmem/tmpfs is storing a swap entry
+			 * here as an exceptional entry: so stop looking
+			 * for contiguous pages.
 			 */
 			break;
 		}
@@ -987,7 +1196,8 @@ repeat:
 			}
 			/*
 			 * This function is never used on a shmem/tmpfs
-			 * mapping, so a swap entry won't be found here.
+			 * mapping, so a swap entry won't be found here,
+			 * and shadow entries are never tagged.
 			 */
 			BUG();
 		}
@@ -1074,6 +1284,27 @@ static void shrink_readahead_size_eio(struct file *filp,
 	ra->ra_pages /= 4;
 }
 
+/*
+ * Lock a page that is not uptodate.  If it is locked, it is most likely
+ * being read in, and the wait tells readahead how far ahead of the reader
+ * it needs to be.
+ */
+static int lock_page_read_stall(struct address_space *mapping,
+				struct page *page)
+{
+	u64 start;
+	int error;
+
+	if (trylock_page(page))
+		return 0;
+
+	start = local_clock();
+	error = __lock_page_killable(page);
+	if (!error)
+		readahead_account_stall(mapping, start);
+	return error;
+}
+
 /**
  * do_generic_file_read - generic file read routine
  * @filp:	the file to read
@@ -1208,7 +1439,7 @@ page_ok:
 
 page_not_up_to_date:
 		/* Get exclusive access to the page ... */
-		error = lock_page_killable(page);
+		error = lock_page_read_stall(mapping, page);
 		if (unlikely(error))
 			goto readpage_error;
 
@@ -1245,7 +1476,7 @@ readpage:
 		}
 
 		if (!PageUptodate(page)) {
-			error = lock_page_killable(page);
+			error = lock_page_read_stall(mapping, page);
 			if (unlikely(error))
 				goto readpage_error;
 			if (!PageUptodate(page)) {
@@ -1707,6 +1938,8 @@ retry_find:
 		return VM_FAULT_SIGBUS;
 	}
 
+	if (PageRaUnused(page))
+		ClearPageRaUnused(page);
 	vmf->page = page;
 	return ret | VM_FAULT_LOCKED;
 
@@ -1759,8 +1992,93 @@ page_not_uptodate:
 }
 EXPORT_SYMBOL(filemap_fault);
 
+/*
+ * Map @page at its place in the fault-around window of @vmf, if it is
+ * uptodate and can be locked without waiting.
+ */
+static bool filemap_map_page(struct vm_area_struct *vma, struct vm_fault *vmf,
+			     struct page *page, pgoff_t size)
+{
+	struct file *file = vma->vm_file;
+	unsigned long address;
+	pte_t *pte;
+
+	if (!PageUptodate(page) || PageReadahead(page) || PageHWPoison(page))
+		return false;
+	if (!trylock_page(page))
+		return false;
+
+	/* Did it get truncated before we got the lock? */
+	if (page->mapping != file->f_mapping || !PageUptodate(page) ||
+	    page->index >= size)
+		goto unlock;
+
+	pte = vmf->pte + page->index - vmf->pgoff;
+	if (!pte_none(*pte))
+		goto unlock;
+
+	if (file->f_ra.mmap_miss > 0)
+		file->f_ra.mmap_miss--;
+	address = (unsigned long)vmf->virtual_address +
+		  ((page->index - vmf->pgoff) << PAGE_SHIFT);
+	do_set_pte(vma, address, page, pte, false, false);
+	unlock_page(page);
+	return true;
+unlock:
+	unlock_page(page);
+	return false;
+}
+
+#define FAULT_AROUND_BATCH	16
+
+/**
+ * filemap_map_pages - map the cached pages around a read fault
+ * @vma:	vma in which the fault was taken
+ * @vmf:	struct vm_fault containing the window to map
+ *
+ * Maps the pages from vmf->pgoff to vmf->max_pgoff that are uptodate in
+ * the page cache and not locked, so that their first access does not
+ * fault.  Pages carrying the readahead mark are left to filemap_fault(),
+ * to keep readahead going.  Called with the page table lock held.
+ */
+void filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	struct page *pages[FAULT_AROUND_BATCH];
+	pgoff_t index = vmf->pgoff;
+	unsigned long nr_mapped = 0;
+	unsigned int i, nr;
+	pgoff_t size;
+
+	size = DIV_ROUND_UP(i_size_read(mapping->host), PAGE_CACHE_SIZE);
+
+	while (index <= vmf->max_pgoff) {
+		nr = find_get_pages(mapping, index,
+				    min_t(pgoff_t, FAULT_AROUND_BATCH,
+					  vmf->max_pgoff - index + 1), pages);
+		if (!nr)
+			break;
+
+		for (i = 0; i < nr; i++) {
+			struct page *page = pages[i];
+
+			index = page->index + 1;
+			/* The mapped page keeps our reference */
+			if (page->index <= vmf->max_pgoff &&
+			    filemap_map_page(vma, vmf, page, size))
+				nr_mapped++;
+			else
+				page_cache_release(page);
+		}
+	}
+
+	count_vm_events(FAULT_AROUND_PAGES, nr_mapped);
+}
+EXPORT_SYMBOL(filemap_map_pages);
+
 const struct vm_operations_struct generic_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
 };
 
 /* This is used for a general mmap of a disk file */
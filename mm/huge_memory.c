@@ -17,6 +17,7 @@
 #include <linux/khugepaged.h>
 #include <linux/freezer.h>
 #include <linux/mman.h>
+#include <linux/userfaultfd_k.h>
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
 #include "internal.h"
@@ -1747,7 +1748,12 @@ static int __collapse_huge_page_isolate(struct vm_area_struct *vma,
 		}
 		VM_BUG_ON(PageCompound(page));
 		BUG_ON(!PageAnon(page));
-		VM_BUG_ON(!PageSwapBacked(page));
+
+		/* leave pages freed by madvise(MADV_FREE) to reclaim */
+		if (!PageSwapBacked(page)) {
+			release_pte_pages(pte, _pte);
+			goto out;
+		}
 
 		/* cannot use mapcount: can't collapse if there's a gup pin */
 		if (page_count(page) != 1) {
@@ -1906,7 +1912,8 @@ static void collapse_huge_page(struct mm_struct *mm,
 	    (vma->vm_flags & VM_NOHUGEPAGE))
 		goto out;
 
-	if (!vma->anon_vma || vma->vm_ops)
+	/* the holes of a userfaultfd range are not for khugepaged to fill */
+	if (!vma->anon_vma || vma->vm_ops || userfaultfd_missing(vma))
 		goto out;
 	if (is_vma_temporary_stack(vma))
 		goto out;
@@ -1934,6 +1941,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	pte = pte_offset_map(pmd, address);
 	ptl = pte_lockptr(mm, pmd);
 
+	mmap_seq_write_begin(mm);
 	spin_lock(&mm->page_table_lock); /* probably unnecessary */
 	/*
 	 * After this gup_fast can't run anymore. This also removes
@@ -1954,6 +1962,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 		BUG_ON(!pmd_none(*pmd));
 		set_pmd_at(mm, address, pmd, _pmd);
 		spin_unlock(&mm->page_table_lock);
+		mmap_seq_write_end(mm);
 		anon_vma_unlock(vma->anon_vma);
 		goto out;
 	}
@@ -1990,6 +1999,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	prepare_pmd_huge_pte(pgtable, mm);
 	mm->nr_ptes--;
 	spin_unlock(&mm->page_table_lock);
+	mmap_seq_write_end(mm);
 
 #ifndef CONFIG_NUMA
 	*hpage = NULL;
@@ -2149,7 +2159,7 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			progress++;
 			continue;
 		}
-		if (!vma->anon_vma || vma->vm_ops)
+		if (!vma->anon_vma || vma->vm_ops || userfaultfd_missing(vma))
 			goto skip;
 		if (is_vma_temporary_stack(vma))
 			goto skip;
@@ -23,7 +23,6 @@
 #include <linux/pagemap.h>
 #include <linux/rmap.h>
 #include <linux/spinlock.h>
-#include <linux/jhash.h>
 #include <linux/delay.h>
 #include <linux/kthread.h>
 #include <linux/wait.h>
@@ -79,36 +78,59 @@
  *    take 10 attempts to find a page in the unstable tree, once it is found,
  *    it is secured in the stable tree.  (When we scan a new page, we first
  *    compare it against the stable tree, and then against the unstable tree.)
+ *
+ * Both trees are sorted first by a hash of the page contents, and only then
+ * by the contents themselves: so a tree walk usually costs one hash of the
+ * scanned page and a single memcmp, instead of a full memcmp at every level.
+ *
+ * If merge_across_nodes is disabled, there is one stable and one unstable
+ * tree for each NUMA node, and pages are only merged with pages which were
+ * found on the same node, so that no task has to access a remote ksm page.
+ *
+ * There may be several ksmd threads, each scanning its own list of mm_slots
+ * with its own cursor: they walk page tables and hash pages in parallel, but
+ * search and update the trees one at a time, under ksm_thread_mutex.  A full
+ * scan is complete when all of them have been through their lists: the last
+ * to finish resets the unstable tree, and they start over together.
  */
 
 /**
  * struct mm_slot - ksm information per mm that is being scanned
  * @link: link to the mm_slots hash list
- * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
+ * @mm_list: link into the mm_slots list, rooted in its scan's mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @scan: the cursor of the ksmd thread which scans this mm
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	struct ksm_scan *scan;
 };
 
 /**
  * struct ksm_scan - cursor for scanning
+ * @mm_head: head of the list of mm_slots scanned with this cursor
  * @mm_slot: the current mm_slot we are scanning
  * @address: the next address inside that to be scanned
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
- * @seqnr: count of completed full scans (needed when removing unstable node)
+ * @stale_items: rmap_items taken off their rmap_list under mmap_sem, to be
+ *		 removed from the trees once it has been released
+ * @nr_mm_slots: number of mm_slots on the list
+ * @done: whether this cursor has completed the current full scan
  *
- * There is only the one ksm_scan instance of this cursor structure.
+ * There is one ksm_scan instance of this cursor structure per ksmd thread.
  */
 struct ksm_scan {
+	struct mm_slot mm_head;
 	struct mm_slot *mm_slot;
 	unsigned long address;
 	struct rmap_item **rmap_list;
-	unsigned long seqnr;
+	struct rmap_item *stale_items;
+	unsigned int nr_mm_slots;
+	bool done;
 };
 
 /**
@@ -116,11 +138,20 @@ struct ksm_scan {
  * @node: rb node of this ksm page in the stable tree
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page
+ * @checksum: hash of the (write-protected) ksm page contents
+ * @nid: NUMA node id of the stable tree in which this node is linked
+ * @migrate_list: link into ksm_migrate_nodes, when its page has been
+ *		  migrated away from the node of its stable tree
  */
 struct stable_node {
 	struct rb_node node;
 	struct hlist_head hlist;
 	unsigned long kpfn;
+	u32 checksum;
+#ifdef CONFIG_NUMA
+	int nid;
+	struct list_head migrate_list;
+#endif
 };
 
 /**
@@ -130,6 +161,7 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @nid: NUMA node id of the unstable tree in which this rmap_item is linked
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -140,6 +172,9 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+#ifdef CONFIG_NUMA
+	int nid;			/* when node of unstable tree */
+#endif
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -153,20 +188,23 @@ struct rmap_item {
 #define UNSTABLE_FLAG	0x100	/* is a node of the unstable tree */
 #define STABLE_FLAG	0x200	/* is listed from the stable tree */
 
-/* The stable and unstable tree heads */
-static struct rb_root root_stable_tree = RB_ROOT;
-static struct rb_root root_unstable_tree = RB_ROOT;
+/* The stable and unstable tree heads, one of each per NUMA node */
+static struct rb_root root_stable_tree[MAX_NUMNODES];
+static struct rb_root root_unstable_tree[MAX_NUMNODES];
 
 #define MM_SLOTS_HASH_SHIFT 10
 #define MM_SLOTS_HASH_HEADS (1 << MM_SLOTS_HASH_SHIFT)
 static struct hlist_head mm_slots_hash[MM_SLOTS_HASH_HEADS];
 
-static struct mm_slot ksm_mm_head = {
-	.mm_list = LIST_HEAD_INIT(ksm_mm_head.mm_list),
-};
-static struct ksm_scan ksm_scan = {
-	.mm_slot = &ksm_mm_head,
-};
+/* The cursors of the ksmd threads */
+static struct ksm_scan *ksm_scans;
+static unsigned int ksm_nr_scans = 1;
+
+/* Count of completed full scans (needed when removing unstable node) */
+static unsigned long ksm_seqnr;
+
+/* The number of ksmd threads yet to complete the current full scan */
+static unsigned int ksm_scans_running;
 
 static struct kmem_cache *rmap_item_cache;
 static struct kmem_cache *stable_node_cache;
@@ -182,7 +220,7 @@ static unsigned long ksm_pages_sharing;
 static unsigned long ksm_pages_unshared;
 
 /* The number of rmap_items in use: to calculate pages_volatile */
-static unsigned long ksm_rmap_items;
+static atomic_long_t ksm_rmap_items = ATOMIC_LONG_INIT(0);
 
 /* Number of pages ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
@@ -190,13 +228,46 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Zero to keep ksm pages node-local: one stable and unstable tree per node */
+static unsigned int ksm_merge_across_nodes = 1;
+
+/* The number of pages ksmd has scanned since boot */
+static unsigned long ksm_pages_scanned;
+
+/* Pages scanned, and jiffies taken, by the last completed full scan */
+static unsigned long ksm_last_scan_pages;
+static unsigned long ksm_last_scan_jiffies;
+
+/* Where the full scan now in progress started from */
+static unsigned long ksm_scan_start_pages;
+static unsigned long ksm_scan_start_jiffies;
+
+#ifdef CONFIG_NUMA
+/* Stable nodes to be moved to the tree of the node their page went to */
+static LIST_HEAD(ksm_migrate_nodes);
+static DEFINE_SPINLOCK(ksm_migrate_lock);
+
+#define NUMA(x)		(x)
+#define DO_NUMA(x)	do { (x); } while (0)
+#else
+#define NUMA(x)		(0)
+#define DO_NUMA(x)	do { } while (0)
+#endif
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
 static unsigned int ksm_run = KSM_RUN_STOP;
 
 static DECLARE_WAIT_QUEUE_HEAD(ksm_thread_wait);
+/*
+ * ksm_thread_mutex serializes the trees, the rmap_items linked in them and
+ * the counters.  It is taken inside ksm_scan_sem, and outside mmap_sem: so
+ * the scan never takes it while holding an mmap_sem.  ksm_scan_sem is held
+ * for read by each ksmd thread while it scans, and for write to stop them.
+ */
 static DEFINE_MUTEX(ksm_thread_mutex);
+static DECLARE_RWSEM(ksm_scan_sem);
 static DEFINE_SPINLOCK(ksm_mmlist_lock);
 
 #define KSM_KMEM_CACHE(__struct, __flags) kmem_cache_create("ksm_"#__struct,\
@@ -241,13 +312,13 @@ static inline struct rmap_item *alloc_rmap_item(void)
 
 	rmap_item = kmem_cache_zalloc(rmap_item_cache, GFP_KERNEL);
 	if (rmap_item)
-		ksm_rmap_items++;
+		atomic_long_inc(&ksm_rmap_items);
 	return rmap_item;
 }
 
 static inline void free_rmap_item(struct rmap_item *rmap_item)
 {
-	ksm_rmap_items--;
+	atomic_long_dec(&ksm_rmap_items);
 	rmap_item->mm = NULL;	/* debug safety */
 	kmem_cache_free(rmap_item_cache, rmap_item);
 }
@@ -303,6 +374,15 @@ static inline int in_stable_tree(struct rmap_item *rmap_item)
 	return rmap_item->address & STABLE_FLAG;
 }
 
+/*
+ * Which pair of stable and unstable trees a page at this pfn belongs in:
+ * always the first pair, unless merge_across_nodes has been switched off.
+ */
+static inline int get_kpfn_nid(unsigned long kpfn)
+{
+	return ksm_merge_across_nodes ? 0 : pfn_to_nid(kpfn);
+}
+
 /*
  * ksmd, and unmerge_and_remove_all_rmap_items(), must not touch an mm's
  * page tables after it has passed through ksm_exit() - which, if necessary,
@@ -459,7 +539,12 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 		cond_resched();
 	}
 
-	rb_erase(&stable_node->node, &root_stable_tree);
+	rb_erase(&stable_node->node, root_stable_tree + NUMA(stable_node->nid));
+#ifdef CONFIG_NUMA
+	spin_lock(&ksm_migrate_lock);
+	list_del(&stable_node->migrate_list);
+	spin_unlock(&ksm_migrate_lock);
+#endif
 	free_stable_node(stable_node);
 }
 
@@ -554,10 +639,11 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		 * if this rmap_item was inserted by this scan, rather
 		 * than left over from before.
 		 */
-		age = (unsigned char)(ksm_scan.seqnr - rmap_item->address);
+		age = (unsigned char)(ksm_seqnr - rmap_item->address);
 		BUG_ON(age > 1);
 		if (!age)
-			rb_erase(&rmap_item->node, &root_unstable_tree);
+			rb_erase(&rmap_item->node,
+				 root_unstable_tree + NUMA(rmap_item->nid));
 
 		ksm_pages_unshared--;
 		rmap_item->address &= PAGE_MASK;
@@ -577,6 +663,42 @@ static void remove_trailing_rmap_items(struct mm_slot *mm_slot,
 	}
 }
 
+/*
+ * The scan finds rmap_items to remove while it holds mmap_sem, inside which
+ * it cannot take ksm_thread_mutex: so it only unlinks them from their
+ * rmap_list, pinning their mm, which tree walks may still look at.
+ */
+static void defer_rmap_item(struct ksm_scan *scan, struct rmap_item *rmap_item)
+{
+	atomic_inc(&rmap_item->mm->mm_count);
+	rmap_item->rmap_list = scan->stale_items;
+	scan->stale_items = rmap_item;
+}
+
+static void defer_trailing_rmap_items(struct ksm_scan *scan,
+				      struct rmap_item **rmap_list)
+{
+	while (*rmap_list) {
+		struct rmap_item *rmap_item = *rmap_list;
+		*rmap_list = rmap_item->rmap_list;
+		defer_rmap_item(scan, rmap_item);
+	}
+}
+
+/* Called with ksm_thread_mutex held, and no mmap_sem */
+static void remove_stale_rmap_items(struct ksm_scan *scan)
+{
+	while (scan->stale_items) {
+		struct rmap_item *rmap_item = scan->stale_items;
+		struct mm_struct *mm = rmap_item->mm;
+
+		scan->stale_items = rmap_item->rmap_list;
+		remove_rmap_item_from_tree(rmap_item);
+		free_rmap_item(rmap_item);
+		mmdrop(mm);
+	}
+}
+
 /*
  * Though it's very tempting to unmerge in_stable_tree(rmap_item)s rather
  * than check every pte of a given vma, the locking doesn't quite work for
@@ -608,10 +730,7 @@ static int unmerge_ksm_pages(struct vm_area_struct *vma,
 }
 
 #ifdef CONFIG_SYSFS
-/*
- * Only called through the sysfs control interface:
- */
-static int unmerge_and_remove_all_rmap_items(void)
+static int unmerge_and_remove_scan_rmap_items(struct ksm_scan *scan)
 {
 	struct mm_slot *mm_slot;
 	struct mm_struct *mm;
@@ -619,12 +738,12 @@ static int unmerge_and_remove_all_rmap_items(void)
 	int err = 0;
 
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(ksm_mm_head.mm_list.next,
+	scan->mm_slot = list_entry(scan->mm_head.mm_list.next,
 						struct mm_slot, mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
-	for (mm_slot = ksm_scan.mm_slot;
-			mm_slot != &ksm_mm_head; mm_slot = ksm_scan.mm_slot) {
+	for (mm_slot = scan->mm_slot;
+			mm_slot != &scan->mm_head; mm_slot = scan->mm_slot) {
 		mm = mm_slot->mm;
 		down_read(&mm->mmap_sem);
 		for (vma = mm->mmap; vma; vma = vma->vm_next) {
@@ -641,11 +760,12 @@ static int unmerge_and_remove_all_rmap_items(void)
 		remove_trailing_rmap_items(mm_slot, &mm_slot->rmap_list);
 
 		spin_lock(&ksm_mmlist_lock);
-		ksm_scan.mm_slot = list_entry(mm_slot->mm_list.next,
+		scan->mm_slot = list_entry(mm_slot->mm_list.next,
 						struct mm_slot, mm_list);
 		if (ksm_test_exit(mm)) {
 			hlist_del(&mm_slot->link);
 			list_del(&mm_slot->mm_list);
+			scan->nr_mm_slots--;
 			spin_unlock(&ksm_mmlist_lock);
 
 			free_mm_slot(mm_slot);
@@ -657,26 +777,83 @@ static int unmerge_and_remove_all_rmap_items(void)
 			up_read(&mm->mmap_sem);
 		}
 	}
-
-	ksm_scan.seqnr = 0;
 	return 0;
 
 error:
 	up_read(&mm->mmap_sem);
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = &ksm_mm_head;
+	scan->mm_slot = &scan->mm_head;
 	spin_unlock(&ksm_mmlist_lock);
 	return err;
 }
+
+/*
+ * Only called through the sysfs control interface, with ksm_scan_sem held
+ * for write and ksm_thread_mutex held:
+ */
+static int unmerge_and_remove_all_rmap_items(void)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < ksm_nr_scans; i++) {
+		err = unmerge_and_remove_scan_rmap_items(&ksm_scans[i]);
+		if (err)
+			return err;
+	}
+
+	/* Nothing is left in the trees: start a new full scan from seqnr 0 */
+	for (i = 0; i < ksm_nr_scans; i++)
+		ksm_scans[i].done = false;
+	ksm_scans_running = ksm_nr_scans;
+	ksm_seqnr = 0;
+	return 0;
+}
 #endif /* CONFIG_SYSFS */
 
+#define KSM_HASH_PRIME1	0x9e3779b185ebca87ULL
+#define KSM_HASH_PRIME2	0xc2b2ae3d27d4eb4fULL
+#define KSM_HASH_PRIME3	0x165667b19e3779f9ULL
+
+static inline u64 ksm_hash_round(u64 acc, u64 val)
+{
+	acc += val * KSM_HASH_PRIME2;
+	acc = rol64(acc, 31);
+	return acc * KSM_HASH_PRIME1;
+}
+
+/*
+ * The page is hashed a word at a time in four independent lanes, which are
+ * only folded together at the end: unlike jhash2 on 32-bit words, this gives
+ * the cpu four multiplies it can keep in flight at once, and halves the
+ * number of loads.  The result decides whether a page is volatile, and is
+ * also the primary key of both trees.
+ */
 static u32 calc_checksum(struct page *page)
 {
-	u32 checksum;
-	void *addr = kmap_atomic(page, KM_USER0);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	u64 h0 = KSM_HASH_PRIME1 + KSM_HASH_PRIME2;
+	u64 h1 = KSM_HASH_PRIME2;
+	u64 h2 = 0;
+	u64 h3 = -KSM_HASH_PRIME1;
+	u64 *addr, *p;
+	u64 h;
+
+	addr = kmap_atomic(page, KM_USER0);
+	for (p = addr; p < addr + PAGE_SIZE / sizeof(u64); p += 4) {
+		h0 = ksm_hash_round(h0, p[0]);
+		h1 = ksm_hash_round(h1, p[1]);
+		h2 = ksm_hash_round(h2, p[2]);
+		h3 = ksm_hash_round(h3, p[3]);
+	}
 	kunmap_atomic(addr, KM_USER0);
-	return checksum;
+
+	h = rol64(h0, 1) + rol64(h1, 7) + rol64(h2, 12) + rol64(h3, 18);
+	h ^= h >> 33;
+	h *= KSM_HASH_PRIME2;
+	h ^= h >> 29;
+	h *= KSM_HASH_PRIME3;
+	h ^= h >> 32;
+	return (u32)h;
 }
 
 static int memcmp_pages(struct page *page1, struct page *page2)
@@ -692,6 +869,18 @@ static int memcmp_pages(struct page *page1, struct page *page2)
 	return ret;
 }
 
+/*
+ * Order of pages in the stable and unstable trees: by checksum first,
+ * falling back to comparing contents only when the checksums are equal.
+ */
+static int cmp_pages_hashed(struct page *page1, u32 checksum1,
+			    struct page *page2, u32 checksum2)
+{
+	if (checksum1 != checksum2)
+		return checksum1 < checksum2 ? -1 : 1;
+	return memcmp_pages(page1, page2);
+}
+
 static inline int pages_identical(struct page *page1, struct page *page2)
 {
 	return !memcmp_pages(page1, page2);
@@ -984,10 +1173,11 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
  * This function returns the stable tree node of identical content if found,
  * NULL otherwise.
  */
-static struct page *stable_tree_search(struct page *page)
+static struct page *stable_tree_search(struct page *page, u32 checksum)
 {
-	struct rb_node *node = root_stable_tree.rb_node;
+	struct rb_node *node;
 	struct stable_node *stable_node;
+	int nid;
 
 	stable_node = page_stable_node(page);
 	if (stable_node) {			/* ksm page forked */
@@ -995,6 +1185,9 @@ static struct page *stable_tree_search(struct page *page)
 		return page;
 	}
 
+	nid = get_kpfn_nid(page_to_pfn(page));
+	node = root_stable_tree[nid].rb_node;
+
 	while (node) {
 		struct page *tree_page;
 		int ret;
@@ -1005,7 +1198,8 @@ static struct page *stable_tree_search(struct page *page)
 		if (!tree_page)
 			return NULL;
 
-		ret = memcmp_pages(page, tree_page);
+		ret = cmp_pages_hashed(page, checksum,
+				       tree_page, stable_node->checksum);
 
 		if (ret < 0) {
 			put_page(tree_page);
@@ -1027,13 +1221,19 @@ static struct page *stable_tree_search(struct page *page)
  * This function returns the stable tree node just allocated on success,
  * NULL otherwise.
  */
-static struct stable_node *stable_tree_insert(struct page *kpage)
+/*
+ * stable_tree_link - find where kpage would be linked in the stable tree
+ * of node nid: returns NULL if an identical page is already there, or if
+ * the tree changed under us while looking.
+ */
+static struct rb_node **stable_tree_link(struct page *kpage, u32 checksum,
+					 int nid, struct rb_node **parentp)
 {
-	struct rb_node **new = &root_stable_tree.rb_node;
+	struct rb_node **new = &root_stable_tree[nid].rb_node;
 	struct rb_node *parent = NULL;
-	struct stable_node *stable_node;
 
 	while (*new) {
+		struct stable_node *stable_node;
 		struct page *tree_page;
 		int ret;
 
@@ -1043,7 +1243,8 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 		if (!tree_page)
 			return NULL;
 
-		ret = memcmp_pages(kpage, tree_page);
+		ret = cmp_pages_hashed(kpage, checksum,
+				       tree_page, stable_node->checksum);
 		put_page(tree_page);
 
 		parent = *new;
@@ -1051,26 +1252,53 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 			new = &parent->rb_left;
 		else if (ret > 0)
 			new = &parent->rb_right;
-		else {
-			/*
-			 * It is not a bug that stable_tree_search() didn't
-			 * find this node: because at that time our page was
-			 * not yet write-protected, so may have changed since.
-			 */
+		else
 			return NULL;
-		}
 	}
 
+	*parentp = parent;
+	return new;
+}
+
+static struct stable_node *stable_tree_insert(struct page *kpage)
+{
+	struct rb_node **new;
+	struct rb_node *parent;
+	struct stable_node *stable_node;
+	u32 checksum;
+	int nid;
+
+	/*
+	 * kpage is now write-protected: hash it afresh, in case its contents
+	 * changed after the checksum was taken by cmp_and_merge_page().
+	 */
+	checksum = calc_checksum(kpage);
+	nid = get_kpfn_nid(page_to_pfn(kpage));
+
+	/*
+	 * It is not a bug if an identical page is found here although
+	 * stable_tree_search() didn't find it: because at that time our
+	 * page was not yet write-protected, so may have changed since.
+	 */
+	new = stable_tree_link(kpage, checksum, nid, &parent);
+	if (!new)
+		return NULL;
+
 	stable_node = alloc_stable_node();
 	if (!stable_node)
 		return NULL;
 
 	rb_link_node(&stable_node->node, parent, new);
-	rb_insert_color(&stable_node->node, &root_stable_tree);
+	rb_insert_color(&stable_node->node, &root_stable_tree[nid]);
 
 	INIT_HLIST_HEAD(&stable_node->hlist);
+#ifdef CONFIG_NUMA
+	INIT_LIST_HEAD(&stable_node->migrate_list);
+#endif
 
 	stable_node->kpfn = page_to_pfn(kpage);
+	stable_node->checksum = checksum;
+	DO_NUMA(stable_node->nid = nid);
 	set_page_stable_node(kpage, stable_node);
 
 	return stable_node;
@@ -1088,7 +1316,8 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
  * to the currently scanned page, NULL otherwise.
  *
  * This function does both searching and inserting, because they share
- * the same walking algorithm in an rbtree.
+ * the same walking algorithm in an rbtree.  rmap_item->oldchecksum must
+ * already hold the checksum of page, as it is the key of the tree.
  */
 static
 struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
@@ -1096,8 +1325,12 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 					      struct page **tree_pagep)
 
 {
-	struct rb_node **new = &root_unstable_tree.rb_node;
+	struct rb_node **new;
 	struct rb_node *parent = NULL;
+	int nid;
+
+	nid = get_kpfn_nid(page_to_pfn(page));
+	new = &root_unstable_tree[nid].rb_node;
 
 	while (*new) {
 		struct rmap_item *tree_rmap_item;
@@ -1118,7 +1351,18 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 			return NULL;
 		}
 
-		ret = memcmp_pages(page, tree_page);
+		/*
+		 * If tree_page has been migrated to another NUMA node since
+		 * it was inserted, it will be put in the right unstable tree
+		 * next time round: only merge with it when across nodes.
+		 */
+		if (!ksm_merge_across_nodes && page_to_nid(tree_page) != nid) {
+			put_page(tree_page);
+			return NULL;
+		}
+
+		ret = cmp_pages_hashed(page, rmap_item->oldchecksum,
+				       tree_page, tree_rmap_item->oldchecksum);
 
 		parent = *new;
 		if (ret < 0) {
@@ -1134,9 +1378,10 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 	}
 
 	rmap_item->address |= UNSTABLE_FLAG;
-	rmap_item->address |= (ksm_scan.seqnr & SEQNR_MASK);
+	rmap_item->address |= (ksm_seqnr & SEQNR_MASK);
+	DO_NUMA(rmap_item->nid = nid);
 	rb_link_node(&rmap_item->node, parent, new);
-	rb_insert_color(&rmap_item->node, &root_unstable_tree);
+	rb_insert_color(&rmap_item->node, &root_unstable_tree[nid]);
 
 	ksm_pages_unshared++;
 	return NULL;
@@ -1168,20 +1413,21 @@ static void stable_tree_append(struct rmap_item *rmap_item,
  *
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
+ * @checksum: the hash of page, the primary key of both trees
  */
-static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
+static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item,
+			       unsigned int checksum)
 {
 	struct rmap_item *tree_rmap_item;
 	struct page *tree_page = NULL;
 	struct stable_node *stable_node;
 	struct page *kpage;
-	unsigned int checksum;
 	int err;
 
 	remove_rmap_item_from_tree(rmap_item);
 
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	kpage = stable_tree_search(page, checksum);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
 		if (!err) {
@@ -1203,7 +1449,6 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -1258,8 +1503,7 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 		if (rmap_item->address > addr)
 			break;
 		*rmap_list = rmap_item->rmap_list;
-		remove_rmap_item_from_tree(rmap_item);
-		free_rmap_item(rmap_item);
+		defer_rmap_item(mm_slot->scan, rmap_item);
 	}
 
 	rmap_item = alloc_rmap_item();
@@ -1273,45 +1517,137 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+#ifdef CONFIG_NUMA
+/*
+ * Move a stable_node into the tree of the node to which its page has been
+ * migrated.  If that tree already holds an identical page, or changes under
+ * us, leave it where it is: it still serves the merges found in its tree.
+ */
+static void move_stable_node(struct stable_node *stable_node, struct page *page)
+{
+	struct rb_node **new;
+	struct rb_node *parent;
+	int nid;
+
+	nid = get_kpfn_nid(stable_node->kpfn);
+	if (nid == stable_node->nid)
+		return;
+
+	new = stable_tree_link(page, stable_node->checksum, nid, &parent);
+	if (!new)
+		return;
+
+	rb_erase(&stable_node->node, root_stable_tree + stable_node->nid);
+	rb_link_node(&stable_node->node, parent, new);
+	rb_insert_color(&stable_node->node, &root_stable_tree[nid]);
+	stable_node->nid = nid;
+}
+
+/*
+ * ksm_migrate_page() cannot take ksm_thread_mutex, so it queues the stable
+ * nodes of the pages it moves to another node: the scan moves them to the
+ * right tree, with ksm_thread_mutex held.
+ */
+static void move_migrated_stable_nodes(void)
+{
+	struct stable_node *stable_node;
+	struct page *page;
+
+	spin_lock(&ksm_migrate_lock);
+	while (!list_empty(&ksm_migrate_nodes)) {
+		stable_node = list_first_entry(&ksm_migrate_nodes,
+					struct stable_node, migrate_list);
+		list_del_init(&stable_node->migrate_list);
+		spin_unlock(&ksm_migrate_lock);
+
+		/* The page lock keeps it from being migrated meanwhile */
+		page = get_ksm_page(stable_node);
+		if (page) {
+			lock_page(page);
+			if (stable_node->kpfn == page_to_pfn(page))
+				move_stable_node(stable_node, page);
+			unlock_page(page);
+			put_page(page);
+		}
+		spin_lock(&ksm_migrate_lock);
+	}
+	spin_unlock(&ksm_migrate_lock);
+}
+#else
+static inline void move_migrated_stable_nodes(void)
+{
+}
+#endif /* CONFIG_NUMA */
+
+/*
+ * The last ksmd thread to complete its part of the full scan completes it:
+ * the unstable tree is reset, and all the threads may start the next one.
+ */
+static void ksm_scan_done(struct ksm_scan *scan)
+{
+	unsigned int i;
+	bool last;
+	int nid;
+
+	mutex_lock(&ksm_thread_mutex);
+	scan->done = true;
+	last = !--ksm_scans_running;
+	if (last) {
+		for (nid = 0; nid < nr_node_ids; nid++)
+			root_unstable_tree[nid] = RB_ROOT;
+
+		ksm_seqnr++;
+		ksm_last_scan_pages = ksm_pages_scanned - ksm_scan_start_pages;
+		ksm_last_scan_jiffies = jiffies - ksm_scan_start_jiffies;
+		ksm_scan_start_pages = ksm_pages_scanned;
+		ksm_scan_start_jiffies = jiffies;
+
+		for (i = 0; i < ksm_nr_scans; i++)
+			ksm_scans[i].done = false;
+		ksm_scans_running = ksm_nr_scans;
+	}
+	mutex_unlock(&ksm_thread_mutex);
+
+	/*
+	 * A number of pages can hang around indefinitely on per-cpu
+	 * pagevecs, raised page count preventing write_protect_page
+	 * from merging them.  Though it doesn't really matter much,
+	 * it is puzzling to see some stuck in pages_volatile until
+	 * other activity jostles them out, and they also prevented
+	 * LTP's KSM test from succeeding deterministically; so drain
+	 * them here (here rather than on entry to ksm_do_scan(),
+	 * so we don't IPI too often when pages_to_scan is set low).
+	 */
+	if (last)
+		lru_add_drain_all();
+}
+
+static struct rmap_item *scan_get_next_rmap_item(struct ksm_scan *scan,
+						 struct page **page)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
 	struct vm_area_struct *vma;
 	struct rmap_item *rmap_item;
 
-	if (list_empty(&ksm_mm_head.mm_list))
-		return NULL;
-
-	slot = ksm_scan.mm_slot;
-	if (slot == &ksm_mm_head) {
-		/*
-		 * A number of pages can hang around indefinitely on per-cpu
-		 * pagevecs, raised page count preventing write_protect_page
-		 * from merging them.  Though it doesn't really matter much,
-		 * it is puzzling to see some stuck in pages_volatile until
-		 * other activity jostles them out, and they also prevented
-		 * LTP's KSM test from succeeding deterministically; so drain
-		 * them here (here rather than on entry to ksm_do_scan(),
-		 * so we don't IPI too often when pages_to_scan is set low).
-		 */
-		lru_add_drain_all();
-
-		root_unstable_tree = RB_ROOT;
+	slot = scan->mm_slot;
+	if (slot == &scan->mm_head) {
+		/* Wait for the other threads to complete the full scan */
+		if (scan->done)
+			return NULL;
 
 		spin_lock(&ksm_mmlist_lock);
 		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
-		ksm_scan.mm_slot = slot;
+		scan->mm_slot = slot;
 		spin_unlock(&ksm_mmlist_lock);
-		/*
-		 * Although we tested list_empty() above, a racing __ksm_exit
-		 * of the last mm on the list may have removed it since then.
-		 */
-		if (slot == &ksm_mm_head)
+
+		if (slot == &scan->mm_head) {
+			ksm_scan_done(scan);
 			return NULL;
+		}
 next_mm:
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 
 	mm = slot->mm;
@@ -1319,60 +1655,60 @@ next_mm:
 	if (ksm_test_exit(mm))
 		vma = NULL;
 	else
-		vma = find_vma(mm, ksm_scan.address);
+		vma = find_vma(mm, scan->address);
 
 	for (; vma; vma = vma->vm_next) {
 		if (!(vma->vm_flags & VM_MERGEABLE))
 			continue;
-		if (ksm_scan.address < vma->vm_start)
-			ksm_scan.address = vma->vm_start;
+		if (scan->address < vma->vm_start)
+			scan->address = vma->vm_start;
 		if (!vma->anon_vma)
-			ksm_scan.address = vma->vm_end;
+			scan->address = vma->vm_end;
 
-		while (ksm_scan.address < vma->vm_end) {
+		while (scan->address < vma->vm_end) {
 			if (ksm_test_exit(mm))
 				break;
-			*page = follow_page(vma, ksm_scan.address, FOLL_GET);
+			*page = follow_page(vma, scan->address, FOLL_GET);
 			if (IS_ERR_OR_NULL(*page)) {
-				ksm_scan.address += PAGE_SIZE;
+				scan->address += PAGE_SIZE;
 				cond_resched();
 				continue;
 			}
 			if (PageAnon(*page) ||
 			    page_trans_compound_anon(*page)) {
-				flush_anon_page(vma, *page, ksm_scan.address);
+				flush_anon_page(vma, *page, scan->address);
 				flush_dcache_page(*page);
 				rmap_item = get_next_rmap_item(slot,
-					ksm_scan.rmap_list, ksm_scan.address);
+					scan->rmap_list, scan->address);
 				if (rmap_item) {
-					ksm_scan.rmap_list =
+					scan->rmap_list =
 							&rmap_item->rmap_list;
-					ksm_scan.address += PAGE_SIZE;
+					scan->address += PAGE_SIZE;
 				} else
 					put_page(*page);
 				up_read(&mm->mmap_sem);
 				return rmap_item;
 			}
 			put_page(*page);
-			ksm_scan.address += PAGE_SIZE;
+			scan->address += PAGE_SIZE;
 			cond_resched();
 		}
 	}
 
 	if (ksm_test_exit(mm)) {
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 	/*
 	 * Nuke all the rmap_items that are above this current rmap:
 	 * because there were no VM_MERGEABLE vmas with such addresses.
 	 */
-	remove_trailing_rmap_items(slot, ksm_scan.rmap_list);
+	defer_trailing_rmap_items(scan, scan->rmap_list);
 
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
+	scan->mm_slot = list_entry(slot->mm_list.next,
 						struct mm_slot, mm_list);
-	if (ksm_scan.address == 0) {
+	if (scan->address == 0) {
 		/*
 		 * We've completed a full scan of all vmas, holding mmap_sem
 		 * throughout, and found no VM_MERGEABLE: so do the same as
@@ -1384,6 +1720,7 @@ next_mm:
 		 */
 		hlist_del(&slot->link);
 		list_del(&slot->mm_list);
+		scan->nr_mm_slots--;
 		spin_unlock(&ksm_mmlist_lock);
 
 		free_mm_slot(slot);
@@ -1396,49 +1733,91 @@ next_mm:
 	}
 
 	/* Repeat until we've completed scanning the whole list */
-	slot = ksm_scan.mm_slot;
-	if (slot != &ksm_mm_head)
+	slot = scan->mm_slot;
+	if (slot != &scan->mm_head)
 		goto next_mm;
 
-	ksm_scan.seqnr++;
+	ksm_scan_done(scan);
 	return NULL;
 }
 
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
+ * @scan - the cursor of this ksmd thread.
  * @scan_npages - number of pages we want to scan before we return.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static void ksm_do_scan(struct ksm_scan *scan, unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
+	unsigned int checksum = 0;
+	bool hashed;
 
 	while (scan_npages-- && likely(!freezing(current))) {
 		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
+		rmap_item = scan_get_next_rmap_item(scan, &page);
 		if (!rmap_item)
-			return;
-		if (!PageKsm(page) || !in_stable_tree(rmap_item))
-			cmp_and_merge_page(page, rmap_item);
+			break;
+
+		/*
+		 * Hashing the page is most of the cost of scanning it, so it
+		 * is done before taking the lock, in parallel with the other
+		 * threads.  A ksm page only needs it if it is not yet linked
+		 * in the stable tree at this address.
+		 */
+		hashed = !PageKsm(page);
+		if (hashed)
+			checksum = calc_checksum(page);
+
+		mutex_lock(&ksm_thread_mutex);
+		remove_stale_rmap_items(scan);
+		move_migrated_stable_nodes();
+		ksm_pages_scanned++;
+		if (!PageKsm(page) || !in_stable_tree(rmap_item)) {
+			if (!hashed)
+				checksum = calc_checksum(page);
+			cmp_and_merge_page(page, rmap_item, checksum);
+		}
+		mutex_unlock(&ksm_thread_mutex);
 		put_page(page);
 	}
+
+	mutex_lock(&ksm_thread_mutex);
+	remove_stale_rmap_items(scan);
+	mutex_unlock(&ksm_thread_mutex);
 }
 
+static bool ksm_has_mm_slots(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ksm_nr_scans; i++)
+		if (!list_empty(&ksm_scans[i].mm_head.mm_list))
+			return true;
+	return false;
+}
+
+/*
+ * All ksmd threads run while any of them has an mm to scan: they need each
+ * other to complete a full scan.
+ */
 static int ksmd_should_run(void)
 {
-	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
+	return (ksm_run & KSM_RUN_MERGE) && ksm_has_mm_slots();
 }
 
-static int ksm_scan_thread(void *nothing)
+static int ksm_scan_thread(void *data)
 {
+	struct ksm_scan *scan = data;
+
 	set_freezable();
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
-		mutex_lock(&ksm_thread_mutex);
+		down_read(&ksm_scan_sem);
 		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
-		mutex_unlock(&ksm_thread_mutex);
+			ksm_do_scan(scan, ksm_thread_pages_to_scan);
+		up_read(&ksm_scan_sem);
 
 		try_to_freeze();
 
@@ -1499,6 +1878,8 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 int __ksm_enter(struct mm_struct *mm)
 {
 	struct mm_slot *mm_slot;
+	struct ksm_scan *scan;
+	unsigned int i;
 	int needs_wakeup;
 
 	mm_slot = alloc_mm_slot();
@@ -1506,16 +1887,23 @@ int __ksm_enter(struct mm_struct *mm)
 		return -ENOMEM;
 
 	/* Check ksm_run too?  Would need tighter locking */
-	needs_wakeup = list_empty(&ksm_mm_head.mm_list);
+	needs_wakeup = !ksm_has_mm_slots();
 
 	spin_lock(&ksm_mmlist_lock);
 	insert_to_mm_slots_hash(mm, mm_slot);
+	/* Give the mm to the ksmd thread with the fewest to scan */
+	scan = &ksm_scans[0];
+	for (i = 1; i < ksm_nr_scans; i++)
+		if (ksm_scans[i].nr_mm_slots < scan->nr_mm_slots)
+			scan = &ksm_scans[i];
+	mm_slot->scan = scan;
+	scan->nr_mm_slots++;
 	/*
 	 * Insert just behind the scanning cursor, to let the area settle
 	 * down a little; when fork is followed by immediate exec, we don't
 	 * want ksmd to waste time setting up and tearing down an rmap_list.
 	 */
-	list_add_tail(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
+	list_add_tail(&mm_slot->mm_list, &scan->mm_slot->mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
 	set_bit(MMF_VM_MERGEABLE, &mm->flags);
@@ -1543,14 +1931,15 @@ void __ksm_exit(struct mm_struct *mm)
 
 	spin_lock(&ksm_mmlist_lock);
 	mm_slot = get_mm_slot(mm);
-	if (mm_slot && ksm_scan.mm_slot != mm_slot) {
+	if (mm_slot && mm_slot->scan->mm_slot != mm_slot) {
 		if (!mm_slot->rmap_list) {
 			hlist_del(&mm_slot->link);
 			list_del(&mm_slot->mm_list);
+			mm_slot->scan->nr_mm_slots--;
 			easy_to_free = 1;
 		} else {
 			list_move(&mm_slot->mm_list,
-				  &ksm_scan.mm_slot->mm_list);
+				  &mm_slot->scan->mm_slot->mm_list);
 		}
 	}
 	spin_unlock(&ksm_mmlist_lock);
@@ -1766,6 +2155,16 @@ void ksm_migrate_page(struct page *newpage, struct page *oldpage)
 	if (stable_node) {
 		VM_BUG_ON(stable_node->kpfn != page_to_pfn(oldpage));
 		stable_node->kpfn = page_to_pfn(newpage);
+#ifdef CONFIG_NUMA
+		/* Have ksmd move it to the tree of the page's new node */
+		if (get_kpfn_nid(stable_node->kpfn) != stable_node->nid) {
+			spin_lock(&ksm_migrate_lock);
+			if (list_empty(&stable_node->migrate_list))
+				list_add_tail(&stable_node->migrate_list,
+					      &ksm_migrate_nodes);
+			spin_unlock(&ksm_migrate_lock);
+		}
+#endif
 	}
 }
 #endif /* CONFIG_MIGRATION */
@@ -1775,14 +2174,18 @@ static struct stable_node *ksm_check_stable_tree(unsigned long start_pfn,
 						 unsigned long end_pfn)
 {
 	struct rb_node *node;
+	int nid;
 
-	for (node = rb_first(&root_stable_tree); node; node = rb_next(node)) {
-		struct stable_node *stable_node;
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		for (node = rb_first(&root_stable_tree[nid]); node;
+						node = rb_next(node)) {
+			struct stable_node *stable_node;
 
-		stable_node = rb_entry(node, struct stable_node, node);
-		if (stable_node->kpfn >= start_pfn &&
-		    stable_node->kpfn < end_pfn)
-			return stable_node;
+			stable_node = rb_entry(node, struct stable_node, node);
+			if (stable_node->kpfn >= start_pfn &&
+			    stable_node->kpfn < end_pfn)
+				return stable_node;
+		}
 	}
 	return NULL;
 }
@@ -1908,6 +2311,7 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 	 * on the list for when ksmd may be set running again).
 	 */
 
+	down_write(&ksm_scan_sem);
 	mutex_lock(&ksm_thread_mutex);
 	if (ksm_run != flags) {
 		ksm_run = flags;
@@ -1925,6 +2329,7 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 		}
 	}
 	mutex_unlock(&ksm_thread_mutex);
+	up_write(&ksm_scan_sem);
 
 	if (flags & KSM_RUN_MERGE)
 		wake_up_interruptible(&ksm_thread_wait);
@@ -1933,6 +2338,45 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 }
 KSM_ATTR(run);
 
+#ifdef CONFIG_NUMA
+static ssize_t merge_across_nodes_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_merge_across_nodes);
+}
+
+static ssize_t merge_across_nodes_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long knob;
+
+	err = strict_strtoul(buf, 10, &knob);
+	if (err)
+		return err;
+	if (knob > 1)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	if (ksm_merge_across_nodes != knob) {
+		/*
+		 * The trees are indexed by node only when merging is kept
+		 * node-local: all ksm pages must be unmerged (by run=2)
+		 * before they can be redistributed between the trees.
+		 */
+		if (ksm_pages_shared)
+			err = -EBUSY;
+		else
+			ksm_merge_across_nodes = knob;
+	}
+	mutex_unlock(&ksm_thread_mutex);
+
+	return err ? err : count;
+}
+KSM_ATTR(merge_across_nodes);
+#endif
+
 static ssize_t pages_shared_show(struct kobject *kobj,
 				 struct kobj_attribute *attr, char *buf)
 {
@@ -1959,7 +2403,7 @@ static ssize_t pages_volatile_show(struct kobject *kobj,
 {
 	long ksm_pages_volatile;
 
-	ksm_pages_volatile = ksm_rmap_items - ksm_pages_shared
+	ksm_pages_volatile = atomic_long_read(&ksm_rmap_items) - ksm_pages_shared
 				- ksm_pages_sharing - ksm_pages_unshared;
 	/*
 	 * It was not worth any locking to calculate that statistic,
@@ -1974,10 +2418,38 @@ KSM_ATTR_RO(pages_volatile);
 static ssize_t full_scans_show(struct kobject *kobj,
 			       struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_scan.seqnr);
+	return sprintf(buf, "%lu\n", ksm_seqnr);
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t scan_threads_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_nr_scans);
+}
+KSM_ATTR_RO(scan_threads);
+
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t last_scan_pages_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_last_scan_pages);
+}
+KSM_ATTR_RO(last_scan_pages);
+
+static ssize_t last_scan_millisecs_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", jiffies_to_msecs(ksm_last_scan_jiffies));
+}
+KSM_ATTR_RO(last_scan_millisecs);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1987,6 +2459,13 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&scan_threads_attr.attr,
+	&pages_scanned_attr.attr,
+	&last_scan_pages_attr.attr,
+	&last_scan_millisecs_attr.attr,
+#ifdef CONFIG_NUMA
+	&merge_across_nodes_attr.attr,
+#endif
 	NULL,
 };
 
@@ -1996,27 +2475,77 @@ static struct attribute_group ksm_attr_group = {
 };
 #endif /* CONFIG_SYSFS */
 
+static int __init ksm_scan_threads_setup(char *str)
+{
+	unsigned long nr;
+
+	if (strict_strtoul(str, 0, &nr) || !nr)
+		return 0;
+	ksm_nr_scans = min_t(unsigned long, nr, nr_cpu_ids);
+	return 1;
+}
+__setup("ksm_scan_threads=", ksm_scan_threads_setup);
+
+static void __init ksm_stop_threads(struct task_struct **threads,
+				    unsigned int nr)
+{
+	while (nr--)
+		kthread_stop(threads[nr]);
+}
+
 static int __init ksm_init(void)
 {
-	struct task_struct *ksm_thread;
+	struct task_struct **threads;
+	unsigned int i;
 	int err;
+	int nid;
+
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		root_stable_tree[nid] = RB_ROOT;
+		root_unstable_tree[nid] = RB_ROOT;
+	}
+
+	ksm_scans = kcalloc(ksm_nr_scans, sizeof(*ksm_scans), GFP_KERNEL);
+	threads = kcalloc(ksm_nr_scans, sizeof(*threads), GFP_KERNEL);
+	if (!ksm_scans || !threads) {
+		err = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < ksm_nr_scans; i++) {
+		INIT_LIST_HEAD(&ksm_scans[i].mm_head.mm_list);
+		ksm_scans[i].mm_slot = &ksm_scans[i].mm_head;
+	}
 
 	err = ksm_slab_init();
 	if (err)
 		goto out;
 
-	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
-	if (IS_ERR(ksm_thread)) {
+	/* Make do with the threads which could be created, if any */
+	for (i = 0; i < ksm_nr_scans; i++) {
+		if (i)
+			threads[i] = kthread_create(ksm_scan_thread,
+					&ksm_scans[i], "ksmd/%u", i);
+		else
+			threads[i] = kthread_create(ksm_scan_thread,
+					&ksm_scans[i], "ksmd");
+		if (IS_ERR(threads[i]))
+			break;
+	}
+	if (!i) {
 		printk(KERN_ERR "ksm: creating kthread failed\n");
-		err = PTR_ERR(ksm_thread);
+		err = PTR_ERR(threads[0]);
 		goto out_free;
 	}
+	ksm_nr_scans = ksm_scans_running = i;
+	ksm_scan_start_jiffies = jiffies;
+	for (i = 0; i < ksm_nr_scans; i++)
+		wake_up_process(threads[i]);
 
 #ifdef CONFIG_SYSFS
 	err = sysfs_create_group(mm_kobj, &ksm_attr_group);
 	if (err) {
 		printk(KERN_ERR "ksm: register sysfs failed\n");
-		kthread_stop(ksm_thread);
+		ksm_stop_threads(threads, ksm_nr_scans);
 		goto out_free;
 	}
 #else
@@ -2031,11 +2560,15 @@ static int __init ksm_init(void)
 	 */
 	hotplug_memory_notifier(ksm_memory_callback, 100);
 #endif
+	kfree(threads);
 	return 0;
 
 out_free:
 	ksm_slab_free();
 out:
+	kfree(threads);
+	kfree(ksm_scans);
+	ksm_scans = NULL;
 	return err;
 }
 module_init(ksm_init)
@@ -0,0 +1,461 @@
+/*
+ * mm/list_lru.c
+ *
+ * LRU lists of reclaimable kernel objects, per node and per memory cgroup.
+ *
+ * Each node has a list for the objects of the root cgroup and, with the
+ * memory controller, a radix tree of lists for the other cgroups, keyed
+ * by css id.  A cgroup's list is allocated when its first object is
+ * added and pins the cgroup, the way swap records do, so that its id is
+ * not reused while objects carry it.  Lists that have run empty are
+ * freed by the next walk of the node.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/list_lru.h>
+#include <linux/memcontrol.h>
+#include <linux/math64.h>
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+struct list_lru_memcg {
+	struct list_lru_one	lru;
+	struct mem_cgroup	*memcg;
+	unsigned short		id;
+};
+
+static inline struct list_lru_one *
+list_lru_from_id(struct list_lru_node *nlru, unsigned short id)
+{
+	struct list_lru_memcg *mlru;
+
+	if (!id)
+		return &nlru->lru;
+	mlru = radix_tree_lookup(&nlru->memcg_lrus, id);
+	return mlru ? &mlru->lru : NULL;
+}
+
+/*
+ * Find the list for an object of cgroup *@id, creating it if need be.
+ * Called with the node lock held, so the list is allocated atomically;
+ * if that fails, or the cgroup is gone, the object is retagged to the
+ * root cgroup.  The cgroup reference then left in *@put is for the
+ * caller to drop with list_lru_put_memcg() after unlocking.
+ */
+static struct list_lru_one *
+list_lru_get_one(struct list_lru_node *nlru, unsigned short *id,
+		 struct mem_cgroup **put)
+{
+	struct list_lru_one *l;
+	struct list_lru_memcg *mlru;
+	struct mem_cgroup *memcg;
+
+	l = list_lru_from_id(nlru, *id);
+	if (l)
+		return l;
+
+	memcg = mem_cgroup_get_by_id(*id);
+	if (!memcg)
+		goto root;
+	mlru = kmalloc(sizeof(*mlru), GFP_ATOMIC | __GFP_NOWARN);
+	if (!mlru)
+		goto put;
+	INIT_LIST_HEAD(&mlru->lru.list);
+	mlru->lru.nr_items = 0;
+	mlru->memcg = memcg;
+	mlru->id = *id;
+	if (radix_tree_insert(&nlru->memcg_lrus, *id, mlru)) {
+		kfree(mlru);
+		goto put;
+	}
+	return &mlru->lru;
+put:
+	*put = memcg;
+root:
+	*id = 0;
+	return &nlru->lru;
+}
+
+static inline void list_lru_put_memcg(struct mem_cgroup *memcg)
+{
+	if (memcg)
+		mem_cgroup_put(memcg);
+}
+
+static inline void list_lru_nr_add(struct list_lru_node *nlru, long nr)
+{
+	nlru->nr_items += nr;
+}
+
+static inline long list_lru_node_nr(struct list_lru_node *nlru)
+{
+	return nlru->nr_items;
+}
+
+/*
+ * Take the empty cgroup lists off @nlru, collecting them on @empty to
+ * be freed with free_memcg_lrus() once the node lock is dropped.
+ */
+static void reap_memcg_lrus(struct list_lru_node *nlru,
+			    struct list_head *empty)
+{
+	struct list_lru_memcg *batch[16];
+	unsigned long index = 1;
+	unsigned int nr, i;
+
+	do {
+		nr = radix_tree_gang_lookup(&nlru->memcg_lrus, (void **)batch,
+					    index, ARRAY_SIZE(batch));
+		for (i = 0; i < nr; i++) {
+			struct list_lru_memcg *mlru = batch[i];
+
+			index = mlru->id + 1;
+			if (mlru->lru.nr_items)
+				continue;
+			radix_tree_delete(&nlru->memcg_lrus, mlru->id);
+			/* the list is empty, reuse its head for the chain */
+			list_add(&mlru->lru.list, empty);
+		}
+	} while (nr == ARRAY_SIZE(batch));
+}
+
+static void free_memcg_lrus(struct list_head *empty)
+{
+	while (!list_empty(empty)) {
+		struct list_lru_memcg *mlru;
+
+		mlru = list_first_entry(empty, struct list_lru_memcg, lru.list);
+		list_del(&mlru->lru.list);
+		mem_cgroup_put(mlru->memcg);
+		kfree(mlru);
+	}
+}
+#else
+static inline struct list_lru_one *
+list_lru_from_id(struct list_lru_node *nlru, unsigned short id)
+{
+	return &nlru->lru;
+}
+
+static inline struct list_lru_one *
+list_lru_get_one(struct list_lru_node *nlru, unsigned short *id,
+		 struct mem_cgroup **put)
+{
+	*id = 0;
+	return &nlru->lru;
+}
+
+static inline void list_lru_put_memcg(struct mem_cgroup *memcg)
+{
+}
+
+static inline void list_lru_nr_add(struct list_lru_node *nlru, long nr)
+{
+}
+
+static inline long list_lru_node_nr(struct list_lru_node *nlru)
+{
+	return nlru->lru.nr_items;
+}
+
+static inline void reap_memcg_lrus(struct list_lru_node *nlru,
+				   struct list_head *empty)
+{
+}
+
+static inline void free_memcg_lrus(struct list_head *empty)
+{
+}
+#endif
+
+/* @budget scaled by @nr / @total, rounded up */
+static unsigned long list_lru_share(unsigned long budget, long nr, long total)
+{
+	if (nr <= 0 || total <= 0)
+		return 0;
+	return div64_u64((u64)budget * nr + total - 1, total);
+}
+
+static inline struct list_lru_node *
+list_lru_item_node(struct list_lru *lru, struct list_head *item)
+{
+	return &lru->node[page_to_nid(virt_to_page(item))];
+}
+
+bool list_lru_add(struct list_lru *lru, struct list_head *item,
+		  unsigned short *memcg_id)
+{
+	struct list_lru_node *nlru = list_lru_item_node(lru, item);
+	struct mem_cgroup *memcg = NULL;
+	unsigned short root_id = 0;
+	struct list_lru_one *l;
+
+	if (!memcg_id)
+		memcg_id = &root_id;
+
+	spin_lock(&nlru->lock);
+	if (list_empty(item)) {
+		l = list_lru_get_one(nlru, memcg_id, &memcg);
+		list_add_tail(item, &l->list);
+		l->nr_items++;
+		list_lru_nr_add(nlru, 1);
+		spin_unlock(&nlru->lock);
+		list_lru_put_memcg(memcg);
+		return true;
+	}
+	spin_unlock(&nlru->lock);
+	return false;
+}
+EXPORT_SYMBOL_GPL(list_lru_add);
+
+bool list_lru_del(struct list_lru *lru, struct list_head *item,
+		  unsigned short *memcg_id)
+{
+	struct list_lru_node *nlru = list_lru_item_node(lru, item);
+	unsigned short root_id = 0;
+	struct list_lru_one *l;
+
+	if (!memcg_id)
+		memcg_id = &root_id;
+
+	spin_lock(&nlru->lock);
+	if (!list_empty(item)) {
+		l = list_lru_from_id(nlru, *memcg_id);
+		list_del_init(item);
+		l->nr_items--;
+		list_lru_nr_add(nlru, -1);
+		spin_unlock(&nlru->lock);
+		return true;
+	}
+	spin_unlock(&nlru->lock);
+	return false;
+}
+EXPORT_SYMBOL_GPL(list_lru_del);
+
+unsigned long list_lru_count_node(struct list_lru *lru, int nid,
+				  struct mem_cgroup *memcg)
+{
+	struct list_lru_node *nlru = &lru->node[nid];
+	struct list_lru_one *l;
+	long count = 0;
+
+	if (!memcg)
+		return max(list_lru_node_nr(nlru), 0L);
+
+	spin_lock(&nlru->lock);
+	l = list_lru_from_id(nlru, mem_cgroup_id(memcg));
+	if (l)
+		count = l->nr_items;
+	spin_unlock(&nlru->lock);
+
+	return max(count, 0L);
+}
+EXPORT_SYMBOL_GPL(list_lru_count_node);
+
+unsigned long list_lru_count_nodemask(struct list_lru *lru,
+				      const nodemask_t *nodes,
+				      struct mem_cgroup *memcg)
+{
+	unsigned long count = 0;
+	int nid;
+
+	for_each_node_mask(nid, *nodes)
+		count += list_lru_count_node(lru, nid, memcg);
+
+	return count;
+}
+EXPORT_SYMBOL_GPL(list_lru_count_nodemask);
+
+static unsigned long
+list_lru_walk_one(struct list_lru_node *nlru, unsigned short id,
+		  list_lru_walk_cb isolate, void *cb_arg,
+		  unsigned long *nr_to_walk)
+{
+	struct list_lru_one *l;
+	struct list_head *item, *n;
+	unsigned long isolated = 0;
+
+	spin_lock(&nlru->lock);
+restart:
+	/* the list may have been reaped while the lock was dropped */
+	l = list_lru_from_id(nlru, id);
+	if (!l)
+		goto out;
+	list_for_each_safe(item, n, &l->list) {
+		enum lru_status ret;
+
+		if (!*nr_to_walk)
+			break;
+		--*nr_to_walk;
+
+		ret = isolate(item, l, &nlru->lock, cb_arg);
+		switch (ret) {
+		case LRU_REMOVED:
+			list_lru_nr_add(nlru, -1);
+			isolated++;
+			break;
+		case LRU_REMOVED_RETRY:
+			list_lru_nr_add(nlru, -1);
+			isolated++;
+			goto restart;
+		case LRU_ROTATE:
+			list_move_tail(item, &l->list);
+			break;
+		case LRU_SKIP:
+			break;
+		case LRU_RETRY:
+			goto restart;
+		default:
+			BUG();
+		}
+	}
+out:
+	spin_unlock(&nlru->lock);
+	return isolated;
+}
+
+unsigned long list_lru_walk_node(struct list_lru *lru, int nid,
+				 struct mem_cgroup *memcg,
+				 list_lru_walk_cb isolate, void *cb_arg,
+				 unsigned long *nr_to_walk)
+{
+	struct list_lru_node *nlru = &lru->node[nid];
+	unsigned long isolated;
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+	struct list_lru_memcg *batch[16];
+	unsigned short ids[ARRAY_SIZE(batch)];
+	unsigned long shares[ARRAY_SIZE(batch)];
+	unsigned long budget = *nr_to_walk;
+	unsigned long index = 1;
+	unsigned int nr, i;
+	long total;
+	LIST_HEAD(empty);
+
+	if (memcg)
+		return list_lru_walk_one(nlru, mem_cgroup_id(memcg),
+					 isolate, cb_arg, nr_to_walk);
+
+	/*
+	 * Global reclaim: give every cgroup's list a share of the walk in
+	 * proportion to its size, starting with the root cgroup's.  The
+	 * shares are sampled under the lock, as the lists may be reaped
+	 * by a concurrent walk once it is dropped.
+	 */
+	spin_lock(&nlru->lock);
+	total = max(list_lru_node_nr(nlru), 1L);
+	shares[0] = list_lru_share(budget, nlru->lru.nr_items, total);
+	spin_unlock(&nlru->lock);
+
+	shares[0] = min(shares[0], *nr_to_walk);
+	*nr_to_walk -= shares[0];
+	isolated = list_lru_walk_one(nlru, 0, isolate, cb_arg, &shares[0]);
+	*nr_to_walk += shares[0];
+
+	do {
+		spin_lock(&nlru->lock);
+		nr = radix_tree_gang_lookup(&nlru->memcg_lrus, (void **)batch,
+					    index, ARRAY_SIZE(batch));
+		for (i = 0; i < nr; i++) {
+			ids[i] = batch[i]->id;
+			shares[i] = list_lru_share(budget,
+						   batch[i]->lru.nr_items, total);
+		}
+		spin_unlock(&nlru->lock);
+
+		for (i = 0; i < nr && *nr_to_walk; i++) {
+			shares[i] = min(shares[i], *nr_to_walk);
+			*nr_to_walk -= shares[i];
+			isolated += list_lru_walk_one(nlru, ids[i], isolate,
+						      cb_arg, &shares[i]);
+			*nr_to_walk += shares[i];
+		}
+		if (nr)
+			index = ids[nr - 1] + 1;
+	} while (nr == ARRAY_SIZE(batch) && *nr_to_walk);
+
+	spin_lock(&nlru->lock);
+	reap_memcg_lrus(nlru, &empty);
+	spin_unlock(&nlru->lock);
+	free_memcg_lrus(&empty);
+#else
+	isolated = list_lru_walk_one(nlru, 0, isolate, cb_arg, nr_to_walk);
+#endif
+	return isolated;
+}
+EXPORT_SYMBOL_GPL(list_lru_walk_node);
+
+unsigned long list_lru_walk_nodemask(struct list_lru *lru,
+				     const nodemask_t *nodes,
+				     struct mem_cgroup *memcg,
+				     list_lru_walk_cb isolate, void *cb_arg,
+				     unsigned long nr_to_walk)
+{
+	unsigned long total = list_lru_count_nodemask(lru, nodes, memcg);
+	unsigned long isolated = 0;
+	int nid;
+
+	if (!total)
+		return 0;
+
+	/* spread the walk over the nodes in proportion to their lists */
+	for_each_node_mask(nid, *nodes) {
+		unsigned long nr;
+
+		nr = list_lru_count_node(lru, nid, memcg);
+		if (!nr)
+			continue;
+		nr = list_lru_share(nr_to_walk, nr, total);
+		isolated += list_lru_walk_node(lru, nid, memcg,
+					       isolate, cb_arg, &nr);
+	}
+	return isolated;
+}
+EXPORT_SYMBOL_GPL(list_lru_walk_nodemask);
+
+/*
+ * @key gives the list locks their own lockdep class, for a list_lru
+ * whose lock nests inside an irq-safe lock.
+ */
+int list_lru_init_key(struct list_lru *lru, struct lock_class_key *key)
+{
+	int i;
+
+	lru->node = kzalloc(nr_node_ids * sizeof(*lru->node), GFP_KERNEL);
+	if (!lru->node)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_node_ids; i++) {
+		spin_lock_init(&lru->node[i].lock);
+		if (key)
+			lockdep_set_class(&lru->node[i].lock, key);
+		INIT_LIST_HEAD(&lru->node[i].lru.list);
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+		INIT_RADIX_TREE(&lru->node[i].memcg_lrus, GFP_ATOMIC);
+#endif
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(list_lru_init_key);
+
+void list_lru_destroy(struct list_lru *lru)
+{
+	int i;
+
+	if (!lru->node)
+		return;
+
+	for (i = 0; i < nr_node_ids; i++) {
+		LIST_HEAD(empty);
+
+		spin_lock(&lru->node[i].lock);
+		reap_memcg_lrus(&lru->node[i], &empty);
+		WARN_ON_ONCE(list_lru_node_nr(&lru->node[i]));
+		spin_unlock(&lru->node[i].lock);
+		free_memcg_lrus(&empty);
+	}
+	kfree(lru->node);
+	lru->node = NULL;
+}
+EXPORT_SYMBOL_GPL(list_lru_destroy);
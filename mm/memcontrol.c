@@ -39,6 +39,7 @@
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
+#include <linux/shmem_fs.h>
 #include <linux/spinlock.h>
 #include <linux/eventfd.h>
 #include <linux/sort.h>
@@ -369,7 +370,6 @@ enum charge_type {
 #define MEM_CGROUP_RECLAIM_SHRINK	(1 << MEM_CGROUP_RECLAIM_SHRINK_BIT)
 
 static void mem_cgroup_get(struct mem_cgroup *memcg);
-static void mem_cgroup_put(struct mem_cgroup *memcg);
 
 /* Writing them here to avoid exposing memcg's inner layout */
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
@@ -2376,6 +2376,49 @@ static struct mem_cgroup *mem_cgroup_lookup(unsigned short id)
 	return container_of(css, struct mem_cgroup, css);
 }
 
+/*
+ * Kernel objects on memcg-aware LRU lists (see mm/list_lru.c) are tagged
+ * with the css id of the cgroup of the task that allocated them, or 0
+ * for the root cgroup.
+ */
+unsigned short mem_cgroup_id(struct mem_cgroup *memcg)
+{
+	if (!memcg || mem_cgroup_is_root(memcg))
+		return 0;
+	return css_id(&memcg->css);
+}
+
+unsigned short mem_cgroup_current_id(void)
+{
+	unsigned short id;
+
+	if (mem_cgroup_disabled())
+		return 0;
+	rcu_read_lock();
+	id = mem_cgroup_id(mem_cgroup_from_task(current));
+	rcu_read_unlock();
+	return id;
+}
+
+/*
+ * Pins the cgroup of @id, like a swap record does, for as long as a list
+ * of its objects exists.  Returns NULL if the cgroup is gone or being
+ * removed; its objects then go to the lists of the root cgroup.
+ */
+struct mem_cgroup *mem_cgroup_get_by_id(unsigned short id)
+{
+	struct mem_cgroup *memcg;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_lookup(id);
+	if (memcg && !css_is_removed(&memcg->css))
+		mem_cgroup_get(memcg);
+	else
+		memcg = NULL;
+	rcu_read_unlock();
+	return memcg;
+}
+
 struct mem_cgroup *try_get_mem_cgroup_from_page(struct page *page)
 {
 	struct mem_cgroup *memcg = NULL;
@@ -4821,7 +4864,7 @@ static void __mem_cgroup_put(struct mem_cgroup *memcg, int count)
 	}
 }
 
-static void mem_cgroup_put(struct mem_cgroup *memcg)
+void mem_cgroup_put(struct mem_cgroup *memcg)
 {
 	__mem_cgroup_put(memcg, 1);
 }
@@ -5127,17 +5170,20 @@ static struct page *mc_handle_file_pte(struct vm_area_struct *vma,
 		pgoff = pte_to_pgoff(ptent);
 
 	/* page is moved even if it's not RSS of this task(page-faulted). */
-	page = find_get_page(mapping, pgoff);
+	page = find_get_entry(mapping, pgoff);
 
-#ifdef CONFIG_SWAP
-	/* shmem/tmpfs may report page out on swap: account for that too. */
 	if (radix_tree_exceptional_entry(page)) {
-		swp_entry_t swap = radix_to_swp_entry(page);
-		if (do_swap_account)
-			*entry = swap;
-		page = find_get_page(&swapper_space, swap.val);
-	}
+#ifdef CONFIG_SWAP
+		/* shmem/tmpfs may report page out on swap: account for that too. */
+		if (shmem_mapping(mapping)) {
+			swp_entry_t swap = radix_to_swp_entry(page);
+			if (do_swap_account)
+				*entry = swap;
+			page = find_get_page(&swapper_space, swap.val);
+		} else
 #endif
+			page = NULL;	/* shadow of an evicted page */
+	}
 	return page;
 }
 
@@ -57,6 +57,7 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/userfaultfd_k.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -1129,6 +1130,7 @@ again:
 	init_rss_vec(rss);
 	start_pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
 	pte = start_pte;
+	flush_tlb_batched_pending(mm);
 	arch_enter_lazy_mmu_mode();
 	do {
 		pte_t ptent = *pte;
@@ -3099,6 +3101,10 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (check_stack_guard_page(vma, address) < 0)
 		return VM_FAULT_SIGBUS;
 
+	/* The missing pages of a registered range are supplied by userspace */
+	if (userfaultfd_missing(vma))
+		return handle_userfault(vma, address, flags);
+
 	/* Use the zero-page for reads */
 	if (!(flags & FAULT_FLAG_WRITE)) {
 		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
@@ -3148,6 +3154,115 @@ oom:
 	return VM_FAULT_OOM;
 }
 
+/**
+ * do_set_pte - setup new PTE entry for given page and add reverse page mapping.
+ * @vma: virtual memory area
+ * @address: user virtual address
+ * @page: page to map
+ * @pte: pointer to target page table entry
+ * @write: true, if new entry is writable
+ * @anon: true, if it's anonymous page
+ *
+ * Caller must hold page table lock relevant for @pte.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte, bool write, bool anon)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	if (write)
+		entry = maybe_mkwrite(pte_mkdirty(entry), vma);
+	if (anon) {
+		inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	} else {
+		inc_mm_counter_fast(vma->vm_mm, MM_FILEPAGES);
+		page_add_file_rmap(page);
+	}
+	set_pte_at(vma->vm_mm, address, pte, entry);
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, pte);
+}
+
+/*
+ * On a read fault, map the pages around the faulting address which are
+ * already uptodate in the page cache, sysctl_fault_around_bytes worth of
+ * them in an aligned window, to save the faults on their first access.
+ */
+unsigned long sysctl_fault_around_bytes __read_mostly = 65536;
+
+static inline unsigned long fault_around_pages(void)
+{
+	return ACCESS_ONCE(sysctl_fault_around_bytes) >> PAGE_SHIFT;
+}
+
+int fault_around_bytes_sysctl_handler(struct ctl_table *table, int write,
+		void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_doulongvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	/* The window is aligned, and must not cross a page table */
+	sysctl_fault_around_bytes = clamp_t(unsigned long,
+			sysctl_fault_around_bytes, PAGE_SIZE,
+			PTRS_PER_PTE * PAGE_SIZE);
+	sysctl_fault_around_bytes =
+		rounddown_pow_of_two(sysctl_fault_around_bytes);
+	return 0;
+}
+
+/*
+ * Call ->map_pages() for the window around address, within the vma and
+ * the page table.  Called with the page table lock held and pte mapped.
+ */
+static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pte_t *pte, pgoff_t pgoff, unsigned int flags)
+{
+	unsigned long nr_pages = fault_around_pages();
+	unsigned long start_addr;
+	pgoff_t max_pgoff;
+	struct vm_fault vmf;
+	int off;
+
+	start_addr = max(address & ~(nr_pages * PAGE_SIZE - 1),
+			 vma->vm_start);
+	off = ((address - start_addr) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1);
+	pte -= off;
+	pgoff -= off;
+
+	/*
+	 * max_pgoff is either end of page table or end of vma
+	 * or nr_pages from pgoff, depending what is nearest.
+	 */
+	max_pgoff = pgoff - ((start_addr >> PAGE_SHIFT) & (PTRS_PER_PTE - 1)) +
+		PTRS_PER_PTE - 1;
+	max_pgoff = min3(max_pgoff, vma_pages(vma) + vma->vm_pgoff - 1,
+			 pgoff + nr_pages - 1);
+
+	/* Check if it makes any sense to call ->map_pages */
+	while (!pte_none(*pte)) {
+		if (++pgoff > max_pgoff)
+			return;
+		start_addr += PAGE_SIZE;
+		if (start_addr >= vma->vm_end)
+			return;
+		pte++;
+	}
+
+	vmf.virtual_address = (void __user *) start_addr;
+	vmf.pte = pte;
+	vmf.pgoff = pgoff;
+	vmf.max_pgoff = max_pgoff;
+	vmf.flags = flags;
+	vma->vm_ops->map_pages(vma, &vmf);
+}
+
 /*
  * __do_fault() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -3169,7 +3284,6 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	spinlock_t *ptl;
 	struct page *page;
 	struct page *cow_page;
-	pte_t entry;
 	int anon = 0;
 	struct page *dirty_page = NULL;
 	struct vm_fault vmf;
@@ -3278,25 +3392,12 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	 */
 	/* Only go through if we didn't race with anybody else... */
 	if (likely(pte_same(*page_table, orig_pte))) {
-		flush_icache_page(vma, page);
-		entry = mk_pte(page, vma->vm_page_prot);
-		if (flags & FAULT_FLAG_WRITE)
-			entry = maybe_mkwrite(pte_mkdirty(entry), vma);
-		if (anon) {
-			inc_mm_counter_fast(mm, MM_ANONPAGES);
-			page_add_new_anon_rmap(page, vma, address);
-		} else {
-			inc_mm_counter_fast(mm, MM_FILEPAGES);
-			page_add_file_rmap(page);
-			if (flags & FAULT_FLAG_WRITE) {
-				dirty_page = page;
-				get_page(dirty_page);
-			}
+		do_set_pte(vma, address, page, page_table,
+			   flags & FAULT_FLAG_WRITE, anon);
+		if (!anon && (flags & FAULT_FLAG_WRITE)) {
+			dirty_page = page;
+			get_page(dirty_page);
 		}
-		set_pte_at(mm, address, page_table, entry);
-
-		/* no need to invalidate: a not-present page won't be cached */
-		update_mmu_cache(vma, address, page_table);
 	} else {
 		if (cow_page)
 			mem_cgroup_uncharge_page(cow_page);
@@ -3352,8 +3453,26 @@ static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 {
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	spinlock_t *ptl;
 
 	pte_unmap(page_table);
+
+	/*
+	 * Let ->map_pages() map what is cached around a read fault first:
+	 * it may well map the faulting page too, and then we are done.
+	 */
+	if (!(flags & FAULT_FLAG_WRITE) && vma->vm_ops->map_pages &&
+	    fault_around_pages() > 1) {
+		page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+		do_fault_around(vma, address, page_table, pgoff, flags);
+		if (!pte_same(*page_table, orig_pte)) {
+			pte_unmap_unlock(page_table, ptl);
+			count_vm_event(FAULT_AROUND);
+			return 0;
+		}
+		pte_unmap_unlock(page_table, ptl);
+	}
+
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
@@ -3485,7 +3604,8 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (!pmd)
 		return VM_FAULT_OOM;
 	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
-		if (!vma->vm_ops)
+		/* userfaultfd resolves faults a page at a time */
+		if (!vma->vm_ops && !userfaultfd_missing(vma))
 			return do_huge_pmd_anonymous_page(mm, vma, address,
 							  pmd, flags);
 	} else {
@@ -3522,6 +3642,207 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Bound on the depth of find_vma_speculative()'s walk: a rebalance of the
+ * rbtree running concurrently might otherwise lead it round in a circle.
+ */
+#define SPF_MAX_DEPTH	64
+
+/*
+ * Lockless variant of find_vma(), returning only a vma which covers addr.
+ * The caller must hold rcu_read_lock() and validate the result against
+ * mm->mmap_seq: the vma may be unlinked and its memory reused meanwhile.
+ */
+static struct vm_area_struct *find_vma_speculative(struct mm_struct *mm,
+						   unsigned long addr)
+{
+	struct rb_node *rb_node = ACCESS_ONCE(mm->mm_rb.rb_node);
+	int depth = 0;
+
+	while (rb_node && depth++ < SPF_MAX_DEPTH) {
+		struct vm_area_struct *vma;
+
+		vma = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (ACCESS_ONCE(vma->vm_end) > addr) {
+			if (ACCESS_ONCE(vma->vm_start) <= addr)
+				return vma;
+			rb_node = ACCESS_ONCE(rb_node->rb_left);
+		} else
+			rb_node = ACCESS_ONCE(rb_node->rb_right);
+	}
+	return NULL;
+}
+
+/*
+ * Find the pmd mapping a pte table for address, without allocating, and
+ * copy its value to *pmdval.  Called with interrupts disabled: that holds
+ * off the TLB flush which must precede the freeing of any page table, as
+ * in get_user_pages_fast().
+ */
+static pmd_t *spf_pmd_lookup(struct mm_struct *mm, unsigned long address,
+			     pmd_t *pmdval)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+	pmd = pmd_offset(pud, address);
+	*pmdval = *pmd;
+	barrier();
+	if (pmd_none(*pmdval) || pmd_trans_huge(*pmdval) || pmd_bad(*pmdval))
+		return NULL;
+	return pmd;
+}
+
+/**
+ * handle_speculative_fault - try to resolve a fault without mmap_sem
+ * @mm: the faulting mm, which must be current->mm
+ * @address: the faulting address
+ * @flags: FAULT_FLAG_xxx as for handle_mm_fault()
+ *
+ * Handles the first touch of a page in a private anonymous vma which has
+ * its anon_vma and page table already: the common case of a heap being
+ * populated by many threads.  The vma is looked up and copied locklessly,
+ * and that copy is trusted only if mm->mmap_seq has not moved by the time
+ * the new pte is installed under the page table lock.
+ *
+ * Returns VM_FAULT_RETRY if the fault must be handled in the ordinary
+ * way, with mmap_sem held; or 0 when the page has been mapped.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma, vma_copy;
+	struct page *page = NULL;
+	spinlock_t *ptl;
+	pmd_t *pmd, pmdval;
+	pte_t *pte, entry;
+	unsigned long irqflags;
+	unsigned int seq;
+
+	seq = ACCESS_ONCE(mm->mmap_seq.sequence);
+	smp_rmb();
+	if (seq & 1)
+		goto fallback;
+
+	rcu_read_lock();
+	vma = find_vma_speculative(mm, address);
+	if (vma)
+		vma_copy = *vma;
+	rcu_read_unlock();
+	if (!vma || read_seqcount_retry(&mm->mmap_seq, seq))
+		goto fallback;
+	vma = &vma_copy;
+
+	/*
+	 * Only private anonymous memory, without any of the flags which need
+	 * more care than do_anonymous_page() gives it; and leave access
+	 * errors to be reported by the ordinary path.  The faults of a range
+	 * registered with a userfaultfd are reported to userspace, which
+	 * needs mmap_sem to be dropped.
+	 */
+	if (vma->vm_mm != mm || vma->vm_file || vma->vm_ops || !vma->anon_vma)
+		goto fallback;
+	if (vma->vm_flags & (VM_SHARED | VM_LOCKED | VM_GROWSDOWN | VM_GROWSUP |
+			     VM_HUGETLB | VM_PFNMAP | VM_MIXEDMAP | VM_IO))
+		goto fallback;
+	if (vma_policy(vma) || userfaultfd_missing(vma))
+		goto fallback;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vma->vm_flags & VM_WRITE))
+			goto fallback;
+	} else if (!(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+		goto fallback;
+
+	/*
+	 * Don't bother to allocate unless the pte is still empty.  The
+	 * fault may have been taken with interrupts off: leave them so.
+	 */
+	local_irq_save(irqflags);
+	pmd = spf_pmd_lookup(mm, address, &pmdval);
+	if (pmd) {
+		pte = pte_offset_map(&pmdval, address);
+		entry = *pte;
+		pte_unmap(pte);
+	}
+	local_irq_restore(irqflags);
+	if (!pmd || !pte_none(entry))
+		goto fallback;
+
+	if (flags & FAULT_FLAG_WRITE) {
+		page = alloc_zeroed_user_highpage_movable(vma, address);
+		if (!page)
+			goto fallback;
+		__SetPageUptodate(page);
+
+		if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+			page_cache_release(page);
+			goto fallback;
+		}
+
+		entry = mk_pte(page, vma->vm_page_prot);
+		if (vma->vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+	} else {
+		/* Use the zero-page for reads */
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+						vma->vm_page_prot));
+	}
+
+	/*
+	 * We cannot wait for the page table lock with interrupts disabled,
+	 * as its holder may be waiting on us to acknowledge a TLB flush.
+	 */
+	local_irq_save(irqflags);
+	pmd = spf_pmd_lookup(mm, address, &pmdval);
+	if (!pmd)
+		goto out_irq;
+	ptl = pte_lockptr(mm, &pmdval);
+	if (!spin_trylock(ptl))
+		goto out_irq;
+	pte = pte_offset_map(&pmdval, address);
+	if (!pmd_same(*pmd, pmdval) || !pte_none(*pte))
+		goto out_unlock;
+	if (read_seqcount_retry(&mm->mmap_seq, seq))
+		goto out_unlock;
+
+	if (page) {
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	}
+	set_pte_at(mm, address, pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, pte);
+	pte_unmap_unlock(pte, ptl);
+	local_irq_restore(irqflags);
+
+	count_vm_event(PGFAULT);
+	mem_cgroup_count_vm_event(mm, PGFAULT);
+	count_vm_event(SPF_SUCCESS);
+	return 0;
+
+out_unlock:
+	pte_unmap_unlock(pte, ptl);
+out_irq:
+	local_irq_restore(irqflags);
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+fallback:
+	count_vm_event(SPF_FALLBACK);
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
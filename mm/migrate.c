@@ -426,6 +426,8 @@ void migrate_page_copy(struct page *newpage, struct page *page)
 		SetPageChecked(newpage);
 	if (PageMappedToDisk(page))
 		SetPageMappedToDisk(newpage);
+	if (PageRaUnused(page))
+		SetPageRaUnused(newpage);
 
 	if (PageDirty(page)) {
 		clear_page_dirty_for_io(page);
@@ -801,8 +803,13 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 		goto skip_unmap;
 	}
 
-	/* Establish migration ptes or remove ptes */
-	try_to_unmap(page, TTU_MIGRATION|TTU_IGNORE_MLOCK|TTU_IGNORE_ACCESS);
+	/*
+	 * Establish migration ptes or remove ptes, with one TLB flush for
+	 * all the mappings of the page, before it is copied.
+	 */
+	try_to_unmap(page, TTU_MIGRATION|TTU_IGNORE_MLOCK|TTU_IGNORE_ACCESS|
+			   TTU_BATCH_FLUSH);
+	try_to_unmap_flush();
 
 skip_unmap:
 	if (!page_mapped(page))
@@ -150,6 +150,8 @@ int pageblock_order __read_mostly;
 #endif
 
 static void __free_pages_ok(struct page *page, unsigned int order);
+static void free_hot_cold_page_order(struct page *page, unsigned int order,
+				     int cold);
 
 /*
  * results with 256, 32 in the lowmem_reserve sysctl:
@@ -620,8 +622,8 @@ static inline int free_pages_check(struct page *page)
 
 /*
  * Frees a number of pages from the PCP lists
- * Assumes all pages on list are in same zone, and of same order.
- * count is the number of pages to free.
+ * Assumes all pages on list are in same zone.
+ * count is the number of base pages to free, pcp->count is updated.
  *
  * If the zone was previously in an "all pages pinned" state then look to
  * see if this freeing clears that state.
@@ -632,17 +634,20 @@ static inline int free_pages_check(struct page *page)
 static void free_pcppages_bulk(struct zone *zone, int count,
 					struct per_cpu_pages *pcp)
 {
-	int migratetype = 0;
+	int pindex = 0;
 	int batch_free = 0;
-	int to_free = count;
+	int to_free = min(count, pcp->count);
+	int freed = 0;
 
 	spin_lock(&zone->lock);
 	zone->all_unreclaimable = 0;
 	zone->pages_scanned = 0;
 
-	while (to_free) {
+	/* A high-order page may take to_free below zero */
+	while (to_free > 0) {
 		struct page *page;
 		struct list_head *list;
+		unsigned int order;
 
 		/*
 		 * Remove pages from lists in a round-robin fashion. A
@@ -653,25 +658,29 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 		 */
 		do {
 			batch_free++;
-			if (++migratetype == MIGRATE_PCPTYPES)
-				migratetype = 0;
-			list = &pcp->lists[migratetype];
+			if (++pindex == NR_PCP_LISTS)
+				pindex = 0;
+			list = &pcp->lists[pindex];
 		} while (list_empty(list));
 
 		/* This is the only non-empty list. Free them all. */
-		if (batch_free == MIGRATE_PCPTYPES)
+		if (batch_free == NR_PCP_LISTS)
 			batch_free = to_free;
 
+		order = pindex / MIGRATE_PCPTYPES;
 		do {
 			page = list_entry(list->prev, struct page, lru);
 			/* must delete as __free_one_page list manipulates */
 			list_del(&page->lru);
 			/* MIGRATE_MOVABLE list may include MIGRATE_RESERVEs */
-			__free_one_page(page, zone, 0, page_private(page));
-			trace_mm_page_pcpu_drain(page, 0, page_private(page));
-		} while (--to_free && --batch_free && !list_empty(list));
+			__free_one_page(page, zone, order, page_private(page));
+			trace_mm_page_pcpu_drain(page, order, page_private(page));
+			to_free -= 1 << order;
+			freed += 1 << order;
+		} while (to_free > 0 && --batch_free && !list_empty(list));
 	}
-	__mod_zone_page_state(zone, NR_FREE_PAGES, count);
+	pcp->count -= freed;
+	__mod_zone_page_state(zone, NR_FREE_PAGES, freed);
 	spin_unlock(&zone->lock);
 }
 
@@ -716,8 +725,14 @@ static bool free_pages_prepare(struct page *page, unsigned int order)
 static void __free_pages_ok(struct page *page, unsigned int order)
 {
 	unsigned long flags;
-	int wasMlocked = __TestClearPageMlocked(page);
+	int wasMlocked;
+
+	if (order < NR_PCP_ORDERS) {
+		free_hot_cold_page_order(page, order, 0);
+		return;
+	}
 
+	wasMlocked = __TestClearPageMlocked(page);
 	if (!free_pages_prepare(page, order))
 		return;
 
@@ -1119,7 +1134,6 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 	else
 		to_drain = pcp->count;
 	free_pcppages_bulk(zone, to_drain, pcp);
-	pcp->count -= to_drain;
 	local_irq_restore(flags);
 }
 #endif
@@ -1144,10 +1158,8 @@ static void drain_pages(unsigned int cpu)
 		pset = per_cpu_ptr(zone->pageset, cpu);
 
 		pcp = &pset->pcp;
-		if (pcp->count) {
+		if (pcp->count)
 			free_pcppages_bulk(zone, pcp->count, pcp);
-			pcp->count = 0;
-		}
 		local_irq_restore(flags);
 	}
 }
@@ -1205,10 +1217,11 @@ void mark_free_pages(struct zone *zone)
 #endif /* CONFIG_PM */
 
 /*
- * Free a 0-order page
+ * Free a page of an order that is kept on the pcp lists
  * cold == 1 ? free a cold page : free a hot page
  */
-void free_hot_cold_page(struct page *page, int cold)
+static void free_hot_cold_page_order(struct page *page, unsigned int order,
+				     int cold)
 {
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
@@ -1216,7 +1229,12 @@ void free_hot_cold_page(struct page *page, int cold)
 	int migratetype;
 	int wasMlocked = __TestClearPageMlocked(page);
 
-	if (!free_pages_prepare(page, 0))
+	if (!free_pages_prepare(page, order))
+		return;
+
+	/* Pages are taken off the pcp lists without prep_compound_page undone */
+	if (order && PageCompound(page) &&
+	    unlikely(destroy_compound_page(page, order)))
 		return;
 
 	migratetype = get_pageblock_migratetype(page);
@@ -1224,7 +1242,7 @@ void free_hot_cold_page(struct page *page, int cold)
 	local_irq_save(flags);
 	if (unlikely(wasMlocked))
 		free_page_mlock(page);
-	__count_vm_event(PGFREE);
+	__count_vm_events(PGFREE, 1 << order);
 
 	/*
 	 * We only track unmovable, reclaimable and movable on pcp lists.
@@ -1235,7 +1253,7 @@ void free_hot_cold_page(struct page *page, int cold)
 	 */
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(migratetype == MIGRATE_ISOLATE)) {
-			free_one_page(zone, page, 0, migratetype);
+			free_one_page(zone, page, order, migratetype);
 			goto out;
 		}
 		migratetype = MIGRATE_MOVABLE;
@@ -1243,19 +1261,28 @@ void free_hot_cold_page(struct page *page, int cold)
 
 	pcp = &this_cpu_ptr(zone->pageset)->pcp;
 	if (cold)
-		list_add_tail(&page->lru, &pcp->lists[migratetype]);
+		list_add_tail(&page->lru, pcp_list(pcp, migratetype, order));
 	else
-		list_add(&page->lru, &pcp->lists[migratetype]);
-	pcp->count++;
-	if (pcp->count >= pcp->high) {
+		list_add(&page->lru, pcp_list(pcp, migratetype, order));
+	pcp->count += 1 << order;
+	if (order)
+		__count_vm_event(PCP_HIGH_ORDER_FREE);
+	if (pcp->count >= pcp->high)
 		free_pcppages_bulk(zone, pcp->batch, pcp);
-		pcp->count -= pcp->batch;
-	}
 
 out:
 	local_irq_restore(flags);
 }
 
+/*
+ * Free a 0-order page
+ * cold == 1 ? free a cold page : free a hot page
+ */
+void free_hot_cold_page(struct page *page, int cold)
+{
+	free_hot_cold_page_order(page, 0, cold);
+}
+
 /*
  * Free a list of 0-order pages
  */
@@ -1356,18 +1383,34 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 	struct page *page;
 	int cold = !!(gfp_flags & __GFP_COLD);
 
+	if (unlikely(gfp_flags & __GFP_NOFAIL)) {
+		/*
+		 * __GFP_NOFAIL is not to be used in new code.
+		 *
+		 * All __GFP_NOFAIL callers should be fixed so that they
+		 * properly detect and handle allocation failures.
+		 *
+		 * We most definitely don't want callers attempting to
+		 * allocate greater than order-1 page units with
+		 * __GFP_NOFAIL.
+		 */
+		WARN_ON_ONCE(order > 1);
+	}
+
 again:
-	if (likely(order == 0)) {
+	if (likely(order < NR_PCP_ORDERS)) {
 		struct per_cpu_pages *pcp;
 		struct list_head *list;
 
 		local_irq_save(flags);
 		pcp = &this_cpu_ptr(zone->pageset)->pcp;
-		list = &pcp->lists[migratetype];
+		list = pcp_list(pcp, migratetype, order);
 		if (list_empty(list)) {
-			pcp->count += rmqueue_bulk(zone, 0,
-					pcp->batch, list,
-					migratetype, cold);
+			pcp->count += rmqueue_bulk(zone, order,
+					max(pcp->batch >> order, 1), list,
+					migratetype, cold) << order;
+			if (order)
+				__count_vm_event(PCP_HIGH_ORDER_REFILL);
 			if (unlikely(list_empty(list)))
 				goto failed;
 		}
@@ -1378,21 +1421,10 @@ again:
 			page = list_entry(list->next, struct page, lru);
 
 		list_del(&page->lru);
-		pcp->count--;
+		pcp->count -= 1 << order;
+		if (order)
+			__count_vm_event(PCP_HIGH_ORDER_ALLOC);
 	} else {
-		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
-			/*
-			 * __GFP_NOFAIL is not to be used in new code.
-			 *
-			 * All __GFP_NOFAIL callers should be fixed so that they
-			 * properly detect and handle allocation failures.
-			 *
-			 * We most definitely don't want callers attempting to
-			 * allocate greater than order-1 page units with
-			 * __GFP_NOFAIL.
-			 */
-			WARN_ON_ONCE(order > 1);
-		}
 		spin_lock_irqsave(&zone->lock, flags);
 		page = __rmqueue(zone, order, migratetype);
 		spin_unlock(&zone->lock);
@@ -2423,6 +2455,140 @@ __alloc_pages_nodemask(gfp_t gfp_mask, unsigned int order,
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/**
+ * alloc_pages_bulk - allocate a number of pages of the same order
+ * @gfp_mask: GFP flags for the allocation
+ * @order: order of each page, at most PAGE_ALLOC_COSTLY_ORDER
+ * @nr_pages: the number of entries in @page_array
+ * @page_array: the array to fill, entries already set are skipped
+ *
+ * The pages are taken, with interrupts disabled once, from the pcp list of
+ * the first zone of the local node that stays above its low watermark
+ * with all of them, which is refilled under a single hold of zone->lock.
+ * If that does not yield a page, one page is allocated the usual way, so
+ * that reclaim and compaction can make progress for the caller.
+ *
+ * Returns the number of entries of @page_array that are set, which can be
+ * anything from 0 to @nr_pages.
+ */
+unsigned long alloc_pages_bulk(gfp_t gfp_mask, unsigned int order,
+			unsigned long nr_pages, struct page **page_array)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	int cold = !!(gfp_mask & __GFP_COLD);
+	struct zonelist *zonelist;
+	struct zone *preferred_zone, *zone;
+	struct zoneref *z;
+	struct per_cpu_pages *pcp;
+	struct list_head *list;
+	struct page *page, *next;
+	unsigned long nr_wanted = 0, nr_taken = 0, nr_populated = 0;
+	unsigned long flags, i;
+	LIST_HEAD(taken);
+
+	for (i = 0; i < nr_pages; i++)
+		if (!page_array[i])
+			nr_wanted++;
+	if (!nr_wanted)
+		return nr_pages;
+
+	gfp_mask &= gfp_allowed_mask;
+
+	if (order >= NR_PCP_ORDERS || nr_wanted == 1)
+		goto failed;
+
+	lockdep_trace_alloc(gfp_mask);
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	zonelist = node_zonelist(numa_node_id(), gfp_mask);
+	get_mems_allowed();
+	first_zones_zonelist(zonelist, high_zoneidx,
+				&cpuset_current_mems_allowed, &preferred_zone);
+	if (!preferred_zone) {
+		put_mems_allowed();
+		goto failed;
+	}
+
+	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
+					&cpuset_current_mems_allowed) {
+		unsigned long mark;
+
+		if (!cpuset_zone_allowed_softwall(zone, gfp_mask))
+			continue;
+
+		mark = low_wmark_pages(zone) + (nr_wanted << order);
+		if (zone_watermark_ok(zone, order, mark,
+				      zone_idx(preferred_zone), 0))
+			break;
+	}
+	put_mems_allowed();
+	if (!zone)
+		goto failed;
+
+	local_irq_save(flags);
+	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list = pcp_list(pcp, migratetype, order);
+	while (nr_taken < nr_wanted) {
+		if (list_empty(list)) {
+			unsigned long count;
+
+			/* Take what is still needed in one go */
+			count = max_t(unsigned long, nr_wanted - nr_taken,
+				      pcp->batch >> order);
+			pcp->count += rmqueue_bulk(zone, order, count, list,
+						   migratetype, cold) << order;
+			__count_vm_event(PGALLOC_BULK_REFILL);
+			if (list_empty(list))
+				break;
+		}
+
+		if (cold)
+			page = list_entry(list->prev, struct page, lru);
+		else
+			page = list_entry(list->next, struct page, lru);
+
+		list_move_tail(&page->lru, &taken);
+		pcp->count -= 1 << order;
+		zone_statistics(preferred_zone, zone, gfp_mask);
+		nr_taken++;
+	}
+	__count_zone_vm_events(PGALLOC, zone, nr_taken << order);
+	__count_vm_events(PGALLOC_BULK, nr_taken);
+	local_irq_restore(flags);
+
+	/* Prepare the pages with interrupts enabled, as buffered_rmqueue */
+	i = 0;
+	list_for_each_entry_safe(page, next, &taken, lru) {
+		list_del(&page->lru);
+		VM_BUG_ON(bad_range(zone, page));
+		if (prep_new_page(page, order, gfp_mask))
+			continue;
+
+		while (page_array[i])
+			i++;
+		page_array[i] = page;
+		trace_mm_page_alloc(page, order, gfp_mask, migratetype);
+	}
+
+	if (nr_taken)
+		goto out;
+
+failed:
+	for (i = 0; i < nr_pages; i++) {
+		if (!page_array[i]) {
+			page_array[i] = alloc_pages(gfp_mask, order);
+			break;
+		}
+	}
+out:
+	for (i = 0; i < nr_pages; i++)
+		if (page_array[i])
+			nr_populated++;
+	return nr_populated;
+}
+EXPORT_SYMBOL(alloc_pages_bulk);
+
 /*
  * Common helper functions.
  */
@@ -3688,7 +3854,7 @@ static int zone_batchsize(struct zone *zone)
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int pindex;
 
 	memset(p, 0, sizeof(*p));
 
@@ -3696,8 +3862,8 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->count = 0;
 	pcp->high = 6 * batch;
 	pcp->batch = max(1UL, 1 * batch);
-	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
-		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	for (pindex = 0; pindex < NR_PCP_LISTS; pindex++)
+		INIT_LIST_HEAD(&pcp->lists[pindex]);
 }
 
 /*
@@ -4257,6 +4423,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 	
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -4314,6 +4483,7 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 		zone_pcp_init(zone);
 		for_each_lru(lru)
 			INIT_LIST_HEAD(&zone->lruvec.lists[lru]);
+		lru_gen_init_zone(zone);
 		zone->reclaim_stat.recent_rotated[0] = 0;
 		zone->reclaim_stat.recent_rotated[1] = 0;
 		zone->reclaim_stat.recent_scanned[0] = 0;
@@ -5607,6 +5777,9 @@ static struct trace_print_flags pageflag_names[] = {
 #endif
 #ifdef CONFIG_MEMORY_FAILURE
 	{1UL << PG_hwpoison,		"hwpoison"	},
+#endif
+#ifdef CONFIG_64BIT
+	{1UL << PG_ra_unused,		"ra_unused"	},
 #endif
 	{-1UL,				NULL		},
 };
@@ -17,6 +17,10 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
+
+#include "internal.h"
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
@@ -139,6 +143,82 @@ out:
 	return ret;
 }
 
+/*
+ * Readahead windows grow to the readahead throughput of the device times
+ * the time readers stall on it, but to no more than this many times the
+ * readahead size that is set for the device.
+ */
+#define RA_MAX_SCALE	8
+
+/*
+ * Estimate the readahead throughput of @bdi, after @nr_pages more pages
+ * have been read ahead.  The rate is sampled every 200ms and smoothed;
+ * periods of over a second without readahead are left out.
+ */
+static void bdi_update_ra_bandwidth(struct backing_dev_info *bdi,
+				    unsigned long nr_pages)
+{
+	unsigned long stamp = bdi->ra_time_stamp;
+	unsigned long elapsed = jiffies - stamp;
+	unsigned long pages, bw;
+
+	__add_bdi_stat(bdi, BDI_READAHEAD, nr_pages);
+
+	if (elapsed < HZ / 5)
+		return;
+	/* only one reader updates the estimate */
+	if (cmpxchg(&bdi->ra_time_stamp, stamp, stamp + elapsed) != stamp)
+		return;
+
+	pages = bdi_stat(bdi, BDI_READAHEAD);
+	if (elapsed <= HZ) {
+		bw = div_u64((u64)(pages - bdi->ra_stamp) * HZ, elapsed);
+		bdi->ra_bandwidth = (bdi->ra_bandwidth * 3 + bw) / 4;
+	}
+	bdi->ra_stamp = pages;
+}
+
+/**
+ * readahead_account_stall - account a wait for a page under read I/O
+ * @mapping: the address_space the page belongs to
+ * @start: local_clock() when the wait began
+ *
+ * Readers that wait for pages still being read in measure how long it
+ * takes the device to serve a read, which is how far ahead of them
+ * readahead must be to avoid the waits.
+ */
+void readahead_account_stall(struct address_space *mapping, u64 start)
+{
+	struct backing_dev_info *bdi = mapping->backing_dev_info;
+	unsigned long delay;
+
+	delay = min_t(u64, div_u64(local_clock() - start, NSEC_PER_USEC),
+		      USEC_PER_SEC);
+	if (bdi->ra_latency)
+		delay = (bdi->ra_latency * 7 + delay) / 8;
+	bdi->ra_latency = delay;
+}
+
+/*
+ * The largest readahead window for @ra: enough pages to cover the time
+ * the device takes to serve a read at its readahead throughput, and at
+ * least ra->ra_pages.
+ */
+static unsigned long ra_max_pages(struct address_space *mapping,
+				  struct file_ra_state *ra)
+{
+	struct backing_dev_info *bdi = mapping->backing_dev_info;
+	unsigned long max = ra->ra_pages;
+	u64 pages;
+
+	pages = div_u64((u64)bdi->ra_bandwidth * bdi->ra_latency,
+			USEC_PER_SEC);
+	if (pages > max)
+		max = min_t(u64, pages, (u64)max * RA_MAX_SCALE);
+
+	return max_sane_readahead(max);
+}
+
 /*
  * __do_page_cache_readahead() actually reads a chunk of disk.  It allocates all
  * the pages first, then submits them all for I/O. This avoids the very bad
@@ -177,13 +257,14 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
 		page = page_cache_alloc_readahead(mapping);
 		if (!page)
 			break;
 		page->index = page_offset;
+		SetPageRaUnused(page);
 		list_add(&page->lru, &page_pool);
 		if (page_idx == nr_to_read - lookahead_size)
 			SetPageReadahead(page);
@@ -195,8 +276,10 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	 * uptodate then the caller will launch readpage again, and
 	 * will then handle the error.
 	 */
-	if (ret)
+	if (ret) {
 		read_pages(mapping, filp, &page_pool, ret);
+		bdi_update_ra_bandwidth(mapping->backing_dev_info, ret);
+	}
 	BUG_ON(!list_empty(&page_pool));
 out:
 	return ret;
@@ -316,10 +399,13 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  * will be equal to size, for maximum pipelining.
  *
  * In interleaved sequential reads, concurrent streams on the same fd can
- * be invalidating each other's readahead state. So we flag the new readahead
- * page at (start+size-async_size) with PG_readahead, and use it as readahead
- * indicator. The flag won't be set on already cached pages, to avoid the
- * readahead-for-nothing fuss, saving pointless page cache lookups.
+ * be invalidating each other's readahead state. So the windows of the last
+ * RA_SAVED_STREAMS other streams are kept in ra->streams, and a read at the
+ * expected offset of one of them switches to it. Beyond that, we flag the
+ * new readahead page at (start+size-async_size) with PG_readahead, and use
+ * it as readahead indicator. The flag won't be set on already cached pages,
+ * to avoid the readahead-for-nothing fuss, saving pointless page cache
+ * lookups.
  *
  * prev_pos tracks the last visited byte in the _previous_ read request.
  * It should be maintained by the caller, and will be used for detecting
@@ -333,8 +419,58 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  * based on I/O request size and the max_readahead.
  *
  * The code ramps up the readahead size aggressively at first, but slow down as
- * it approaches max_readhead.
+ * it approaches max_readhead, which ra_max_pages() scales to the throughput
+ * and latency of the device.
+ */
+
+/*
+ * Save the current window before it is replaced by that of a new stream.
+ */
+static void ra_save_stream(struct file_ra_state *ra)
+{
+	if (!ra->size)
+		return;
+
+	memmove(&ra->streams[1], &ra->streams[0],
+		(RA_SAVED_STREAMS - 1) * sizeof(ra->streams[0]));
+	ra->streams[0].start = ra->start;
+	ra->streams[0].size = ra->size;
+	ra->streams[0].async_size = ra->async_size;
+}
+
+/*
+ * Is @offset where the sequential stream of a saved window goes on?  If
+ * so, make that window the current one, and save the current one first.
  */
+static bool ra_switch_stream(struct file_ra_state *ra, pgoff_t offset)
+{
+	struct file_ra_stream cur = {
+		.start = ra->start,
+		.size = ra->size,
+		.async_size = ra->async_size,
+	};
+	int i;
+
+	for (i = 0; i < RA_SAVED_STREAMS; i++) {
+		struct file_ra_stream *stream = &ra->streams[i];
+
+		if (!stream->size)
+			continue;
+		if (offset != stream->start + stream->size - stream->async_size &&
+		    offset != stream->start + stream->size)
+			continue;
+
+		ra->start = stream->start;
+		ra->size = stream->size;
+		ra->async_size = stream->async_size;
+
+		memmove(&ra->streams[1], &ra->streams[0],
+			i * sizeof(ra->streams[0]));
+		ra->streams[0] = cur;
+		return true;
+	}
+	return false;
+}
 
 /*
  * Count contiguously cached pages from @offset-1 to @offset-@max,
@@ -382,6 +518,7 @@ static int try_context_readahead(struct address_space *mapping,
 	if (size >= offset)
 		size *= 2;
 
+	ra_save_stream(ra);
 	ra->start = offset;
 	ra->size = get_init_ra_size(size + req_size, max);
 	ra->async_size = ra->size;
@@ -398,7 +535,7 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long max = ra_max_pages(mapping, ra);
 
 	/*
 	 * start of file
@@ -407,11 +544,13 @@ ondemand_readahead(struct address_space *mapping,
 		goto initial_readahead;
 
 	/*
-	 * It's the expected callback offset, assume sequential access.
+	 * It's the expected callback offset of this or another stream,
+	 * assume sequential access.
 	 * Ramp up sizes, and push forward the readahead window.
 	 */
-	if ((offset == (ra->start + ra->size - ra->async_size) ||
-	     offset == (ra->start + ra->size))) {
+	if (offset == (ra->start + ra->size - ra->async_size) ||
+	    offset == (ra->start + ra->size) ||
+	    ra_switch_stream(ra, offset)) {
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
@@ -434,6 +573,7 @@ ondemand_readahead(struct address_space *mapping,
 		if (!start || start - offset > max)
 			return 0;
 
+		ra_save_stream(ra);
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
@@ -468,6 +608,7 @@ ondemand_readahead(struct address_space *mapping,
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
+	ra_save_stream(ra);
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
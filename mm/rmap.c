@@ -1211,6 +1211,117 @@ void page_remove_rmap(struct page *page)
  * Subfunctions of try_to_unmap: try_to_unmap_one called
  * repeatedly from try_to_unmap_ksm, try_to_unmap_anon or try_to_unmap_file.
  */
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+/*
+ * Flush the TLB entries of the pages unmapped since the last flush, on
+ * all the cpus that may hold them.  It must be done before the pages are
+ * freed, so that nothing can access them through a stale entry.
+ */
+void try_to_unmap_flush(void)
+{
+	struct tlbflush_unmap_batch *tlb_ubc = &current->tlb_ubc;
+	unsigned int nr_ipis;
+
+	if (!tlb_ubc->flush_required)
+		return;
+
+	nr_ipis = flush_tlb_batched(&tlb_ubc->cpumask);
+	count_vm_events(TLB_BATCH_IPI_SENT, nr_ipis);
+	if (tlb_ubc->nr_deferred > nr_ipis)
+		count_vm_events(TLB_BATCH_IPI_SAVED,
+				tlb_ubc->nr_deferred - nr_ipis);
+
+	cpumask_clear(&tlb_ubc->cpumask);
+	tlb_ubc->flush_required = false;
+	tlb_ubc->writable = false;
+	tlb_ubc->nr_deferred = 0;
+}
+
+/*
+ * Flush if a page unmapped since the last flush may still be written
+ * through a stale TLB entry: the write would be lost by the I/O that is
+ * about to start.
+ */
+void try_to_unmap_flush_dirty(void)
+{
+	if (current->tlb_ubc.writable)
+		try_to_unmap_flush();
+}
+
+static void set_tlb_ubc_flush_pending(struct mm_struct *mm, bool writable)
+{
+	struct tlbflush_unmap_batch *tlb_ubc = &current->tlb_ubc;
+	int cpu = get_cpu();
+
+	cpumask_or(&tlb_ubc->cpumask, &tlb_ubc->cpumask, mm_cpumask(mm));
+	tlb_ubc->nr_deferred += cpumask_weight(mm_cpumask(mm)) -
+				cpumask_test_cpu(cpu, mm_cpumask(mm));
+	tlb_ubc->flush_required = true;
+	put_cpu();
+
+	/*
+	 * A pte that was dirty is best assumed writable: the caller must
+	 * flush before the page is queued for I/O.
+	 */
+	if (writable)
+		tlb_ubc->writable = true;
+
+	/*
+	 * Do not let the compiler set tlb_flush_batched before the pte is
+	 * cleared: flush_tlb_batched_pending() must see it then.
+	 */
+	barrier();
+	mm->tlb_flush_batched = true;
+}
+
+/*
+ * Put off the flush only if other cpus would need an IPI for it: the
+ * local flush is cheap.
+ */
+static bool should_defer_flush(struct mm_struct *mm, enum ttu_flags flags)
+{
+	bool should_defer = false;
+
+	if (!(flags & TTU_BATCH_FLUSH))
+		return false;
+
+	if (cpumask_any_but(mm_cpumask(mm), get_cpu()) < nr_cpu_ids)
+		should_defer = true;
+	put_cpu();
+
+	return should_defer;
+}
+
+/*
+ * Reclaim may have cleared ptes of @mm and not flushed the TLBs yet.  A
+ * change of the page tables that relies on the TLBs being in sync with
+ * them, like mprotect() or munmap(), must flush them first.  Called with
+ * the page table lock held.
+ */
+void flush_tlb_batched_pending(struct mm_struct *mm)
+{
+	if (mm->tlb_flush_batched) {
+		flush_tlb_mm(mm);
+
+		/*
+		 * Do not allow the compiler to re-order the clearing of
+		 * tlb_flush_batched before the tlb is flushed.
+		 */
+		barrier();
+		mm->tlb_flush_batched = false;
+	}
+}
+#else
+static void set_tlb_ubc_flush_pending(struct mm_struct *mm, bool writable)
+{
+}
+
+static bool should_defer_flush(struct mm_struct *mm, enum ttu_flags flags)
+{
+	return false;
+}
+#endif /* CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH */
+
 int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		     unsigned long address, enum ttu_flags flags)
 {
@@ -1243,9 +1354,27 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		}
   	}
 
+	/*
+	 * A lazily freed page is discarded as soon as it is unmapped, so
+	 * no other cpu may write to it through a stale TLB entry: do not
+	 * defer the flush.
+	 */
+	if (PageAnon(page) && !PageSwapBacked(page))
+		flags &= ~TTU_BATCH_FLUSH;
+
 	/* Nuke the page table entry. */
 	flush_cache_page(vma, address, page_to_pfn(page));
-	pteval = ptep_clear_flush_notify(vma, address, pte);
+	if (should_defer_flush(mm, flags)) {
+		/*
+		 * Leave the TLB flush to the caller, which batches it with
+		 * those of the other pages it unmaps.  Secondary MMUs are
+		 * not batched.
+		 */
+		pteval = ptep_get_and_clear(mm, address, pte);
+		mmu_notifier_invalidate_page(mm, address);
+		set_tlb_ubc_flush_pending(mm, pte_dirty(pteval));
+	} else
+		pteval = ptep_clear_flush_notify(vma, address, pte);
 
 	/* Move the dirty bit to the physical page now the pte is gone. */
 	if (pte_dirty(pteval))
@@ -1264,6 +1393,21 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else if (PageAnon(page)) {
 		swp_entry_t entry = { .val = page_private(page) };
 
+		if (!PageSwapBacked(page) && TTU_ACTION(flags) == TTU_UNMAP) {
+			/*
+			 * madvise(MADV_FREE) page: drop it if it has not been
+			 * written to since, otherwise it must be kept.
+			 */
+			if (!PageDirty(page)) {
+				dec_mm_counter(mm, MM_ANONPAGES);
+				goto discard;
+			}
+			set_pte_at(mm, address, pte, pteval);
+			SetPageSwapBacked(page);
+			ret = SWAP_FAIL;
+			goto out_unmap;
+		}
+
 		if (PageSwapCache(page)) {
 			/*
 			 * Store the swap location in the pte.
@@ -1301,6 +1445,7 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else
 		dec_mm_counter(mm, MM_FILEPAGES);
 
+discard:
 	page_remove_rmap(page);
 	page_cache_release(page);
 
@@ -2402,12 +2402,15 @@ EXPORT_SYMBOL(kmem_cache_alloc_node_trace);
  * So we still attempt to reduce cache line usage. Just take the slab
  * lock and free the item. If there is no additional partial page
  * handling required then we can return immediately.
+ *
+ * The cnt objects from head to tail, which are linked through their free
+ * pointers, are put back on the slab freelist in one go.  Debug caches
+ * free a single object at a time.
  */
 static void __slab_free(struct kmem_cache *s, struct page *page,
-			void *x, unsigned long addr)
+			void *head, void *tail, int cnt, unsigned long addr)
 {
 	void *prior;
-	void **object = (void *)x;
 	int was_frozen;
 	int inuse;
 	struct page new;
@@ -2417,16 +2420,16 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 	stat(s, FREE_SLOWPATH);
 
-	if (kmem_cache_debug(s) && !free_debug_processing(s, page, x, addr))
+	if (kmem_cache_debug(s) && !free_debug_processing(s, page, head, addr))
 		return;
 
 	do {
 		prior = page->freelist;
 		counters = page->counters;
-		set_freepointer(s, object, prior);
+		set_freepointer(s, tail, prior);
 		new.counters = counters;
 		was_frozen = new.frozen;
-		new.inuse--;
+		new.inuse -= cnt;
 		if ((!new.inuse || !prior) && !was_frozen && !n) {
 
 			if (!kmem_cache_debug(s) && !prior)
@@ -2456,7 +2459,7 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 	} while (!cmpxchg_double_slab(s, page,
 		prior, counters,
-		object, new.counters,
+		head, new.counters,
 		"__slab_free"));
 
 	if (likely(!n)) {
@@ -2527,15 +2530,13 @@ slab_empty:
  * If fastpath is not possible then fall back to __slab_free where we deal
  * with all sorts of special processing.
  */
-static __always_inline void slab_free(struct kmem_cache *s,
-			struct page *page, void *x, unsigned long addr)
+static __always_inline void do_slab_free(struct kmem_cache *s,
+			struct page *page, void *head, void *tail, int cnt,
+			unsigned long addr)
 {
-	void **object = (void *)x;
 	struct kmem_cache_cpu *c;
 	unsigned long tid;
 
-	slab_free_hook(s, x);
-
 redo:
 	/*
 	 * Determine the currently cpus per cpu slab.
@@ -2549,20 +2550,27 @@ redo:
 	barrier();
 
 	if (likely(page == c->page)) {
-		set_freepointer(s, object, c->freelist);
+		set_freepointer(s, tail, c->freelist);
 
 		if (unlikely(!this_cpu_cmpxchg_double(
 				s->cpu_slab->freelist, s->cpu_slab->tid,
 				c->freelist, tid,
-				object, next_tid(tid)))) {
+				head, next_tid(tid)))) {
 
 			note_cmpxchg_failure("slab_free", s, tid);
 			goto redo;
 		}
 		stat(s, FREE_FASTPATH);
 	} else
-		__slab_free(s, page, x, addr);
+		__slab_free(s, page, head, tail, cnt, addr);
+
+}
 
+static __always_inline void slab_free(struct kmem_cache *s,
+			struct page *page, void *x, unsigned long addr)
+{
+	slab_free_hook(s, x);
+	do_slab_free(s, page, x, x, 1, addr);
 }
 
 void kmem_cache_free(struct kmem_cache *s, void *x)
@@ -2577,6 +2585,157 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/* A run of objects of one slab, linked through their free pointers */
+struct detached_freelist {
+	struct page *page;
+	void *head;
+	void *tail;
+	int cnt;
+};
+
+/*
+ * Link the last object left in p[] with the other objects of its slab
+ * that follow close enough below it, clearing their entries.  Returns
+ * the number of entries of p[] still to be looked at.
+ */
+static size_t build_detached_freelist(struct kmem_cache *s, size_t size,
+				      void **p, struct detached_freelist *df)
+{
+	size_t first_skipped_index = 0;
+	int lookahead = 3;
+	void *object;
+
+	df->page = NULL;
+
+	do {
+		object = p[--size];
+	} while (!object && size);
+
+	if (!object)
+		return 0;
+
+	df->page = virt_to_head_page(object);
+	slab_free_hook(s, object);
+	set_freepointer(s, object, NULL);
+	df->head = df->tail = object;
+	df->cnt = 1;
+	p[size] = NULL;
+
+	while (size) {
+		object = p[--size];
+		if (!object)
+			continue;
+
+		if (virt_to_head_page(object) == df->page) {
+			slab_free_hook(s, object);
+			set_freepointer(s, object, df->head);
+			df->head = object;
+			df->cnt++;
+			p[size] = NULL;
+			continue;
+		}
+
+		/* Give up on objects of other slabs after a few of them */
+		if (!--lookahead)
+			break;
+
+		if (!first_skipped_index)
+			first_skipped_index = size + 1;
+	}
+
+	return first_skipped_index;
+}
+
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		if (p[i])
+			trace_kmem_cache_free(_RET_IP_, p[i]);
+
+	if (kmem_cache_debug(s)) {
+		for (i = 0; i < size; i++)
+			if (p[i])
+				slab_free(s, virt_to_head_page(p[i]), p[i],
+					  _RET_IP_);
+		return;
+	}
+
+	/*
+	 * Objects allocated together tend to sit together in a slab, so a
+	 * run of them usually goes back with a single cmpxchg.
+	 */
+	while (size) {
+		struct detached_freelist df;
+
+		size = build_detached_freelist(s, size, p, &df);
+		if (df.page)
+			do_slab_free(s, df.page, df.head, df.tail, df.cnt,
+				     _RET_IP_);
+	}
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	size_t i;
+
+	if (slab_pre_alloc_hook(s, flags))
+		return 0;
+
+	/*
+	 * With interrupts off, nothing but this loop touches the cpu slab,
+	 * so objects can be taken off its freelist without the cmpxchg.
+	 */
+	local_irq_disable();
+	c = this_cpu_ptr(s->cpu_slab);
+
+	for (i = 0; i < size; i++) {
+		void *object = c->freelist;
+
+		if (unlikely(!object)) {
+			/*
+			 * __slab_alloc may enable interrupts to allocate a
+			 * slab: make a fastpath that gets in meanwhile retry.
+			 */
+			c->tid = next_tid(c->tid);
+
+			p[i] = __slab_alloc(s, flags, NUMA_NO_NODE, _RET_IP_, c);
+			if (unlikely(!p[i]))
+				goto error;
+
+			c = this_cpu_ptr(s->cpu_slab);
+			continue;
+		}
+		c->freelist = get_freepointer(s, object);
+		p[i] = object;
+		stat(s, ALLOC_FASTPATH);
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_enable();
+
+	for (i = 0; i < size; i++) {
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, s->objsize);
+		slab_post_alloc_hook(s, flags, p[i]);
+		trace_kmem_cache_alloc(_RET_IP_, p[i], s->objsize, s->size,
+				       flags);
+	}
+	return size;
+
+error:
+	local_irq_enable();
+	size = i;
+	for (i = 0; i < size; i++)
+		slab_post_alloc_hook(s, flags, p[i]);
+	kmem_cache_free_bulk(s, size, p);
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /*
  * Object placement in a slab is made very easy because we always start at
  * offset 0. If we tune the size of the object to the alignment then we can
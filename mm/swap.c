@@ -39,6 +39,7 @@ int page_cluster;
 static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, lru_lazyfree_pvecs);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -236,9 +237,11 @@ static void pagevec_move_tail_fn(struct page *page, void *arg)
 		enum lru_list lru = page_lru_base_type(page);
 		struct lruvec *lruvec;
 
-		lruvec = mem_cgroup_lru_move_lists(page_zone(page),
-						   page, lru, lru);
-		list_move_tail(&page->lru, &lruvec->lists[lru]);
+		if (!lru_gen_rotate_page(page_zone(page), page)) {
+			lruvec = mem_cgroup_lru_move_lists(page_zone(page),
+							   page, lru, lru);
+			list_move_tail(&page->lru, &lruvec->lists[lru]);
+		}
 		(*pgmoved)++;
 	}
 }
@@ -327,6 +330,12 @@ static void activate_page_drain(int cpu)
 
 void activate_page(struct page *page)
 {
+	/* Generations are promoted in place, without the lru_lock */
+	if (lru_gen_enabled() && lru_gen_promote_page(page)) {
+		count_vm_event(PGACTIVATE);
+		return;
+	}
+
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 		struct pagevec *pvec = &get_cpu_var(activate_page_pvecs);
 
@@ -346,6 +355,11 @@ void activate_page(struct page *page)
 {
 	struct zone *zone = page_zone(page);
 
+	if (lru_gen_enabled() && lru_gen_promote_page(page)) {
+		count_vm_event(PGACTIVATE);
+		return;
+	}
+
 	spin_lock_irq(&zone->lru_lock);
 	__activate_page(page, NULL);
 	spin_unlock_irq(&zone->lru_lock);
@@ -361,10 +375,14 @@ void activate_page(struct page *page)
  */
 void mark_page_accessed(struct page *page)
 {
+	if (PageRaUnused(page))
+		ClearPageRaUnused(page);
 	if (!PageActive(page) && !PageUnevictable(page) &&
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -481,8 +499,10 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 		 * The page's writeback ends up during pagevec
 		 * We moves tha page into tail of inactive.
 		 */
-		lruvec = mem_cgroup_lru_move_lists(zone, page, lru, lru);
-		list_move_tail(&page->lru, &lruvec->lists[lru]);
+		if (!lru_gen_rotate_page(zone, page)) {
+			lruvec = mem_cgroup_lru_move_lists(zone, page, lru, lru);
+			list_move_tail(&page->lru, &lruvec->lists[lru]);
+		}
 		__count_vm_event(PGROTATED);
 	}
 
@@ -491,6 +511,30 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 	update_page_reclaim_stat(zone, page, file, 0);
 }
 
+/*
+ * Move a clean anonymous page that madvise(MADV_FREE) was applied to
+ * onto the inactive file list, with PG_swapbacked cleared: reclaim will
+ * drop it instead of swapping it out, unless it is written to again.
+ */
+static void lru_lazyfree_fn(struct page *page, void *arg)
+{
+	struct zone *zone = page_zone(page);
+	bool active;
+
+	if (!PageLRU(page) || !PageAnon(page) || !PageSwapBacked(page) ||
+	    PageSwapCache(page) || PageUnevictable(page))
+		return;
+
+	active = PageActive(page);
+	del_page_from_lru_list(zone, page, LRU_INACTIVE_ANON + active);
+	ClearPageActive(page);
+	ClearPageReferenced(page);
+	ClearPageSwapBacked(page);
+	add_page_to_lru_list(zone, page, LRU_INACTIVE_FILE);
+
+	__count_vm_event(PGLAZYFREE);
+}
+
 /*
  * Drain pages out of the cpu's pagevecs.
  * Either "cpu" is the current CPU, and preemption has already been
@@ -522,6 +566,10 @@ static void drain_cpu_pagevecs(int cpu)
 	if (pagevec_count(pvec))
 		pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
 
+	pvec = &per_cpu(lru_lazyfree_pvecs, cpu);
+	if (pagevec_count(pvec))
+		pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+
 	activate_page_drain(cpu);
 }
 
@@ -551,6 +599,26 @@ void deactivate_page(struct page *page)
 	}
 }
 
+/**
+ * mark_page_lazyfree - make an anonymous page lazily freeable
+ * @page: page to mark
+ *
+ * Called by madvise(MADV_FREE) for a clean anonymous page, which reclaim
+ * may then free instead of swapping it out.
+ */
+void mark_page_lazyfree(struct page *page)
+{
+	if (PageLRU(page) && PageAnon(page) && PageSwapBacked(page) &&
+	    !PageSwapCache(page) && !PageUnevictable(page)) {
+		struct pagevec *pvec = &get_cpu_var(lru_lazyfree_pvecs);
+
+		page_cache_get(page);
+		if (!pagevec_add(pvec, page))
+			pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+		put_cpu_var(lru_lazyfree_pvecs);
+	}
+}
+
 void lru_add_drain(void)
 {
 	drain_cpu_pagevecs(get_cpu());
@@ -678,9 +746,12 @@ void lru_add_page_tail(struct zone* zone,
 		lru = LRU_UNEVICTABLE;
 	}
 
-	if (likely(PageLRU(page)))
+	if (likely(PageLRU(page))) {
+		/* The head was accounted in its generation as a whole */
+		if (lru_gen_enabled() && page_lru_gen(page) >= 0)
+			page_set_lru_gen(page_tail, page_lru_gen(page));
 		list_add_tail(&page_tail->lru, &page->lru);
-	else {
+	} else {
 		struct list_head *list_head;
 		/*
 		 * Head page has not yet been counted, as an hpage,
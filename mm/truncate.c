@@ -183,6 +183,79 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+static void clear_shadow_entry(struct address_space *mapping, pgoff_t index)
+{
+	struct radix_tree_node *node;
+	void **slot;
+
+	__radix_tree_lookup(&mapping->page_tree, index, &node, &slot);
+	radix_tree_replace_slot(slot, NULL);
+	mapping->nrshadows--;
+	if (!node)
+		return;
+	workingset_node_shadows_dec(node);
+	/*
+	 * A node without shadow entries is no business of the shadow
+	 * node shrinker.  node->private_list is protected by the
+	 * tree_lock, so the list_empty() test saves taking the
+	 * list_lru lock when the node is not on the list.
+	 */
+	if (!workingset_node_shadows(node) &&
+	    !list_empty(&node->private_list))
+		list_lru_del(&workingset_shadow_nodes, &node->private_list,
+			     NULL);
+	__radix_tree_delete_node(&mapping->page_tree, node);
+}
+
+/**
+ * clear_shadow_entries - remove shadow entries from a range of a mapping
+ * @mapping: the address_space to clear
+ * @start: the first page index
+ * @end: the last page index (inclusive)
+ *
+ * Removes the shadow entries that reclaim left behind for evicted pages
+ * in the given range, see mm/workingset.c.
+ */
+void clear_shadow_entries(struct address_space *mapping,
+			  pgoff_t start, pgoff_t end)
+{
+	struct radix_tree_root *root = &mapping->page_tree;
+	unsigned long indices[PAGEVEC_SIZE];
+	void **slots[PAGEVEC_SIZE];
+	pgoff_t index = start;
+	unsigned int nr_found;
+	unsigned int nr;
+	unsigned int i;
+
+	while (index <= end && mapping->nrshadows) {
+		spin_lock_irq(&mapping->tree_lock);
+		nr_found = radix_tree_gang_lookup_slot(root, slots, indices,
+						       index, PAGEVEC_SIZE);
+		/*
+		 * Collect the shadow entries first: deleting an entry
+		 * can free the node that the remaining slots point to.
+		 */
+		for (i = 0, nr = 0; i < nr_found; i++) {
+			void *entry;
+
+			if (indices[i] > end)
+				break;
+			index = indices[i] + 1;
+			entry = radix_tree_deref_slot_protected(slots[i],
+							&mapping->tree_lock);
+			if (radix_tree_exceptional_entry(entry))
+				indices[nr++] = indices[i];
+		}
+		while (nr--)
+			clear_shadow_entry(mapping, indices[nr]);
+		spin_unlock_irq(&mapping->tree_lock);
+
+		if (i < PAGEVEC_SIZE || !index)
+			break;
+		cond_resched();
+	}
+}
+
 /**
  * truncate_inode_pages - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -214,7 +287,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	int i;
 
 	cleancache_flush_inode(mapping);
-	if (mapping->nrpages == 0)
+	if (mapping->nrpages == 0 && mapping->nrshadows == 0)
 		return;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
@@ -292,6 +365,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		mem_cgroup_uncharge_end();
 		index++;
 	}
+	clear_shadow_entries(mapping, start, end);
 	cleancache_flush_inode(mapping);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
@@ -338,10 +412,9 @@ unsigned long invalidate_mapping_pages(struct address_space *mapping,
 
 	/*
 	 * Note: this function may get called on a shmem/tmpfs mapping:
-	 * pagevec_lookup() might then return 0 prematurely (because it
-	 * got a gangful of swap entries); but it's hardly worth worrying
-	 * about - it can rarely have anything to free from such a mapping
-	 * (most pages are dirty), and already skips over any difficulties.
+	 * pagevec_lookup() skips over its swap entries; it can rarely
+	 * have anything to free from such a mapping (most pages are
+	 * dirty), and already skips over any difficulties.
 	 */
 
 	pagevec_init(&pvec, 0);
@@ -374,6 +447,7 @@ unsigned long invalidate_mapping_pages(struct address_space *mapping,
 		cond_resched();
 		index++;
 	}
+	clear_shadow_entries(mapping, start, end);
 	return count;
 }
 EXPORT_SYMBOL(invalidate_mapping_pages);
@@ -400,7 +474,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
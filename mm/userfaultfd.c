@@ -0,0 +1,185 @@
+/*
+ *  mm/userfaultfd.c
+ *
+ * Install the pages that userspace supplies, with UFFDIO_COPY and
+ * UFFDIO_ZEROPAGE, for the missing pages of a range registered with a
+ * userfaultfd.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/pagemap.h>
+#include <linux/rmap.h>
+#include <linux/highmem.h>
+#include <linux/memcontrol.h>
+#include <linux/userfaultfd_k.h>
+
+#include <asm/uaccess.h>
+#include <asm/tlbflush.h>
+
+/*
+ * Map @page, or the zero page if @page is NULL, at @dst_addr, which must
+ * still be missing.  Called with mmap_sem held for reading.
+ */
+static int mfill_pte(struct mm_struct *dst_mm, struct vm_area_struct *dst_vma,
+		     unsigned long dst_addr, struct page *page)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte, entry;
+	spinlock_t *ptl;
+
+	pgd = pgd_offset(dst_mm, dst_addr);
+	pud = pud_alloc(dst_mm, pgd, dst_addr);
+	if (!pud)
+		return -ENOMEM;
+	pmd = pmd_alloc(dst_mm, pud, dst_addr);
+	if (!pmd)
+		return -ENOMEM;
+	if (unlikely(pmd_none(*pmd)) &&
+	    __pte_alloc(dst_mm, dst_vma, pmd, dst_addr))
+		return -ENOMEM;
+	/* A huge page, mapped before the range was registered */
+	if (unlikely(pmd_trans_huge(*pmd)))
+		return -EEXIST;
+
+	if (page) {
+		entry = mk_pte(page, dst_vma->vm_page_prot);
+		if (dst_vma->vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+	} else
+		entry = pte_mkspecial(pfn_pte(page_to_pfn(ZERO_PAGE(dst_addr)),
+					      dst_vma->vm_page_prot));
+
+	pte = pte_offset_map_lock(dst_mm, pmd, dst_addr, &ptl);
+	if (!pte_none(*pte)) {
+		pte_unmap_unlock(pte, ptl);
+		return -EEXIST;
+	}
+	if (page) {
+		inc_mm_counter(dst_mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, dst_vma, dst_addr);
+	}
+	set_pte_at(dst_mm, dst_addr, pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(dst_vma, dst_addr, pte);
+	pte_unmap_unlock(pte, ptl);
+	return 0;
+}
+
+/*
+ * Fill [dst_start, dst_start + len) with copies of the pages at
+ * src_start, or with the zero page if zeropage is set.  The source is
+ * read without mmap_sem, which is taken for each page in turn, so that
+ * the source may itself be in a registered range, and the faulting
+ * threads are not held up any longer than necessary.
+ */
+static ssize_t __mcopy_atomic(struct mm_struct *dst_mm,
+			      unsigned long dst_start,
+			      unsigned long src_start,
+			      unsigned long len, bool zeropage)
+{
+	struct vm_area_struct *dst_vma;
+	struct page *page = NULL;
+	unsigned long dst_addr = dst_start, src_addr = src_start;
+	ssize_t copied = 0;
+	int err = 0;
+
+	/* Checked by the caller */
+	BUG_ON(dst_start & ~PAGE_MASK);
+	BUG_ON(len & ~PAGE_MASK);
+	BUG_ON(dst_start + len <= dst_start);
+
+	while (dst_addr < dst_start + len) {
+		if (!zeropage) {
+			void *kaddr;
+
+			page = alloc_page(GFP_HIGHUSER_MOVABLE);
+			if (!page) {
+				err = -ENOMEM;
+				break;
+			}
+			kaddr = kmap(page);
+			if (copy_from_user(kaddr, (const void __user *)src_addr,
+					   PAGE_SIZE))
+				err = -EFAULT;
+			kunmap(page);
+			if (err)
+				break;
+			__SetPageUptodate(page);
+		}
+
+		down_read(&dst_mm->mmap_sem);
+
+		/* The range may have been unregistered or unmapped meanwhile */
+		err = -EINVAL;
+		dst_vma = find_vma(dst_mm, dst_addr);
+		if (!dst_vma || dst_addr < dst_vma->vm_start ||
+		    !userfaultfd_missing(dst_vma) || dst_vma->vm_ops)
+			goto unlock;
+
+		err = -ENOMEM;
+		if (unlikely(anon_vma_prepare(dst_vma)))
+			goto unlock;
+		if (page && mem_cgroup_newpage_charge(page, dst_mm, GFP_KERNEL))
+			goto unlock;
+
+		err = mfill_pte(dst_mm, dst_vma, dst_addr, page);
+		if (!err)
+			page = NULL;
+		else if (page)
+			mem_cgroup_uncharge_page(page);
+unlock:
+		up_read(&dst_mm->mmap_sem);
+		if (err)
+			break;
+
+		dst_addr += PAGE_SIZE;
+		src_addr += PAGE_SIZE;
+		copied += PAGE_SIZE;
+
+		if (fatal_signal_pending(current)) {
+			err = -EINTR;
+			break;
+		}
+		cond_resched();
+	}
+
+	if (page)
+		page_cache_release(page);
+	return copied ? copied : err;
+}
+
+/**
+ * mcopy_atomic - resolve missing page faults with copies of user pages
+ * @dst_mm: the mm the userfaultfd was created for
+ * @dst_start: start of the missing range, page aligned
+ * @src_start: the pages to copy, in current's address space
+ * @len: length of the range, page aligned
+ *
+ * Each page of the range is copied and mapped in one step, so a faulting
+ * thread either finds no page or the whole of the new one.  Returns the
+ * number of bytes copied, or an error if none were: -EEXIST if the first
+ * page is mapped already.
+ */
+ssize_t mcopy_atomic(struct mm_struct *dst_mm, unsigned long dst_start,
+		     unsigned long src_start, unsigned long len)
+{
+	return __mcopy_atomic(dst_mm, dst_start, src_start, len, false);
+}
+
+/**
+ * mfill_zeropage - resolve missing page faults with the zero page
+ * @dst_mm: the mm the userfaultfd was created for
+ * @start: start of the missing range, page aligned
+ * @len: length of the range, page aligned
+ *
+ * As mcopy_atomic(), with the zero page mapped read-only.
+ */
+ssize_t mfill_zeropage(struct mm_struct *dst_mm, unsigned long start,
+		       unsigned long len)
+{
+	return __mcopy_atomic(dst_mm, start, 0, len, true);
+}
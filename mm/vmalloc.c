@@ -27,6 +27,7 @@
 #include <linux/pfn.h>
 #include <linux/kmemleak.h>
 #include <linux/atomic.h>
+#include <linux/llist.h>
 #include <asm/uaccess.h>
 #include <asm/tlbflush.h>
 #include <asm/shmparam.h>
@@ -245,8 +246,6 @@ EXPORT_SYMBOL(vmalloc_to_pfn);
 
 /*** Global kva allocator ***/
 
-#define VM_LAZY_FREE	0x01
-#define VM_LAZY_FREEING	0x02
 #define VM_VM_AREA	0x04
 
 struct vmap_area {
@@ -255,20 +254,32 @@ struct vmap_area {
 	unsigned long flags;
 	struct rb_node rb_node;		/* address sorted rbtree */
 	struct list_head list;		/* address sorted list */
-	struct list_head purge_list;	/* "lazy purge" list */
+	struct llist_node purge_list;	/* "lazy purge" list */
 	struct vm_struct *vm;
-	struct rcu_head rcu_head;
+	unsigned long subtree_max_size;	/* free tree: largest area below */
 };
 
 static DEFINE_SPINLOCK(vmap_area_lock);
 static LIST_HEAD(vmap_area_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
+/*
+ * The free address space is kept, also under vmap_area_lock, as
+ * vmap_areas on an address sorted list and in an address sorted
+ * rbtree, in which each node records the size of the largest free area
+ * in its subtree.  That finds the lowest fitting area in O(log n) steps,
+ * however fragmented the address space gets.
+ */
+static LIST_HEAD(free_vmap_area_list);
+static struct rb_root free_vmap_area_root = RB_ROOT;
+
+static struct kmem_cache *vmap_area_cachep __read_mostly;
+
+/*
+ * A spare vmap_area per CPU, allocated before taking vmap_area_lock, for
+ * when an allocation splits a free area in two.
+ */
+static DEFINE_PER_CPU(struct vmap_area *, vmap_area_preload);
 
 static unsigned long vmap_area_pcpu_hole;
 
@@ -318,11 +329,263 @@ static void __insert_vmap_area(struct vmap_area *va)
 	if (tmp) {
 		struct vmap_area *prev;
 		prev = rb_entry(tmp, struct vmap_area, rb_node);
-		list_add_rcu(&va->list, &prev->list);
+		list_add(&va->list, &prev->list);
 	} else
-		list_add_rcu(&va->list, &vmap_area_list);
+		list_add(&va->list, &vmap_area_list);
+}
+
+static inline unsigned long va_size(struct vmap_area *va)
+{
+	return va->va_end - va->va_start;
+}
+
+static inline unsigned long get_subtree_max_size(struct rb_node *node)
+{
+	struct vmap_area *va;
+
+	if (!node)
+		return 0;
+	va = rb_entry(node, struct vmap_area, rb_node);
+	return va->subtree_max_size;
 }
 
+/* Update 'subtree_max_size' for a node, based on node and its children */
+static void free_vmap_area_augment_cb(struct rb_node *node, void *unused)
+{
+	struct vmap_area *va;
+
+	if (!node)
+		return;
+
+	va = rb_entry(node, struct vmap_area, rb_node);
+	va->subtree_max_size = max3(va_size(va),
+				    get_subtree_max_size(node->rb_left),
+				    get_subtree_max_size(node->rb_right));
+}
+
+/* The size of free area @va changed: fix up the maxima above it */
+static void free_vmap_area_propagate(struct vmap_area *va)
+{
+	rb_augment_erase_end(&va->rb_node, free_vmap_area_augment_cb, NULL);
+}
+
+static void __insert_free_vmap_area(struct vmap_area *va)
+{
+	struct rb_node **p = &free_vmap_area_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct rb_node *tmp;
+
+	while (*p) {
+		struct vmap_area *tmp_va;
+
+		parent = *p;
+		tmp_va = rb_entry(parent, struct vmap_area, rb_node);
+		if (va->va_end <= tmp_va->va_start)
+			p = &(*p)->rb_left;
+		else if (va->va_start >= tmp_va->va_end)
+			p = &(*p)->rb_right;
+		else
+			BUG();
+	}
+
+	va->subtree_max_size = va_size(va);
+	rb_link_node(&va->rb_node, parent, p);
+	rb_insert_color(&va->rb_node, &free_vmap_area_root);
+	rb_augment_insert(&va->rb_node, free_vmap_area_augment_cb, NULL);
+
+	tmp = rb_prev(&va->rb_node);
+	if (tmp) {
+		struct vmap_area *prev;
+		prev = rb_entry(tmp, struct vmap_area, rb_node);
+		list_add(&va->list, &prev->list);
+	} else
+		list_add(&va->list, &free_vmap_area_list);
+}
+
+static void __erase_free_vmap_area(struct vmap_area *va)
+{
+	struct rb_node *deepest;
+
+	deepest = rb_augment_erase_begin(&va->rb_node);
+	rb_erase(&va->rb_node, &free_vmap_area_root);
+	rb_augment_erase_end(deepest, free_vmap_area_augment_cb, NULL);
+	list_del(&va->list);
+}
+
+/*
+ * Return the range of @va, which is no longer in use, to the free
+ * address space, merging it with the free areas on either side.
+ */
+static void __merge_free_vmap_area(struct vmap_area *va)
+{
+	struct rb_node *n = free_vmap_area_root.rb_node;
+	struct vmap_area *prev = NULL, *next = NULL;
+	struct list_head *head;
+
+	/* the first free area above @va */
+	while (n) {
+		struct vmap_area *tmp;
+
+		tmp = rb_entry(n, struct vmap_area, rb_node);
+		if (tmp->va_start >= va->va_end) {
+			next = tmp;
+			n = n->rb_left;
+		} else
+			n = n->rb_right;
+	}
+
+	head = next ? next->list.prev : free_vmap_area_list.prev;
+	if (head != &free_vmap_area_list)
+		prev = list_entry(head, struct vmap_area, list);
+
+	if (next && next->va_start == va->va_end) {
+		next->va_start = va->va_start;
+		if (prev && prev->va_end == va->va_start) {
+			next->va_start = prev->va_start;
+			__erase_free_vmap_area(prev);
+			kmem_cache_free(vmap_area_cachep, prev);
+		}
+		free_vmap_area_propagate(next);
+		kmem_cache_free(vmap_area_cachep, va);
+	} else if (prev && prev->va_end == va->va_start) {
+		prev->va_end = va->va_end;
+		free_vmap_area_propagate(prev);
+		kmem_cache_free(vmap_area_cachep, va);
+	} else
+		__insert_free_vmap_area(va);
+}
+
+/*
+ * The lowest address in free area @va, not below @vstart, at which an
+ * area of @size bytes aligned to @align fits, or 0.
+ */
+static unsigned long free_vmap_area_fit(struct vmap_area *va,
+					unsigned long size,
+					unsigned long align,
+					unsigned long vstart)
+{
+	unsigned long addr = ALIGN(max(va->va_start, vstart), align);
+
+	/* overflow check */
+	if (addr + size - 1 < addr)
+		return 0;
+	if (addr < va->va_start || addr + size > va->va_end)
+		return 0;
+	return addr;
+}
+
+/*
+ * Find the free area with the lowest address which can fit @size bytes
+ * aligned to @align at or above @vstart.  Subtrees whose largest area is
+ * smaller than size + align - 1 cannot be guaranteed to fit and are not
+ * descended into.
+ */
+static struct vmap_area *find_lowest_free_vmap_area(unsigned long size,
+						     unsigned long align,
+						     unsigned long vstart)
+{
+	unsigned long length = size + align - 1;
+	struct rb_node *node = free_vmap_area_root.rb_node;
+	struct vmap_area *va;
+
+	while (node) {
+		va = rb_entry(node, struct vmap_area, rb_node);
+
+		if (get_subtree_max_size(node->rb_left) >= length &&
+		    vstart < va->va_start) {
+			node = node->rb_left;
+			continue;
+		}
+
+		if (free_vmap_area_fit(va, size, align, vstart))
+			return va;
+
+		if (get_subtree_max_size(node->rb_right) >= length) {
+			node = node->rb_right;
+			continue;
+		}
+
+		/*
+		 * Nothing fits in this subtree, because of @vstart or of
+		 * the alignment: go back up and try the ancestors above it
+		 * and their right subtrees.  Raising @vstart past an
+		 * ancestor whose right subtree is searched keeps us from
+		 * searching it twice.
+		 */
+		while ((node = rb_parent(node))) {
+			va = rb_entry(node, struct vmap_area, rb_node);
+			if (free_vmap_area_fit(va, size, align, vstart))
+				return va;
+
+			if (get_subtree_max_size(node->rb_right) >= length &&
+			    vstart <= va->va_start) {
+				vstart = va->va_start + 1;
+				node = node->rb_right;
+				break;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Take [@start, @end) out of free area @va.  Splitting @va in two needs
+ * another vmap_area, which is taken from *@spare.
+ */
+static int __clip_free_vmap_area(struct vmap_area *va, unsigned long start,
+				 unsigned long end, struct vmap_area **spare)
+{
+	struct vmap_area *lva;
+
+	BUG_ON(start < va->va_start || end > va->va_end);
+
+	if (va->va_start == start && va->va_end == end) {
+		__erase_free_vmap_area(va);
+		kmem_cache_free(vmap_area_cachep, va);
+	} else if (va->va_start == start) {
+		va->va_start = end;
+		free_vmap_area_propagate(va);
+	} else if (va->va_end == end) {
+		va->va_end = start;
+		free_vmap_area_propagate(va);
+	} else {
+		lva = *spare;
+		if (!lva)
+			return -ENOMEM;
+		*spare = NULL;
+
+		lva->va_start = va->va_start;
+		lva->va_end = start;
+		va->va_start = end;
+		free_vmap_area_propagate(va);
+		__insert_free_vmap_area(lva);
+	}
+	return 0;
+}
+
+#ifdef CONFIG_SMP
+/* The free area containing @addr */
+static struct vmap_area *__find_free_vmap_area(unsigned long addr)
+{
+	struct rb_node *n = free_vmap_area_root.rb_node;
+
+	while (n) {
+		struct vmap_area *va;
+
+		va = rb_entry(n, struct vmap_area, rb_node);
+		if (addr < va->va_start)
+			n = n->rb_left;
+		else if (addr >= va->va_end)
+			n = n->rb_right;
+		else
+			return va;
+	}
+
+	BUG();
+}
+#endif
+
 static void purge_vmap_area_lazy(void);
 
 /*
@@ -334,101 +597,63 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				unsigned long vstart, unsigned long vend,
 				int node, gfp_t gfp_mask)
 {
-	struct vmap_area *va;
-	struct rb_node *n;
+	struct vmap_area *va, *fva, *pva;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
+	bool no_spare;
 
 	BUG_ON(!size);
 	BUG_ON(size & ~PAGE_MASK);
 	BUG_ON(!is_power_of_2(align));
 
-	va = kmalloc_node(sizeof(struct vmap_area),
+	va = kmem_cache_alloc_node(vmap_area_cachep,
 			gfp_mask & GFP_RECLAIM_MASK, node);
 	if (unlikely(!va))
 		return ERR_PTR(-ENOMEM);
 
 retry:
-	spin_lock(&vmap_area_lock);
 	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
+	 * Make sure this CPU has a spare vmap_area, in case the fitting
+	 * free area has to be split.  Racing with another CPU here only
+	 * means one extra allocation.
 	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
+	pva = NULL;
+	no_spare = false;
+	if (!this_cpu_read(vmap_area_preload)) {
+		pva = kmem_cache_alloc_node(vmap_area_cachep,
+				gfp_mask & GFP_RECLAIM_MASK, node);
+		no_spare = !pva;
 	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
 
-		if (!first)
-			goto found;
-	}
+	spin_lock(&vmap_area_lock);
+	if (pva && __this_cpu_cmpxchg(vmap_area_preload, NULL, pva))
+		kmem_cache_free(vmap_area_cachep, pva);
 
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		n = rb_next(&first->rb_node);
-		if (n)
-			first = rb_entry(n, struct vmap_area, rb_node);
-		else
-			goto found;
-	}
+	fva = find_lowest_free_vmap_area(size, align, vstart);
+	if (!fva)
+		goto overflow;
 
-found:
+	addr = free_vmap_area_fit(fva, size, align, vstart);
 	if (addr + size > vend)
 		goto overflow;
 
+	if (__clip_free_vmap_area(fva, addr, addr + size,
+				  __this_cpu_ptr(&vmap_area_preload))) {
+		spin_unlock(&vmap_area_lock);
+		/*
+		 * Either the spare could not be allocated, or we moved to a
+		 * CPU without one before taking the lock: only then retry.
+		 */
+		if (!no_spare)
+			goto retry;
+		kmem_cache_free(vmap_area_cachep, va);
+		return ERR_PTR(-ENOMEM);
+	}
+
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(va->va_start & (align-1));
@@ -448,7 +673,7 @@ overflow:
 		printk(KERN_WARNING
 			"vmap allocation for size %lu failed: "
 			"use vmalloc=<size> to increase size.\n", size);
-	kfree(va);
+	kmem_cache_free(vmap_area_cachep, va);
 	return ERR_PTR(-EBUSY);
 }
 
@@ -456,24 +681,9 @@ static void __free_vmap_area(struct vmap_area *va)
 {
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
 	rb_erase(&va->rb_node, &vmap_area_root);
 	RB_CLEAR_NODE(&va->rb_node);
-	list_del_rcu(&va->list);
+	list_del(&va->list);
 
 	/*
 	 * Track the highest possible candidate for pcpu area
@@ -484,7 +694,7 @@ static void __free_vmap_area(struct vmap_area *va)
 	if (va->va_end > VMALLOC_START && va->va_end <= VMALLOC_END)
 		vmap_area_pcpu_hole = max(vmap_area_pcpu_hole, va->va_end);
 
-	kfree_rcu(va, rcu_head);
+	__merge_free_vmap_area(va);
 }
 
 /*
@@ -553,6 +763,9 @@ static unsigned long lazy_max_pages(void)
 
 static atomic_t vmap_lazy_nr = ATOMIC_INIT(0);
 
+/* Lazily freed areas, waiting for a TLB flush to be returned */
+static LLIST_HEAD(vmap_purge_list);
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 
@@ -579,9 +792,9 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 					int sync, int force_flush)
 {
 	static DEFINE_SPINLOCK(purge_lock);
-	LIST_HEAD(valist);
+	struct llist_node *valist, *next;
 	struct vmap_area *va;
-	struct vmap_area *n_va;
+	unsigned long nr_areas = 0;
 	int nr = 0;
 
 	/*
@@ -598,32 +811,38 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (sync)
 		purge_fragmented_blocks_allcpus();
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(va, &vmap_area_list, list) {
-		if (va->flags & VM_LAZY_FREE) {
-			if (va->va_start < *start)
-				*start = va->va_start;
-			if (va->va_end > *end)
-				*end = va->va_end;
-			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
-			list_add_tail(&va->purge_list, &valist);
-			va->flags |= VM_LAZY_FREEING;
-			va->flags &= ~VM_LAZY_FREE;
-		}
+	/*
+	 * Everything freed lazily so far is taken off the purge list in
+	 * one go and covered by a single TLB flush.
+	 */
+	valist = llist_del_all(&vmap_purge_list);
+	llist_for_each_entry(va, valist, purge_list) {
+		if (va->va_start < *start)
+			*start = va->va_start;
+		if (va->va_end > *end)
+			*end = va->va_end;
+		nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
+		nr_areas++;
 	}
-	rcu_read_unlock();
 
 	if (nr)
 		atomic_sub(nr, &vmap_lazy_nr);
 
-	if (nr || force_flush)
+	if (nr || force_flush) {
 		flush_tlb_kernel_range(*start, *end);
+		count_vm_event(VMAP_TLB_FLUSH);
+	}
 
 	if (nr) {
 		spin_lock(&vmap_area_lock);
-		list_for_each_entry_safe(va, n_va, &valist, purge_list)
+		while (valist) {
+			next = valist->next;
+			va = llist_entry(valist, struct vmap_area, purge_list);
 			__free_vmap_area(va);
+			valist = next;
+		}
 		spin_unlock(&vmap_area_lock);
+		count_vm_events(VMAP_LAZY_PURGED, nr_areas);
 	}
 	spin_unlock(&purge_lock);
 }
@@ -656,9 +875,13 @@ static void purge_vmap_area_lazy(void)
  */
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
-	va->flags |= VM_LAZY_FREE;
-	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
-	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
+	int nr_lazy;
+
+	nr_lazy = atomic_add_return((va->va_end - va->va_start) >> PAGE_SHIFT,
+				    &vmap_lazy_nr);
+	llist_add(&va->purge_list, &vmap_purge_list);
+
+	if (unlikely(nr_lazy > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
 }
 
@@ -1168,6 +1391,35 @@ void __init vm_area_register_early(struct vm_struct *vm, size_t align)
 	vm_area_add_early(vm);
 }
 
+/*
+ * All of the address space not taken by the early vmlist entries is
+ * free.  Address 0 is never handed out, and the free space ends just
+ * short of ULONG_MAX so that va_end does not wrap.
+ */
+static void __init vmap_init_free_space(void)
+{
+	unsigned long vmap_start = 1;
+	const unsigned long vmap_end = ULONG_MAX;
+	struct vmap_area *busy, *free;
+
+	list_for_each_entry(busy, &vmap_area_list, list) {
+		if (busy->va_start > vmap_start) {
+			free = kmem_cache_zalloc(vmap_area_cachep, GFP_NOWAIT);
+			free->va_start = vmap_start;
+			free->va_end = busy->va_start;
+			__insert_free_vmap_area(free);
+		}
+		vmap_start = busy->va_end;
+	}
+
+	if (vmap_end > vmap_start) {
+		free = kmem_cache_zalloc(vmap_area_cachep, GFP_NOWAIT);
+		free->va_start = vmap_start;
+		free->va_end = vmap_end;
+		__insert_free_vmap_area(free);
+	}
+}
+
 void __init vmalloc_init(void)
 {
 	struct vmap_area *va;
@@ -1182,15 +1434,19 @@ void __init vmalloc_init(void)
 		INIT_LIST_HEAD(&vbq->free);
 	}
 
+	vmap_area_cachep = KMEM_CACHE(vmap_area, SLAB_PANIC);
+
 	/* Import existing vmlist entries. */
 	for (tmp = vmlist; tmp; tmp = tmp->next) {
-		va = kzalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+		va = kmem_cache_zalloc(vmap_area_cachep, GFP_NOWAIT);
 		va->flags = tmp->flags | VM_VM_AREA;
 		va->va_start = (unsigned long)tmp->addr;
 		va->va_end = va->va_start + tmp->size;
 		__insert_vmap_area(va);
 	}
 
+	vmap_init_free_space();
+
 	vmap_area_pcpu_hole = VMALLOC_END;
 
 	vmap_initialized = true;
@@ -2337,7 +2593,7 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 {
 	const unsigned long vmalloc_start = ALIGN(VMALLOC_START, align);
 	const unsigned long vmalloc_end = VMALLOC_END & ~(align - 1);
-	struct vmap_area **vas, *prev, *next;
+	struct vmap_area **vas, **spares, *prev, *next;
 	struct vm_struct **vms;
 	int area, area2, last_area, term_area;
 	unsigned long base, start, end, last_end;
@@ -2377,13 +2633,16 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 
 	vms = kzalloc(sizeof(vms[0]) * nr_vms, GFP_KERNEL);
 	vas = kzalloc(sizeof(vas[0]) * nr_vms, GFP_KERNEL);
-	if (!vas || !vms)
+	spares = kzalloc(sizeof(spares[0]) * nr_vms, GFP_KERNEL);
+	if (!vas || !vms || !spares)
 		goto err_free2;
 
 	for (area = 0; area < nr_vms; area++) {
-		vas[area] = kzalloc(sizeof(struct vmap_area), GFP_KERNEL);
+		vas[area] = kmem_cache_zalloc(vmap_area_cachep, GFP_KERNEL);
 		vms[area] = kzalloc(sizeof(struct vm_struct), GFP_KERNEL);
-		if (!vas[area] || !vms[area])
+		/* each area may split a free area in two */
+		spares[area] = kmem_cache_zalloc(vmap_area_cachep, GFP_KERNEL);
+		if (!vas[area] || !vms[area] || !spares[area])
 			goto err_free;
 	}
 retry:
@@ -2460,6 +2719,8 @@ found:
 		va->va_start = base + offsets[area];
 		va->va_end = va->va_start + sizes[area];
 		__insert_vmap_area(va);
+		__clip_free_vmap_area(__find_free_vmap_area(va->va_start),
+				      va->va_start, va->va_end, &spares[area]);
 	}
 
 	vmap_area_pcpu_hole = base + offsets[last_area];
@@ -2471,15 +2732,23 @@ found:
 		insert_vmalloc_vm(vms[area], vas[area], VM_ALLOC,
 				  pcpu_get_vm_areas);
 
+	for (area = 0; area < nr_vms; area++)
+		if (spares[area])
+			kmem_cache_free(vmap_area_cachep, spares[area]);
+	kfree(spares);
 	kfree(vas);
 	return vms;
 
 err_free:
 	for (area = 0; area < nr_vms; area++) {
-		kfree(vas[area]);
+		if (vas[area])
+			kmem_cache_free(vmap_area_cachep, vas[area]);
+		if (spares[area])
+			kmem_cache_free(vmap_area_cachep, spares[area]);
 		kfree(vms[area]);
 	}
 err_free2:
+	kfree(spares);
 	kfree(vas);
 	kfree(vms);
 	return NULL;
@@ -251,6 +251,10 @@ static inline int do_shrinker_shrink(struct shrinker *shrinker,
  * are eligible for the caller's allocation attempt.  It is used for balancing
  * slab reclaim versus page reclaim.
  *
+ * `shrink->nodes_to_scan' are the nodes under reclaim; an empty mask means
+ * all of them.  When `shrink->memcg' is set, only the shrinkers which can
+ * tell the objects of that memory cgroup apart are called.
+ *
  * Returns the number of slab objects which we shrunk.
  */
 unsigned long shrink_slab(struct shrink_control *shrink,
@@ -263,6 +267,9 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 	if (nr_pages_scanned == 0)
 		nr_pages_scanned = SWAP_CLUSTER_MAX;
 
+	if (nodes_empty(shrink->nodes_to_scan))
+		shrink->nodes_to_scan = node_online_map;
+
 	if (!down_read_trylock(&shrinker_rwsem)) {
 		/* Assume we'll be able to shrink next time */
 		ret = 1;
@@ -279,6 +286,9 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 		long batch_size = shrinker->batch ? shrinker->batch
 						  : SHRINK_BATCH;
 
+		if (shrink->memcg && !(shrinker->flags & SHRINKER_MEMCG_AWARE))
+			continue;
+
 		max_pass = do_shrinker_shrink(shrinker, shrink, 0);
 		if (max_pass <= 0)
 			continue;
@@ -286,9 +296,14 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 		/*
 		 * copy the current shrinker scan count into a local variable
 		 * and zero it so that other concurrent shrinker invocations
-		 * don't also do this scanning work.
+		 * don't also do this scanning work.  The deferred count is
+		 * for global reclaim: limit reclaim of one cgroup must not
+		 * pass its leftovers on to another.
 		 */
-		nr = atomic_long_xchg(&shrinker->nr_in_batch, 0);
+		if (shrink->memcg)
+			nr = 0;
+		else
+			nr = atomic_long_xchg(&shrinker->nr_in_batch, 0);
 
 		total_scan = nr;
 		delta = (4 * nr_pages_scanned) / shrinker->seeks;
@@ -350,7 +365,7 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 		 * manner that handles concurrent updates. If we exhausted the
 		 * scan, there is no need to do an update.
 		 */
-		if (total_scan > 0)
+		if (total_scan > 0 && !shrink->memcg)
 			new_nr = atomic_long_add_return(total_scan,
 					&shrinker->nr_in_batch);
 		else
@@ -364,6 +379,37 @@ out:
 	return ret;
 }
 
+/*
+ * Shrink the slab objects of the cgroup under limit reclaim and of its
+ * descendants, balanced against the pages on their LRU lists.
+ */
+static void shrink_memcg_slab(struct scan_control *sc,
+			      struct shrink_control *shrink)
+{
+	struct mem_cgroup *root = sc->target_mem_cgroup;
+	unsigned long lru_pages = 0;
+	struct mem_cgroup *memcg;
+	struct zone *zone;
+
+	memcg = mem_cgroup_iter(root, NULL, NULL);
+	while (memcg) {
+		for_each_populated_zone(zone)
+			lru_pages += mem_cgroup_zone_nr_lru_pages(memcg,
+					zone_to_nid(zone), zone_idx(zone),
+					LRU_ALL_EVICTABLE);
+		memcg = mem_cgroup_iter(root, memcg, NULL);
+	}
+
+	nodes_clear(shrink->nodes_to_scan);
+	memcg = mem_cgroup_iter(root, NULL, NULL);
+	while (memcg) {
+		shrink->memcg = memcg;
+		shrink_slab(shrink, sc->nr_scanned, lru_pages);
+		memcg = mem_cgroup_iter(root, memcg, NULL);
+	}
+	shrink->memcg = NULL;
+}
+
 static void set_reclaim_mode(int priority, struct scan_control *sc,
 				   bool sync)
 {
@@ -536,7 +582,8 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
  * Same as remove_mapping, but if the page is removed from the mapping, it
  * gets returned with a refcount of 0.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -582,10 +629,18 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
-
-		__delete_from_page_cache(page);
+		/*
+		 * Remember when a page cache page was reclaimed, so that
+		 * its refault can be told apart from a first access.
+		 * Pages that are removed for other reasons, such as
+		 * invalidation, are not counted as evictions.
+		 */
+		if (reclaimed && page_is_file_cache(page))
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -608,7 +663,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -722,7 +777,7 @@ static enum page_references page_check_references(struct page *page,
 		return PAGEREF_RECLAIM;
 
 	if (referenced_ptes) {
-		if (PageAnon(page))
+		if (PageAnon(page) && PageSwapBacked(page))
 			return PAGEREF_ACTIVATE;
 		/*
 		 * All mapped pages start out with page table
@@ -782,8 +837,10 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 	while (!list_empty(page_list)) {
 		enum page_references references;
 		struct address_space *mapping;
+		struct backing_dev_info *bdi;
 		struct page *page;
 		int may_enter_fs;
+		bool lazyfree;
 
 		cond_resched();
 
@@ -841,9 +898,12 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 
 		/*
 		 * Anonymous process memory has backing store?
-		 * Try to allocate it some swap space here.
+		 * Try to allocate it some swap space here.  Pages freed
+		 * by madvise(MADV_FREE) are not swapped out but dropped.
 		 */
-		if (PageAnon(page) && !PageSwapCache(page)) {
+		lazyfree = PageAnon(page) && !PageSwapBacked(page);
+		if (PageAnon(page) && PageSwapBacked(page) &&
+		    !PageSwapCache(page)) {
 			if (!(sc->gfp_mask & __GFP_IO))
 				goto keep_locked;
 			if (!add_to_swap(page))
@@ -857,8 +917,8 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * The page is mapped into the page tables of one or more
 		 * processes. Try to unmap it here.
 		 */
-		if (page_mapped(page) && mapping) {
-			switch (try_to_unmap(page, TTU_UNMAP)) {
+		if (page_mapped(page) && (mapping || lazyfree)) {
+			switch (try_to_unmap(page, TTU_UNMAP|TTU_BATCH_FLUSH)) {
 			case SWAP_FAIL:
 				goto activate_locked;
 			case SWAP_AGAIN:
@@ -870,6 +930,25 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
+		if (lazyfree) {
+			/* Written to again since madvise(MADV_FREE)? */
+			if (PageDirty(page)) {
+				SetPageSwapBacked(page);
+				goto activate_locked;
+			}
+			/* Only the isolation reference is left, keep it so */
+			if (!page_freeze_refs(page, 1))
+				goto keep_locked;
+			if (PageDirty(page)) {
+				page_unfreeze_refs(page, 1);
+				SetPageSwapBacked(page);
+				goto activate_locked;
+			}
+			count_vm_event(PGLAZYFREED);
+			__clear_page_locked(page);
+			goto free_it;
+		}
+
 		if (PageDirty(page)) {
 			nr_dirty++;
 
@@ -899,7 +978,11 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			if (!sc->may_writepage)
 				goto keep_locked;
 
-			/* Page is dirty, try to write it out here */
+			/*
+			 * Page is dirty, try to write it out here.  Writes
+			 * through stale TLB entries would be lost: flush them.
+			 */
+			try_to_unmap_flush_dirty();
 			switch (pageout(page, mapping, sc)) {
 			case PAGE_KEEP:
 				nr_congested++;
@@ -968,9 +1051,18 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping)
 			goto keep_locked;
 
+		bdi = mapping->backing_dev_info;
+
+		if (!__remove_mapping(mapping, page, true))
+			goto keep_locked;
+
+		/* Read ahead, but never read: that readahead was wasted */
+		if (PageRaUnused(page))
+			inc_bdi_stat(bdi, BDI_READAHEAD_WASTED);
+
 		/*
 		 * At this point, we have no other references and there is
 		 * no way to pick any more up (removed from LRU, removed
@@ -1022,6 +1114,7 @@ keep_lumpy:
 	if (nr_dirty && nr_dirty == nr_congested && global_reclaim(sc))
 		zone_set_flag(mz->zone, ZONE_CONGESTED);
 
+	try_to_unmap_flush();
 	free_hot_cold_page_list(&free_pages, 1);
 
 	list_splice(&ret_pages, page_list);
@@ -1124,6 +1217,417 @@ int __isolate_lru_page(struct page *page, isolate_mode_t mode, int file)
 	return ret;
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-generational LRU
+ *
+ * Instead of an active and an inactive list, the evictable pages of a
+ * zone are kept in up to MAX_NR_GENS generations.  Aging creates a new
+ * youngest generation and then walks the page tables of the mm's that
+ * ran since the previous walk, moving every page found young into it.
+ * Eviction takes pages from the tail of the oldest generation and feeds
+ * them to shrink_page_list() like the inactive list would.
+ *
+ * Promotions only update the generation in page->flags; the page stays
+ * on the list it was on until eviction finds it there and sorts it onto
+ * the list of its generation.  A page is thus never on a list younger
+ * than its generation, which is what allows min_seq to advance as soon
+ * as the oldest list is empty.
+ */
+int lru_gen_requested __read_mostly;
+
+static int __init setup_lru_gen(char *str)
+{
+	unsigned long val;
+
+	if (!strict_strtoul(str, 0, &val))
+		lru_gen_requested = !!val;
+	return 1;
+}
+__setup("lru_gen=", setup_lru_gen);
+
+/* mm's that aging walks, protected by lru_gen_mm_lock */
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+/* Serializes aging: only the ager increments max_seq */
+static DEFINE_MUTEX(lru_gen_aging_mutex);
+
+void lru_gen_init_zone(struct zone *zone)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int gen, type;
+
+	lrugen->max_seq = MIN_NR_GENS - 1;
+	for (type = 0; type < 2; type++)
+		lrugen->min_seq[type] = 0;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		lrugen->timestamps[gen] = jiffies;
+		for (type = 0; type < 2; type++) {
+			INIT_LIST_HEAD(&lrugen->lists[gen][type]);
+			atomic_long_set(&lrugen->nr_pages[gen][type], 0);
+		}
+	}
+}
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	if (!lru_gen_enabled())
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	if (list_empty(&mm->lru_gen_list))
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	list_del_init(&mm->lru_gen_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+static void page_move_lru_gen(struct page *page, int old_gen, int gen)
+{
+	struct lru_gen_struct *lrugen = &page_zone(page)->lrugen;
+	int type = page_is_file_cache(page);
+	int nr_pages = hpage_nr_pages(page);
+
+	if (old_gen == gen)
+		return;
+
+	atomic_long_sub(nr_pages, &lrugen->nr_pages[old_gen][type]);
+	atomic_long_add(nr_pages, &lrugen->nr_pages[gen][type]);
+}
+
+/**
+ * lru_gen_promote_page - move a page into the youngest generation
+ * @page: the page, which the caller holds a reference on
+ *
+ * Only the generation in page->flags is updated, so the lru_lock is not
+ * needed.  Returns false if @page is not on a generation list.
+ */
+bool lru_gen_promote_page(struct page *page)
+{
+	struct lru_gen_struct *lrugen = &page_zone(page)->lrugen;
+	unsigned long old_flags, new_flags, seq;
+	int old_gen, gen;
+
+	do {
+		seq = ACCESS_ONCE(lrugen->max_seq);
+		gen = lru_gen_from_seq(seq);
+		do {
+			old_flags = ACCESS_ONCE(page->flags);
+			old_gen = lru_gen_from_flags(old_flags);
+			if (old_gen < 0)
+				return false;
+			if (old_gen == gen)
+				break;
+			new_flags = (old_flags & ~LRU_GEN_MASK) |
+				    ((gen + 1UL) << LRU_GEN_PGOFF);
+		} while (cmpxchg(&page->flags, old_flags, new_flags) != old_flags);
+		page_move_lru_gen(page, old_gen, gen);
+		/*
+		 * Had aging created a new generation meanwhile, the page may
+		 * already have been put into it: never leave it behind.
+		 */
+	} while (seq != ACCESS_ONCE(lrugen->max_seq));
+
+	return true;
+}
+
+/**
+ * lru_gen_rotate_page - make a page the next one to be evicted
+ * @zone: the zone of @page, whose lru_lock is held
+ * @page: the page
+ *
+ * Returns false if @page is not on a generation list.
+ */
+bool lru_gen_rotate_page(struct zone *zone, struct page *page)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int type = page_is_file_cache(page);
+	int gen;
+
+	if (page_lru_gen(page) < 0)
+		return false;
+
+	gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	page_move_lru_gen(page, page_set_lru_gen(page, gen), gen);
+	list_move_tail(&page->lru, &lrugen->lists[gen][type]);
+	return true;
+}
+
+/*
+ * Retire the oldest generations of @type while they are empty, but keep
+ * at least MIN_NR_GENS of them.  Called with the lru_lock held.
+ */
+static void lru_gen_inc_min_seq(struct zone *zone, int type)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+
+	while (lrugen->max_seq - lrugen->min_seq[type] + 1 > MIN_NR_GENS) {
+		int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+		if (!list_empty(&lrugen->lists[gen][type]))
+			break;
+		lrugen->min_seq[type]++;
+	}
+}
+
+/*
+ * Merge the oldest generation of @type into the next one, to make room
+ * for a new generation when pages of @type are not being evicted, like
+ * anon pages without swap.  Called with the lru_lock held.
+ */
+static void lru_gen_fold_oldest(struct zone *zone, int type)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int gen = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	unsigned long old_flags, new_flags;
+	struct page *page;
+
+	list_for_each_entry(page, &lrugen->lists[old_gen][type], lru) {
+		do {
+			old_flags = ACCESS_ONCE(page->flags);
+			/* Promoted since, and moved out of this generation */
+			if (lru_gen_from_flags(old_flags) != old_gen)
+				break;
+			new_flags = (old_flags & ~LRU_GEN_MASK) |
+				    ((gen + 1UL) << LRU_GEN_PGOFF);
+		} while (cmpxchg(&page->flags, old_flags, new_flags) != old_flags);
+		if (lru_gen_from_flags(old_flags) == old_gen)
+			page_move_lru_gen(page, old_gen, gen);
+	}
+	/* Older pages go to the tail, to be evicted first */
+	list_splice_tail_init(&lrugen->lists[old_gen][type],
+			      &lrugen->lists[gen][type]);
+	lrugen->min_seq[type]++;
+}
+
+/*
+ * Create a new youngest generation.  Unless @force is set, zones that
+ * already have MAX_NR_GENS generations of either type are left alone.
+ * Called with the lru_lock held.
+ */
+static void lru_gen_inc_max_seq(struct zone *zone, bool force)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int type;
+
+	for (type = 0; type < 2; type++) {
+		lru_gen_inc_min_seq(zone, type);
+		if (lrugen->max_seq - lrugen->min_seq[type] + 1 < MAX_NR_GENS)
+			continue;
+		if (!force)
+			return;
+		lru_gen_fold_oldest(zone, type);
+	}
+
+	lrugen->max_seq++;
+	lrugen->timestamps[lru_gen_from_seq(lrugen->max_seq)] = jiffies;
+}
+
+static bool lru_gen_need_aging(struct zone *zone, int type)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+
+	return ACCESS_ONCE(lrugen->max_seq) -
+	       ACCESS_ONCE(lrugen->min_seq[type]) + 1 <= MIN_NR_GENS;
+}
+
+struct lru_gen_walk {
+	struct vm_area_struct *vma;
+	unsigned long nr_promoted;
+};
+
+static int lru_gen_pmd_entry(pmd_t *pmd, unsigned long addr,
+			     unsigned long end, struct mm_walk *walk)
+{
+	struct lru_gen_walk *args = walk->private;
+	struct vm_area_struct *vma = args->vma;
+	struct page *page;
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	spin_lock(&walk->mm->page_table_lock);
+	if (pmd_trans_huge(*pmd)) {
+		if (!pmd_trans_splitting(*pmd) && pmd_young(*pmd)) {
+			page = pmd_page(*pmd);
+			if (page_lru_gen(page) >= 0 &&
+			    pmdp_test_and_clear_young(vma, addr, pmd) &&
+			    lru_gen_promote_page(page))
+				args->nr_promoted += HPAGE_PMD_NR;
+		}
+		spin_unlock(&walk->mm->page_table_lock);
+		return 0;
+	}
+	spin_unlock(&walk->mm->page_table_lock);
+#endif
+
+	/*
+	 * The mmap_sem taken by lru_gen_walk_mm() keeps khugepaged from
+	 * collapsing the page table under us.
+	 */
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page || page_lru_gen(page) < 0)
+			continue;
+		/*
+		 * Clearing the accessed bit without a TLB flush may miss an
+		 * access through a stale TLB entry, which only delays the
+		 * next promotion; flushing here would cost far more.
+		 */
+		if (ptep_test_and_clear_young(vma, addr, pte) &&
+		    lru_gen_promote_page(page))
+			args->nr_promoted++;
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+	cond_resched();
+	return 0;
+}
+
+static void lru_gen_walk_mm(struct mm_struct *mm, struct lru_gen_walk *args)
+{
+	struct vm_area_struct *vma;
+	struct mm_walk walk = {
+		.pmd_entry = lru_gen_pmd_entry,
+		.mm = mm,
+		.private = args,
+	};
+
+	/* Do not wait for the mmap_sem: rmap still catches what we skip */
+	if (!down_read_trylock(&mm->mmap_sem))
+		return;
+
+	mm->lru_gen_used = 0;
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (vma->vm_flags & (VM_LOCKED | VM_IO | VM_PFNMAP | VM_HUGETLB))
+			continue;
+		args->vma = vma;
+		walk_page_range(vma->vm_start, vma->vm_end, &walk);
+	}
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Age all zones, giving @zone a new generation of @type to evict from,
+ * then promote the pages found young in the page tables of the mm's
+ * which ran since the last walk.
+ */
+static void lru_gen_age(struct zone *zone, int type, struct scan_control *sc)
+{
+	struct lru_gen_walk args = { .nr_promoted = 0 };
+	struct mm_struct *mm, *prev = NULL;
+	struct list_head *pos;
+	struct zone *z;
+
+	if (!lru_gen_need_aging(zone, type))
+		return;
+	/*
+	 * A caller that cannot enter the filesystem may hold its locks:
+	 * leave the walk, and the wait for it, to other reclaimers.  Its
+	 * eviction still finds the young pages through the rmap.
+	 */
+	if (!(sc->gfp_mask & __GFP_FS))
+		return;
+
+	mutex_lock(&lru_gen_aging_mutex);
+	/* Somebody else may have aged while we waited */
+	if (!lru_gen_need_aging(zone, type))
+		goto out;
+
+	for_each_populated_zone(z) {
+		spin_lock_irq(&z->lru_lock);
+		lru_gen_inc_max_seq(z, z == zone);
+		spin_unlock_irq(&z->lru_lock);
+	}
+
+	spin_lock(&lru_gen_mm_lock);
+	pos = lru_gen_mm_list.next;
+	while (pos != &lru_gen_mm_list) {
+		mm = list_entry(pos, struct mm_struct, lru_gen_list);
+		if (!mm->lru_gen_used || !atomic_inc_not_zero(&mm->mm_users)) {
+			pos = pos->next;
+			continue;
+		}
+		spin_unlock(&lru_gen_mm_lock);
+
+		/* An mm whose task exited meanwhile is torn down elsewhere */
+		if (prev)
+			mmput_async(prev);
+		prev = mm;
+		lru_gen_walk_mm(mm, &args);
+
+		/* Our reference keeps mm on the list */
+		spin_lock(&lru_gen_mm_lock);
+		pos = mm->lru_gen_list.next;
+	}
+	spin_unlock(&lru_gen_mm_lock);
+	if (prev)
+		mmput_async(prev);
+
+	count_vm_event(LRU_GEN_AGING);
+	count_vm_events(LRU_GEN_PROMOTED, args.nr_promoted);
+out:
+	mutex_unlock(&lru_gen_aging_mutex);
+}
+
+/*
+ * Returns the list eviction takes pages of @type from.  Called with the
+ * lru_lock held.
+ */
+static struct list_head *lru_gen_evict_list(struct zone *zone, int type)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+
+	lru_gen_inc_min_seq(zone, type);
+	return &lrugen->lists[lru_gen_from_seq(lrugen->min_seq[type])][type];
+}
+
+/*
+ * Move @page, found on @src, onto the list of its generation if it was
+ * promoted since.  Returns true if the page was moved.  Called with the
+ * lru_lock held.
+ */
+static bool lru_gen_sort_page(struct zone *zone, struct page *page,
+			      struct list_head *src)
+{
+	struct list_head *list;
+
+	list = &zone->lrugen.lists[page_lru_gen(page)][page_is_file_cache(page)];
+	if (list == src)
+		return false;
+
+	list_move(&page->lru, list);
+	return true;
+}
+#else
+static inline void lru_gen_age(struct zone *zone, int type,
+			       struct scan_control *sc)
+{
+}
+
+static inline struct list_head *lru_gen_evict_list(struct zone *zone, int type)
+{
+	return NULL;
+}
+
+static inline bool lru_gen_sort_page(struct zone *zone, struct page *page,
+				     struct list_head *src)
+{
+	return false;
+}
+#endif /* CONFIG_LRU_GEN */
+
 /*
  * zone->lru_lock is heavily contended.  Some of the functions that
  * shrink the lists perform better by taking out a batch of pages
@@ -1165,6 +1669,8 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 	if (file)
 		lru += LRU_FILE;
 	src = &lruvec->lists[lru];
+	if (lru_gen_enabled() && !active)
+		src = lru_gen_evict_list(mz->zone, file);
 
 	for (scan = 0; scan < nr_to_scan && !list_empty(src); scan++) {
 		struct page *page;
@@ -1178,8 +1684,12 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 
 		VM_BUG_ON(!PageLRU(page));
 
+		if (lru_gen_enabled() && lru_gen_sort_page(mz->zone, page, src))
+			continue;
+
 		switch (__isolate_lru_page(page, mode, file)) {
 		case 0:
+			lru_gen_del_page(mz->zone, page);
 			mem_cgroup_lru_del(page);
 			list_move(&page->lru, dst);
 			nr_taken += hpage_nr_pages(page);
@@ -1239,6 +1749,7 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 			if (__isolate_lru_page(cursor_page, mode, file) == 0) {
 				unsigned int isolated_pages;
 
+				lru_gen_del_page(mz->zone, cursor_page);
 				mem_cgroup_lru_del(cursor_page);
 				list_move(&cursor_page->lru, dst);
 				isolated_pages = hpage_nr_pages(cursor_page);
@@ -1531,6 +2042,9 @@ shrink_inactive_list(unsigned long nr_to_scan, struct mem_cgroup_zone *mz,
 	if (!sc->may_writepage)
 		reclaim_mode |= ISOLATE_CLEAN;
 
+	if (lru_gen_enabled())
+		lru_gen_age(zone, file, sc);
+
 	spin_lock_irq(&zone->lru_lock);
 
 	nr_taken = isolate_lru_pages(nr_to_scan, mz, &page_list,
@@ -2350,24 +2864,31 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		aborted_reclaim = shrink_zones(priority, zonelist, sc);
 
 		/*
-		 * Don't shrink slabs when reclaiming memory from
-		 * over limit cgroups
+		 * Over limit cgroups only shrink the slab objects they own,
+		 * on all nodes, as their reclaim does not care about the
+		 * placement of their pages either.
 		 */
 		if (global_reclaim(sc)) {
 			unsigned long lru_pages = 0;
+
+			nodes_clear(shrink->nodes_to_scan);
 			for_each_zone_zonelist(zone, z, zonelist,
 					gfp_zone(sc->gfp_mask)) {
 				if (!cpuset_zone_allowed_hardwall(zone, GFP_KERNEL))
 					continue;
 
 				lru_pages += zone_reclaimable_pages(zone);
+				node_set(zone_to_nid(zone),
+					 shrink->nodes_to_scan);
 			}
 
 			shrink_slab(shrink, sc->nr_scanned, lru_pages);
-			if (reclaim_state) {
-				sc->nr_reclaimed += reclaim_state->reclaimed_slab;
-				reclaim_state->reclaimed_slab = 0;
-			}
+		} else
+			shrink_memcg_slab(sc, shrink);
+
+		if (reclaim_state) {
+			sc->nr_reclaimed += reclaim_state->reclaimed_slab;
+			reclaim_state->reclaimed_slab = 0;
 		}
 		total_scanned += sc->nr_scanned;
 		if (sc->nr_reclaimed >= sc->nr_to_reclaim)
@@ -2688,6 +3209,8 @@ static unsigned long balance_pgdat(pg_data_t *pgdat, int order,
 	struct shrink_control shrink = {
 		.gfp_mask = sc.gfp_mask,
 	};
+
+	node_set(pgdat->node_id, shrink.nodes_to_scan);
 loop_again:
 	total_scanned = 0;
 	sc.nr_reclaimed = 0;
@@ -2960,6 +3483,12 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 	if (!sleeping_prematurely(pgdat, order, remaining, classzone_idx)) {
 		trace_mm_vmscan_kswapd_sleep(pgdat->node_id);
 
+		/*
+		 * kswapd has freed enough memory; let kcompactd turn it into
+		 * the high-order pages that kswapd was woken for.
+		 */
+		wakeup_kcompactd(pgdat, order, classzone_idx);
+
 		/*
 		 * vmstat counters are not perfectly accurate and the estimated
 		 * value for counters such as NR_FREE_PAGES can deviate from the
@@ -3250,6 +3779,10 @@ static int __init kswapd_init(void)
 	int nid;
 
 	swap_setup();
+#ifdef CONFIG_LRU_GEN
+	if (lru_gen_requested && !lru_gen_enabled())
+		printk(KERN_INFO "lru_gen: not used with the memory controller\n");
+#endif
 	for_each_node_state(nid, N_HIGH_MEMORY)
  		kswapd_run(nid);
 	hotcpu_notifier(cpu_callback, 0);
@@ -3357,6 +3890,7 @@ static int __zone_reclaim(struct zone *zone, gfp_t gfp_mask, unsigned int order)
 	};
 	unsigned long nr_slab_pages0, nr_slab_pages1;
 
+	node_set(zone_to_nid(zone), shrink.nodes_to_scan);
 	cond_resched();
 	/*
 	 * We need to be able to allocate from the reserves for RECLAIM_SWAP
@@ -3389,8 +3923,8 @@ static int __zone_reclaim(struct zone *zone, gfp_t gfp_mask, unsigned int order)
 		 * by the same nr_pages that we used for reclaiming unmapped
 		 * pages.
 		 *
-		 * Note that shrink_slab will free memory on all zones and may
-		 * take a long time.
+		 * Note that shrink_slab will free memory on all zones of the
+		 * node and may take a long time.
 		 */
 		for (;;) {
 			unsigned long lru_pages = zone_reclaimable_pages(zone);
@@ -3537,11 +4071,17 @@ void check_move_unevictable_pages(struct page **pages, int nr_pages)
 
 			VM_BUG_ON(PageActive(page));
 			ClearPageUnevictable(page);
-			__dec_zone_state(zone, NR_UNEVICTABLE);
-			lruvec = mem_cgroup_lru_move_lists(zone, page,
-						LRU_UNEVICTABLE, lru);
-			list_move(&page->lru, &lruvec->lists[lru]);
-			__inc_zone_state(zone, NR_INACTIVE_ANON + lru);
+			if (lru_gen_enabled()) {
+				del_page_from_lru_list(zone, page,
+						       LRU_UNEVICTABLE);
+				add_page_to_lru_list(zone, page, lru);
+			} else {
+				__dec_zone_state(zone, NR_UNEVICTABLE);
+				lruvec = mem_cgroup_lru_move_lists(zone, page,
+							LRU_UNEVICTABLE, lru);
+				list_move(&page->lru, &lruvec->lists[lru]);
+				__inc_zone_state(zone, NR_INACTIVE_ANON + lru);
+			}
 			pgrescued++;
 		}
 	}
@@ -19,6 +19,7 @@
 #include <linux/math64.h>
 #include <linux/writeback.h>
 #include <linux/compaction.h>
+#include <linux/mm_inline.h>
 
 #ifdef CONFIG_VM_EVENT_COUNTERS
 DEFINE_PER_CPU(struct vm_event_state, vm_event_states) = {{0}};
@@ -602,6 +603,25 @@ int fragmentation_index(struct zone *zone, unsigned int order)
 	fill_contig_page_info(zone, order, &info);
 	return __fragmentation_index(order, &info);
 }
+
+/*
+ * The percentage of the free memory of a zone that is in blocks too
+ * small for an allocation of the given order.  Unlike the fragmentation
+ * index this is meaningful whether or not such an allocation would fail,
+ * and is what proactive compaction tries to keep low.
+ */
+unsigned int extfrag_for_order(struct zone *zone, unsigned int order)
+{
+	struct contig_page_info info;
+
+	fill_contig_page_info(zone, order, &info);
+	if (!info.free_pages)
+		return 0;
+
+	return div_u64((info.free_pages -
+			(info.free_blocks_suitable << order)) * 100,
+			info.free_pages);
+}
 #endif
 
 #if defined(CONFIG_PROC_FS) || defined(CONFIG_COMPACTION)
@@ -718,6 +738,9 @@ const char * const vmstat_text[] = {
 	"numa_local",
 	"numa_other",
 #endif
+	"workingset_refault",
+	"workingset_activate",
+	"workingset_nodereclaim",
 	"nr_anon_transparent_hugepages",
 	"nr_dirty_threshold",
 	"nr_dirty_background_threshold",
@@ -733,9 +756,23 @@ const char * const vmstat_text[] = {
 	"pgfree",
 	"pgactivate",
 	"pgdeactivate",
+	"pglazyfree",
+	"pcp_high_order_alloc",
+	"pcp_high_order_free",
+	"pcp_high_order_refill",
+	"pgalloc_bulk",
+	"pgalloc_bulk_refill",
 
 	"pgfault",
 	"pgmajfault",
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"spf_success",
+	"spf_fallback",
+#endif
+#ifdef CONFIG_MMU
+	"fault_around",
+	"fault_around_pages",
+#endif
 
 	TEXTS_FOR_ZONES("pgrefill")
 	TEXTS_FOR_ZONES("pgsteal")
@@ -756,6 +793,12 @@ const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"pglazyfreed",
+
+#ifdef CONFIG_LRU_GEN
+	"lru_gen_aging",
+	"lru_gen_promoted",
+#endif
 
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
@@ -764,11 +807,22 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_daemon_wake",
+	"compact_proactive_run",
+	"compact_daemon_pages_moved",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
 	"htlb_buddy_alloc_success",
 	"htlb_buddy_alloc_fail",
+#endif
+#ifdef CONFIG_MMU
+	"vmap_tlb_flush",
+	"vmap_lazy_purged",
+#endif
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	"tlb_batch_ipi_sent",
+	"tlb_batch_ipi_saved",
 #endif
 	"unevictable_pgs_culled",
 	"unevictable_pgs_scanned",
@@ -1022,6 +1076,27 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 		   zone->all_unreclaimable,
 		   zone->zone_start_pfn,
 		   zone->inactive_ratio);
+#ifdef CONFIG_LRU_GEN
+	if (lru_gen_enabled()) {
+		struct lru_gen_struct *lrugen = &zone->lrugen;
+		unsigned long seq;
+
+		seq = min(lrugen->min_seq[0], lrugen->min_seq[1]);
+		for (; seq <= lrugen->max_seq; seq++) {
+			int gen = lru_gen_from_seq(seq);
+			long nr[2];
+
+			for (i = 0; i < 2; i++)
+				nr[i] = seq < lrugen->min_seq[i] ? 0 :
+					atomic_long_read(&lrugen->nr_pages[gen][i]);
+			seq_printf(m,
+				   "\n  lru_gen %lu: age %u ms, anon %ld, file %ld",
+				   seq,
+				   jiffies_to_msecs(jiffies - lrugen->timestamps[gen]),
+				   nr[0], nr[1]);
+		}
+	}
+#endif
 	seq_putc(m, '\n');
 }
 
@@ -0,0 +1,350 @@
+/*
+ * Workingset detection
+ *
+ * Evicted page cache pages leave a shadow entry in their slot of the
+ * page cache radix tree, so that a refault can tell how long the page
+ * was gone.
+ */
+
+#include <linux/mm.h>
+#include <linux/mm_inline.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/radix-tree.h>
+#include <linux/list_lru.h>
+#include <linux/module.h>
+#include <linux/vmstat.h>
+
+/*
+ * Double CLOCK lists
+ *
+ * Per zone, two clock lists are maintained for file pages: the
+ * inactive and the active list.  Freshly faulted pages start out at
+ * the head of the inactive list and page reclaim scans pages from the
+ * tail.  Pages that are accessed multiple times on the inactive list
+ * are promoted to the active list, to protect them from reclaim,
+ * whereas active pages are demoted to the inactive list when the
+ * active list grows too big.
+ *
+ * A workload whose frequently used pages do not fit into the inactive
+ * list keeps evicting them before their second access, and so never
+ * gets them onto the active list, even if they would easily fit into
+ * the memory that is used by the stale active pages.
+ *
+ * Refault distance
+ *
+ * Each zone keeps a counter, inactive_age, that is incremented for
+ * every page evicted from the inactive list and for every page
+ * activated from it.  Both move pages one slot closer to the tail of
+ * the inactive list, so the difference between the counter at the
+ * time a page was evicted and at the time it refaults - the refault
+ * distance - is the minimum number of extra inactive list slots the
+ * page would have needed to stay resident until its second access.
+ *
+ * The inactive list can only grow at the expense of the active list,
+ * so when the refault distance is smaller than the size of the active
+ * list, the page is activated right away at refault time to make it
+ * compete with the active pages.  If it is not used again it will
+ * eventually be deactivated, and the workload has lost nothing.
+ *
+ * With the multi-generational LRU there is no active list; the file
+ * pages in generations younger than the oldest one stand in for it.
+ *
+ * Implementation
+ *
+ * The eviction counter of the zone is packed, together with the node
+ * and zone index, into an exceptional radix tree entry that replaces
+ * the evicted page in the page cache.  Shadow entries are removed on
+ * truncation and when the inode is evicted, but a large file that
+ * stays cached could pin the radix tree nodes of its evicted pages
+ * indefinitely.  The nodes that hold nothing but shadow entries are
+ * therefore kept on a list_lru, from which a shrinker frees them once
+ * they grow out of proportion to the memory they describe.
+ */
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 NODES_SHIFT + ZONES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	/*
+	 * The unsigned subtraction here gives an accurate distance
+	 * across inactive_age overflows in most cases.
+	 *
+	 * There is a special case: usually, shadow entries have a short
+	 * lifetime and are either refaulted or reclaimed along with the
+	 * inode before they get too old.  But it is not impossible for
+	 * the inactive_age to lap a shadow entry in the field, which
+	 * can then result in a false small refault distance, leading
+	 * to a false activation should this old entry actually
+	 * refault again.  However, earlier kernels used to deactivate
+	 * unconditionally with *every* reclaim invocation for the
+	 * longest time, so the occasional inappropriate activation
+	 * leading to pressure on the active list is not a problem.
+	 */
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+#ifdef CONFIG_LRU_GEN
+/*
+ * The file pages of a zone that are protected from the next eviction
+ * pass: those in generations younger than the oldest one.
+ */
+static unsigned long lru_gen_nr_protected(struct zone *zone)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	unsigned long max_seq = ACCESS_ONCE(lrugen->max_seq);
+	unsigned long seq = ACCESS_ONCE(lrugen->min_seq[1]);
+	long nr = 0;
+
+	while (++seq <= max_seq)
+		nr += atomic_long_read(&lrugen->nr_pages[lru_gen_from_seq(seq)][1]);
+
+	return nr > 0 ? nr : 0;
+}
+#else
+static inline unsigned long lru_gen_nr_protected(struct zone *zone)
+{
+	return 0;
+}
+#endif
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	unsigned long nr_active;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (lru_gen_enabled())
+		nr_active = lru_gen_nr_protected(zone);
+	else
+		nr_active = zone_page_state(zone, NR_ACTIVE_FILE);
+
+	if (refault_distance <= nr_active) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * Shadow entries reflect the share of the working set that does not
+ * fit into memory, so their number depends on the access pattern of
+ * the workload.  In most cases, they will refault or get reclaimed
+ * along with the inode, but a (malicious) workload that streams
+ * through files with a total size several times that of available
+ * memory, while preventing the inodes from being reclaimed, can
+ * create excessive amounts of shadow nodes.  To keep a lid on this,
+ * track shadow nodes and reclaim them when they grow way past the
+ * point where they would still be useful.
+ */
+
+struct list_lru workingset_shadow_nodes;
+
+/*
+ * The shadow nodes of @nid that exceed its share.  The list_lru lock
+ * nests inside the irq-safe tree_lock, so interrupts are disabled by
+ * the caller.
+ */
+static unsigned long excess_shadow_nodes(int nid)
+{
+	unsigned long shadow_nodes;
+	unsigned long max_nodes;
+
+	shadow_nodes = list_lru_count_node(&workingset_shadow_nodes, nid,
+					   NULL);
+	/*
+	 * Active cache pages are limited to 50% of memory, and shadow
+	 * entries that represent a refault distance bigger than that
+	 * do not have any effect.  Limit the number of shadow nodes
+	 * such that shadow entries do not exceed the number of active
+	 * cache pages, assuming a worst-case node population density
+	 * of 1/8th on average.
+	 *
+	 * On 64-bit with 7 radix_tree_nodes per page and 64 slots
+	 * each, this will reclaim shadow entries when they consume
+	 * ~2% of available memory.
+	 */
+	max_nodes = node_present_pages(nid) >> (1 + RADIX_TREE_MAP_SHIFT - 3);
+
+	return shadow_nodes > max_nodes ? shadow_nodes - max_nodes : 0;
+}
+
+static enum lru_status shadow_lru_isolate(struct list_head *item,
+					  struct list_lru_one *list,
+					  spinlock_t *lru_lock, void *arg)
+{
+	struct address_space *mapping;
+	struct radix_tree_node *node;
+	unsigned int i;
+	enum lru_status ret;
+
+	/*
+	 * Page cache insertions and deletions synchronously maintain
+	 * the shadow node LRU under the mapping->tree_lock and the
+	 * lru_lock.  Because the page cache tree is emptied before
+	 * the inode can be destroyed, holding the lru_lock pins any
+	 * address_space that has radix tree nodes on the LRU.
+	 *
+	 * We can then safely transition to the mapping->tree_lock to
+	 * pin only the address_space of the particular node we want
+	 * to reclaim, take the node off-LRU, and drop the lru_lock.
+	 */
+	node = container_of(item, struct radix_tree_node, private_list);
+	mapping = node->private_data;
+
+	/* Coming from the list, invert the lock order */
+	if (!spin_trylock(&mapping->tree_lock)) {
+		spin_unlock(lru_lock);
+		ret = LRU_RETRY;
+		goto out;
+	}
+
+	list_lru_isolate(list, item);
+	spin_unlock(lru_lock);
+
+	/*
+	 * The node holds only shadow entries, no pages, so we expect
+	 * to be able to remove them all and free the node afterwards.
+	 */
+	BUG_ON(!workingset_node_shadows(node));
+	BUG_ON(workingset_node_pages(node));
+
+	for (i = 0; i < RADIX_TREE_MAP_SIZE; i++) {
+		if (node->slots[i]) {
+			BUG_ON(!radix_tree_exceptional_entry(node->slots[i]));
+			node->slots[i] = NULL;
+			workingset_node_shadows_dec(node);
+			BUG_ON(!mapping->nrshadows);
+			mapping->nrshadows--;
+		}
+	}
+	BUG_ON(workingset_node_shadows(node));
+	inc_zone_state(page_zone(virt_to_page(node)), WORKINGSET_NODERECLAIM);
+	if (!__radix_tree_delete_node(&mapping->page_tree, node))
+		BUG();
+
+	spin_unlock(&mapping->tree_lock);
+	ret = LRU_REMOVED_RETRY;
+out:
+	local_irq_enable();
+	cond_resched();
+	local_irq_disable();
+	spin_lock(lru_lock);
+	return ret;
+}
+
+static int shrink_shadow_nodes(struct shrinker *shrinker,
+			       struct shrink_control *sc)
+{
+	unsigned long nr_to_scan = sc->nr_to_scan;
+	unsigned long count = 0;
+	int nid;
+
+	/* list_lru lock nests inside IRQ-safe mapping->tree_lock */
+	local_irq_disable();
+	for_each_node_mask(nid, sc->nodes_to_scan) {
+		unsigned long nr = excess_shadow_nodes(nid);
+
+		if (nr && nr_to_scan) {
+			nr = min(nr, nr_to_scan);
+			nr_to_scan -= nr;
+			list_lru_walk_node(&workingset_shadow_nodes, nid, NULL,
+					   shadow_lru_isolate, NULL, &nr);
+			nr_to_scan += nr;
+			nr = excess_shadow_nodes(nid);
+		}
+		count += nr;
+	}
+	local_irq_enable();
+
+	return min_t(unsigned long, count, INT_MAX);
+}
+
+static struct shrinker workingset_shadow_shrinker = {
+	.shrink = shrink_shadow_nodes,
+	.seeks = DEFAULT_SEEKS,
+	.flags = SHRINKER_NUMA_AWARE,
+};
+
+/*
+ * Our list_lru->lock is IRQ-safe as it nests inside the IRQ-safe
+ * mapping->tree_lock.
+ */
+static struct lock_class_key shadow_nodes_key;
+
+static int __init workingset_init(void)
+{
+	int ret;
+
+	ret = list_lru_init_key(&workingset_shadow_nodes, &shadow_nodes_key);
+	if (ret)
+		return ret;
+	register_shrinker(&workingset_shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);